@@ -0,0 +1,362 @@
+#ifndef CONST_EVAL_HPP
+#define CONST_EVAL_HPP
+
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "parser.hpp"
+
+//编译期常量的值，整数统一用128位保存，每一步运算后再按类型检查范围
+struct ConstValue {
+  std::string type; //i32 i64 u32 u64 isize usize bool
+  __int128 value = 0;
+
+  bool is_bool() const { return type == "bool"; }
+
+  std::string toString() const {
+    if (is_bool()) return value ? "true" : "false";
+    if (value == 0) return "0";
+    bool neg = value < 0;
+    unsigned __int128 v = neg ? -(unsigned __int128)value : (unsigned __int128)value;
+    std::string s;
+    while (v) {
+      s.push_back(char('0' + int(v % 10)));
+      v /= 10;
+    }
+    if (neg) s.push_back('-');
+    return std::string(s.rbegin(), s.rend());
+  }
+};
+
+//语义检查和IR生成共用的常量求值器
+//const item按节点记忆化，数组长度按表达式节点记忆化，两个阶段共享同一个实例时每个常量只算一次
+class ConstEvaluator {
+ public:
+  //按名字找到const item，用来处理块内的const和Self::X这样依赖作用域的名字，返回空时再查declare过的全局const
+  using Resolver = std::function<const ConstantItemNode*(const std::string&)>;
+
+  static bool is_integer_type(const std::string& type) {
+    return type == "i32" || type == "i64" || type == "u32" || type == "u64" || type == "isize" || type == "usize";
+  }
+
+  static bool is_scalar_type(const std::string& type) {
+    return type == "bool" || is_integer_type(type);
+  }
+
+  //全局的const（包括Type::NAME形式的关联常量）
+  void declare(const std::string& name, const ConstantItemNode* item) {
+    std::lock_guard<std::mutex> lock(mtx);
+    items[name] = item;
+  }
+
+  std::optional<ConstValue> evaluate_item(const ConstantItemNode* item, const Resolver& resolve = nullptr, std::string* why = nullptr) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string msg;
+    auto res = eval_item(item, resolve, msg);
+    if (!res && why) *why = msg;
+    return res;
+  }
+
+  //type为空时按表达式本身推断类型（无后缀的整数字面量默认为i32）
+  std::optional<ConstValue> evaluate(const ExpressionNode* expr, const std::string& type, const Resolver& resolve = nullptr, std::string* why = nullptr) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string msg;
+    auto res = eval(expr, type, resolve, msg);
+    if (!res && why) *why = msg;
+    return res;
+  }
+
+  //数组类型的长度和[x; N]的重复次数，按usize求值
+  std::optional<long long> array_length(const ExpressionNode* expr, const Resolver& resolve = nullptr, std::string* why = nullptr) {
+    if (!expr) return std::nullopt;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = lengths.find(expr);
+    if (it != lengths.end()) return it->second;
+    std::string msg;
+    auto res = eval(expr, "usize", resolve, msg);
+    if (!res) {
+      if (why) *why = msg;
+      return std::nullopt;
+    }
+    long long len = (long long)res->value;
+    lengths[expr] = len;
+    return len;
+  }
+
+  //整数字面量在type（有后缀时按后缀）下是否越界
+  bool literal_fits(const LiteralExpressionNode* lit, const std::string& type) {
+    std::string want = is_integer_type(type) ? type : "i32";
+    std::string msg;
+    return eval_literal(lit, want, msg).has_value();
+  }
+
+ private:
+  std::mutex mtx;
+  std::unordered_map<std::string, const ConstantItemNode*> items;
+  std::unordered_map<const ConstantItemNode*, ConstValue> item_values;
+  std::unordered_set<const ConstantItemNode*> evaluating;
+  std::unordered_map<const ExpressionNode*, long long> lengths;
+
+  static int bits_of(const std::string& type) {
+    return (type == "i32" || type == "u32") ? 32 : 64;
+  }
+
+  static bool is_signed(const std::string& type) {
+    return type[0] == 'i';
+  }
+
+  static __int128 min_of(const std::string& type) {
+    return is_signed(type) ? -((__int128)1 << (bits_of(type) - 1)) : 0;
+  }
+
+  static __int128 max_of(const std::string& type) {
+    return is_signed(type) ? ((__int128)1 << (bits_of(type) - 1)) - 1 : ((__int128)1 << bits_of(type)) - 1;
+  }
+
+  static bool fits(__int128 v, const std::string& type) {
+    return v >= min_of(type) && v <= max_of(type);
+  }
+
+  //按补码截断到type的位宽，用于as转换和左移
+  static __int128 wrap(__int128 v, const std::string& type) {
+    unsigned __int128 mask = ((unsigned __int128)1 << bits_of(type)) - 1;
+    __int128 r = (__int128)((unsigned __int128)v & mask);
+    if (is_signed(type) && r > max_of(type)) r -= (__int128)1 << bits_of(type);
+    return r;
+  }
+
+  std::optional<ConstValue> fail(std::string& why, const std::string& msg) {
+    why = msg;
+    return std::nullopt;
+  }
+
+  std::optional<ConstValue> checked(__int128 v, const std::string& type, std::string& why) {
+    if (!fits(v, type)) return fail(why, "overflow in constant expression of type " + type);
+    return ConstValue{type, v};
+  }
+
+  //解析整数字面量的数值和后缀，去掉进制前缀和下划线
+  static bool parse_integer(const std::string& raw, __int128& value, std::string& suffix) {
+    static const char* suffixes[] = {"isize", "usize", "i32", "i64", "u32", "u64"};
+    std::string s = raw;
+    suffix.clear();
+    for (const char* suf : suffixes) {
+      std::string t(suf);
+      if (s.size() > t.size() && s.compare(s.size() - t.size(), t.size(), t) == 0) {
+        suffix = t;
+        s.erase(s.size() - t.size());
+        break;
+      }
+    }
+    int base = 10;
+    size_t pos = 0;
+    if (s.size() >= 2 && s[0] == '0') {
+      char p = s[1];
+      if (p == 'b' || p == 'B') { base = 2; pos = 2; }
+      else if (p == 'o' || p == 'O') { base = 8; pos = 2; }
+      else if (p == 'x' || p == 'X') { base = 16; pos = 2; }
+    }
+    value = 0;
+    bool any = false;
+    for (; pos < s.size(); ++pos) {
+      char c = s[pos];
+      if (c == '_') continue;
+      int d;
+      if (c >= '0' && c <= '9') d = c - '0';
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+      else return false;
+      if (d >= base) return false;
+      value = value * base + d;
+      if (value > ((__int128)1 << 64)) value = ((__int128)1 << 64) + 1; //超过任何支持的类型，之后的范围检查一定失败
+      any = true;
+    }
+    return any;
+  }
+
+  std::optional<ConstValue> eval_literal(const LiteralExpressionNode* lit, const std::string& want, std::string& why, bool negated = false) {
+    if (auto* b = std::get_if<std::unique_ptr<bool>>(&lit->literal)) {
+      if (!want.empty() && want != "bool") return fail(why, "expected " + want + ", found bool");
+      return ConstValue{"bool", **b ? 1 : 0};
+    }
+    auto* int_lit = std::get_if<std::unique_ptr<integer_literal>>(&lit->literal);
+    if (!int_lit) return fail(why, "unsupported literal in constant expression");
+    __int128 v;
+    std::string suffix;
+    if (!parse_integer((*int_lit)->raw, v, suffix)) return fail(why, "invalid integer literal " + (*int_lit)->raw);
+    //只有无后缀的字面量取期望的类型，带后缀的必须和期望类型一致
+    std::string type = !suffix.empty() ? suffix : (is_integer_type(want) ? want : "i32");
+    if (!want.empty() && want != type) return fail(why, "expected " + want + ", found " + type);
+    if (negated) {
+      if (!is_signed(type)) return fail(why, "cannot negate unsigned constant of type " + type);
+      v = -v;
+    }
+    return checked(v, type, why);
+  }
+
+  std::optional<ConstValue> eval_item(const ConstantItemNode* item, const Resolver& resolve, std::string& why) {
+    if (!item || !item->expression || !item->type) return fail(why, "constant has no value");
+    auto it = item_values.find(item);
+    if (it != item_values.end()) return it->second;
+    std::string type = item->type->toString();
+    if (!is_scalar_type(type)) return fail(why, "constant of type " + type + " is not a scalar");
+    if (evaluating.count(item)) return fail(why, "cycle in constant " + item->identifier.value_or("_"));
+    evaluating.insert(item);
+    auto res = eval(item->expression.get(), type, resolve, why);
+    evaluating.erase(item);
+    if (!res) return std::nullopt;
+    if (res->type != type) return fail(why, "expected " + type + ", found " + res->type);
+    item_values[item] = *res;
+    return res;
+  }
+
+  std::optional<ConstValue> eval_path(const PathExpressionNode* path, const std::string& want, const Resolver& resolve, std::string& why) {
+    std::string name = path->toString();
+    const ConstantItemNode* item = resolve ? resolve(name) : nullptr;
+    if (!item) {
+      auto it = items.find(name);
+      if (it != items.end()) item = it->second;
+    }
+    if (!item) return fail(why, name + " is not a constant");
+    auto res = eval_item(item, resolve, why);
+    if (!res) return std::nullopt;
+    //常量的类型是声明的类型，不会隐式转换
+    if (!want.empty() && want != res->type) return fail(why, "expected " + want + ", found " + res->type);
+    return res;
+  }
+
+  //按左侧的类型求右侧；左侧类型不是外面要求的（无后缀字面量默认i32）而右侧类型固定时，
+  //改按右侧的类型重新求左侧
+  std::optional<ConstValue> eval_rhs(std::optional<ConstValue>& lhs, const ExpressionNode* lhs_expr, const ExpressionNode* rhs_expr, const std::string& want, const Resolver& resolve, std::string& why) {
+    auto rhs = eval(rhs_expr, lhs->type, resolve, why);
+    if (rhs || !want.empty()) return rhs;
+    rhs = eval(rhs_expr, "", resolve, why);
+    if (!rhs) return std::nullopt;
+    lhs = eval(lhs_expr, rhs->type, resolve, why);
+    if (!lhs) return std::nullopt;
+    return rhs;
+  }
+
+  std::optional<ConstValue> eval_binary(OperationType op, const ExpressionNode* lhs_expr, const ExpressionNode* rhs_expr, const std::string& want, const Resolver& resolve, std::string& why) {
+    auto lhs = eval(lhs_expr, want, resolve, why);
+    if (!lhs) return std::nullopt;
+    if (op == SHL || op == SHR) {
+      const std::string& type = lhs->type;
+      //移位的右操作数可以是任意整数类型，只检查移位量
+      auto rhs = eval(rhs_expr, "", resolve, why);
+      if (!rhs) return std::nullopt;
+      if (lhs->is_bool() || rhs->is_bool()) return fail(why, "shift of bool in constant expression");
+      if (rhs->value < 0 || rhs->value >= bits_of(type)) return fail(why, "shift amount out of range in constant expression");
+      int s = (int)rhs->value;
+      if (op == SHL) return ConstValue{type, wrap((__int128)((unsigned __int128)lhs->value << s), type)};
+      return ConstValue{type, lhs->value >> s};
+    }
+    auto rhs = eval_rhs(lhs, lhs_expr, rhs_expr, want, resolve, why);
+    if (!rhs) return std::nullopt;
+    if (rhs->type != lhs->type) return fail(why, "mismatched types " + lhs->type + " and " + rhs->type + " in constant expression");
+    const std::string& type = lhs->type;
+    __int128 a = lhs->value, b = rhs->value;
+    if (lhs->is_bool()) {
+      switch (op) {
+        case AND: return ConstValue{type, a & b};
+        case OR: return ConstValue{type, a | b};
+        case XOR: return ConstValue{type, a ^ b};
+        default: return fail(why, "invalid operator on bool in constant expression");
+      }
+    }
+    switch (op) {
+      case ADD: return checked(a + b, type, why);
+      case MINUS: return checked(a - b, type, why);
+      case MUL: return checked(a * b, type, why);
+      case DIV:
+        if (b == 0) return fail(why, "division by zero in constant expression");
+        return checked(a / b, type, why);
+      case MOD:
+        if (b == 0) return fail(why, "remainder by zero in constant expression");
+        return checked(a % b, type, why);
+      case AND: return ConstValue{type, a & b};
+      case OR: return ConstValue{type, a | b};
+      case XOR: return ConstValue{type, a ^ b};
+      default: break;
+    }
+    return fail(why, "unsupported operator in constant expression");
+  }
+
+  std::optional<ConstValue> eval_compare(ComparisonType op, const ExpressionNode* lhs_expr, const ExpressionNode* rhs_expr, const Resolver& resolve, std::string& why) {
+    //左侧是无后缀字面量时用右侧的类型
+    auto lhs = eval(lhs_expr, "", resolve, why);
+    if (!lhs) return std::nullopt;
+    auto rhs = eval_rhs(lhs, lhs_expr, rhs_expr, "", resolve, why);
+    if (!rhs) return std::nullopt;
+    if (rhs->type != lhs->type) return fail(why, "mismatched types in constant comparison");
+    __int128 a = lhs->value, b = rhs->value;
+    bool r = false;
+    switch (op) {
+      case EQ: r = a == b; break;
+      case NEQ: r = a != b; break;
+      case GT: r = a > b; break;
+      case LT: r = a < b; break;
+      case GEQ: r = a >= b; break;
+      case LEQ: r = a <= b; break;
+    }
+    return ConstValue{"bool", r ? 1 : 0};
+  }
+
+  std::optional<ConstValue> eval(const ExpressionNode* expr, const std::string& want, const Resolver& resolve, std::string& why) {
+    if (!expr) return fail(why, "missing constant expression");
+    if (auto* lit = dynamic_cast<const LiteralExpressionNode*>(expr)) {
+      return eval_literal(lit, want, why);
+    }
+    if (auto* path = dynamic_cast<const PathExpressionNode*>(expr)) {
+      return eval_path(path, want, resolve, why);
+    }
+    if (auto* group = dynamic_cast<const GroupedExpressionNode*>(expr)) {
+      return eval(group->expression.get(), want, resolve, why);
+    }
+    if (auto* arith = dynamic_cast<const ArithmeticOrLogicalExpressionNode*>(expr)) {
+      return eval_binary(arith->type, arith->expression1.get(), arith->expression2.get(), want, resolve, why);
+    }
+    if (auto* cmp = dynamic_cast<const ComparisonExpressionNode*>(expr)) {
+      if (!want.empty() && want != "bool") return fail(why, "expected " + want + ", found bool");
+      return eval_compare(cmp->type, cmp->expression1.get(), cmp->expression2.get(), resolve, why);
+    }
+    if (auto* lazy = dynamic_cast<const LazyBooleanExpressionNode*>(expr)) {
+      if (!want.empty() && want != "bool") return fail(why, "expected " + want + ", found bool");
+      auto lhs = eval(lazy->expression1.get(), "bool", resolve, why);
+      if (!lhs) return std::nullopt;
+      if (lazy->type == LAZY_AND && !lhs->value) return lhs;
+      if (lazy->type == LAZY_OR && lhs->value) return lhs;
+      return eval(lazy->expression2.get(), "bool", resolve, why);
+    }
+    if (auto* neg = dynamic_cast<const NegationExpressionNode*>(expr)) {
+      if (neg->type == NegationExpressionNode::MINUS) {
+        //-2147483648这样的字面量要先取负再检查范围
+        if (auto* lit = dynamic_cast<const LiteralExpressionNode*>(neg->expression.get())) {
+          return eval_literal(lit, want, why, true);
+        }
+        auto v = eval(neg->expression.get(), want, resolve, why);
+        if (!v) return std::nullopt;
+        if (v->is_bool() || !is_signed(v->type)) return fail(why, "cannot negate constant of type " + v->type);
+        return checked(-v->value, v->type, why);
+      }
+      auto v = eval(neg->expression.get(), want, resolve, why);
+      if (!v) return std::nullopt;
+      if (v->is_bool()) return ConstValue{"bool", v->value ? 0 : 1};
+      return ConstValue{v->type, is_signed(v->type) ? ~v->value : max_of(v->type) - v->value};
+    }
+    if (auto* cast = dynamic_cast<const TypeCastExpressionNode*>(expr)) {
+      std::string to = cast->type ? cast->type->toString() : "";
+      if (!is_integer_type(to)) return fail(why, "unsupported cast to " + to + " in constant expression");
+      if (!want.empty() && want != to) return fail(why, "expected " + want + ", found " + to);
+      auto v = eval(cast->expression.get(), "", resolve, why);
+      if (!v) return std::nullopt;
+      return ConstValue{to, wrap(v->value, to)};
+    }
+    return fail(why, "expression is not a constant expression");
+  }
+};
+
+#endif
@@ -2,14 +2,26 @@
 #define IR_HPP
 
 #include <string>
-#include <sstream>
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 #include <cassert>
 #include <cctype>
 #include "parser.hpp"
+#include "const_eval.hpp"
+#include "item_index.hpp"
+#include "ir_builder.hpp"
+#include "ir_type.hpp"
+#include "ir_mem2reg.hpp"
+#include "ir_inline.hpp"
+#include "ir_tailcall.hpp"
+#include "ir_sccp.hpp"
+#include "ir_gvn.hpp"
+#include "ir_licm.hpp"
+#include "ir_strength.hpp"
+#include "ir_dce.hpp"
 
 // LLVM IR 对全局符号名的“裸标识符”限制比较严格；包含 ':' 等字符时需要使用带引号的形式：@"Foo::bar"。
 static bool isValidLLVMGlobalBareIdent(const std::string& s) {
@@ -59,49 +71,102 @@ static std::string sanitizeImplTypePrefix(std::string t) {
 
 class IRGenerator {
   public:
-   IRGenerator();
+   // shared为语义检查阶段的常量求值器，传入后已经求出的常量不再重复计算
+   // index为语义检查阶段建好的顶层item索引，为空时generate中自己建立
+   explicit IRGenerator(std::shared_ptr<ConstEvaluator> shared = nullptr, std::shared_ptr<const ItemIndex> index = nullptr);
    ~IRGenerator();
 
    std::string generate(const std::vector<std::unique_ptr<ASTNode>>& ast);
    std::string getCurrentIR();
 
+   // generate之后的内存IR，优化都在它上面进行
+   IRModule* getModule() { return module.get(); }
+
+   // 不小于这个字节数的数组不放在栈上，见emitAlloca
+   int largeArrayThreshold = 1 << 16;
+
    private:
-   std::stringstream irStream;
+   std::unique_ptr<IRModule> module;
+   IRBuilder builder;  // 各个visit通过它直接在module中构建指令
    int tempCounter;
    int labelCounter;
    std::unordered_map<std::string, std::string> symbolTable; // 保留全局
-   std::unordered_map<std::string, std::string> functionTable;
-   std::unordered_map<std::string, std::vector<std::string>> paramTypesTable; // function name -> list of param types
-   std::unordered_map<std::string, std::string> constantTable;
-   std::unordered_map<std::string, std::string> typeTable; // struct name -> LLVM type string
-   std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> structFields; // struct name -> list of (field_name, type)
+   std::unordered_map<std::string, ConstantItemNode*> constantTable; // const name -> item，值由consts求出
+   std::shared_ptr<ConstEvaluator> consts;
+   std::shared_ptr<const ItemIndex> items;
+  // main中定义的struct、函数和impl方法不在items里，单独按名字记下来（方法记为Type::name）
+  std::unordered_map<std::string, ItemIndex::Struct> localStructs;
+  std::unordered_map<std::string, FunctionNode*> localFunctions;
+  // 函数的IR返回类型和参数类型：内置函数直接给出，其余由FunctionNode求出后按节点记下来
+  struct Signature {
+    std::string ret;
+    std::vector<std::string> params;
+  };
+  std::unordered_map<std::string, Signature> builtinSignatures;
+  std::unordered_map<const FunctionNode*, Signature> signatures;
+  IRTypeTable irTypes;  // 类型字符串对应的解析结果
    std::unordered_map<std::string, std::string> varTypes; // 保留全局
 
-   // Scope management
-   std::vector<std::unordered_map<std::string, std::string>> symbolScopes;
-   std::vector<std::unordered_map<std::string, std::string>> varTypeScopes;
-   std::vector<std::unordered_map<std::string, std::unordered_map<std::string, std::string>>> fieldScopes;
-   std::vector<std::unordered_map<std::string, std::unordered_map<std::string, std::string>>> fieldTypeScopes;
-   std::vector<std::unordered_map<std::string, bool>> isLetDefinedScopes;
-   std::vector<std::unordered_map<std::string, std::string>> typeNameScopes;
-
-   // Pre-allocated addresses for let statements in loops
-   std::unordered_map<std::string, std::string> loopPreAlloc;
+  // 当前函数的局部变量，按语义检查记在PathExpressionNode::binding上的声明节点查找
+  struct FieldRegister {
+    std::string symbol;
+    std::string type;
+  };
+  struct Local {
+    std::string symbol;  // 不带%
+    std::string type;    // 栈槽记为T*，寄存器记为T
+    bool let = false;    // let定义的变量（以及和它一样使用的栈槽）
+    std::unordered_map<std::string, FieldRegister> fields;  // 按字段拆开传入的结构体参数
+  };
+  std::unordered_map<const void*, Local> locals;
+  std::unordered_map<const void*, ConstantItemNode*> scalarConstants;  // 整数、bool等常量的声明节点
+
+  // 运算表达式的类型沿子表达式递归求出，求过一次就记下来
+  std::unordered_map<ExpressionNode*, std::string> lhsTypeCache;
+  // emitElementPtr算出的地址 -> 它的gep的源类型、基址和下标，在它上面再取元素或字段时接着加下标
+  struct ElementPtr {
+    std::string type;
+    std::string base;
+    std::vector<IRBuilder::Index> indices;
+  };
+  std::unordered_map<std::string, ElementPtr> elementPtrs;
+  // 当前函数中malloc出来的大数组，每个返回处释放
+  std::vector<std::string>* heapArrays = nullptr;
+  // main中的大数组、常量数据等全局变量的定义，最后放在模块末尾
+  std::string globalDefs;
+  std::unordered_map<std::string, std::string> constantData;  // 类型和初始值 -> 只读全局变量，相同的数据只放一份
+  // 数组、结构体类型的const：数据放在只读全局变量中，在函数里绑定成指向它的只读变量
+  struct ConstantGlobal {
+    const ConstantItemNode* item;
+    std::string type;
+    std::string ref;
+  };
+  std::vector<ConstantGlobal> constantGlobals;
+  bool inMain = false;
    std::string currentRetType;
    bool inFunctionBody = false;
    std::string returnVar;
+  bool returnsIndirect = false;  // 当前函数通过sret指针返回，returnVar就是这个参数
    std::string returnLabel;
    std::string currentLoopLabel;
    std::string currentBreakLabel;
 
   void preScan(const std::vector<std::unique_ptr<ASTNode>>& ast);
   void preScanFunctionBody(BlockExpressionNode* block);
-  void generateStructTypes();
 
   std::string toIRType(TypeNode* type);
   std::string toIRType(const std::string& typeName);
   std::string expandStructType(const std::string& typeName);
-  std::vector<std::string> expandParamTypes(const std::string& paramType);
+  void defineStructType(const ItemIndex::Struct& s);
+  const ItemIndex::Struct* findStruct(const std::string& name);
+  std::vector<std::pair<std::string, std::string>> structLayout(const ItemIndex::Struct* s);
+  FunctionNode* findFunction(const std::string& path);
+  const Signature* signature(const std::string& path);
+  Signature lowerSignature(FunctionNode* fn);
+  // 结构体按值传参/返回：不超过16字节的按字段拆成标量参数，更大的传只读指针、通过sret返回
+  bool passIndirect(const std::string& type);
+  void passArgument(std::vector<IRBuilder::Arg>& args, const std::string& type, const std::string& value, bool isAddress);
+  std::string emitCall(const std::string& funcName, const std::string& retType, std::vector<IRBuilder::Arg> args);
 
   std::string visit(ExpressionNode* node);
   std::string visit(LiteralExpressionNode* node);
@@ -110,8 +175,19 @@ class IRGenerator {
   std::string visit(MethodCallExpressionNode* node);
   std::string visit(IndexExpressionNode* node);
   std::string visit(ArrayExpressionNode* node);
+  // 目标地址已知时（let、赋值、返回值）把数组/结构体表达式直接构造在目标位置上
+  bool emitInto(ExpressionNode* expr, const std::string& type, const std::string& ptr);
+  bool selfContained(ExpressionNode* expr);
+  void fillArray(ArrayExpressionNode* node, const std::string& arrayType, const std::string& ptr);
+  void fillStruct(StructExpressionNode* node, const std::string& ptr);
   bool isConstantZero(ExpressionNode* expr);
-  int getTypeSize(const std::string& type);
+  // 按目标数据布局计算的大小和对齐
+  int64_t getTypeSize(const std::string& type);
+  int getTypeAlign(const std::string& type);
+  bool isAggregate(const std::string& type);
+  // 聚合类型的复制和清零用llvm.memcpy/llvm.memset，不整体load/store
+  void emitCopy(const std::string& type, const std::string& dst, const std::string& src);
+  void emitZero(const std::string& type, const std::string& ptr);
   std::string visit(ArithmeticOrLogicalExpressionNode* node);
   std::string visit(ComparisonExpressionNode* node);
   std::string visit(LazyBooleanExpressionNode* node);
@@ -162,17 +238,32 @@ class IRGenerator {
   std::string emitAlloca(const std::string& type, const std::string& name = "");
   std::string emitLoad(const std::string& type, const std::string& ptr);
   std::string emitStore(const std::string& value, const std::string& ptr);
-  std::string emitBinaryOp(const std::string& op, const std::string& lhs, const std::string& rhs, const std::string& type);
+  std::string emitElementPtr(const std::string& type, const std::string& base, const std::string& index);
+  std::string emitBinaryOp(IROp op, const std::string& lhs, const std::string& rhs, const std::string& type);
 
+  // lhs的地址和这个值的类型：通常是指向lhs的指针，按值存放的结构体和字段寄存器是值本身
+  struct LhsAddress {
+    std::string value;
+    std::string type;
+  };
+  LhsAddress lhsAddress(ExpressionNode* lhs);
   std::string getLhsAddress(ExpressionNode* lhs);
   std::string getLhsType(ExpressionNode* lhs);
-  std::string getLhsTypeWithStar(ExpressionNode* lhs);
+  std::string computeLhsType(ExpressionNode* lhs);
+  std::string checkedType(ExpressionNode* expr);
+  std::string methodPath(MethodCallExpressionNode* node, const std::string& selfType, const std::string& methodName);
+  int fieldIndex(const std::string& structName, const std::string& fieldName);
 
-  bool isLetDefined(const std::string& name);
+  bool isLetDefined(PathExpressionNode* path);
 
   std::optional<int> evaluateConstant(ExpressionNode* expr);
-  std::optional<int> computeConstantValue(ArithmeticOrLogicalExpressionNode* node);
-  std::string getElementType(const std::string& typeStr);
+  ConstEvaluator::Resolver constResolver();
+  std::string constantOperand(ConstantItemNode* item);
+  std::string constantInitializer(ExpressionNode* expr, const std::string& type);
+  std::string constantGlobal(const std::string& type, const std::string& init, const std::string& name = "");
+  void bindConstantGlobal(const ConstantGlobal& c);
+  std::string stringConstant(const std::string& bytes);
+  std::string constantIRType(ConstantItemNode* item);
 
   bool hasReturn(BlockExpressionNode* block);
   bool hasReturnInExpression(ExpressionNode* expr);
@@ -181,52 +272,40 @@ class IRGenerator {
 
   void error(const std::string& msg);
 
-  void enterScope();
-  void exitScope();
-  std::string lookupSymbol(const std::string& name);
-  std::string lookupVarType(const std::string& name);
-  std::string getTypeName(const std::string& name);
+  Local* lookupLocal(PathExpressionNode* path);
+  ConstantItemNode* lookupConstant(PathExpressionNode* path);
+  const FieldRegister* lookupFieldRegister(ExpressionNode* base, const std::string& field);
+  std::string lookupSymbol(PathExpressionNode* path);
+  std::string lookupVarType(PathExpressionNode* path);
 };
 
-IRGenerator::IRGenerator() : tempCounter(0), labelCounter(0) {
-  irStream << "; ModuleID = 'generated.ll'\n";
-  irStream << "source_filename = \"generated.ll\"\n";
-  irStream << "target datalayout = \"e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128\"\n";
-  irStream << "target triple = \"x86_64-pc-linux-gnu\"\n\n";
-  // Initialize global scope
-  symbolScopes.push_back({});
-  varTypeScopes.push_back({});
-  fieldScopes.push_back({});
-  fieldTypeScopes.push_back({});
-  isLetDefinedScopes.push_back({});
-  typeNameScopes.push_back({});
+IRGenerator::IRGenerator(std::shared_ptr<ConstEvaluator> shared, std::shared_ptr<const ItemIndex> index)
+    : module(std::make_unique<IRModule>()), builder(*module), tempCounter(0), labelCounter(0), consts(shared ? std::move(shared) : std::make_shared<ConstEvaluator>()), items(std::move(index)) {
+  builder.text("; ModuleID = 'generated.ll'\n");
+  builder.text("source_filename = \"generated.ll\"\n");
+  builder.text("target datalayout = \"e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128\"\n");
+  builder.text("target triple = \"x86_64-pc-linux-gnu\"\n\n");
 }
 
 IRGenerator::~IRGenerator() = default;
 
 std::string IRGenerator::generate(const std::vector<std::unique_ptr<ASTNode>>& ast) {
+  if (!items) items = ItemIndex::build(ast);
   // 第一步：预扫描全局声明
   preScan(ast);
 
-  // 添加内置函数信息到table
-  functionTable["print"] = "void";
-  paramTypesTable["print"] = {"i8*"};
-  functionTable["println"] = "void";
-  paramTypesTable["println"] = {"i8*"};
-  functionTable["printInt"] = "void";
-  paramTypesTable["printInt"] = {"i32"};
-  functionTable["printlnInt"] = "void";
-  paramTypesTable["printlnInt"] = {"i32"};
-  functionTable["getString"] = "i8*";
-  paramTypesTable["getString"] = {};
-  functionTable["getInt"] = "i32";
-  paramTypesTable["getInt"] = {};
-  functionTable["builtin_memset"] = "i8*";
-  paramTypesTable["builtin_memset"] = {"i8*", "i32", "i32"};
-  functionTable["builtin_memcpy"] = "i8*";
-  paramTypesTable["builtin_memcpy"] = {"i8*", "i8*", "i32"};
-  functionTable["exit"] = "void";
-  paramTypesTable["exit"] = {"i32"};
+  // 内置函数的签名
+  builtinSignatures = {
+    {"print", {"void", {"i8*"}}},
+    {"println", {"void", {"i8*"}}},
+    {"printInt", {"void", {"i32"}}},
+    {"printlnInt", {"void", {"i32"}}},
+    {"getString", {"i8*", {}}},
+    {"getInt", {"i32", {}}},
+    {"builtin_memset", {"i8*", {"i8*", "i32", "i32"}}},
+    {"builtin_memcpy", {"i8*", {"i8*", "i8*", "i32"}}},
+    {"exit", {"void", {"i32"}}},
+  };
 
   //irStream << "; begin generating IR of struct\n";
   // 第二步：先生成所有 struct 的 IR
@@ -241,95 +320,84 @@ std::string IRGenerator::generate(const std::vector<std::unique_ptr<ASTNode>>& a
   //irStream << "; finish generating IR of struct\n";
 
   // 添加内置函数定义
-  irStream << "@.str = private unnamed_addr constant [3 x i8] c\"%s\\00\", align 1\n";
-  irStream << "@.str.1 = private unnamed_addr constant [4 x i8] c\"%s\\0A\\00\", align 1\n";
-  irStream << "@.str.2 = private unnamed_addr constant [3 x i8] c\"%d\\00\", align 1\n";
-  irStream << "@.str.3 = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\", align 1\n";
-  irStream << "\n";
-  irStream << "define dso_local void @print(i8* noundef %0) {\n";
-  irStream << "  %2 = alloca i8*, align 8\n";
-  irStream << "  store i8* %0, i8** %2, align 8\n";
-  irStream << "  %3 = load i8*, i8** %2, align 8\n";
-  irStream << "  %4 = call i32 (i8*, ...) @printf(i8* noundef getelementptr inbounds ([3 x i8], [3 x i8]* @.str, i64 0, i64 0), i8* noundef %3)\n";
-  irStream << "  ret void\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local void @println(i8* noundef %0) {\n";
-  irStream << "  %2 = alloca i8*, align 8\n";
-  irStream << "  store i8* %0, i8** %2, align 8\n";
-  irStream << "  %3 = load i8*, i8** %2, align 8\n";
-  irStream << "  %4 = call i32 (i8*, ...) @printf(i8* noundef getelementptr inbounds ([4 x i8], [4 x i8]* @.str.1, i64 0, i64 0), i8* noundef %3)\n";
-  irStream << "  ret void\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local void @printInt(i32 noundef %0) {\n";
-  irStream << "  %2 = alloca i32, align 4\n";
-  irStream << "  store i32 %0, i32* %2, align 4\n";
-  irStream << "  %3 = load i32, i32* %2, align 4\n";
-  irStream << "  %4 = call i32 (i8*, ...) @printf(i8* noundef getelementptr inbounds ([3 x i8], [3 x i8]* @.str.2, i64 0, i64 0), i32 noundef %3)\n";
-  irStream << "  ret void\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local void @printlnInt(i32 noundef %0) {\n";
-  irStream << "  %2 = alloca i32, align 4\n";
-  irStream << "  store i32 %0, i32* %2, align 4\n";
-  irStream << "  %3 = load i32, i32* %2, align 4\n";
-  irStream << "  %4 = call i32 (i8*, ...) @printf(i8* noundef getelementptr inbounds ([4 x i8], [4 x i8]* @.str.3, i64 0, i64 0), i32 noundef %3)\n";
-  irStream << "  ret void\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local i8* @getString() {\n";
-  irStream << "  %1 = alloca i8*, align 8\n";
-  irStream << "  %2 = call i8* @malloc(i32 noundef 256)\n";
-  irStream << "  store i8* %2, i8** %1, align 8\n";
-  irStream << "  %3 = load i8*, i8** %1, align 8\n";
-  irStream << "  %4 = call i32 (i8*, ...) @scanf(i8* noundef getelementptr inbounds ([3 x i8], [3 x i8]* @.str, i64 0, i64 0), i8* noundef %3)\n";
-  irStream << "  %5 = load i8*, i8** %1, align 8\n";
-  irStream << "  ret i8* %5\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local i32 @getInt() {\n";
-  irStream << "  %1 = alloca i32, align 4\n";
-  irStream << "  %2 = call i32 (i8*, ...) @scanf(i8* noundef getelementptr inbounds ([3 x i8], [3 x i8]* @.str.2, i64 0, i64 0), i32* noundef %1)\n";
-  irStream << "  %3 = load i32, i32* %1, align 4\n";
-  irStream << "  ret i32 %3\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local i8* @builtin_memset(i8* noundef %0, i32 noundef %1, i32 noundef %2) {\n";
-  irStream << "  %4 = alloca i8*, align 8\n";
-  irStream << "  %5 = alloca i32, align 4\n";
-  irStream << "  %6 = alloca i32, align 4\n";
-  irStream << "  store i8* %0, i8** %4, align 8\n";
-  irStream << "  store i32 %1, i32* %5, align 4\n";
-  irStream << "  store i32 %2, i32* %6, align 4\n";
-  irStream << "  %7 = load i8*, i8** %4, align 8\n";
-  irStream << "  %8 = load i32, i32* %5, align 4\n";
-  irStream << "  %9 = load i32, i32* %6, align 4\n";
-  irStream << "  %10 = call i8* @memset(i8* noundef %7, i32 noundef %8, i32 noundef %9)\n";
-  irStream << "  ret i8* %10\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "define dso_local i8* @builtin_memcpy(i8* noundef %0, i8* noundef %1, i32 noundef %2) {\n";
-  irStream << "  %4 = alloca i8*, align 8\n";
-  irStream << "  %5 = alloca i8*, align 8\n";
-  irStream << "  %6 = alloca i32, align 4\n";
-  irStream << "  store i8* %0, i8** %4, align 8\n";
-  irStream << "  store i8* %1, i8** %5, align 8\n";
-  irStream << "  store i32 %2, i32* %6, align 4\n";
-  irStream << "  %7 = load i8*, i8** %4, align 8\n";
-  irStream << "  %8 = load i8*, i8** %5, align 8\n";
-  irStream << "  %9 = load i32, i32* %6, align 4\n";
-  irStream << "  %10 = call i8* @memcpy(i8* noundef %7, i8* noundef %8, i32 noundef %9)\n";
-  irStream << "  ret i8* %10\n";
-  irStream << "}\n";
-  irStream << "\n";
-  irStream << "declare i32 @scanf(i8*, ...)\n";
-  irStream << "declare i32 @printf(i8*, ...)\n";
-  irStream << "declare i8* @malloc(i32 noundef)\n";
-  irStream << "declare i8* @memset(i8* noundef, i32 noundef, i32 noundef)\n";
-  irStream << "declare i8* @memcpy(i8* noundef, i8* noundef, i32 noundef)\n";
-  irStream << "declare void @exit(i32 noundef)\n";
-  irStream << "declare void @llvm.memset.p0i8.i32(i8*, i8, i32, i1)\n\n";
+  builder.text("@.str = private unnamed_addr constant [3 x i8] c\"%s\\00\", align 1\n");
+  builder.text("@.str.1 = private unnamed_addr constant [4 x i8] c\"%s\\0A\\00\", align 1\n");
+  builder.text("@.str.2 = private unnamed_addr constant [3 x i8] c\"%d\\00\", align 1\n");
+  builder.text("@.str.3 = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\", align 1\n");
+  builder.text("\n");
+  // print/println/printInt/printlnInt：参数放进栈槽再读出来交给printf
+  struct PrintBuiltin {
+    const char* name;
+    const char* type;
+    int align;
+    const char* format;
+  };
+  const PrintBuiltin prints[] = {
+    {"print", "i8*", 8, "getelementptr inbounds ([3 x i8], [3 x i8]* @.str, i64 0, i64 0)"},
+    {"println", "i8*", 8, "getelementptr inbounds ([4 x i8], [4 x i8]* @.str.1, i64 0, i64 0)"},
+    {"printInt", "i32", 4, "getelementptr inbounds ([3 x i8], [3 x i8]* @.str.2, i64 0, i64 0)"},
+    {"printlnInt", "i32", 4, "getelementptr inbounds ([4 x i8], [4 x i8]* @.str.3, i64 0, i64 0)"},
+  };
+  for (const auto& p : prints) {
+    builder.beginFunction("void", p.name, {{p.type, "noundef", "0"}}, "dso_local");
+    builder.allocate("2", p.type, p.align);
+    builder.store(p.type, "%0", "%2", p.align);
+    builder.load("3", p.type, "%2", p.align);
+    builder.call("4", "i32", "@printf", {{"i8*", p.format, "noundef"}, {p.type, "%3", "noundef"}}, "i32 (i8*, ...)");
+    builder.retVoid();
+    builder.endFunction();
+    builder.text("\n");
+  }
+  builder.beginFunction("i8*", "getString", {}, "dso_local");
+  builder.allocate("1", "i8*", 8);
+  builder.call("2", "i8*", "@malloc", {{"i64", "256", "noundef"}});
+  builder.store("i8*", "%2", "%1", 8);
+  builder.load("3", "i8*", "%1", 8);
+  builder.call("4", "i32", "@scanf", {{"i8*", prints[0].format, "noundef"}, {"i8*", "%3", "noundef"}}, "i32 (i8*, ...)");
+  builder.load("5", "i8*", "%1", 8);
+  builder.ret("i8*", "%5");
+  builder.endFunction();
+  builder.text("\n");
+  builder.beginFunction("i32", "getInt", {}, "dso_local");
+  builder.allocate("1", "i32", 4);
+  builder.call("2", "i32", "@scanf", {{"i8*", prints[2].format, "noundef"}, {"i32*", "%1", "noundef"}}, "i32 (i8*, ...)");
+  builder.load("3", "i32", "%1", 4);
+  builder.ret("i32", "%3");
+  builder.endFunction();
+  builder.text("\n");
+  // builtin_memset/builtin_memcpy只是转发到intrinsic，内联后调用处就是intrinsic本身
+  builder.beginFunction("i8*", "builtin_memset", {{"i8*", "noundef", "0"}, {"i32", "noundef", "1"}, {"i32", "noundef", "2"}}, "dso_local");
+  builder.cast("4", IROp::Trunc, "i32", "%1", "i8");
+  builder.call("", "void", "@llvm.memset.p0i8.i32", {{"i8*", "%0"}, {"i8", "%4"}, {"i32", "%2"}, {"i1", "false"}});
+  builder.ret("i8*", "%0");
+  builder.endFunction();
+  builder.text("\n");
+  builder.beginFunction("i8*", "builtin_memcpy", {{"i8*", "noundef", "0"}, {"i8*", "noundef", "1"}, {"i32", "noundef", "2"}}, "dso_local");
+  builder.call("", "void", "@llvm.memcpy.p0i8.p0i8.i32", {{"i8*", "%0"}, {"i8*", "%1"}, {"i32", "%2"}, {"i1", "false"}});
+  builder.ret("i8*", "%0");
+  builder.endFunction();
+  builder.text("\n");
+  // heap_alloc：大数组的malloc，分配失败时exit(1)，不让空指针流到数组访问中
+  builder.beginFunction("i8*", "heap_alloc", {{"i64", "noundef", "0"}}, "dso_local");
+  builder.call("2", "i8*", "@malloc", {{"i64", "%0"}});
+  builder.icmp("3", "eq", "i8*", "%2", "null");
+  builder.condBr("%3", "4", "5");
+  builder.label("4");
+  builder.call("", "void", "@exit", {{"i32", "1"}});
+  builder.unreachable();
+  builder.label("5");
+  builder.ret("i8*", "%2");
+  builder.endFunction();
+  builder.text("\n");
+  builder.text("declare i32 @scanf(i8*, ...)\n");
+  builder.text("declare i32 @printf(i8*, ...)\n");
+  builder.text("declare i8* @malloc(i64 noundef)\n");
+  builder.text("declare void @free(i8* noundef)\n");
+  builder.text("declare void @exit(i32 noundef)\n");
+  builder.text("declare void @llvm.memset.p0i8.i32(i8*, i8, i32, i1)\n");
+  builder.text("declare void @llvm.memcpy.p0i8.p0i8.i32(i8*, i8*, i32, i1)\n");
+  builder.text("declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)\n");
+  builder.text("declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)\n\n");
 
   // 第三步：生成其他代码（函数等）
   for (const auto& node : ast) {
@@ -345,7 +413,19 @@ std::string IRGenerator::generate(const std::vector<std::unique_ptr<ASTNode>>& a
       error("Unknown AST node type");
     }
   }
-  return irStream.str();
+  builder.text(globalDefs);
+  // 分析和变换都在module上做，最后统一打印
+  promoteMemoryToRegisters(*module);
+  eliminateTailRecursion(*module);
+  inlineFunctions(*module);
+  propagateConstants(*module);
+  numberValues(*module);
+  hoistLoopInvariants(*module);
+  reduceStrength(*module);
+  numberValues(*module);
+  eliminateDeadCode(*module);
+  markTailCalls(*module);
+  return module->print();
 }
 
 std::string IRGenerator::toIRType(TypeNode* type) {
@@ -357,16 +437,21 @@ std::string IRGenerator::toIRType(TypeNode* type) {
       auto* typePathNode = dynamic_cast<TypePathNode*>(type);
       if (typePathNode && typePathNode->type_path) {
         std::string path = typePathNode->type_path->toString();
-        if (typeTable.find(path) != typeTable.end()) {
-          return typeTable[path];
-        }
+        if (findStruct(path)) return "%" + path;
         if (path == "i32") return "i32";
         if (path == "i64") return "i64";
-        if (path == "u32") return "i32";
+        if (path == "u32") return "i64";  // u32按i64存放，不会变成负数
         if (path == "bool") return "i1";
+        if (path == "str") return "i8";
       }
       break;
     }
+    case TypeType::TupleType_node: {
+      // ()
+      auto* tupleType = dynamic_cast<TupleTypeNode*>(type);
+      if (tupleType && tupleType->types.empty()) return "void";
+      break;
+    }
     case TypeType::ReferenceType_node: {
       //irStream << "; the type is reference type\n";
       auto* refType = dynamic_cast<ReferenceTypeNode*>(type);
@@ -402,53 +487,85 @@ std::string IRGenerator::toIRType(const std::string& typeName) {
 }
 
 std::string IRGenerator::expandStructType(const std::string& typeName) {
-  if (typeName.back() == '*') {
-    // Pointer type, expand the pointed type and add *
-    std::string pointed = typeName.substr(0, typeName.size() - 1);
-    std::string expanded = expandStructType(pointed);
-    return expanded + "*";
-  } else if (typeName[0] == '[') {
-    // Array type [N x T]
-    size_t xPos = typeName.find(" x ");
-    if (xPos != std::string::npos) {
-      std::string nStr = typeName.substr(1, xPos - 1);
-      std::string tStr = typeName.substr(xPos + 3, typeName.size() - xPos - 4); // remove ]
-      std::string expandedT = expandStructType(tStr); // recursive
-      std::string res = "[" + nStr + " x " + expandedT + "]";
-      return res;
-    }
-  } else if (typeName[0] == '%') {
-    // Struct type
-    std::string name = typeName.substr(1);
-    auto it = structFields.find(name);
-    if (it != structFields.end()) {
-      std::string res = "{";
-      for (size_t i = 0; i < it->second.size(); ++i) {
-        std::string fieldType = it->second[i].second;
-        fieldType = expandStructType(fieldType); // recursive
-        res += fieldType;
-        if (i + 1 < it->second.size()) res += ", ";
-      }
-      res += "}";
-      return res;
-    }
+  return irTypes.get(typeName)->expanded;
+}
+
+void IRGenerator::defineStructType(const ItemIndex::Struct& s) {
+  std::vector<std::string> fieldTypes;
+  if (s.node->struct_fields) {
+    for (const auto& field : s.node->struct_fields->struct_fields) fieldTypes.push_back(toIRType(field->type.get()));
   }
-  return typeName;
+  irTypes.defineStruct(s.name, std::move(fieldTypes));
+}
+
+// main中的struct遮住同名的顶层struct
+const ItemIndex::Struct* IRGenerator::findStruct(const std::string& name) {
+  auto it = localStructs.find(name);
+  return it != localStructs.end() ? &it->second : items->find_struct(name);
+}
+
+// 按声明顺序的字段名和IR类型，类型在preScan中已经交给irTypes
+std::vector<std::pair<std::string, std::string>> IRGenerator::structLayout(const ItemIndex::Struct* s) {
+  std::vector<std::pair<std::string, std::string>> fields;
+  if (!s->node->struct_fields) return fields;
+  const IRType* type = irTypes.get("%" + s->name);
+  const auto& decl = s->node->struct_fields->struct_fields;
+  for (size_t i = 0; i < decl.size(); i++) fields.emplace_back(decl[i]->identifier, type->fields[i]->name);
+  return fields;
 }
 
-std::vector<std::string> IRGenerator::expandParamTypes(const std::string& paramType) {
-  if (paramType[0] == '%') {
-    std::string name = paramType.substr(1);
-    auto it = structFields.find(name);
-    if (it != structFields.end()) {
-      std::vector<std::string> res;
-      for (auto& p : it->second) {
-        res.push_back(p.second);
+bool IRGenerator::passIndirect(const std::string& type) {
+  if (type.empty() || type[0] != '%' || type.back() == '*') return false;
+  return findStruct(type.substr(1)) && getTypeSize(type) > 16;
+}
+
+// value为isAddress时是实参所在的地址：间接传递时直接把这个地址传过去，被调函数只在入口读一次
+void IRGenerator::passArgument(std::vector<IRBuilder::Arg>& args, const std::string& type, const std::string& value, bool isAddress) {
+  std::string expanded = expandStructType(type);
+  if (passIndirect(type)) {
+    std::string ptr = value;
+    if (!isAddress) {
+      std::string temp = createTemp();
+      emitAlloca(type, temp);
+      builder.store(expanded, value, "%" + temp);
+      ptr = "%" + temp;
+    }
+    args.push_back({expanded + "*", ptr});
+    return;
+  }
+  std::string v = value;
+  if (isAddress) v = emitLoad(type, value);
+  if (type[0] == '%' && type.back() != '*') {
+    if (const ItemIndex::Struct* s = findStruct(type.substr(1))) {
+      auto fields = structLayout(s);
+      for (size_t j = 0; j < fields.size(); ++j) {
+        std::string temp = createTemp();
+        builder.extractValue(temp, expanded, v, {(unsigned)j});
+        args.push_back({fields[j].second, "%" + temp});
       }
-      return res;
+      return;
     }
   }
-  return {paramType};
+  args.push_back({expanded, v});
+}
+
+// 返回值需要sret时在调用者栈上留出位置，调用后再读出来
+std::string IRGenerator::emitCall(const std::string& funcName, const std::string& retType, std::vector<IRBuilder::Arg> args) {
+  if (retType == "void") {
+    builder.call("", "void", llvmGlobalRef(funcName), args);
+    return "";
+  }
+  std::string expanded = expandStructType(retType);
+  if (passIndirect(retType)) {
+    std::string slot = createTemp();
+    emitAlloca(retType, slot);
+    args.insert(args.begin(), {expanded + "*", "%" + slot, "sret(" + expanded + ")"});
+    builder.call("", "void", llvmGlobalRef(funcName), args);
+    return emitLoad(retType, "%" + slot);
+  }
+  std::string temp = createTemp();
+  builder.call(temp, expanded, llvmGlobalRef(funcName), args);
+  return "%" + temp;
 }
 
 std::string IRGenerator::visit(ExpressionNode* node) {
@@ -510,20 +627,14 @@ std::string IRGenerator::visit(ExpressionNode* node) {
 std::string IRGenerator::visit(LiteralExpressionNode* node) {
   if (std::holds_alternative<std::unique_ptr<string_literal>>(node->literal)) {
     auto& strLit = std::get<std::unique_ptr<string_literal>>(node->literal);
-    std::string strValue = strLit->value;
-    // 转义字符串，添加 null terminator
-    std::string escaped = strValue + "\\00";
-    int len = strValue.size() + 1;
-    std::string globalName = ".str." + std::to_string(tempCounter++);
-    irStream << "@" << globalName << " = private unnamed_addr constant [" << len << " x i8] c\"" << escaped << "\", align 1\n";
-    std::string temp = createTemp();
-    irStream << "  %" << temp << " = getelementptr [" << len << " x i8], [" << len << " x i8]* @" << globalName << ", i32 0, i32 0\n";
-    return "%" + temp;
+    // value中保留了两边的引号
+    const std::string& value = strLit->value;
+    return stringConstant(value.size() >= 2 && value.front() == '"' ? value.substr(1, value.size() - 2) : value);
   } else if (std::holds_alternative<std::unique_ptr<bool>>(node->literal)) {
     auto& boolLit = std::get<std::unique_ptr<bool>>(node->literal);
     std::string temp = createTemp();
     std::string value = *boolLit ? "1" : "0";
-    irStream << "  %" << temp << " = add i1 0, " << value << "\n";
+    builder.binary(temp, IROp::Add, "i1", "0", value);
     return "%" + temp;
   } else {
     // 整数或其他
@@ -554,79 +665,53 @@ std::string IRGenerator::visit(LiteralExpressionNode* node) {
     } else {
       value_str = node->toString();
     }
-    irStream << "  %" << temp << " = add " << type << " 0, " << value_str << "\n";
+    builder.binary(temp, IROp::Add, type, "0", value_str);
     return "%" + temp;
   }
 }
 
 std::string IRGenerator::visit(PathExpressionNode* node) {
-    std::string name = node->toString();
-    //irStream << "; visiting pathexpression with path: " << name << '\n';
-    if (constantTable.find(name) != constantTable.end()) {
+    if (ConstantItemNode* item = lookupConstant(node)) {
       // 常量，直接返回值
-      //irStream << "; constant found: " << name << " = " << constantTable[name] << '\n';
-      return constantTable[name];
-    } else {
-      std::string temp = lookupSymbol(name);
-      if (!temp.empty()) {
-        std::string type = lookupVarType(name);
-        //irStream << "; type of " << name << " : " << type << '\n';
-        if (type.empty()) type = "i32";
-        if (temp == name) {
-          // 直接是 register
-          return "%" + temp;
-        } else {
-          // temp is a stored pointer, load value
-          if (type.find('%') == 0 && type.back() == '*') {
-            // 结构体指针，load 指针
-            return "%" + temp;
-          } else if (type.find('*') != std::string::npos) {
-            // 其他指针，直接返回指针
-            return "%" + temp;
-          } else if (type[0] == '%') {
-            // struct value, temp is value register, return directly
-            return "%" + temp;
-          } else if (type[0] == '{') {
-            // struct value expanded, load
-            std::string loadTemp = createTemp();
-            irStream << "  %" << loadTemp << " = load " << expandStructType(type) << ", " << expandStructType(type) << "* %" << temp << "\n";
-            return "%" + loadTemp;
-          } else if (type[0] == '[' && type.back() == '*') {
-            // array pointer, return pointer
-            return "%" + temp;
-          } else {
-            // 基本类型，load
-            std::string loadTemp = createTemp();
-            irStream << "  %" << loadTemp << " = load " << expandStructType(type) << ", " << expandStructType(type) << "* %" << temp << "\n";
-            return "%" + loadTemp;
-          }
-        }
+      return constantOperand(item);
+    } else if (Local* local = lookupLocal(node)) {
+      std::string temp = local->symbol;
+      std::string type = local->type;
+      if (type.find('*') != std::string::npos) {
+        // 栈槽、指针参数，直接返回指针
+        return "%" + temp;
+      } else if (type[0] == '%') {
+        // struct value, temp is value register, return directly
+        return "%" + temp;
+      } else {
+        // 按值传入的参数放在栈槽中，load
+        return emitLoad(type, "%" + temp);
       }
     }
-    error("Undefined variable: " + name);
+    error("Undefined variable: " + node->toString());
     return "";
   }
 
 std::string IRGenerator::visit(CallExpressionNode* node) {
-    std::string funcName;
+    std::string calleePath;
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-        funcName = path->toString();
+        calleePath = path->toString();
     } else {
         error("Unsupported function expression in call");
         return "";
     }
-    funcName = mangleFuncName(funcName);
+    std::string funcName = mangleFuncName(calleePath);
+    const Signature* sig = signature(calleePath);
     // Special handling for exit
     if (funcName == "exit") {
         std::string arg = visit(node->call_params->expressions[0].get());
-        irStream << "  ret i32 " << arg << "\n";
+        builder.ret("i32", arg);
         return "";
     }
-    std::string args = "";
+    std::vector<IRBuilder::Arg> args;
     if (node->call_params) {
-        auto it = paramTypesTable.find(funcName);
-        if (it != paramTypesTable.end()) {
-            const auto& paramTypes = it->second;
+        if (sig) {
+            const auto& paramTypes = sig->params;
             size_t argIndex = 0;
             for (size_t i = 0; i < node->call_params->expressions.size(); ++i) {
                 std::string argValue = visit_in_rhs(node->call_params->expressions[i].get());
@@ -635,72 +720,38 @@ std::string IRGenerator::visit(CallExpressionNode* node) {
                 // 这里的 actualType 以 getLhsType/lookupVarType 的结果为准（此项目中局部变量通常记录为 T*）
                 std::string actualType;
                 if (auto* pathArg = dynamic_cast<PathExpressionNode*>(node->call_params->expressions[i].get())) {
-                  actualType = lookupVarType(pathArg->toString());
+                  actualType = lookupVarType(pathArg);
                   //irStream << "; actual type is " << actualType << " after looking up var type\n";
                 } else {
                   actualType = getLhsType(node->call_params->expressions[i].get());
                   //irStream << "; actual type is " << actualType << " after getting lhs type\n";
                 }
                 //irStream << "; argvalue in call expression of " << funcName << " is " << argValue << " with argtype " << argType << "\n";
+                // argValue是实参所在的地址时，由passArgument决定读出来还是直接传地址
+                bool isAddress = false;
                 if (!actualType.empty() && actualType == argType + "*") {
                   if (auto* borrow = dynamic_cast<BorrowExpressionNode*>(node->call_params->expressions[i].get())) {
                     if (auto* path = dynamic_cast<PathExpressionNode*>(borrow->expression.get())) {
-                      if (!isLetDefined(path->toString())) {
-                        std::string param_temp = createTemp();
-                        irStream << "  %" << param_temp << " = load " << expandStructType(argType)
-                                 << ", " << expandStructType(actualType) << " " << argValue << "\n";
-                        argValue = "%" + param_temp;
-                      }
+                      if (!isLetDefined(path)) isAddress = true;
                     }
                   } else {
-                    std::string param_temp = createTemp();
-                    irStream << "  %" << param_temp << " = load " << expandStructType(argType)
-                             << ", " << expandStructType(actualType) << " " << argValue << "\n";
-                    argValue = "%" + param_temp;
+                    isAddress = true;
                   }
                 }
-                if (argType[0] == '%' && argType.back() != '*') {
-                    std::string name = argType.substr(1);
-                    auto it2 = structFields.find(name);
-                    if (it2 != structFields.end()) {
-                        for (size_t j = 0; j < it2->second.size(); ++j) {
-                            if (argIndex > 0) args += ", ";
-                            std::string temp = createTemp();
-                            irStream << "  %" << temp << " = extractvalue " << expandStructType(argType) << " " << argValue << ", " << j << "\n";
-                            args += it2->second[j].second + " %" + temp;
-                            argIndex++;
-                        }
-                    } else {
-                        if (argIndex > 0) args += ", ";
-                        args += expandStructType(argType) + " " + argValue;
-                        argIndex++;
-                    }
-                } else {
-                    if (argIndex > 0) args += ", ";
-                    args += expandStructType(argType) + " " + argValue;
-                    argIndex++;
-                }
+                passArgument(args, argType, argValue, isAddress);
+                argIndex++;
             }
         } else {
             // 默认 i32
-            //irStream << "; function: " << funcName << " not found in paramTypesTable\n";
+            //irStream << "; function: " << funcName << " has no signature\n";
             for (size_t i = 0; i < node->call_params->expressions.size(); ++i) {
-                if (i > 0) args += ", ";
                 std::string argValue = visit_in_rhs(node->call_params->expressions[i].get());
-                args += "i32 " + argValue;
+                args.push_back({"i32", argValue});
             }
         }
     }
-    std::string retType = functionTable[funcName];
-    if (retType.empty()) retType = "i32"; // 默认
-    if (retType == "void") {
-        irStream << "  call void " << llvmGlobalRef(funcName) << "(" << args << ")\n";
-        return "";
-    } else {
-        std::string temp = createTemp();
-        irStream << "  %" << temp << " = call " << expandStructType(retType) << " " << llvmGlobalRef(funcName) << "(" << args << ")\n";
-        return "%" + temp;
-    }
+    std::string retType = sig ? sig->ret : "i32"; // 默认
+    return emitCall(funcName, retType, args);
 }
 
 std::string IRGenerator::visit(ArithmeticOrLogicalExpressionNode* node) {
@@ -708,40 +759,38 @@ std::string IRGenerator::visit(ArithmeticOrLogicalExpressionNode* node) {
   std::string lhs = visit(node->expression1.get());
   std::string lhsType = getLhsType(node->expression1.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
-    std::string lhs_path = path->toString();
-    std::string lhs_type = lookupVarType(lhs_path);
-    std::string lhs_addr = lookupSymbol(lhs_path);
+    std::string lhs_type = lookupVarType(path);
+    std::string lhs_addr = lookupSymbol(path);
     if (lhs_type == "i32*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i32, i32* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i32", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i32";
     } else if (lhs_type == "i64*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i64, i64* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i64", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i64";
     }
   }
   if (auto* type_cast = dynamic_cast<TypeCastExpressionNode*>(node->expression1.get())) {
     if (auto* path = dynamic_cast<PathExpressionNode*>(type_cast->expression.get())) {
-      std::string lhs_path = path->toString();
-      std::string lhs_type = lookupVarType(lhs_path);
-      std::string lhs_addr = lookupSymbol(lhs_path);
+      std::string lhs_type = lookupVarType(path);
+      std::string lhs_addr = lookupSymbol(path);
       if (lhs_type == "i32*") {
         std::string lhs_temp = createTemp();
-        irStream << "  %" << lhs_temp << " = load i32, i32* %" << lhs_addr << '\n';
+        builder.load(lhs_temp, "i32", "%" + lhs_addr);
         lhs = "%" + lhs_temp;
         lhsType = "i32";
       } else if (lhs_type == "i64*") {
         std::string lhs_temp = createTemp();
-        irStream << "  %" << lhs_temp << " = load i64, i64* %" << lhs_addr << '\n';
+        builder.load(lhs_temp, "i64", "%" + lhs_addr);
         lhs = "%" + lhs_temp;
         lhsType = "i64";
         if (toIRType(type_cast->type.get()) == "i32") {
           lhsType = "i32";
           std::string temp = createTemp();
-          irStream << "  %" << temp << " = trunc i64 " << lhs << " to i32\n";
+          builder.cast(temp, IROp::Trunc, "i64", lhs, "i32");
           lhs = "%" + temp;
         }
       }
@@ -750,17 +799,16 @@ std::string IRGenerator::visit(ArithmeticOrLogicalExpressionNode* node) {
   std::string rhs = visit(node->expression2.get());
   std::string rhsType = getLhsType(node->expression2.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-    std::string rhs_path = path->toString();
-    std::string rhs_type = lookupVarType(rhs_path);
-    std::string rhs_addr = lookupSymbol(rhs_path);
+    std::string rhs_type = lookupVarType(path);
+    std::string rhs_addr = lookupSymbol(path);
     if (rhs_type == "i32*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i32, i32* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i32", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i32";
     } else if (rhs_type == "i64*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i64, i64* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i64", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i64";
     }
@@ -770,41 +818,41 @@ std::string IRGenerator::visit(ArithmeticOrLogicalExpressionNode* node) {
   if (resultType == "i64") {
     if (lhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << lhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", lhs, "i64");
       lhs = "%" + temp;
     }
     if (rhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << rhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", rhs, "i64");
       rhs = "%" + temp;
     }
   }
   //irStream << "; lhsType: " << lhsType << ", rhsType: " << rhsType << ", resultType: " << resultType << "\n";
   std::string temp = createTemp();
-  std::string op;
+  IROp op;
   switch (node->type) {
-    case ADD: op = "add"; break;
-    case MINUS: op = "sub"; break;
-    case MUL: op = "mul"; break;
-    case DIV: op = "sdiv"; break;
-    case MOD: op = "srem"; break;
-    case AND: op = "and"; break;
-    case OR: op = "or"; break;
-    case XOR: op = "xor"; break;
-    case SHL: op = "shl"; break;
-    case SHR: op = "ashr"; break;
-    default: op = "add";
-  }
-  if (op == "shl" || op == "ashr") {
+    case ADD: op = IROp::Add; break;
+    case MINUS: op = IROp::Sub; break;
+    case MUL: op = IROp::Mul; break;
+    case DIV: op = IROp::SDiv; break;
+    case MOD: op = IROp::SRem; break;
+    case AND: op = IROp::And; break;
+    case OR: op = IROp::Or; break;
+    case XOR: op = IROp::Xor; break;
+    case SHL: op = IROp::Shl; break;
+    case SHR: op = IROp::AShr; break;
+    default: op = IROp::Add;
+  }
+  if (op == IROp::Shl || op == IROp::AShr) {
     if (resultType == "i64" && lhsType == "i32") {
       //irStream << "; need modifying in shl or ashr" << '\n';
       resultType = "i32";
       std::string modTemp = createTemp();
-      irStream << "  %" << modTemp << " = trunc i64 " << rhs << " to i32\n";
+      builder.cast(modTemp, IROp::Trunc, "i64", rhs, "i32");
       rhs = "%" + modTemp;
     }
   }
-  irStream << "  %" << temp << " = " << op << " " << resultType << " " << lhs << ", " << rhs << "\n";
+  builder.binary(temp, op, resultType, lhs, rhs);
   return "%" + temp;
 }
 
@@ -813,18 +861,16 @@ std::string IRGenerator::visit(ComparisonExpressionNode* node) {
   std::string lhs = visit_in_rhs(node->expression1.get());
   std::string lhsType = getLhsType(node->expression1.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
-    std::string lhs_path = path->toString();
-    //irStream << "; lhs_path in comparison expression: " << lhs_path << "\n";
-    std::string lhs_type = lookupVarType(lhs_path);
-    std::string lhs_addr = lookupSymbol(lhs_path);
+    std::string lhs_type = lookupVarType(path);
+    std::string lhs_addr = lookupSymbol(path);
     if (lhs_type == "i32*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i32, i32* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i32", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i32";
     } else if (lhs_type == "i64*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i64, i64* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i64", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i64";
     }
@@ -832,18 +878,16 @@ std::string IRGenerator::visit(ComparisonExpressionNode* node) {
   std::string rhs = visit_in_rhs(node->expression2.get());
   std::string rhsType = getLhsType(node->expression2.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-    std::string rhs_path = path->toString();
-    //irStream << "; rhs_path in comparison expression: " << rhs_path << "\n";
-    std::string rhs_type = lookupVarType(rhs_path);
-    std::string rhs_addr = lookupSymbol(rhs_path);
+    std::string rhs_type = lookupVarType(path);
+    std::string rhs_addr = lookupSymbol(path);
     if (rhs_type == "i32*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i32, i32* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i32", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i32";
     } else if (rhs_type == "i64*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i64, i64* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i64", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i64";
     }
@@ -853,42 +897,42 @@ std::string IRGenerator::visit(ComparisonExpressionNode* node) {
   if (compareType == "i64") {
     if (lhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << lhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", lhs, "i64");
       lhs = "%" + temp;
     }
     if (rhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << rhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", rhs, "i64");
       rhs = "%" + temp;
     }
   }
   std::string temp = createTemp();
-  std::string op;
+  std::string pred;
   switch (node->type) {
-    case EQ: op = "icmp eq"; break;
-    case NEQ: op = "icmp ne"; break;
-    case GT: op = "icmp sgt"; break;
-    case LT: op = "icmp slt"; break;
-    case GEQ: op = "icmp sge"; break;
-    case LEQ: op = "icmp sle"; break;
-    default: op = "icmp eq";
+    case EQ: pred = "eq"; break;
+    case NEQ: pred = "ne"; break;
+    case GT: pred = "sgt"; break;
+    case LT: pred = "slt"; break;
+    case GEQ: pred = "sge"; break;
+    case LEQ: pred = "sle"; break;
+    default: pred = "eq";
   }
   if (lhsType == "i1*") {
     std::string temp1 = createTemp();
-    irStream << "  %" << temp1 << " = load i1, i1* " << lhs << "\n";
+    builder.load(temp1, "i1", lhs);
     lhs = "%" + temp1;
     lhsType = "i1";
   }
   if (rhsType == "i1*") {
     std::string temp2 = createTemp();
-    irStream << "  %" << temp2 << " = load i1, i1* " << rhs << "\n";
+    builder.load(temp2, "i1", rhs);
     rhs = "%" + temp2;
     rhsType = "i1";
   }
   if (lhsType == "i1" && rhsType == "i1") {
     compareType = "i1";
   }
-  irStream << "  %" << temp << " = " << op << " " << compareType << " " << lhs << ", " << rhs << "\n";
+  builder.icmp(temp, pred, compareType, lhs, rhs);
   return "%" + temp;
 }
 
@@ -913,11 +957,10 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
     if (std::holds_alternative<std::unique_ptr<ExpressionNode>>(ifExpr->conditions->condition)) {
       cond = visit(std::get<std::unique_ptr<ExpressionNode>>(ifExpr->conditions->condition).get());
       if (auto* path = dynamic_cast<PathExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(ifExpr->conditions->condition).get())) {
-        std::string condName = path->toString();
-        std::string condType = lookupVarType(condName);
+        std::string condType = lookupVarType(path);
         if (condType == "i1*") {
           std::string condTemp = createTemp();
-          irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+          builder.load(condTemp, "i1", cond);
           cond = "%" + condTemp;
         }
       }
@@ -930,9 +973,9 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
     std::string elseLabel = createLabel();
     std::string endLabel = createLabel();
 
-    irStream << "  br i1 " << cond << ", label %" << thenLabel << ", label %" << elseLabel << "\n";
+    builder.condBr(cond, thenLabel, elseLabel);
 
-    irStream << thenLabel << ":\n";
+    builder.label(thenLabel);
     //irStream << "  ; then branch assignment\n";
     // 处理 statements，但不处理 expression_without_block 的 store/br
     for (auto& stmt : ifExpr->block_expression->statement) {
@@ -942,18 +985,18 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
     std::string thenType = ifExpr->block_expression->expression_without_block ? getLhsType(ifExpr->block_expression->expression_without_block.get()) : "void";
     if (lhsType == "i64" && thenType == "i32") {
       std::string sextTemp = createTemp();
-      irStream << "  %" << sextTemp << " = sext i32 " << thenValue << " to i64\n";
+      builder.cast(sextTemp, IROp::SExt, "i32", thenValue, "i64");
       thenValue = "%" + sextTemp;
     }
     if (thenType == "i32*") {
       std::string loadTemp = createTemp();
-      irStream << "  %" << loadTemp << " = load i32, i32* " << thenValue << "\n";
+      builder.load(loadTemp, "i32", thenValue);
       thenValue = "%" + loadTemp;
     }
-    irStream << "  store " << expandStructType(lhsType) << " " << thenValue << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.store(expandStructType(lhsType), thenValue, lhsAddr);
+    builder.br(endLabel);
 
-    irStream << elseLabel << ":\n";
+    builder.label(elseLabel);
     //irStream << "  ; else branch assignment\n";
     std::string elseValue;
     if (ifExpr->else_block) {
@@ -977,12 +1020,13 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
       error("If expression in assignment must have else");
       return "";
     }
-    irStream << "  store " << expandStructType(lhsType) << " " << elseValue << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.store(expandStructType(lhsType), elseValue, lhsAddr);
+    builder.br(endLabel);
 
-    irStream << endLabel << ":\n";
+    builder.label(endLabel);
   } else {
-    // 普通 rhs
+    // 普通 rhs；右边不读任何变量时直接构造在左边的位置上
+    if (selfContained(node->expression2.get()) && emitInto(node->expression2.get(), lhsType, lhsAddr)) return "";
     std::string rhsValue = visit_in_rhs(node->expression2.get());
     std::string rhsType = getLhsType(node->expression2.get());
     std::string lhsValue = visit(node->expression1.get());
@@ -993,39 +1037,47 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
 
     // 类型对齐：如果 rhs 比 lhs 多一层指针，则 load 之后再 store
     // 例：lhsValueType = T, rhsValueType = T*  =>  load T, T* rhsValue
+    // 右边是聚合类型的变量时rhsValue是它的地址，直接按字节复制；
+    // let定义的变量记录的类型比值多一层指针
+    std::string lhsValueType = lhsType;
+    if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
+      if (isLetDefined(path) && lhsType.back() == '*') lhsValueType.pop_back();
+    }
+    if (!lhsValueType.empty() && rhsType == lhsValueType + "*" && isAggregate(lhsValueType)) {
+      emitCopy(lhsValueType, lhsAddr, rhsValue);
+      return "";
+    }
     if (!lhsType.empty() && rhsType == lhsType + "*") {
       std::string rhsTemp = createTemp();
-      irStream << "  %" << rhsTemp << " = load " << expandStructType(lhsType)
-               << ", " << expandStructType(rhsType) << " " << rhsValue << "\n";
+      builder.load(rhsTemp, expandStructType(lhsType), rhsValue);
       rhsValue = "%" + rhsTemp;
       rhsType = lhsType;
     }
     if (!rhsType.empty() && lhsType == rhsType + "*") {
       std::string lhsTemp = createTemp();
-      irStream << "  %" << lhsTemp << " = load " << expandStructType(rhsType)
-               << ", " << expandStructType(lhsType) << " " << lhsValue << "\n";
+      builder.load(lhsTemp, expandStructType(rhsType), lhsValue);
       lhsValue = "%" + lhsTemp;
       lhsType = rhsType;
     }
     if (lhsType == "i32*" && rhsType == "i32*") {
       std::string rhsTemp = createTemp();
-      irStream << "  %" << rhsTemp << " = load i32, i32* " << rhsValue << "\n";
+      builder.load(rhsTemp, "i32", rhsValue);
       rhsValue = "%" + rhsTemp;
-      irStream << "  store i32 " << rhsValue << ", i32* " << lhsValue << "\n";
+      builder.store("i32", rhsValue, lhsValue);
       return "";
     }
 
     if (lhsType == "i1*" && rhsType == "i1*") {
       std::string rhsTemp = createTemp();
-      irStream << "  %" << rhsTemp << " = load i1, i1* " << rhsValue << "\n";
+      builder.load(rhsTemp, "i1", rhsValue);
       rhsValue = "%" + rhsTemp;
-      irStream << "  store i1 " << rhsValue << ", i1* " << lhsValue << "\n";
+      builder.store("i1", rhsValue, lhsValue);
       return "";
     }
     // 类型转换：如果 rhs 是 i64，lhs 是 i32，trunc
     if (rhsType == "i64" && lhsType == "i32") {
       std::string truncTemp = createTemp();
-      irStream << "  %" << truncTemp << " = trunc i64 " << rhsValue << " to i32\n";
+      builder.cast(truncTemp, IROp::Trunc, "i64", rhsValue, "i32");
       rhsValue = "%" + truncTemp;
       rhsType = "i32";
     }
@@ -1033,28 +1085,21 @@ std::string IRGenerator::visit(AssignmentExpressionNode* node) {
     // 类型转换：如果 lhs 是 i64，rhs 是 i32，sext
     if (lhsType == "i64" && rhsType == "i32") {
       std::string sextTemp = createTemp();
-      irStream << "  %" << sextTemp << " = sext i32 " << rhsValue << " to i64\n";
+      builder.cast(sextTemp, IROp::SExt, "i32", rhsValue, "i64");
       rhsValue = "%" + sextTemp;
       rhsType = "i64";
     }
 
     // 统一使用 lhsValueType 进行 store
-    irStream << "  store " << expandStructType(lhsType) << " " << rhsValue
-             << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
+    builder.store(expandStructType(lhsType), rhsValue, lhsAddr);
   }
   return "";
 }
 
 std::string IRGenerator::visit(CompoundAssignmentExpressionNode* node) {
-  // 获取 lhs 地址和类型
-  //irStream << "; visiting compoundassignmentexpression\n";
-  //irStream << "; getting address of lhs in compoundexpression\n";
-  std::string lhsAddr = getLhsAddress(node->expression1.get());
-  //irStream << "; address of lhs in compoundexpression: "<< lhsAddr << "\n";
-  //irStream << "; getting type of lhs in compoundexpression\n";
+  // 操作数都是基本类型，先求rhs，再求一次lhs的地址，load、运算、store都用这个地址
   std::string lhsType = getLhsType(node->expression1.get());
-  //irStream << "; type of lhs in compoundexpression: "<< lhsType << "\n";
-  if (lhsAddr.empty() || lhsType.empty()) {
+  if (lhsType.empty()) {
     return "";
   }
 
@@ -1062,80 +1107,61 @@ std::string IRGenerator::visit(CompoundAssignmentExpressionNode* node) {
     lhsType.pop_back();
   }
 
-  // load lhs 值
-  std::string lhsValue;
-  if (lhsType.find('%') == 0 && lhsType.back() == '*') {
-    // 结构体指针，load 结构体
-    std::string structType = lhsType.substr(0, lhsType.size() - 1);
-    std::string loadTemp = createTemp();
-    irStream << "  %" << loadTemp << " = load " << expandStructType(structType) << ", " << expandStructType(lhsType) << " " << lhsAddr << "\n";
-    lhsValue = "%" + loadTemp;
-  } else {
-    // 基本类型，load
-    std::string loadTemp = createTemp();
-    irStream << "  %" << loadTemp << " = load " << expandStructType(lhsType) << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
-    lhsValue = "%" + loadTemp;
-  }
-
   // 获取 rhs 值
   std::string rhsValue = visit_in_rhs(node->expression2.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-    std::string rhsName = path->toString();
-    //irStream << "; rhs name in compoundassignmentexpression: " << rhsName << "\n";
-    std::string rhsType = lookupVarType(rhsName);
+    std::string rhsType = lookupVarType(path);
     std::string rhsTemp = createTemp();
     //irStream << "; rhs type in compoundassignmentexpression: " << rhsType << "\n";
     //irStream << "; lhs type in compoundassignmentexpression: " << lhsType << "\n";
-    if (isLetDefined(rhsName) && rhsType == lhsType + "*") {
-      irStream << "  %" << rhsTemp << " = load " << expandStructType(lhsType)
-               << ", " << expandStructType(rhsType) << " " << rhsValue << "\n";
+    if (isLetDefined(path) && rhsType == lhsType + "*") {
+      builder.load(rhsTemp, expandStructType(lhsType), rhsValue);
       rhsValue = "%" + rhsTemp;
       rhsType = lhsType;
     }
   }
 
+  std::string lhsAddr = getLhsAddress(node->expression1.get());
+  if (lhsAddr.empty()) {
+    error("Compound assignment target has no address");
+    return "";
+  }
+  std::string lhsValue = createTemp();
+  builder.load(lhsValue, expandStructType(lhsType), lhsAddr);
+  lhsValue = "%" + lhsValue;
+
   // 计算 lhs op rhs
-  std::string op;
+  IROp op;
   switch (node->type) {
-    case ADD: op = "add"; break;
-    case MINUS: op = "sub"; break;
-    case MUL: op = "mul"; break;
-    case DIV: op = "sdiv"; break;
-    case MOD: op = "srem"; break;
-    case AND: op = "and"; break;
-    case OR: op = "or"; break;
-    case XOR: op = "xor"; break;
-    case SHL: op = "shl"; break;
-    case SHR: op = "ashr"; break;
-    default: op = "add";
+    case ADD: op = IROp::Add; break;
+    case MINUS: op = IROp::Sub; break;
+    case MUL: op = IROp::Mul; break;
+    case DIV: op = IROp::SDiv; break;
+    case MOD: op = IROp::SRem; break;
+    case AND: op = IROp::And; break;
+    case OR: op = IROp::Or; break;
+    case XOR: op = IROp::Xor; break;
+    case SHL: op = IROp::Shl; break;
+    case SHR: op = IROp::AShr; break;
+    default: op = IROp::Add;
   }
   std::string resultTemp = createTemp();
-  irStream << "  %" << resultTemp << " = " << op << " " << lhsType << " " << lhsValue << ", " << rhsValue << "\n";
+  builder.binary(resultTemp, op, lhsType, lhsValue, rhsValue);
 
   // store 结果到 lhs
-  if (lhsType.find('%') == 0 && lhsType.back() == '*') {
-    // 结构体指针，store 结构体值
-    std::string structType = lhsType.substr(0, lhsType.size() - 1);
-    irStream << "  store " << expandStructType(structType) << " %" << resultTemp << ", " << expandStructType(lhsType) << " " << lhsAddr << "\n";
-  } else if (lhsType[0] == '{') {
-    // struct value
-    irStream << "  store " << expandStructType(lhsType) << " %" << resultTemp << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
-  } else {
-    // 基本类型
-    irStream << "  store " << expandStructType(lhsType) << " %" << resultTemp << ", " << expandStructType(lhsType) << "* " << lhsAddr << "\n";
-  }
-  //irStream << "; finish visiting compound assignment expression\n";
+  builder.store(expandStructType(lhsType), "%" + resultTemp, lhsAddr);
   return "";
 }
 
 std::string IRGenerator::visit(StructExpressionNode* node) {
   //irStream << "; visiting struct expression\n";
   std::string structName = node->pathin_expression->toString();
-  auto it = structFields.find(structName);
-  if (it == structFields.end()) {
+  const ItemIndex::Struct* s = findStruct(structName);
+  if (!s) {
     error("Unknown struct " + structName);
     return "";
   }
+  auto fields = structLayout(s);
   std::string structType = expandStructType("%" + structName);
 
   // 初始值
@@ -1158,13 +1184,7 @@ std::string IRGenerator::visit(StructExpressionNode* node) {
         return "";
       }
       // 找到索引
-      int index = -1;
-      for (int i = 0; i < it->second.size(); ++i) {
-        if (it->second[i].first == fieldName) {
-          index = i;
-          break;
-        }
-      }
+      int index = fieldIndex(structName, fieldName);
       if (index == -1) {
         error("Field not found: " + fieldName);
         return "";
@@ -1172,15 +1192,14 @@ std::string IRGenerator::visit(StructExpressionNode* node) {
       std::string fieldValue = visit(field->expression.get());
       std::string temp = createTemp();
       if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-        std::string varName = path->toString();
-        std::string varType = lookupVarType(varName);
-        if (expandStructType(varType) == expandStructType(it->second[index].second) + "*") {
+        std::string varType = lookupVarType(path);
+        if (expandStructType(varType) == expandStructType(fields[index].second) + "*") {
           std::string varTemp = createTemp();
-          irStream << "  %" << varTemp << " = load " << expandStructType(it->second[index].second) << ", " << expandStructType(varType) << " " << fieldValue << "\n";
+          builder.load(varTemp, expandStructType(fields[index].second), fieldValue);
           fieldValue = "%" + varTemp;
         }
       }
-      irStream << "  %" << temp << " = insertvalue " << expandStructType(structType) << " " << currentValue << ", " << expandStructType(it->second[index].second) << " " << fieldValue << ", " << index << "\n";
+      builder.insertValue(temp, expandStructType(structType), currentValue, expandStructType(fields[index].second), fieldValue, {(unsigned)index});
       currentValue = "%" + temp;
     }
   }
@@ -1188,46 +1207,118 @@ std::string IRGenerator::visit(StructExpressionNode* node) {
   return currentValue;
 }
 
-std::string IRGenerator::visit(DereferenceExpressionNode* node) {
-  //irStream << "; visit dereferenceexpression\n";
-  std::string ptr = visit(node->expression.get());
-  std::string ptrType = getLhsType(node->expression.get());
-  std::string valueType;
-  if (ptrType.back() == '*') {
-    valueType = ptrType.substr(0, ptrType.size() - 1);
+// 逐个字段写入ptr指向的结构体，不经过insertvalue链
+void IRGenerator::fillStruct(StructExpressionNode* node, const std::string& ptr) {
+  std::string structName = node->pathin_expression->toString();
+  const ItemIndex::Struct* s = findStruct(structName);
+  if (!s) {
+    error("Unknown struct " + structName);
+    return;
+  }
+  auto fields = structLayout(s);
+  std::string structType = expandStructType("%" + structName);
+  if (node->struct_base) {
+    std::string base = visit(node->struct_base->expression.get());
+    builder.store(structType, base, ptr);
+  }
+  if (!node->struct_expr_fields) return;
+  for (const auto& field : node->struct_expr_fields->struct_expr_fields) {
+    if (!std::holds_alternative<Identifier>(field->id_or_tupe_index)) {
+      error("Tuple index in struct expression not supported");
+      return;
+    }
+    std::string fieldName = std::get<Identifier>(field->id_or_tupe_index).id;
+    int index = fieldIndex(structName, fieldName);
+    if (index == -1) {
+      error("Field not found: " + fieldName);
+      return;
+    }
+    std::string fieldType = expandStructType(fields[index].second);
+    std::string fieldPtr = emitElementPtr(structType, ptr, std::to_string(index)).substr(1);
+    if (emitInto(field->expression.get(), fields[index].second, "%" + fieldPtr)) continue;
+    std::string fieldValue = visit(field->expression.get());
+    if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
+      std::string varType = lookupVarType(path);
+      if (expandStructType(varType) == fieldType + "*") fieldValue = emitLoad(fields[index].second, fieldValue);
+    }
+    builder.store(fieldType, fieldValue, "%" + fieldPtr);
+  }
+}
+
+// expr是类型为type的数组/结构体表达式时直接构造在ptr上，返回false时由调用者按值计算再store
+bool IRGenerator::emitInto(ExpressionNode* expr, const std::string& type, const std::string& ptr) {
+  if (auto* wrapper = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+    if (auto* a = std::get_if<std::unique_ptr<ArrayExpressionNode>>(&wrapper->expr)) return emitInto(a->get(), type, ptr);
+    if (auto* s = std::get_if<std::unique_ptr<StructExpressionNode>>(&wrapper->expr)) return emitInto(s->get(), type, ptr);
+    if (auto* g = std::get_if<std::unique_ptr<GroupedExpressionNode>>(&wrapper->expr)) return emitInto(g->get(), type, ptr);
+    return false;
+  }
+  if (auto* group = dynamic_cast<GroupedExpressionNode*>(expr)) return emitInto(group->expression.get(), type, ptr);
+  auto* array = dynamic_cast<ArrayExpressionNode*>(expr);
+  auto* struct_ = dynamic_cast<StructExpressionNode*>(expr);
+  if (!array && !struct_) return false;
+  if (type.empty() || expandStructType(getLhsType(expr)) != expandStructType(type)) return false;
+  if (array) {
+    if (array->if_empty) return false;
+    fillArray(array, expandStructType(type), ptr);
   } else {
-    error("Dereference on non-pointer type");
-    return "";
+    fillStruct(struct_, ptr);
   }
-  std::string temp = createTemp();
-  irStream << "  %" << temp << " = load " << expandStructType(valueType) << ", " << expandStructType(ptrType) << " " << ptr << "\n";
-  return "%" + temp;
+  return true;
+}
+
+// 只由字面量和常量组成的数组/结构体表达式，构造时不会读到正在被写入的目标
+bool IRGenerator::selfContained(ExpressionNode* expr) {
+  if (auto* wrapper = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+    return std::visit([&](auto&& arg) { return selfContained(arg.get()); }, wrapper->expr);
+  }
+  if (auto* group = dynamic_cast<GroupedExpressionNode*>(expr)) return selfContained(group->expression.get());
+  if (auto* array = dynamic_cast<ArrayExpressionNode*>(expr)) {
+    if (array->if_empty) return false;
+    for (const auto& e : array->expressions) {
+      if (!selfContained(e.get())) return false;
+    }
+    return true;
+  }
+  if (auto* struct_ = dynamic_cast<StructExpressionNode*>(expr)) {
+    if (struct_->struct_base) return false;
+    if (!struct_->struct_expr_fields) return true;
+    for (const auto& field : struct_->struct_expr_fields->struct_expr_fields) {
+      if (!selfContained(field->expression.get())) return false;
+    }
+    return true;
+  }
+  return dynamic_cast<LiteralExpressionNode*>(expr) || evaluateConstant(expr).has_value();
+}
+
+std::string IRGenerator::visit(DereferenceExpressionNode* node) {
+  //irStream << "; visit dereferenceexpression\n";
+  return emitLoad(getLhsType(node), getLhsAddress(node));
 }
 
 std::string IRGenerator::visit(NegationExpressionNode* node) {
   std::string expr = visit(node->expression.get());
   std::string temp = createTemp();
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-    std::string negName = path->toString();
-    std::string negType = lookupVarType(negName);
+    std::string negType = lookupVarType(path);
     if (negType == "i32*") {
       std::string negTemp = createTemp();
-      irStream << "  %" << negTemp << " = load i32, i32* " << expr << "\n";
+      builder.load(negTemp, "i32", expr);
       expr = "%" + negTemp;
     }
   }
   if (node->type == NegationExpressionNode::MINUS) {
-    irStream << "  %" << temp << " = sub i32 0, " << expr << "\n";
+    builder.binary(temp, IROp::Sub, "i32", "0", expr);
   } else if (node->type == NegationExpressionNode::BANG) {
     std::string exprType = getLhsType(node->expression.get());
     if (exprType == "i1") {
-      irStream << "  %" << temp << " = xor i1 " << expr << ", -1\n";
+      builder.binary(temp, IROp::Xor, "i1", expr, "-1");
     } else if (exprType == "i32") {
-      irStream << "  %" << temp << " = xor i32 " << expr << ", -1\n";
+      builder.binary(temp, IROp::Xor, "i32", expr, "-1");
     } else if (exprType == "i1*") {
       std::string exprTemp = createTemp();
-      irStream << "  %" << exprTemp << " = load i1, i1* " << expr << "\n";
-      irStream << "  %" << temp << " = xor i1 %" << exprTemp << ", -1\n";
+      builder.load(exprTemp, "i1", expr);
+      builder.binary(temp, IROp::Xor, "i1", "%" + exprTemp, "-1");
     }
   } else {
     error("Unknown negation type");
@@ -1246,8 +1337,8 @@ std::string IRGenerator::visit(BorrowExpressionNode* node) {
     std::string type = getLhsType(node->expression.get());
     if (type.empty()) type = "i32"; // 默认
     std::string tempPtr = createTemp();
-    irStream << "  %" << tempPtr << " = alloca " << type << "\n";
-    irStream << "  store " << expandStructType(type) << " " << value << ", " << expandStructType(type) << "* %" << tempPtr << "\n";
+    emitAlloca(type, tempPtr);
+    builder.store(expandStructType(type), value, "%" + tempPtr);
     return "%" + tempPtr;
   }
 }
@@ -1269,23 +1360,16 @@ std::string IRGenerator::visit(MethodCallExpressionNode* node) {
   // 根据 receiver 的类型合成真实的函数名：Type::FuncName。
   // 注意：selfType 可能带有若干 '*'（比如 %Foo**），这里需要全部去掉。
   // 同时 IR 层结构体类型通常长成 %Foo，因此要去掉前导 '%'.
-  std::string baseTypeForName;
-  baseTypeForName = stripTrailingStars(selfType);
-  if (!baseTypeForName.empty() && baseTypeForName.front() == '%') baseTypeForName.erase(baseTypeForName.begin());
-  if (self == "%self") {
-    //irStream << "; base of methodcall expression: self\n";
-    //irStream << "; type of methodcall expression: " << selfType << "\n";
-    baseTypeForName = stripTrailingStars(selfType);
-    if (baseTypeForName.front() == '%') baseTypeForName.erase(baseTypeForName.begin());
-  }
-  std::string mangledMethodName = baseTypeForName.empty() ? methodName : (baseTypeForName + "_" + methodName);
+  std::string path = methodPath(node, selfType, methodName);
+  std::string mangledMethodName = mangleFuncName(path);
+  const Signature* sig = signature(path);
   //irStream << "; self: " << self << ", type: " << selfType << '\n';
   //irStream << "; baseTypeForName: " << baseTypeForName << '\n';
   //irStream << "; method name: " << mangledMethodName << '\n';
   // 检查是否需要 autoref
-  auto it = paramTypesTable.find(mangledMethodName);
-  if (it != paramTypesTable.end()) {
-    const auto& paramTypes = it->second;
+  bool selfIsAddress = false;
+  if (sig) {
+    const auto& paramTypes = sig->params;
     if (!paramTypes.empty()) {
       std::string expectedSelfType = paramTypes[0];
       //irStream << "; expected self type: " << expectedSelfType << '\n';
@@ -1299,8 +1383,8 @@ std::string IRGenerator::visit(MethodCallExpressionNode* node) {
         } else {
           // 如果不能取地址，创建一个临时
           std::string tempPtr = createTemp();
-          irStream << "  %" << tempPtr << " = alloca " << expandStructType(selfType) << "\n";
-          irStream << "  store " << expandStructType(selfType) << " " << self << ", " << expandStructType(selfType) << "* %" << tempPtr << "\n";
+          emitAlloca(selfType, tempPtr);
+          builder.store(expandStructType(selfType), self, "%" + tempPtr);
           self = "%" + tempPtr;
           selfType = selfType + "*";
           //irStream << "; autoref: created temp ptr " << self << '\n';
@@ -1313,55 +1397,41 @@ std::string IRGenerator::visit(MethodCallExpressionNode* node) {
           selfType = "ptr";
         } else {
           std::string tempPtr = createTemp();
-          irStream << "  %" << tempPtr << " = alloca " << expandStructType(selfType) << "\n";
-          irStream << "  store " << expandStructType(selfType) << " " << self << ", " << expandStructType(selfType) << "* %" << tempPtr << "\n";
+          emitAlloca(selfType, tempPtr);
+          builder.store(expandStructType(selfType), self, "%" + tempPtr);
           self = "%" + tempPtr;
           selfType = "ptr";
         }
       }
 
-      // 参数类型检查：如果 self 的实际类型比声明多一层指针，则需要 load
-      if (!expectedSelfType.empty() && selfType == expectedSelfType + "*") {
+      // 参数类型检查：如果 self 的实际类型比声明多一层指针，则需要 load；间接传递的结构体直接传地址
+      if (passIndirect(expectedSelfType) && selfType == expectedSelfType + "*") {
+        selfIsAddress = true;
+        selfType = expectedSelfType;
+      } else if (!expectedSelfType.empty() && selfType == expectedSelfType + "*") {
         //irStream << "; self type: " << selfType << ", expected: " << expectedSelfType << ", need load\n";
         std::string tmp = createTemp();
-        irStream << "  %" << tmp << " = load " << expandStructType(expectedSelfType)
-                 << ", " << expandStructType(selfType) << " " << self << "\n";
+        builder.load(tmp, expandStructType(expectedSelfType), self);
         self = "%" + tmp;
         selfType = expectedSelfType;
       } else if (expectedSelfType == "%" + selfType.substr(1) && selfType[0] == '%' && selfType.back() == '*' && expectedSelfType != selfType) {
         // expected is value, self is pointer, load
         //irStream << "; self type: " << selfType << ", expected: " << expectedSelfType << ", need load\n";
         std::string tmp = createTemp();
-        irStream << "  %" << tmp << " = load " << expandStructType(expectedSelfType)
-                 << ", " << expandStructType(selfType) << " " << self << "\n";
+        builder.load(tmp, expandStructType(expectedSelfType), self);
         self = "%" + tmp;
         selfType = expectedSelfType;
       }
     }
   }
 
-  std::string args;
   // 处理 self
   //irStream << "; self type: " << selfType << '\n';
-  if (selfType[0] == '%' && selfType.back() != '*') {
-    std::string name = selfType.substr(1);
-    auto it2 = structFields.find(name);
-    if (it2 != structFields.end()) {
-      for (size_t j = 0; j < it2->second.size(); ++j) {
-        if (!args.empty()) args += ", ";
-        std::string temp = createTemp();
-        irStream << "  %" << temp << " = extractvalue " << expandStructType(selfType) << " " << self << ", " << j << "\n";
-        args += it2->second[j].second + " %" + temp;
-      }
-    } else {
-      args = expandStructType(selfType) + " " + self;
-    }
-  } else {
-    args = expandStructType(selfType) + " " + self;
-  }
+  std::vector<IRBuilder::Arg> args;
+  passArgument(args, selfType, self, selfIsAddress);
   if (node->call_params) {
-    if (it != paramTypesTable.end()) {
-      const auto& paramTypes = it->second;
+    if (sig) {
+      const auto& paramTypes = sig->params;
       size_t argIndex = 1;  // self是0
       //irStream << "; size of call_params: " << node->call_params->expressions.size() << '\n';
       for (size_t i = 0; i < node->call_params->expressions.size(); ++i) {
@@ -1376,53 +1446,98 @@ std::string IRGenerator::visit(MethodCallExpressionNode* node) {
           actualType = actualType.substr(0, actualType.size() - 1);
         }
         //irStream << "; arg type: " << argType << ", actual: " << actualType << '\n';
-        if (!actualType.empty() && actualType == argType + "*") {
-          //irStream << "; need loading\n";
-          std::string tmp = createTemp();
-          irStream << "  %" << tmp << " = load " << expandStructType(argType)
-                   << ", " << expandStructType(actualType) << " " << argValue << "\n";
-          argValue = "%" + tmp;
-        }
-
-        if (argType[0] == '%' && argType.back() != '*') {
-          std::string name = argType.substr(1);
-          auto it3 = structFields.find(name);
-          if (it3 != structFields.end()) {
-            for (size_t j = 0; j < it3->second.size(); ++j) {
-              if (!args.empty()) args += ", ";
-              std::string temp = createTemp();
-              irStream << "  %" << temp << " = extractvalue " << expandStructType(argType) << " " << argValue << ", " << j << "\n";
-              args += it3->second[j].second + " %" + temp;
-            }
-          } else {
-            if (!args.empty()) args += ", ";
-            args += expandStructType(argType) + " " + argValue;
-          }
-        } else {
-          if (!args.empty()) args += ", ";
-          args += expandStructType(argType) + " " + argValue;
-        }
+        bool isAddress = !actualType.empty() && actualType == argType + "*";
+        passArgument(args, argType, argValue, isAddress);
         argIndex++;
       }
     } else {
       for (auto& arg : node->call_params->expressions) {
-        if (!args.empty()) args += ", ";
-        args += "i32 " + visit(arg.get());
+        args.push_back({"i32", visit(arg.get())});
       }
     }
   }
   //irStream << "; args: " << args << '\n';
-  std::string retType = functionTable[mangledMethodName];
-  if (retType.empty()) retType = "i32";
-  std::string temp = createTemp();
-  if (retType == "void") {
-    irStream << "  call void " << llvmGlobalRef(mangledMethodName) << "(" << args << ")\n";
-    return "";
-  } else {
-    std::string temp = createTemp();
-    irStream << "  %" << temp << " = call " << expandStructType(retType) << " " << llvmGlobalRef(mangledMethodName) << "(" << args << ")\n";
-    return "%" + temp;
+  std::string retType = sig ? sig->ret : "i32";
+  return emitCall(mangledMethodName, retType, args);
+}
+
+// 方法调用的目标Type::name：语义检查已经把methodcall绑定到了具体的方法，直接使用；没有绑定时（比如函数体命中了检查缓存）按receiver的IR类型拼出来
+std::string IRGenerator::methodPath(MethodCallExpressionNode* node, const std::string& selfType, const std::string& methodName) {
+  if (!node->resolved_method.empty() && findFunction(node->resolved_method)) return node->resolved_method;
+  // 注意：selfType 可能带有若干 '*'（比如 %Foo**），这里需要全部去掉。
+  // 同时 IR 层结构体类型通常长成 %Foo，因此要去掉前导 '%'.
+  std::string baseTypeForName = stripTrailingStars(selfType);
+  if (!baseTypeForName.empty() && baseTypeForName.front() == '%') baseTypeForName.erase(baseTypeForName.begin());
+  if (auto* method = items->find_method(baseTypeForName, methodName)) return method->type + "::" + method->name;
+  return baseTypeForName.empty() ? methodName : (baseTypeForName + "::" + methodName);
+}
+
+int IRGenerator::fieldIndex(const std::string& structName, const std::string& fieldName) {
+  const ItemIndex::Struct* s = findStruct(structName);
+  const ItemIndex::Field* field = s ? s->find_field(fieldName) : nullptr;
+  return field ? field->offset : -1;
+}
+
+// path是f或Type::f，main中定义的函数和方法遮住顶层的同名item
+FunctionNode* IRGenerator::findFunction(const std::string& path) {
+  auto it = localFunctions.find(path);
+  if (it != localFunctions.end()) return it->second;
+  size_t sep = path.rfind("::");
+  if (sep == std::string::npos) return items->find_function(path);
+  const ItemIndex::Method* method = items->find_method(path.substr(0, sep), path.substr(sep + 2));
+  return method ? method->function : nullptr;
+}
+
+const IRGenerator::Signature* IRGenerator::signature(const std::string& path) {
+  auto builtin = builtinSignatures.find(path);
+  if (builtin != builtinSignatures.end()) return &builtin->second;
+  FunctionNode* fn = findFunction(path);
+  if (!fn) return nullptr;
+  auto it = signatures.find(fn);
+  if (it == signatures.end()) it = signatures.emplace(fn, lowerSignature(fn)).first;
+  return &it->second;
+}
+
+IRGenerator::Signature IRGenerator::lowerSignature(FunctionNode* fn) {
+  Signature sig;
+  sig.ret = fn->return_type ? toIRType(fn->return_type->type.get()) : "void";
+  if (fn->identifier == "main") sig.ret = "i32";
+  if (!fn->function_parameter) return sig;
+  if (fn->function_parameter->self_param) {
+    std::string selfType;
+    if (fn->impl_type_name) {
+      if (std::holds_alternative<std::unique_ptr<ShorthandSelf>>(fn->function_parameter->self_param->self)) {
+        auto& ss = std::get<std::unique_ptr<ShorthandSelf>>(fn->function_parameter->self_param->self);
+        selfType = "%" + *fn->impl_type_name + (ss->if_prefix ? "*" : "");
+      } else {
+        auto& ts = std::get<std::unique_ptr<TypedSelf>>(fn->function_parameter->self_param->self);
+        selfType = toIRType(ts->type.get());
+        if (ts->if_mut) selfType += "*";
+      }
+    } else {
+      selfType = "i8*";
+    }
+    sig.params.push_back(selfType);
+  }
+  for (const auto& param : fn->function_parameter->function_params) {
+    std::string paramType;
+    if (std::holds_alternative<std::unique_ptr<FunctionParamPattern>>(param->info)) {
+      const auto& fpp = std::get<std::unique_ptr<FunctionParamPattern>>(param->info);
+      paramType = fpp->type ? toIRType(fpp->type.get()) : "i32";
+    } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
+      paramType = toIRType(std::get<std::unique_ptr<TypeNode>>(param->info).get());
+    }
+    sig.params.push_back(paramType);
   }
+  return sig;
+}
+
+// 模式是否是mut绑定，如 mut p
+static bool isMutableBinding(PatternNoTopAlt* pattern) {
+  auto* p = std::get_if<std::unique_ptr<PatternWithoutRange>>(&pattern->pattern);
+  if (!p || !*p) return false;
+  auto* id = std::get_if<std::unique_ptr<IdentifierPattern>>(&(*p)->pattern);
+  return id && *id && (*id)->if_mut;
 }
 
 std::string stripStarOnce(const std::string &t) {
@@ -1445,15 +1560,15 @@ std::string IRGenerator::visit(IndexExpressionNode* node) {
   std::string baseType = getLhsType(node->base.get());
   //irStream << "; base type of index expression: " << baseType << '\n';
   if (baseAddr.empty() || baseType.empty()) return "";
+  std::string elemType = checkedType(node);
 
   std::string idxVal = visit(node->index.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->index.get())) {
-    std::string idx_path = path->toString();
-    std::string idx_type = lookupVarType(idx_path);
-    std::string idx_addr = lookupSymbol(idx_path);
+    std::string idx_type = lookupVarType(path);
+    std::string idx_addr = lookupSymbol(path);
     if (idx_type == "i32*") {
       std::string idx_temp = createTemp();
-      irStream << "  %" << idx_temp << " = load i32, i32* %" << idx_addr << '\n';
+      builder.load(idx_temp, "i32", "%" + idx_addr);
       idxVal = "%" + idx_temp;
     }
   }
@@ -1462,40 +1577,32 @@ std::string IRGenerator::visit(IndexExpressionNode* node) {
   //irStream << "; idxVal: " << idxVal << '\n';
 
   if (isArrayType(baseType) && !isPointerType(baseType)) {
-    irStream << "  %" << ptrTemp << " = getelementptr " << expandStructType(baseType) << ", " << expandStructType(baseType) << "* " << baseAddr << ", i32 0, i32 " << idxVal << "\n";
-    std::string res = "%" + ptrTemp;
+    std::string res = emitElementPtr(baseType, baseAddr, idxVal);
     std::string loadTemp = createTemp();
-    std::string elemType = getElementType(baseType);
-    irStream << "  %" << loadTemp << " = load " << expandStructType(elemType) << ", " << expandStructType(elemType) << "* " << res << "\n";
+    builder.load(loadTemp, expandStructType(elemType), res);
     return "%" + loadTemp;
   }
 
   if (isArrayType(baseType) && isPointerType(baseType)) {
-    irStream << "  %" << ptrTemp << " = getelementptr " << expandStructType(stripStarOnce(baseType)) << ", " << expandStructType(baseType) << " " << baseAddr << ", i32 0, i32 " << idxVal << "\n";
-    std::string res = "%" + ptrTemp;
+    std::string res = emitElementPtr(stripStarOnce(baseType), baseAddr, idxVal);
     std::string loadTemp = createTemp();
-    std::string elemType = getElementType(baseType);
-    //irStream << "; elem type: " << elemType << '\n';
-
-    irStream << "  %" << loadTemp << " = load " << expandStructType(stripStarOnce(elemType)) << ", " << expandStructType(stripStarOnce(elemType)) << "* " << res << "\n";
+    builder.load(loadTemp, expandStructType(elemType), res);
     return "%" + loadTemp;
   }
 
   std::string loadedPtr = createTemp();
-  irStream << "  %" << loadedPtr << " = load " << expandStructType(baseType) << ", " << expandStructType(baseType) << "* " << baseAddr << "\n";
+  builder.load(loadedPtr, expandStructType(baseType), baseAddr);
 
   if (isArrayType(stripStarOnce(baseType))) {
     std::string arrayType = stripStarOnce(baseType);
-    irStream << "  %" << ptrTemp << " = getelementptr " << expandStructType(arrayType) << ", " << expandStructType(arrayType) << "* %" << loadedPtr << ", i32 0, i32 " << idxVal << "\n";
-    std::string elemType = getElementType(arrayType);
+    std::string elemPtr = emitElementPtr(arrayType, "%" + loadedPtr, idxVal);
     std::string loadTemp = createTemp();
-    irStream << "  %" << loadTemp << " = load " << expandStructType(stripStarOnce(elemType)) << ", " << expandStructType(stripStarOnce(elemType)) << "* %" << ptrTemp << "\n";
+    builder.load(loadTemp, expandStructType(elemType), elemPtr);
     return "%" + loadTemp;
   } else {
-    std::string elemType = getElementType(baseType);
-    irStream << "  %" << ptrTemp << " = getelementptr " << elemType << ", " << elemType << "* %" << loadedPtr << ", i32 " << idxVal << "\n";
+    builder.gep(ptrTemp, expandStructType(elemType), "%" + loadedPtr, {{"i32", idxVal}}, false);
     std::string loadTemp = createTemp();
-    irStream << "  %" << loadTemp << " = load " << expandStructType(elemType) << ", " << expandStructType(elemType) << "* %" << ptrTemp << "\n";
+    builder.load(loadTemp, expandStructType(elemType), "%" + ptrTemp);
     return "%" + loadTemp;
   }
 }
@@ -1512,50 +1619,27 @@ std::string IRGenerator::visit(PredicateLoopExpressionNode* node) {
   currentLoopLabel = loopLabel;
   currentBreakLabel = endLabel;
 
-  // Pre-allocate addresses for let statements in the loop body
-  loopPreAlloc.clear();
-  for (auto& stmt : node->block_expression->statement) {
-    if (stmt->let_statement) {
-      std::string varName = stmt->let_statement->pattern->toString();
-      std::string type = stmt->let_statement->type ? toIRType(stmt->let_statement->type.get()) : "i32";
-      std::string allocTemp = createTemp();
-      if (stmt->let_statement->type->node_type == TypeType::TypePath_node) {
-        auto* typePathNode = dynamic_cast<TypePathNode*>(stmt->let_statement->type.get());
-        if (typePathNode && typePathNode->type_path) {
-          std::string path = typePathNode->type_path->toString();
-          if (path == "u32") type = "i64";
-        }
-      }
-      irStream << "  %" << allocTemp << " = alloca " << expandStructType(type) << "\n";
-      loopPreAlloc[varName] = allocTemp;
-    }
-  }
-
-  irStream << "  br label %" << loopLabel << "\n";
-  irStream << loopLabel << ":\n";
+  builder.br(loopLabel);
+  builder.label(loopLabel);
   std::string cond;
   if (std::holds_alternative<std::unique_ptr<ExpressionNode>>(node->conditions->condition)) {
     cond = visit(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get());
     //irStream << "; condition expression type: " << typeid(*std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get()).name() << "\n"; 
     if (auto* path = dynamic_cast<PathExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
-      std::string condName = path->toString();
-      //irStream << "; condName: " << condName << "\n";
-      std::string condType = lookupVarType(condName);
+      std::string condType = lookupVarType(path);
       //irStream << "; condType: " << condType << "\n";
       if (condType == "i1*") {
         std::string condTemp = createTemp();
-        irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+        builder.load(condTemp, "i1", cond);
         cond = "%" + condTemp;
       }
     } else if (auto* group = dynamic_cast<GroupedExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
       if (auto* path = dynamic_cast<PathExpressionNode*>(group->expression.get())) {
-        std::string condName = path->toString();
-        //irStream << "; condName: " << condName << "\n";
-        std::string condType = lookupVarType(condName);
+        std::string condType = lookupVarType(path);
         //irStream << "; condType: " << condType << "\n";
         if (condType == "i1*") {
           std::string condTemp = createTemp();
-          irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+          builder.load(condTemp, "i1", cond);
           cond = "%" + condTemp;
         }
       }
@@ -1564,17 +1648,16 @@ std::string IRGenerator::visit(PredicateLoopExpressionNode* node) {
     error("Unsupported condition type in while");
     return "";
   }
-  irStream << "  br i1 " << cond << ", label %" << bodyLabel << ", label %" << endLabel << "\n";
+  builder.condBr(cond, bodyLabel, endLabel);
 
-  irStream << bodyLabel << ":\n";
+  builder.label(bodyLabel);
   visit_block_in_loop(node->block_expression.get());
-  irStream << "  br label %" << loopLabel << "\n";
+  builder.br(loopLabel);
 
-  irStream << endLabel << ":\n";
+  builder.label(endLabel);
 
   currentLoopLabel = oldLoopLabel;
   currentBreakLabel = oldBreakLabel;
-  loopPreAlloc.clear(); // Clear after loop
   return "";
 }
 
@@ -1583,7 +1666,7 @@ std::string IRGenerator::visit(ContinueExpressionNode* node) {
     error("continue outside of loop");
     return "";
   }
-  irStream << "  br label %" << currentLoopLabel << "\n";
+  builder.br(currentLoopLabel);
   return "";
 }
 
@@ -1592,7 +1675,7 @@ std::string IRGenerator::visit(BreakExpressionNode* node) {
     error("break outside of loop");
     return "";
   }
-  irStream << "  br label %" << currentBreakLabel << "\n";
+  builder.br(currentBreakLabel);
   return "";
 }
 
@@ -1601,50 +1684,26 @@ std::string IRGenerator::visit(TypeCastExpressionNode* node) {
   std::string expr = visit(node->expression.get());
   std::string srcType = getLhsType(node->expression.get());
   std::string dstType = toIRType(node->type.get());
-  bool isDstU32 = false;
-  if (auto* typePath = dynamic_cast<TypePathNode*>(node->type.get())) {
-    if (typePath->type_path->toString() == "u32") {
-      //irStream << "; typecast to u32\n";
-      isDstU32 = true;
-    }
-  }
   //irStream << "; srcType: " << srcType << ", dstType: " << dstType << "\n";
-  if (srcType == "i1" && dstType == "i32") {
-    std::string temp = createTemp();
-    irStream << "  %" << temp << " = zext i1 " << expr << " to i32\n";
-    return "%" + temp;
-  } else if (srcType == "i32" && dstType == "i32") {
-    if (isDstU32) {
-      std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << expr << " to i64\n";
-      //irStream << "; result of type cast expression: " << "%" << temp << "\n";
-      return "%" + temp;
-    } else {
-      return expr;
-    }
+  // 栈槽中的变量先读出来
+  if (srcType == "i1*" || srcType == "i32*" || srcType == "i64*") {
+    srcType.pop_back();
+    expr = emitLoad(srcType, expr);
+  }
+  IROp op;
+  if (srcType == "i1" && dstType != "i1") {
+    op = IROp::ZExt;
+  } else if (srcType == "i32" && dstType == "i64") {
+    op = IROp::SExt;
   } else if (srcType == "i64" && dstType == "i32") {
-    std::string temp = createTemp();
-    irStream << "  %" << temp << " = trunc i64 " << expr << " to i32\n";
-    return "%" + temp;
-  } else if (srcType == "i64*" && dstType == "i32") {
-    std::string srcTemp = createTemp();
-    irStream << "  %" << srcTemp << " = load i64, i64* " << expr << "\n";
-    std::string temp = createTemp();
-    irStream << "  %" << temp << " = trunc i64 %" << srcTemp << " to i32\n";
-    return "%" + temp;
-  } else if (srcType == "i32*" && (dstType == "i32" || dstType == "usize")) {
-      std::string temp = createTemp();
-      irStream << "  %" << temp << " = load i32, i32* " << expr << "\n";
-      if (isDstU32) {
-        std::string temp2 = createTemp();
-        irStream << "  %" << temp2 << " = sext i32 %" << temp << " to i64\n";
-        return "%" + temp2;
-      }
-      return "%" + temp;
+    op = IROp::Trunc;
   } else {
-    // Other casts not implemented, just return the expression
+    // 其他情况值不变
     return expr;
   }
+  std::string temp = createTemp();
+  builder.cast(temp, op, srcType, expr, dstType);
+  return "%" + temp;
 }
 
 std::string IRGenerator::visit(ArrayExpressionNode* node) {
@@ -1652,113 +1711,106 @@ std::string IRGenerator::visit(ArrayExpressionNode* node) {
     error("Empty array expression not supported");
     return "";
   }
-  std::string elementType = "i32"; // default
-  if (!node->expressions.empty()) {
-    elementType = getLhsType(node->expressions[0].get());
+  // 没有目标地址时构造在临时栈槽中，再把整个数组读出来作为表达式的值
+  std::string arrPtr = createTemp();
+  std::string arrayType = expandStructType(getLhsType(node));
+  emitAlloca(arrayType, arrPtr);
+  fillArray(node, arrayType, "%" + arrPtr);
+
+  std::string arrVal = createTemp();
+  builder.load(arrVal, arrayType, "%" + arrPtr);
+  return "%" + arrVal;
+}
+
+// 逐个元素写入ptr指向的数组，元素本身是数组/结构体表达式时直接构造在元素的位置上
+void IRGenerator::fillArray(ArrayExpressionNode* node, const std::string& arrayType, const std::string& ptr) {
+  if (node->if_empty) {
+    error("Empty array expression not supported");
+    return;
   }
+  std::string elementType = checkedType(node->expressions[0].get());
   int size;
   if (node->type == ArrayExpressionType::REPEAT) {
     auto countOpt = evaluateConstant(node->expressions[1].get());
     if (!countOpt) {
       error("Array repeat count must be constant");
-      return "";
+      return;
     }
     size = *countOpt;
   } else {
     size = node->expressions.size();
   }
-  // Memory model for array construction:
-  //   1) alloca array once
-  //   2) gep to element
-  //   3) store element
-  //   4) load whole array value as expression result
-  std::string arrPtr = createTemp();
-  std::string arrayType = "[" + std::to_string(size) + " x " + expandStructType(elementType) + "]";
-  irStream << "  %" << arrPtr << " = alloca " << arrayType << "\n";
 
   // Store elements
   if (node->type == ArrayExpressionType::REPEAT) {
-    std::string value = visit(node->expressions[0].get());
     if (isConstantZero(node->expressions[0].get())) {
-      // use memset for zero initialization
-      int elemSizeInt = getTypeSize(elementType);
-      int totalSize = size * elemSizeInt;
-      std::string byteLength = std::to_string(totalSize);
-      std::string ptrTemp = createTemp();
-      irStream << "  %" << ptrTemp << " = bitcast " << arrayType << "* %" << arrPtr << " to i8*\n";
-      irStream << "  call void @llvm.memset.p0i8.i32(i8* %" << ptrTemp << ", i8 0, i32 " << byteLength << ", i1 false)\n";
+      emitZero(arrayType, ptr);
     } else {
-      // Use memcpy for repeating values
-      std::string valuePtr = createTemp();
-      irStream << "  %" << valuePtr << " = alloca " << expandStructType(elementType) << "\n";
-      irStream << "  store " << expandStructType(elementType) << " " << value << ", " << expandStructType(elementType) << "* %" << valuePtr << "\n";
-
-      std::string elemSize = std::to_string(getTypeSize(elementType));
+      // 标量元素直接store，聚合元素先构造一份再逐个memcpy
+      bool aggregate = isAggregate(elementType);
+      std::string value;
+      std::string valuePtr;
+      if (aggregate) {
+        valuePtr = createTemp();
+        emitAlloca(elementType, valuePtr);
+        if (!emitInto(node->expressions[0].get(), elementType, "%" + valuePtr)) {
+          value = visit(node->expressions[0].get());
+          builder.store(expandStructType(elementType), value, "%" + valuePtr);
+        }
+      } else {
+        value = visit(node->expressions[0].get());
+        if (auto* path = dynamic_cast<PathExpressionNode*>(node->expressions[0].get())) {
+          if (lookupVarType(path) == elementType + "*") value = emitLoad(elementType, value);
+        }
+      }
 
-      // Generate loop with memcpy
+      // Generate fill loop
       std::string loopVar = createTemp();
       std::string loopLabel = createLabel();
       std::string bodyLabel = createLabel();
       std::string endLabel = createLabel();
-      irStream << "  %" << loopVar << " = alloca i32\n";
-      irStream << "  store i32 0, i32* %" << loopVar << "\n";
-      irStream << "  br label %" << loopLabel << "\n";
-      irStream << loopLabel << ":\n";
+      emitAlloca("i32", loopVar);
+      builder.store("i32", "0", "%" + loopVar);
+      builder.br(loopLabel);
+      builder.label(loopLabel);
       std::string iv = createTemp();
-      irStream << "  %" << iv << " = load i32, i32* %" << loopVar << "\n";
+      builder.load(iv, "i32", "%" + loopVar);
       std::string cond = createTemp();
-      irStream << "  %" << cond << " = icmp slt i32 %" << iv << ", " << size << "\n";
-      irStream << "  br i1 %" << cond << ", label %" << bodyLabel << ", label %" << endLabel << "\n";
-      irStream << bodyLabel << ":\n";
-      std::string elemPtr = createTemp();
-      irStream << "  %" << elemPtr << " = getelementptr " << arrayType << ", " << arrayType << "* %" << arrPtr
-               << ", i32 0, i32 %" << iv << "\n";
-      std::string srcCast = createTemp();
-      irStream << "  %" << srcCast << " = bitcast " << expandStructType(elementType) << "* %" << valuePtr << " to i8*\n";
-      std::string dstCast = createTemp();
-      irStream << "  %" << dstCast << " = bitcast " << expandStructType(elementType) << "* %" << elemPtr << " to i8*\n";
-      std::string memcpyTemp = createTemp();
-      irStream << "  %" << memcpyTemp << " = call i8* @builtin_memcpy(i8* %" << dstCast << ", i8* %" << srcCast << ", i32 " << elemSize << ")\n";
+      builder.icmp(cond, "slt", "i32", "%" + iv, std::to_string(size));
+      builder.condBr("%" + cond, bodyLabel, endLabel);
+      builder.label(bodyLabel);
+      std::string elemPtr = emitElementPtr(arrayType, ptr, "%" + iv).substr(1);
+      if (aggregate) {
+        emitCopy(elementType, "%" + elemPtr, "%" + valuePtr);
+      } else {
+        builder.store(expandStructType(elementType), value, "%" + elemPtr);
+      }
       std::string ivNext = createTemp();
-      irStream << "  %" << ivNext << " = add i32 %" << iv << ", 1\n";
-      irStream << "  store i32 %" << ivNext << ", i32* %" << loopVar << "\n";
-      irStream << "  br label %" << loopLabel << "\n";
-      irStream << endLabel << ":\n";
-    }
+      builder.binary(ivNext, IROp::Add, "i32", "%" + iv, "1");
+      builder.store("i32", "%" + ivNext, "%" + loopVar);
+      builder.br(loopLabel);
+      builder.label(endLabel);
+    }
+  } else if (std::string init = size > 4 ? constantInitializer(node, arrayType) : ""; !init.empty()) {
+    // 元素都是编译期常量时数据放在只读全局变量中，构造时只需一次memcpy
+    emitCopy(arrayType, ptr, constantGlobal(arrayType, init));
   } else {
     for (int i = 0; i < size; ++i) {
+      std::string elemPtr = emitElementPtr(arrayType, ptr, std::to_string(i)).substr(1);
+      if (emitInto(node->expressions[i].get(), elementType, "%" + elemPtr)) continue;
       std::string value = visit(node->expressions[i].get());
-      std::string elemPtr = createTemp();
-      irStream << "  %" << elemPtr << " = getelementptr " << arrayType << ", " << arrayType << "* %" << arrPtr
-               << ", i32 0, i32 " << i << "\n";
       if (auto* path = dynamic_cast<PathExpressionNode*>(node->expressions[i].get())) {
-        std::string varName = path->toString();
-        std::string varType = lookupVarType(varName);
-        if (varType == "i1*") {
-          std::string val = createTemp();
-          irStream << "  %" << val << " = load i1, i1* " << value << "\n";
-          value = "%" + val;
-        }
-        if (varType == "i32*") {
-          std::string val = createTemp();
-          irStream << "  %" << val << " = load i32, i32* " << value << "\n";
-          value = "%" + val;
-        }
+        if (lookupVarType(path) == elementType + "*") value = emitLoad(elementType, value);
       }
-      irStream << "  store " << expandStructType(elementType) << " " << value
-               << ", " << expandStructType(elementType) << "* %" << elemPtr << "\n";
+      builder.store(expandStructType(elementType), value, "%" + elemPtr);
     }
   }
-
-  std::string arrVal = createTemp();
-  irStream << "  %" << arrVal << " = load " << arrayType << ", " << arrayType << "* %" << arrPtr << "\n";
-  return "%" + arrVal;
 }
 
 std::string IRGenerator::visit(LazyBooleanExpressionNode* node) {
   //irStream << "; visiting lazy boolean expression\n";
   std::string resultPtr = createTemp();
-  irStream << "  %" << resultPtr << " = alloca i1\n";
+  emitAlloca("i1", resultPtr);
   std::string lhs = visit(node->expression1.get());
   std::string trueLabel = createLabel();
   std::string falseLabel = createLabel();
@@ -1766,143 +1818,133 @@ std::string IRGenerator::visit(LazyBooleanExpressionNode* node) {
 
   if (node->type == LAZY_AND) {
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
-      std::string lhsName = path->toString();
-      std::string lhsType = lookupVarType(lhsName);
+      std::string lhsType = lookupVarType(path);
       if (lhsType == "i1*") {
         std::string lhsVal = createTemp();
-        irStream << "  %" << lhsVal << " = load i1, i1* " << lhs << "\n";
+        builder.load(lhsVal, "i1", lhs);
         lhs = "%" + lhsVal;
       }
     }
-    irStream << "  br i1 " << lhs << ", label %" << trueLabel << ", label %" << falseLabel << "\n";
+    builder.condBr(lhs, trueLabel, falseLabel);
 
-    irStream << trueLabel << ":\n";
+    builder.label(trueLabel);
     std::string rhs = visit(node->expression2.get());
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-      std::string rhsName = path->toString();
-      std::string rhsType = lookupVarType(rhsName);
+      std::string rhsType = lookupVarType(path);
       if (rhsType == "i1*") {
         std::string rhsVal = createTemp();
-        irStream << "  %" << rhsVal << " = load i1, i1* " << rhs << "\n";
+        builder.load(rhsVal, "i1", rhs);
         rhs = "%" + rhsVal;
       }
     }
-    irStream << "  store i1 " << rhs << ", i1* %" << resultPtr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.store("i1", rhs, "%" + resultPtr);
+    builder.br(endLabel);
 
-    irStream << falseLabel << ":\n";
-    irStream << "  store i1 0, i1* %" << resultPtr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.label(falseLabel);
+    builder.store("i1", "0", "%" + resultPtr);
+    builder.br(endLabel);
   } else { // LAZY_OR
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
-      std::string lhsName = path->toString();
-      std::string lhsType = lookupVarType(lhsName);
+      std::string lhsType = lookupVarType(path);
       if (lhsType == "i1*") {
         std::string lhsVal = createTemp();
-        irStream << "  %" << lhsVal << " = load i1, i1* " << lhs << "\n";
+        builder.load(lhsVal, "i1", lhs);
         lhs = "%" + lhsVal;
       }
     }
-    irStream << "  br i1 " << lhs << ", label %" << trueLabel << ", label %" << falseLabel << "\n";
+    builder.condBr(lhs, trueLabel, falseLabel);
 
-    irStream << trueLabel << ":\n";
-    irStream << "  store i1 1, i1* %" << resultPtr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.label(trueLabel);
+    builder.store("i1", "1", "%" + resultPtr);
+    builder.br(endLabel);
 
-    irStream << falseLabel << ":\n";
+    builder.label(falseLabel);
     std::string rhs = visit(node->expression2.get());
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-      std::string rhsName = path->toString();
-      std::string rhsType = lookupVarType(rhsName);
+      std::string rhsType = lookupVarType(path);
       if (rhsType == "i1*") {
         std::string rhsVal = createTemp();
-        irStream << "  %" << rhsVal << " = load i1, i1* " << rhs << "\n";
+        builder.load(rhsVal, "i1", rhs);
         rhs = "%" + rhsVal;
       }
     }
-    irStream << "  store i1 " << rhs << ", i1* %" << resultPtr << "\n";
-    irStream << "  br label %" << endLabel << "\n";
+    builder.store("i1", rhs, "%" + resultPtr);
+    builder.br(endLabel);
   }
 
-  irStream << endLabel << ":\n";
+  builder.label(endLabel);
   std::string result = createTemp();
-  irStream << "  %" << result << " = load i1, i1* %" << resultPtr << "\n";
+  builder.load(result, "i1", "%" + resultPtr);
   return "%" + result;
 }
 
 std::string IRGenerator::visit(BlockExpressionNode* node) {
   //irStream << "; visiting block expression\n";
-  enterScope();
   for (const auto& stmt : node->statement) {
     visit(stmt.get());
   }
   std::string result = "";
   if (node->expression_without_block) {
     //irStream << "; visiting expression without block in block expression\n";
-    if (inFunctionBody) {
+    if (inFunctionBody && emitInto(node->expression_without_block.get(), currentRetType, "%" + returnVar)) {
+      builder.br(returnLabel);
+    } else if (inFunctionBody) {
       //irStream << "; visiting expression without block in block expression in func body\n";
       std::string value = visit(node->expression_without_block.get());
       if (auto* p = std::get_if<std::unique_ptr<PathExpressionNode>>(&node->expression_without_block->expr)) {
         PathExpressionNode* path = p->get();
         //irStream << "; visiting path expression in block expression\n";
-        std::string retName = path->toString();
-        //irStream << "; retName: " << retName << "\n";
         //irStream << "; currentRetType: " << currentRetType << "\n";
-        std::string retType = lookupVarType(retName);
+        std::string retType = lookupVarType(path);
         std::string retTemp = createTemp();
-        if (isLetDefined(retName) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
-          irStream << "  %" << retTemp << " = load " << expandStructType(currentRetType)
-                 << ", " << expandStructType(retType) << " " << value << "\n";
+        if (isLetDefined(path) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
+          builder.load(retTemp, expandStructType(currentRetType), value);
           value = "%" + retTemp;
         }
       }
       if (!std::holds_alternative<std::unique_ptr<ReturnExpressionNode>>(node->expression_without_block->expr)) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << value << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), value, "%" + returnVar);
+        builder.br(returnLabel);
       }
     } else {
       result = visit(node->expression_without_block.get());
     }
   }
-  exitScope();
   return result;
 }
 
 std::string IRGenerator::visit_in_main(BlockExpressionNode* node) {
   //irStream << "; visiting block expression\n";
-  enterScope();
   for (const auto& stmt : node->statement) {
     if (!(stmt->item)) visit(stmt.get());
   }
   std::string result = "";
   if (node->expression_without_block) {
     //irStream << "; visiting expression without block in block expression\n";
-    if (inFunctionBody) {
+    if (inFunctionBody && emitInto(node->expression_without_block.get(), currentRetType, "%" + returnVar)) {
+      builder.br(returnLabel);
+    } else if (inFunctionBody) {
       //irStream << "; visiting expression without block in block expression in func body\n";
       std::string value = visit(node->expression_without_block.get());
       if (auto* p = std::get_if<std::unique_ptr<PathExpressionNode>>(&node->expression_without_block->expr)) {
         PathExpressionNode* path = p->get();
         //irStream << "; visiting path expression in block expression\n";
-        std::string retName = path->toString();
-        //irStream << "; retName: " << retName << "\n";
         //irStream << "; currentRetType: " << currentRetType << "\n";
-        std::string retType = lookupVarType(retName);
+        std::string retType = lookupVarType(path);
         std::string retTemp = createTemp();
-        if (isLetDefined(retName) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
-          irStream << "  %" << retTemp << " = load " << expandStructType(currentRetType)
-                 << ", " << expandStructType(retType) << " " << value << "\n";
+        if (isLetDefined(path) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
+          builder.load(retTemp, expandStructType(currentRetType), value);
           value = "%" + retTemp;
         }
       }
       if (!std::holds_alternative<std::unique_ptr<ReturnExpressionNode>>(node->expression_without_block->expr)) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << value << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), value, "%" + returnVar);
+        builder.br(returnLabel);
       }
     } else {
       result = visit(node->expression_without_block.get());
     }
   }
-  exitScope();
   return result;
 }
 
@@ -1910,22 +1952,30 @@ std::string IRGenerator::visit_in_main(BlockExpressionNode* node) {
 std::string IRGenerator::visit(ReturnExpressionNode* node) {
   //irStream << "; visiting return expression\n";
   if (node->expression) {
+    if (returnsIndirect && emitInto(node->expression.get(), currentRetType, "%" + returnVar)) {
+      builder.retVoid();
+      return "";
+    }
     std::string value = visit_in_rhs(node->expression.get());
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-      std::string retName = path->toString();
-      std::string retType = lookupVarType(retName);
+      std::string retType = lookupVarType(path);
       std::string retTemp = createTemp();
       //irStream << "; retType: " << retType << "\n";
       //irStream << "; currentRetType: " << currentRetType << "\n";
-      if (isLetDefined(retName) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
-        irStream << "  %" << retTemp << " = load " << expandStructType(currentRetType)
-               << ", " << expandStructType(retType) << " " << value << "\n";
+      if (isLetDefined(path) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
+        builder.load(retTemp, expandStructType(currentRetType), value);
         value = "%" + retTemp;
       }
     }
-    irStream << "  ret " << currentRetType << " " << value << "\n";
+    if (returnsIndirect) {
+      // sret函数把返回值写到调用者提供的位置
+      builder.store(currentRetType, value, "%" + returnVar);
+      builder.retVoid();
+    } else {
+      builder.ret(currentRetType, value);
+    }
   } else {
-    irStream << "  ret void\n";
+    builder.retVoid();
   }
   return "";
 }
@@ -2013,12 +2063,8 @@ std::string IRGenerator::visit(OperatorExpressionNode* node) {
 
 std::string IRGenerator::visit(FieldExpressionNode* node) {
   //irStream << "; visiting field expression\n";
-  if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-    std::string baseName = path->toString();
-    std::string fieldSym = lookupSymbol(baseName + "." + node->identifier.id);
-    if (!fieldSym.empty()) {
-      return "%" + fieldSym;
-    }
+  if (const FieldRegister* reg = lookupFieldRegister(node->expression.get(), node->identifier.id)) {
+    return "%" + reg->symbol;
   }
   std::string addr = getLhsAddress(node);
   //irStream << "; lhs address of fieldexpression: " << addr << '\n';
@@ -2028,7 +2074,7 @@ std::string IRGenerator::visit(FieldExpressionNode* node) {
     return "";
   }
   std::string temp = createTemp();
-  irStream << "  %" << temp << " = load " << expandStructType(type) << ", " << expandStructType(type) << "* " << addr << "\n";
+  builder.load(temp, expandStructType(type), addr);
   return "%" + temp;
 }
 
@@ -2042,25 +2088,21 @@ std::string IRGenerator::visit(IfExpressionNode* node) {
     //irStream << "; cond: " << cond << "\n";
     //irStream << "; expresstin type: " << typeid(*expr.get()).name() << "\n";
     if (auto* path = dynamic_cast<PathExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
-      std::string condName = path->toString();
-      //irStream << "; condName: " << condName << "\n";
-      std::string condType = lookupVarType(condName);
+      std::string condType = lookupVarType(path);
       //irStream << "; condType: " << condType << "\n";
       if (condType == "i1*") {
         std::string condTemp = createTemp();
-        irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+        builder.load(condTemp, "i1", cond);
         cond = "%" + condTemp;
       }
     }
     if (auto* group = dynamic_cast<GroupedExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
       if (auto* path = dynamic_cast<PathExpressionNode*>(group->expression.get())) {
-        std::string condName = path->toString();
-        //irStream << "; condName: " << condName << "\n";
-        std::string condType = lookupVarType(condName);
+        std::string condType = lookupVarType(path);
         //irStream << "; condType: " << condType << "\n";
         if (condType == "i1*") {
           std::string condTemp = createTemp();
-          irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+          builder.load(condTemp, "i1", cond);
           cond = "%" + condTemp;
         }
       }
@@ -2093,44 +2135,42 @@ std::string IRGenerator::visit(IfExpressionNode* node) {
   std::string endLabel = allBranchesWillReturn ? "" : createLabel();
   //irStream << "; end label: " << endLabel << '\n';
 
-  irStream << "  br i1 " << cond << ", label %" << thenLabel << ", label %" << elseLabel << "\n";
+  builder.condBr(cond, thenLabel, elseLabel);
 
   // 总是生成 phi，如果需要
   std::string thenValue = "";
   std::string elseValue = "";
   std::string phiValue = "";
 
-  irStream << thenLabel << ":\n";
-  irStream << "  ; then branch\n";
+  builder.label(thenLabel);
   thenValue = visit(node->block_expression.get());
   if (!allBranchesWillReturn) {
-    irStream << "  br label %" << endLabel << "\n";
+    builder.br(endLabel);
   }
 
-  irStream << elseLabel << ":\n";
-  irStream << "  ; else branch\n";
+  builder.label(elseLabel);
   if (node->else_block) {
     elseValue = visit(node->else_block.get());
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   } else if (node->else_if) {
     elseValue = visit(node->else_if.get());
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   } else {
     // no else, always br
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   }
 
   if (!allBranchesWillReturn) {
-    irStream << endLabel << ":\n";
+    builder.label(endLabel);
     if (!thenValue.empty() && !elseValue.empty()) {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = phi " << currentRetType << " [ " << thenValue << ", %" << thenLabel << " ], [ " << elseValue << ", %" << elseLabel << " ]\n";
+      builder.phi(temp, currentRetType, {{thenValue, thenLabel}, {elseValue, elseLabel}});
       phiValue = "%" + temp;
     }
   }
@@ -2138,15 +2178,15 @@ std::string IRGenerator::visit(IfExpressionNode* node) {
   // 如果在函数体中，store phiValue 到 returnVar 并 br
   if (inFunctionBody) {
     if (!phiValue.empty()) {
-      irStream << "  store " << expandStructType(currentRetType) << " " << phiValue << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-      irStream << "  br label %" << returnLabel << "\n";
+      builder.store(expandStructType(currentRetType), phiValue, "%" + returnVar);
+      builder.br(returnLabel);
     }
     return "";
   } else {
     if (inFunctionBody) {
       if (!phiValue.empty()) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << phiValue << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), phiValue, "%" + returnVar);
+        builder.br(returnLabel);
       }
       return "";
     } else {
@@ -2176,17 +2216,23 @@ void IRGenerator::visit(ItemNode* node) {
 
 void IRGenerator::visit(FunctionNode* node) {
   std::string funcName = node->identifier;
-  std::string retType = node->return_type ? expandStructType(toIRType(node->return_type->type.get())) : "void";
+  std::string declaredRetType = node->return_type ? toIRType(node->return_type->type.get()) : "void";
+  std::string retType = expandStructType(declaredRetType);
   if (funcName == "main") {
     retType = "i32";
     preScanFunctionBody(node->block_expression.get());
   }
   currentRetType = retType;
+  // 大结构体通过调用者提供的sret指针返回，returnVar直接就是这个参数
+  bool sret = funcName != "main" && passIndirect(declaredRetType);
+  returnsIndirect = sret;
 
     // 函数签名
-    std::string params = "";
     std::vector<std::pair<std::string, std::string>> paramList; // paramType, paramName
     std::vector<std::pair<std::string, std::string>> structList; // structName, baseName
+    std::vector<std::pair<std::string, std::string>> indirectList; // structName, baseName，按指针传入
+    std::unordered_set<std::string> mutableParams;  // 声明为mut的按值传入的参数
+    std::unordered_map<std::string, const void*> paramBindings;  // 参数名 -> 声明它的节点
 
     if (node->function_parameter) {
         // 处理 self_param
@@ -2199,6 +2245,7 @@ void IRGenerator::visit(FunctionNode* node) {
                   selfType = "%" + *node->impl_type_name + "*";
                 } else {
                   selfType = "%" + *node->impl_type_name;
+                  if (ss->if_mut) mutableParams.insert("self");
                 }
               } else {
                 auto& ts = std::get<std::unique_ptr<TypedSelf>>(node->function_parameter->self_param->self);
@@ -2211,16 +2258,19 @@ void IRGenerator::visit(FunctionNode* node) {
               selfType = "i8*"; // 默认
             }
             std::string selfName = "self";
-            if (selfType[0] == '%' && selfType.back() != '*') {
+            paramBindings[selfName] = node->function_parameter->self_param.get();
+            if (passIndirect(selfType)) {
+                indirectList.push_back({selfType.substr(1), selfName});
+                paramList.emplace_back(selfType + "*", selfName);
+            } else if (selfType[0] == '%' && selfType.back() != '*') {
                 std::string name = selfType.substr(1);
                 //irStream << "; type of self: " << name << '\n';
-                auto it = structFields.find(name);
-                if (it != structFields.end()) {
+                if (const ItemIndex::Struct* s = findStruct(name)) {
                     structList.push_back({name, selfName});
-                    for (size_t j = 0; j < it->second.size(); ++j) {
-                        std::string fieldName = selfName + "." + it->second[j].first;
+                    for (const auto& field : structLayout(s)) {
+                        std::string fieldName = selfName + "." + field.first;
                         //irStream << "; inserting " << fieldName << " into param list\n";
-                        paramList.emplace_back(it->second[j].second, fieldName);
+                        paramList.emplace_back(field.second, fieldName);
                     }
                 } else {
                     paramList.emplace_back(selfType, selfName);
@@ -2249,6 +2299,8 @@ void IRGenerator::visit(FunctionNode* node) {
                 }
                 //irStream << "； the " << i << "th param type in function node: " << paramType << '\n';
                 paramName = fpp->pattern ? fpp->pattern->toString() : "arg" + std::to_string(i);
+                paramBindings[paramName] = param.get();
+                if (fpp->pattern && isMutableBinding(fpp->pattern.get())) mutableParams.insert(paramName);
             } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
                 const auto& typeNode = std::get<std::unique_ptr<TypeNode>>(param->info);
                 if (auto* ref = dynamic_cast<ReferenceTypeNode*>(typeNode.get())) {
@@ -2261,15 +2313,17 @@ void IRGenerator::visit(FunctionNode* node) {
                 // 跳过 ellipsis
                 continue;
             }
-                if (paramType[0] == '%') {
+                if (passIndirect(paramType)) {
+                    indirectList.push_back({paramType.substr(1), paramName});
+                    paramList.emplace_back(paramType + "*", paramName);
+                } else if (paramType[0] == '%') {
                     std::string name = paramType.substr(1);
-                    auto it = structFields.find(name);
-                    if (it != structFields.end()) {
+                    if (const ItemIndex::Struct* s = findStruct(name)) {
                         structList.push_back({name, paramName});
-                        for (size_t j = 0; j < it->second.size(); ++j) {
-                            std::string fieldName = paramName + "." + it->second[j].first;
+                        for (const auto& field : structLayout(s)) {
+                            std::string fieldName = paramName + "." + field.first;
                             //irStream << "; inserting " << fieldName << " into param list\n";
-                            paramList.emplace_back(it->second[j].second, fieldName);
+                            paramList.emplace_back(field.second, fieldName);
                         }
                     } else {
                         paramList.emplace_back(paramType, paramName);
@@ -2280,22 +2334,39 @@ void IRGenerator::visit(FunctionNode* node) {
         }
     }
 
-    for (size_t i = 0; i < paramList.size(); ++i) {
-        params += expandStructType(paramList[i].first) + " %" + paramList[i].second;
-        if (i + 1 < paramList.size()) params += ", ";
+    std::vector<IRBuilder::Param> params;
+    if (sret) {
+        returnVar = createTemp();
+        params.push_back({retType + "*", "noalias sret(" + retType + ")", returnVar});
+    }
+    for (const auto& p : paramList) {
+        std::string attrs;
+        for (const auto& indirect : indirectList) {
+            // 被调函数只在入口读一次，不写也不保存这个指针
+            if (indirect.second == p.second) attrs = "noalias nocapture readonly";
+        }
+        params.push_back({expandStructType(p.first), attrs, p.second});
     }
 
-    irStream << "; Function: " << funcName << "\n";
-    irStream << "define " << retType << " " << llvmGlobalRef(funcName) << "(" << params << ") {\n";
+    builder.text("; Function: " + funcName + "\n");
+    // 函数体中的alloca由emitAlloca放到入口块开头
+    builder.beginFunction(sret ? "void" : retType, llvmGlobalRef(funcName).substr(1), params);
+    std::vector<std::string> heap;
+    std::vector<std::string>* outerHeap = heapArrays;
+    heapArrays = &heap;
+    bool outerInMain = inMain;
+    inMain = funcName == "main";
 
     returnLabel = createLabel();
-    if (retType != "void" && funcName != "main") {
+    if (retType != "void" && funcName != "main" && !sret) {
         returnVar = createTemp();
-        irStream << "  %" << returnVar << " = alloca " << expandStructType(retType) << "\n";
+        emitAlloca(retType, returnVar);
     }
 
     // basic blocks 和 expression visitor
-    enterScope();  // 函数作用域
+    std::unordered_map<const void*, Local> outerLocals = std::move(locals);  // 嵌套定义的函数看不到外层的局部变量
+    locals.clear();
+    for (const auto& c : constantGlobals) bindConstantGlobal(c);
 
     // 局部变量：参数处理
     //irStream << "; begin processing param\n";
@@ -2308,22 +2379,19 @@ void IRGenerator::visit(FunctionNode* node) {
         size_t dotPos = paramName.find('.');
         if (dotPos != std::string::npos) {
             // 展开的参数，直接使用参数名作为符号（值传递）
-            symbolScopes.back()[paramName] = paramName;
-            varTypeScopes.back()[paramName] = paramType;
+            locals[paramBindings[paramName.substr(0, dotPos)]].fields[paramName.substr(dotPos + 1)] = {paramName, paramType};
             //irStream << "; type: " << paramType << '\n';
             //irStream << "; name: " << paramName << '\n';
         } else {
             // 对于值参数，alloc
             if (paramType.back() != '*') {
                 std::string temp = createTemp();
-                symbolScopes.back()[paramName] = temp;
-                varTypeScopes.back()[paramName] = paramType;
-                irStream << "  %" << temp << " = alloca " << expandStructType(paramType) << "\n";
-                irStream << "  store " << expandStructType(paramType) << " %" << paramName << ", " << expandStructType(paramType) << "* %" << temp << "\n";
+                locals[paramBindings[paramName]] = {temp, paramType};
+                emitAlloca(paramType, temp);
+                builder.store(expandStructType(paramType), "%" + paramName, "%" + temp);
             } else {
                 // 指针参数，直接使用
-                symbolScopes.back()[paramName] = paramName;
-                varTypeScopes.back()[paramName] = paramType;
+                locals[paramBindings[paramName]] = {paramName, paramType};
             }
         }
     }
@@ -2332,23 +2400,41 @@ void IRGenerator::visit(FunctionNode* node) {
     for (const auto& [structName, baseName] : structList) {
         //irStream << "; reconstructing struct: " << structName << " for " << baseName << '\n';
         std::string structType = "%" + structName;
-        auto it = structFields.find(structName);
-        if (it != structFields.end()) {
+        if (const ItemIndex::Struct* s = findStruct(structName)) {
+            auto fields = structLayout(s);
             std::string structValue = "undef";
-            for (size_t j = 0; j < it->second.size(); ++j) {
-                std::string fieldName = it->second[j].first;
+            for (size_t j = 0; j < fields.size(); ++j) {
+                std::string fieldName = fields[j].first;
                 std::string paramName = baseName + "." + fieldName;
                 std::string temp = createTemp();
-                irStream << "  %" << temp << " = insertvalue " << expandStructType(structType) << " " << structValue << ", " << expandStructType(it->second[j].second) << " %" << paramName << ", " << j << "\n";
+                builder.insertValue(temp, expandStructType(structType), structValue, expandStructType(fields[j].second), "%" + paramName, {(unsigned)j});
                 structValue = "%" + temp;
             }
-            symbolScopes.back()[baseName] = structValue.substr(1);
-            varTypeScopes.back()[baseName] = structType;
+            if (mutableParams.count(baseName)) {
+              // 字段会被赋值，和let mut一样放到栈槽中，字段按地址读写
+              std::string slot = createTemp();
+              emitAlloca(structType, slot);
+              builder.store(expandStructType(structType), structValue, "%" + slot);
+              locals[paramBindings[baseName]] = {slot, structType + "*", true};
+              continue;
+            }
+            Local& local = locals[paramBindings[baseName]];
+            local.symbol = structValue.substr(1);
+            local.type = structType;
             //irStream << "; struct name: " << baseName << '\n';
             //irStream << "; struct type: " << structType << '\n';
         }
     }
 
+    // 按指针传入的结构体是调用者的数据，复制到自己的栈槽中，之后和局部变量一样使用
+    for (const auto& [structName, baseName] : indirectList) {
+        std::string structType = "%" + structName;
+        std::string temp = createTemp();
+        emitAlloca(structType, temp);
+        emitCopy(structType, "%" + temp, "%" + baseName);
+        locals[paramBindings[baseName]] = {temp, structType + "*", true};
+    }
+
     //irStream << "; finish processing param\n";
     inFunctionBody = true;
     if (node->block_expression && funcName != "main") {
@@ -2357,73 +2443,89 @@ void IRGenerator::visit(FunctionNode* node) {
       visit_in_main(node->block_expression.get());
     }
     inFunctionBody = false;
-    exitScope();
+    locals = std::move(outerLocals);
 
     // 生成统一的 return block
-    if (retType != "void") {
+    if (sret) {
+        builder.label(returnLabel);
+        builder.retVoid();
+    } else if (retType != "void") {
         if (funcName == "main") {
-            irStream << "  ret i32 0\n";
+            builder.ret("i32", "0");
         } else {
-            irStream << returnLabel << ":\n";
+            builder.label(returnLabel);
             std::string val = createTemp();
-            irStream << "  %" << val << " = load " << expandStructType(retType) << ", " << expandStructType(retType) << "* %" << returnVar << "\n";
-            irStream << "  ret " << expandStructType(retType) << " %" << val << "\n";
+            builder.load(val, expandStructType(retType), "%" + returnVar);
+            builder.ret(expandStructType(retType), "%" + val);
         }
     } else {
-        irStream << "  ret void\n";
+        builder.retVoid();
     }
 
-    irStream << "}\n\n";
+    if (!heap.empty()) {
+      // 入口处malloc的数组在每条ret之前释放
+      std::vector<IRInstruction*> rets;
+      for (const auto& bb : builder.function()->blocks) {
+        if (bb->terminator() && bb->terminator()->op == IROp::Ret) rets.push_back(bb->terminator());
+      }
+      for (IRInstruction* ret : rets) {
+        builder.setInsertBefore(ret);
+        for (const auto& p : heap) builder.call("", "void", "@free", {{"i8*", p}});
+      }
+      builder.setInsertBefore(nullptr);
+    }
+    builder.endFunction();
+    builder.text("\n");
+    heapArrays = outerHeap;
+    inMain = outerInMain;
 }
 
 void IRGenerator::visit(StructStructNode* node) {
-  irStream << "%" << node->identifier << " = type { ";
+  std::vector<std::string> fields;
   if (node->struct_fields) {
-    for (size_t i = 0; i < node->struct_fields->struct_fields.size(); ++i) {
-      const auto& field = node->struct_fields->struct_fields[i];
-      std::string fieldType = toIRType(field->type.get());
-      irStream << fieldType;
-      if (i + 1 < node->struct_fields->struct_fields.size()) irStream << ", ";
-    }
+    for (const auto& field : node->struct_fields->struct_fields) fields.push_back(toIRType(field->type.get()));
   }
-  irStream << " }\n\n";
+  builder.namedType(node->identifier, fields);
+  builder.text("\n");
 }
 
 void IRGenerator::visit(TupleStructNode* node) {
-  irStream << "%" << node->identifier << " = type { ";
+  std::vector<std::string> fields;
   if (node->tuple_fields) {
-    for (const auto& field : node->tuple_fields->tuple_fields) {
-      std::string typeStr = toIRType(field->type.get());
-      irStream << typeStr << ", ";
-    }
+    for (const auto& field : node->tuple_fields->tuple_fields) fields.push_back(toIRType(field->type.get()));
   }
-  irStream << "}\n\n";
+  builder.namedType(node->identifier, fields);
+  builder.text("\n");
 }
 
 void IRGenerator::visit(EnumerationNode* node) {
-  irStream << "; Enum " << node->identifier << "\n";
 }
 
 void IRGenerator::visit(ConstantItemNode* node) {
   //irStream << "; visiting constant item\n";
   if (node->identifier && node->expression) {
-    std::string value;
-    if (auto* lit = dynamic_cast<LiteralExpressionNode*>(node->expression.get())) {
-      value = lit->toString();
-    } else if (auto* neg = dynamic_cast<NegationExpressionNode*>(node->expression.get())) {
-      if (auto* lit = dynamic_cast<LiteralExpressionNode*>(neg->expression.get())) {
-        value = "-" + lit->toString();
+    if (node->type && !ConstEvaluator::is_scalar_type(node->type->toString())) {
+      std::string type = toIRType(node->type.get());
+      std::string init = isAggregate(type) ? constantInitializer(node->expression.get(), type) : "";
+      if (!init.empty()) {
+        ConstantGlobal c{node, type, constantGlobal(type, init, "const." + *node->identifier)};
+        // 函数体中的const只在当前作用域可见，其余的在每个函数入口绑定
+        if (builder.inFunction()) {
+          bindConstantGlobal(c);
+        } else {
+          constantGlobals.push_back(c);
+        }
+        return;
       }
-    } else if (auto* arith = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(node->expression.get())) {
-      auto constVal = computeConstantValue(arith);
-      if (constVal) {
-        value = std::to_string(*constVal);
-      } else {
+    }
+    constantTable[*node->identifier] = node;
+    scalarConstants[node] = node;
+    // 整数和bool常量在这里求值（语义检查阶段已经求过的直接命中缓存）
+    if (node->type && ConstEvaluator::is_scalar_type(node->type->toString())) {
+      if (!consts->evaluate_item(node, constResolver())) {
         error("Constant expression cannot be evaluated");
       }
     }
-    //irStream << "; constant : " << *node->identifier << " = " << value << "\n";
-    constantTable[*node->identifier] = value;
   }
 }
 
@@ -2464,71 +2566,45 @@ void IRGenerator::visit(StatementNode* node) {
 }
 
 void IRGenerator::visit(LetStatement* node) {
-  std::string varName = node->pattern->toString(); // 简化
   std::string type;
-  std::string typeNameStr;
   if (node->type) {
-    typeNameStr = node->type->toString();
-    //irStream << "; type name in let statement: " << typeNameStr << '\n';
     if (auto* ref = dynamic_cast<ReferenceTypeNode*>(node->type.get())) {
-      std::string innerType = toIRType(ref->type.get());
-      // check if u32 and overflow
-      if (auto* typePath = dynamic_cast<TypePathNode*>(ref->type.get())) {
-        std::string path = typePath->type_path->toString();
-        if (path == "u32") {
-          innerType = "i64";
-        }
-      }
-      type = innerType + "*";
+      type = toIRType(ref->type.get()) + "*";
     } else {
       type = toIRType(node->type.get());
-      if (auto* typePath = dynamic_cast<TypePathNode*>(node->type.get())) {
-        std::string path = typePath->type_path->toString();
-        if (path == "u32") {
-          type = "i64";
-        }
-      }
     }
   } else {
     type = "i32";
-    typeNameStr = "i32";
   }
-  std::string temp;
-  if (loopPreAlloc.find(varName) != loopPreAlloc.end()) {
-    temp = loopPreAlloc[varName];
-  } else {
-    temp = createTemp();
-    //irStream << "; var name in let statement: " << varName << '\n';
-    //irStream << "; var type in let statement: " << type + "*" << '\n';
-    //irStream << "; var address in let statement: " << temp << '\n';
-    bool isArray = type.find('[') != std::string::npos;
-    irStream << "  %" << temp << " = alloca " << expandStructType(type) << "\n";
-  }
-  if (node->expression) {
+  std::string temp = createTemp();
+  //irStream << "; var type in let statement: " << type + "*" << '\n';
+  //irStream << "; var address in let statement: " << temp << '\n';
+  emitAlloca(type, temp);
+  if (node->expression && !emitInto(node->expression.get(), type, "%" + temp)) {
     std::string value = visit_in_rhs(node->expression.get());
     std::string rhsType = getLhsType(node->expression.get());
     if (type == "i64" && rhsType == "i32") {
       rhsType = "i64";
       std::string rhsTemp = createTemp();
-      irStream << "  %" << rhsTemp << " = sext i32 " << value << " to i64\n";
+      builder.cast(rhsTemp, IROp::SExt, "i32", value, "i64");
       value = "%" + rhsTemp;
     }
+    bool copied = false;
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-      std::string letName = path->toString();
-      std::string letType = lookupVarType(letName);
-      if (letType == type + "*") {
+      std::string letType = lookupVarType(path);
+      if (letType == type + "*" && isAggregate(type)) {
+        emitCopy(type, "%" + temp, value);
+        copied = true;
+      } else if (letType == type + "*") {
         std::string letTemp = createTemp();
-        irStream << "  %" << letTemp << " = load " << type << ", " << type << "* " << value << '\n';
+        builder.load(letTemp, type, value);
         value = "%" + letTemp;
       }
     }
-    irStream << "  store " << expandStructType(type) << " " << value << ", " << expandStructType(type) << "* %" << temp << "\n";
+    if (!copied) builder.store(expandStructType(type), value, "%" + temp);
   }
-  // 更新 scopes 在计算 value 之后
-  symbolScopes.back()[varName] = temp;
-  varTypeScopes.back()[varName] = type + "*";
-  typeNameScopes.back()[varName] = typeNameStr;
-  isLetDefinedScopes.back()[varName] = true;
+  // 在计算 value 之后登记，初始值中的同名变量是外层的
+  locals[node] = {temp, type + "*", true};
 }
 
 void IRGenerator::visit(ExpressionStatement* node) {
@@ -2539,30 +2615,59 @@ std::string IRGenerator::createTemp() {
   return "t" + std::to_string(tempCounter++);
 }
 
+// 数组元素或结构体字段的地址。base本身是这样算出来的地址时直接在它的gep后面加下标，
+// a[i][j].f这样的访问合成一条多下标的gep，中间的gep没有其他用处，最后被DCE删掉
+std::string IRGenerator::emitElementPtr(const std::string& type, const std::string& base, const std::string& index) {
+  auto it = elementPtrs.find(base);
+  ElementPtr gep = it != elementPtrs.end() ? it->second : ElementPtr{expandStructType(type), base, {{"i32", "0"}}};
+  gep.indices.push_back({"i32", index});
+  std::string temp = createTemp();
+  builder.gep(temp, gep.type, gep.base, gep.indices);
+  elementPtrs["%" + temp] = std::move(gep);
+  return "%" + temp;
+}
+
 std::string IRGenerator::createLabel() {
   return "L" + std::to_string(labelCounter++);
 }
 
 std::string IRGenerator::emitAlloca(const std::string& type, const std::string& name) {
   std::string temp = name.empty() ? createTemp() : name;
-  irStream << "  %" << temp << " = alloca " << expandStructType(type) << "\n";
+  std::string t = expandStructType(type);
+  // 函数内的栈槽都放到入口块，循环中的let和临时值也只分配一次
+  builder.setEntryInsert(true);
+  // 大数组不占栈：main只执行一次，放到零初始化的全局变量（.bss）中；
+  // 其他函数可能递归，在入口malloc、每个返回处free
+  if (t[0] == '[' && getTypeSize(t) >= largeArrayThreshold && inMain) {
+    std::string global = "main." + temp;
+    globalDefs += "@" + global + " = internal global " + t + " zeroinitializer, align " + std::to_string(getTypeAlign(t)) + "\n";
+    builder.gep(temp, t, "@" + global, {{"i32", "0"}}, false);
+  } else if (t[0] == '[' && getTypeSize(t) >= largeArrayThreshold && heapArrays) {
+    std::string raw = temp + ".heap";
+    builder.call(raw, "i8*", "@heap_alloc", {{"i64", std::to_string(getTypeSize(t))}});
+    builder.cast(temp, IROp::BitCast, "i8*", "%" + raw, t + "*");
+    heapArrays->push_back("%" + raw);
+  } else {
+    builder.allocate(temp, t);
+  }
+  builder.setEntryInsert(false);
   return "%" + temp;
 }
 
 std::string IRGenerator::emitLoad(const std::string& type, const std::string& ptr) {
   std::string temp = createTemp();
-  irStream << "  %" << temp << " = load " << expandStructType(type) << ", " << expandStructType(type) << "* " << ptr << "\n";
+  builder.load(temp, expandStructType(type), ptr);
   return "%" + temp;
 }
 
 std::string IRGenerator::emitStore(const std::string& value, const std::string& ptr) {
-  irStream << "  store i32 " << value << ", i32* " << ptr << "\n";
+  builder.store("i32", value, ptr);
   return "";
 }
 
-std::string IRGenerator::emitBinaryOp(const std::string& op, const std::string& lhs, const std::string& rhs, const std::string& type) {
+std::string IRGenerator::emitBinaryOp(IROp op, const std::string& lhs, const std::string& rhs, const std::string& type) {
   std::string temp = createTemp();
-  irStream << "  %" << temp << " = " << op << " " << expandStructType(type) << " " << lhs << ", " << rhs << "\n";
+  builder.binary(temp, op, expandStructType(type), lhs, rhs);
   return "%" + temp;
 }
 
@@ -2572,7 +2677,7 @@ void IRGenerator::error(const std::string& msg) {
 }
 
 std::string IRGenerator::getCurrentIR() {
-  return irStream.str();
+  return module->print();
 }
 
 void IRGenerator::preScan(const std::vector<std::unique_ptr<ASTNode>>& ast) {
@@ -2583,478 +2688,140 @@ void IRGenerator::preScan(const std::vector<std::unique_ptr<ASTNode>>& ast) {
       }
     }
   }
-  for (const auto& node : ast) {
-    if (auto* item = dynamic_cast<ItemNode*>(node.get())) {
-      if (auto* func = dynamic_cast<FunctionNode*>(item)) {
-        // 记录函数原型
-        std::string retType = func->return_type ? toIRType(func->return_type->type.get()) : "void";
-        if (func->identifier == "main") retType = "i32";
-        //irStream << "; return type of function: " << func->identifier << " : " << retType << '\n';
-        functionTable[func->identifier] = retType;
-        // 记录参数类型
-        std::vector<std::string> paramTypes;
-        if (func->function_parameter) {
-          if (func->function_parameter->self_param) {
-            //irStream << "; having self in function: " << func->identifier << "\n";
-            std::string selfType;
-            if (func->impl_type_name) {
-              if (std::holds_alternative<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self)) {
-                auto& ss = std::get<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self);
-                if (ss->if_prefix) {
-                  selfType = "%" + *func->impl_type_name + "*";
-                } else {
-                  selfType = "%" + *func->impl_type_name;
-                }
-              } else {
-                auto& ts = std::get<std::unique_ptr<TypedSelf>>(func->function_parameter->self_param->self);
-                if (auto* ref = dynamic_cast<ReferenceTypeNode*>(ts->type.get())) {
-                  selfType = toIRType(ref->type.get()) + "*";
-                } else {
-                  selfType = toIRType(ts->type.get());
-                }
-                if (ts->if_mut) {
-                  selfType += "*";
-                }
-              }
-            } else {
-              selfType = "i8*";
-            }
-            paramTypes.push_back(selfType);
-          }
-          for (size_t i = 0; i < func->function_parameter->function_params.size(); ++i) {
-            const auto& param = func->function_parameter->function_params[i];
-            std::string paramType;
-            if (std::holds_alternative<std::unique_ptr<FunctionParamPattern>>(param->info)) {
-              const auto& fpp = std::get<std::unique_ptr<FunctionParamPattern>>(param->info);
-              if (fpp->type) {
-                if (auto* ref = dynamic_cast<ReferenceTypeNode*>(fpp->type.get())) {
-                  paramType = toIRType(ref->type.get()) + "*";
-                } else {
-                  paramType = toIRType(fpp->type.get());
-                }
-              } else {
-                paramType = "i32";
-              }
-            } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
-              const auto& typeNode = std::get<std::unique_ptr<TypeNode>>(param->info);
-              if (auto* ref = dynamic_cast<ReferenceTypeNode*>(typeNode.get())) {
-                paramType = toIRType(ref->type.get()) + "*";
-              } else {
-                paramType = toIRType(typeNode.get());
-              }
-            }
-            paramTypes.push_back(paramType);
-          }
-        }
-        paramTypesTable[func->identifier] = paramTypes;
-        //irStream << "; func name: " << func->identifier << '\n';
-        for (size_t i = 0; i < paramTypesTable[func->identifier].size(); i++) {
-          //irStream << "; the "<< i << "th param: " << paramTypesTable[func->identifier][i] << '\n';
-        }
-        if (func->identifier == "main") {
-          //irStream << "; prescanning main function\n";
-          for (auto& stmt : func->block_expression->statement) {
-            if (stmt->item) {
-              if (auto* func1 = dynamic_cast<FunctionNode*>(stmt->item.get())) {
-                // 记录函数原型
-                //irStream << "; function: " << func1->identifier << " in main function\n";
-                std::string retType = func1->return_type ? toIRType(func1->return_type->type.get()) : "void";
-                if (func1->identifier == "main") retType = "i32";
-                //irStream << "; return type of function: " << func->identifier << " : " << retType << '\n';
-                functionTable[func1->identifier] = retType;
-                // 记录参数类型
-                std::vector<std::string> paramTypes;
-                if (func1->function_parameter) {
-                  if (func1->function_parameter->self_param) {
-                    //irStream << "; having self in function: " << func1->identifier << "\n";
-                    std::string selfType;
-                    if (func1->impl_type_name) {
-                      if (std::holds_alternative<std::unique_ptr<ShorthandSelf>>(func1->function_parameter->self_param->self)) {
-                        auto& ss = std::get<std::unique_ptr<ShorthandSelf>>(func1->function_parameter->self_param->self);
-                        if (ss->if_prefix) {
-                          selfType = "%" + *func1->impl_type_name + "*";
-                        } else {
-                          selfType = "%" + *func1->impl_type_name;
-                        }
-                      } else {
-                        auto& ts = std::get<std::unique_ptr<TypedSelf>>(func1->function_parameter->self_param->self);
-                        if (auto* ref = dynamic_cast<ReferenceTypeNode*>(ts->type.get())) {
-                          selfType = toIRType(ref->type.get()) + "*";
-                        } else {
-                          selfType = toIRType(ts->type.get());
-                        }
-                        if (ts->if_mut) {
-                          selfType += "*";
-                        }
-                      }
-                    } else {
-                      selfType = "i8*";
-                    }
-                    paramTypes.push_back(selfType);
-                  }
-                  for (size_t i = 0; i < func1->function_parameter->function_params.size(); ++i) {
-                    const auto& param = func1->function_parameter->function_params[i];
-                    std::string paramType;
-                    if (std::holds_alternative<std::unique_ptr<FunctionParamPattern>>(param->info)) {
-                      const auto& fpp = std::get<std::unique_ptr<FunctionParamPattern>>(param->info);
-                      if (fpp->type) {
-                        if (auto* ref = dynamic_cast<ReferenceTypeNode*>(fpp->type.get())) {
-                          paramType = toIRType(ref->type.get()) + "*";
-                        } else {
-                          paramType = toIRType(fpp->type.get());
-                        }
-                      } else {
-                        paramType = "i32";
-                      }
-                    } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
-                      const auto& typeNode = std::get<std::unique_ptr<TypeNode>>(param->info);
-                      if (auto* ref = dynamic_cast<ReferenceTypeNode*>(typeNode.get())) {
-                        paramType = toIRType(ref->type.get()) + "*";
-                      } else {
-                        paramType = toIRType(typeNode.get());
-                      }
-                    }
-                    paramTypes.push_back(paramType);
-                  }
-                }
-                paramTypesTable[func1->identifier] = paramTypes;
-              } else if (auto* impl = dynamic_cast<InherentImplNode*>(stmt->item.get())) {
-                //irStream << "; inherent impl in main function: " << impl->type->toString() << '\n';
-                const std::string implTypePrefix = sanitizeImplTypePrefix(impl->type ? impl->type->toString() : "");
-                for (auto& assoc : impl->associated_item) {
-                  std::visit([&](auto&& arg) {
-                    using T = std::decay_t<decltype(arg)>;
-                    if constexpr (std::is_same_v<T, std::unique_ptr<FunctionNode>>) {
-                      auto* func = arg.get();
-                      const std::string mangledName = implTypePrefix.empty() ? func->identifier : (implTypePrefix + "_" + func->identifier);
-                      std::string retType = func->return_type ? toIRType(func->return_type->type.get()) : "void";
-                      functionTable[mangledName] = retType;
-                      std::vector<std::string> paramTypes;
-                      if (func->function_parameter) {
-                        if (func->function_parameter->self_param) {
-                          std::string selfType;
-                          if (func->impl_type_name) {
-                            if (std::holds_alternative<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self)) {
-                              auto& ss = std::get<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self);
-                              if (ss->if_prefix) {
-                                selfType = "%" + *func->impl_type_name + "*";
-                              } else {
-                                selfType = "%" + *func->impl_type_name;
-                              }
-                            } else {
-                              auto& ts = std::get<std::unique_ptr<TypedSelf>>(func->function_parameter->self_param->self);
-                              if (auto* ref = dynamic_cast<ReferenceTypeNode*>(ts->type.get())) {
-                                selfType = toIRType(ref->type.get()) + "*";
-                              } else {
-                                selfType = toIRType(ts->type.get());
-                              }
-                              if (ts->if_mut) {
-                                selfType += "*";
-                              }
-                            }
-                          } else {
-                            selfType = "i8*";
-                          }
-                          paramTypes.push_back(selfType);
-                        }
-                        for (size_t i = 0; i < func->function_parameter->function_params.size(); ++i) {
-                          const auto& param = func->function_parameter->function_params[i];
-                          std::string paramType;
-                          if (std::holds_alternative<std::unique_ptr<FunctionParamPattern>>(param->info)) {
-                            const auto& fpp = std::get<std::unique_ptr<FunctionParamPattern>>(param->info);
-                            if (fpp->type) {
-                              if (auto* ref = dynamic_cast<ReferenceTypeNode*>(fpp->type.get())) {
-                                paramType = toIRType(ref->type.get()) + "*";
-                              } else {
-                                paramType = toIRType(fpp->type.get());
-                              }
-                            } else {
-                              paramType = "i32";
-                            }
-                          } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
-                            const auto& typeNode = std::get<std::unique_ptr<TypeNode>>(param->info);
-                            if (auto* ref = dynamic_cast<ReferenceTypeNode*>(typeNode.get())) {
-                              paramType = toIRType(ref->type.get()) + "*";
-                            } else {
-                              paramType = toIRType(typeNode.get());
-                            }
-                          }
-                          paramTypes.push_back(paramType);
-                        }
-                      }
-                      paramTypesTable[mangledName] = paramTypes;
-                      //irStream << "; impl func name: " << func->identifier << '\n';
-                      for (size_t i = 0; i < paramTypesTable[mangledName].size(); i++) {
-                        //irStream << "; the "<< i << "th param: " << paramTypesTable[func->identifier][i] << '\n';
-                      }
-                    }
-                  }, assoc->associated_item);
-                }
-              } else if (auto* struct_ = dynamic_cast<StructStructNode*>(stmt->item.get())) {
-                //irStream << "; struct in main function: " << struct_->identifier << '\n';
-                std::vector<std::pair<std::string, std::string>> fields;
-                if (struct_->struct_fields) {
-                  size_t index = 0;
-                  for (const auto& field : struct_->struct_fields->struct_fields) {
-                    std::string fieldType = toIRType(field->type.get());
-                    //irStream << "; the " << index << "th element in the struct: " << fieldType << '\n';
-                    index++;
-                    fields.emplace_back(field->identifier, fieldType);
-                  }
-                }
-                structFields[struct_->identifier] = fields;
-                typeTable[struct_->identifier] = "%" + struct_->identifier;
-                //irStream << "; adding type: " << struct_->identifier << '\n';
-              }
-            }
-          }
-        }
-      } else if (auto* impl = dynamic_cast<InherentImplNode*>(item)) {
-        // 处理 impl 中的函数
-        const std::string implTypePrefix = sanitizeImplTypePrefix(impl->type ? impl->type->toString() : "");
+  // 顶层item都在索引里，只需要记下main中定义的struct、函数和impl方法
+  FunctionNode* main = items->find_function("main");
+  if (main && main->block_expression) {
+    for (auto& stmt : main->block_expression->statement) {
+      if (!stmt->item) continue;
+      if (auto* func = dynamic_cast<FunctionNode*>(stmt->item.get())) {
+        localFunctions[func->identifier] = func;
+      } else if (auto* impl = dynamic_cast<InherentImplNode*>(stmt->item.get())) {
+        const std::string implType = sanitizeImplTypePrefix(impl->type ? impl->type->toString() : "");
         for (auto& assoc : impl->associated_item) {
-          std::visit([&](auto&& arg) {
-            using T = std::decay_t<decltype(arg)>;
-            if constexpr (std::is_same_v<T, std::unique_ptr<FunctionNode>>) {
-              auto* func = arg.get();
-              const std::string mangledName = implTypePrefix.empty() ? func->identifier : (implTypePrefix + "_" + func->identifier);
-              std::string retType = func->return_type ? toIRType(func->return_type->type.get()) : "void";
-              functionTable[mangledName] = retType;
-              std::vector<std::string> paramTypes;
-              if (func->function_parameter) {
-                if (func->function_parameter->self_param) {
-                  std::string selfType;
-                  if (func->impl_type_name) {
-                    if (std::holds_alternative<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self)) {
-                      auto& ss = std::get<std::unique_ptr<ShorthandSelf>>(func->function_parameter->self_param->self);
-                      if (ss->if_prefix) {
-                        selfType = "%" + *func->impl_type_name + "*";
-                      } else {
-                        selfType = "%" + *func->impl_type_name;
-                      }
-                    } else {
-                      auto& ts = std::get<std::unique_ptr<TypedSelf>>(func->function_parameter->self_param->self);
-                      if (auto* ref = dynamic_cast<ReferenceTypeNode*>(ts->type.get())) {
-                        selfType = toIRType(ref->type.get()) + "*";
-                      } else {
-                        selfType = toIRType(ts->type.get());
-                      }
-                      if (ts->if_mut) {
-                        selfType += "*";
-                      }
-                    }
-                  } else {
-                    selfType = "i8*";
-                  }
-                  paramTypes.push_back(selfType);
-                }
-                for (size_t i = 0; i < func->function_parameter->function_params.size(); ++i) {
-                  const auto& param = func->function_parameter->function_params[i];
-                  std::string paramType;
-                  if (std::holds_alternative<std::unique_ptr<FunctionParamPattern>>(param->info)) {
-                    const auto& fpp = std::get<std::unique_ptr<FunctionParamPattern>>(param->info);
-                    if (fpp->type) {
-                      if (auto* ref = dynamic_cast<ReferenceTypeNode*>(fpp->type.get())) {
-                        paramType = toIRType(ref->type.get()) + "*";
-                      } else {
-                        paramType = toIRType(fpp->type.get());
-                      }
-                    } else {
-                      paramType = "i32";
-                    }
-                  } else if (std::holds_alternative<std::unique_ptr<TypeNode>>(param->info)) {
-                    const auto& typeNode = std::get<std::unique_ptr<TypeNode>>(param->info);
-                    if (auto* ref = dynamic_cast<ReferenceTypeNode*>(typeNode.get())) {
-                      paramType = toIRType(ref->type.get()) + "*";
-                    } else {
-                      paramType = toIRType(typeNode.get());
-                    }
-                  }
-                  paramTypes.push_back(paramType);
-                }
-              }
-              paramTypesTable[mangledName] = paramTypes;
-              //irStream << "; impl func name: " << func->identifier << '\n';
-              for (size_t i = 0; i < paramTypesTable[mangledName].size(); i++) {
-                //irStream << "; the "<< i << "th param: " << paramTypesTable[func->identifier][i] << '\n';
-              }
-            }
-          }, assoc->associated_item);
-        }
-      } else if (auto* struct_ = dynamic_cast<StructStructNode*>(item)) {
-        // 记录 struct 字段
-        //irStream << "; recording elements of struct " << struct_->identifier << ": \n";
-        std::vector<std::pair<std::string, std::string>> fields;
-        if (struct_->struct_fields) {
-          size_t index = 0;
-          for (const auto& field : struct_->struct_fields->struct_fields) {
-            std::string fieldType = toIRType(field->type.get());
-            //irStream << "; the " << index << "th element in the struct: " << fieldType << '\n';
-            index++;
-            fields.emplace_back(field->identifier, fieldType);
+          if (auto* fn = std::get_if<std::unique_ptr<FunctionNode>>(&assoc->associated_item)) {
+            localFunctions[implType.empty() ? (*fn)->identifier : implType + "::" + (*fn)->identifier] = fn->get();
           }
         }
-        structFields[struct_->identifier] = fields;
-        typeTable[struct_->identifier] = "%" + struct_->identifier;
+      } else if (auto* struct_ = dynamic_cast<StructStructNode*>(stmt->item.get())) {
+        localStructs[struct_->identifier] = ItemIndex::make_struct(struct_);
       }
     }
   }
-}
-
-void IRGenerator::generateStructTypes() {
-  for (const auto& [name, fields] : structFields) {
-    irStream << "%" << name << " = type { ";
-    for (size_t i = 0; i < fields.size(); ++i) {
-      irStream << fields[i].second;
-      if (i + 1 < fields.size()) irStream << ", ";
+  // 所有struct的名字都知道之后再把字段类型交给irTypes，字段可以引用后面定义的struct
+  for (const auto& node : ast) {
+    if (auto* struct_ = dynamic_cast<StructStructNode*>(node.get())) {
+      if (const ItemIndex::Struct* s = findStruct(struct_->identifier)) defineStructType(*s);
     }
-    irStream << " }\n";
   }
-  if (!structFields.empty()) irStream << "\n";
+  for (const auto& [name, s] : localStructs) defineStructType(s);
 }
 
-void IRGenerator::enterScope() {
-  symbolScopes.push_back({});
-  varTypeScopes.push_back({});
-  fieldScopes.push_back({});
-  fieldTypeScopes.push_back({});
-  isLetDefinedScopes.push_back({});
-  typeNameScopes.push_back({});
+IRGenerator::Local* IRGenerator::lookupLocal(PathExpressionNode* path) {
+  if (!path->binding) return nullptr;
+  auto it = locals.find(path->binding);
+  return it != locals.end() ? &it->second : nullptr;
 }
 
-void IRGenerator::exitScope() {
-  if (!symbolScopes.empty()) symbolScopes.pop_back();
-  if (!varTypeScopes.empty()) varTypeScopes.pop_back();
-  if (!fieldScopes.empty()) fieldScopes.pop_back();
-  if (!fieldTypeScopes.empty()) fieldTypeScopes.pop_back();
-  if (!isLetDefinedScopes.empty()) isLetDefinedScopes.pop_back();
-  if (!typeNameScopes.empty()) typeNameScopes.pop_back();
+ConstantItemNode* IRGenerator::lookupConstant(PathExpressionNode* path) {
+  if (!path->binding) return nullptr;
+  auto it = scalarConstants.find(path->binding);
+  return it != scalarConstants.end() ? it->second : nullptr;
 }
 
-std::string IRGenerator::lookupSymbol(const std::string& name) {
-  size_t dotPos = name.find('.');
-  if (dotPos != std::string::npos) {
-    std::string base = name.substr(0, dotPos);
-    std::string field = name.substr(dotPos + 1);
-    for (auto it = fieldScopes.rbegin(); it != fieldScopes.rend(); ++it) {
-      if (it->count(base) && (*it)[base].count(field)) {
-        return (*it)[base][field];
-      }
-    }
-  }
-  for (auto it = symbolScopes.rbegin(); it != symbolScopes.rend(); ++it) {
-    if (it->find(name) != it->end()) return (*it)[name];
-  }
-  return "";
+// base.field中base是按字段拆开传入的结构体参数时，字段所在的寄存器
+const IRGenerator::FieldRegister* IRGenerator::lookupFieldRegister(ExpressionNode* base, const std::string& field) {
+  auto* path = dynamic_cast<PathExpressionNode*>(base);
+  Local* local = path ? lookupLocal(path) : nullptr;
+  if (!local) return nullptr;
+  auto it = local->fields.find(field);
+  return it != local->fields.end() ? &it->second : nullptr;
 }
 
-std::string IRGenerator::lookupVarType(const std::string& name) {
-   //irStream << "; looking up var type of " << name << '\n';
-   size_t dotPos = name.find('.');
-   if (dotPos != std::string::npos) {
-     std::string base = name.substr(0, dotPos);
-     std::string field = name.substr(dotPos + 1);
-     for (auto it = fieldTypeScopes.rbegin(); it != fieldTypeScopes.rend(); ++it) {
-       if (it->count(base) && (*it)[base].count(field)) {
-         return (*it)[base][field];
-       }
-     }
-   }
-   for (auto it = varTypeScopes.rbegin(); it != varTypeScopes.rend(); ++it) {
-     if (it->find(name) != it->end()) {
-      //irStream << "; type of " << name << ": " << (*it)[name] << " in func lookupVarType\n";
-      return (*it)[name];
-     }
-   }
-   return "";
+std::string IRGenerator::lookupSymbol(PathExpressionNode* path) {
+  Local* local = lookupLocal(path);
+  return local ? local->symbol : "";
 }
 
-std::string IRGenerator::getTypeName(const std::string& name) {
-  for (auto it = typeNameScopes.rbegin(); it != typeNameScopes.rend(); ++it) {
-    if (it->find(name) != it->end()) return (*it)[name];
-  }
-  return "";
+std::string IRGenerator::lookupVarType(PathExpressionNode* path) {
+  Local* local = lookupLocal(path);
+  return local ? local->type : "";
+}
+
+bool IRGenerator::isLetDefined(PathExpressionNode* path) {
+  Local* local = lookupLocal(path);
+  return local && local->let;
+}
+
+// 语义检查记在节点上的类型
+std::string IRGenerator::checkedType(ExpressionNode* expr) {
+  if (!expr->checked_type) error(std::string("Missing type of expression: ") + typeid(*expr).name());
+  return toIRType(expr->checked_type);
 }
 
 std::string IRGenerator::getLhsAddress(ExpressionNode* lhs) {
+  return lhsAddress(lhs).value;
+}
+
+// 地址和类型一起算出来，a.b.c这样的访问只沿着base走一遍
+IRGenerator::LhsAddress IRGenerator::lhsAddress(ExpressionNode* lhs) {
   //irStream << "; getting lhs address\n";
   if (auto* path = dynamic_cast<PathExpressionNode*>(lhs)) {
-    std::string name = path->toString();
-    //irStream << "; name of pathexpression in getting address: " << name << '\n';
-    if (constantTable.find(name) != constantTable.end()) {
+    if (ConstantItemNode* item = lookupConstant(path)) {
       // 常量，不能取地址
-      return "";
+      return {"", constantIRType(item)};
     } else {
-      return "%" + lookupSymbol(name);
+      std::string type = lookupVarType(path);
+      return {"%" + lookupSymbol(path), type.back() == '*' ? type : type + "*"};
     }
   } else if (auto* deref = dynamic_cast<DereferenceExpressionNode*>(lhs)) {
-    // *expr, expr 应该是指针，地址是 expr 的值
-    return visit(deref->expression.get());
+    // *expr, expr 应该是指针，地址是 expr 的值；let定义的引用在栈槽中，先读出来
+    std::string ptr = visit(deref->expression.get());
+    if (auto* path = dynamic_cast<PathExpressionNode*>(deref->expression.get())) {
+      std::string refType = checkedType(path);
+      if (refType.back() == '*' && lookupVarType(path) == refType + "*") ptr = emitLoad(refType, ptr);
+    }
+    return {ptr, checkedType(deref) + "*"};
   } else if (auto* field = dynamic_cast<FieldExpressionNode*>(lhs)) {
     // 检查是否是 register 字段
     //irStream << "; getting lhsaddress of field expression\n";
-    if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-      std::string baseName = path->toString();
-      std::string fieldSym = lookupSymbol(baseName + "." + field->identifier.id);
-      if (!fieldSym.empty() && fieldSym == baseName + "." + field->identifier.id) {
-        // 是 register，不能取地址
-        return "";
-      }
+    if (const FieldRegister* reg = lookupFieldRegister(field->expression.get(), field->identifier.id)) {
+      // 是 register，不能取地址
+      return {"", reg->type};
     }
     // expr.field, 生成 getelementptr
     //irStream << "; getting address of base expr in field expression\n";
-    std::string baseAddr = getLhsAddress(field->expression.get());
+    LhsAddress base = lhsAddress(field->expression.get());
+    std::string baseAddr = base.value;
+    std::string baseType = base.type;
     //irStream << "; address of base expr in field expression: " << baseAddr << '\n';
-    std::string baseType = getLhsTypeWithStar(field->expression.get());
     //irStream << "; type of base expr in field expression: " << baseType << '\n';
-    if (baseType == "") {
-      if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-        //irStream << "; trying to get type in struct field\n";
-        std::string name = path->toString();
-        //irStream <<"; finding " << name << " in struct field\n";
-        std::string fieldName = name + "." + field->identifier.id;
-        //irStream << "; getting type of struct item: " << fieldName << '\n';
-        baseType = lookupVarType(fieldName);
-        baseAddr = "%" + lookupSymbol(fieldName);
-        return baseAddr;
-      }
-    }
     size_t starPos = baseType.find('*');
     if (starPos == std::string::npos) {
       // base is struct value, need to alloca temporary
       //irStream << "; allocating temporary struct for type: " << baseType << "\n";
       std::string tempPtr = createTemp();
-      irStream << "  %" << tempPtr << " = alloca " << expandStructType(baseType) << "\n";
-      irStream << "  store " << expandStructType(baseType) << " " << baseAddr << ", " << expandStructType(baseType) << "* %" << tempPtr << "\n";
+      emitAlloca(baseType, tempPtr);
+      builder.store(expandStructType(baseType), baseAddr, "%" + tempPtr);
       baseAddr = "%" + tempPtr;
       baseType += "*";
       starPos = baseType.size() - 1;
     }
     std::string structName = baseType.substr(1, starPos - 1);
-    auto it = structFields.find(structName);
-    if (it == structFields.end()) {
+    if (!findStruct(structName)) {
       error("Unknown struct " + structName);
-      return "";
-    }
-    int index = -1;
-    for (int i = 0; i < it->second.size(); ++i) {
-      if (it->second[i].first == field->identifier.id) {
-        index = i;
-        break;
-      }
+      return {};
     }
+    int index = fieldIndex(structName, field->identifier.id);
     if (index == -1) {
       error("Field not found " + field->identifier.id);
-      return "";
+      return {};
     }
-    std::string fieldPtr = createTemp();
     if (baseType == "%" + structName + "**") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = load " << expandStructType("%" + structName) << "*, " << expandStructType("%" + structName) << "** " << baseAddr << "\n";
+      builder.load(temp, expandStructType("%" + structName) + "*", baseAddr);
       baseAddr = "%" + temp;
     }
-    irStream << "  %" << fieldPtr << " = getelementptr " << expandStructType("%" + structName) << ", " << expandStructType("%" + structName) << "* " << baseAddr << ", i32 0, i32 " << index << "\n";
-    return "%" + fieldPtr;
+    return {emitElementPtr("%" + structName, baseAddr, std::to_string(index)), checkedType(field) + "*"};
   } else if (auto* index = dynamic_cast<IndexExpressionNode*>(lhs)) {
     //irStream << "; getting address of index expression\n";
     std::string baseAddr = getLhsAddress(index->base.get());
@@ -3066,490 +2833,205 @@ std::string IRGenerator::getLhsAddress(ExpressionNode* lhs) {
     std::string temp = createTemp();
 
     if (auto* path = dynamic_cast<PathExpressionNode*>(index->index.get())) {
-      std::string idx_path = path->toString();
-      std::string idx_type = lookupVarType(idx_path);
-      std::string idx_addr = lookupSymbol(idx_path);
+      std::string idx_type = lookupVarType(path);
+      std::string idx_addr = lookupSymbol(path);
       if (idx_type == "i32*") {
         std::string idx_temp = createTemp();
-        irStream << "  %" << idx_temp << " = load i32, i32* %" << idx_addr << '\n';
+        builder.load(idx_temp, "i32", "%" + idx_addr);
         idxVal = "%" + idx_temp;
       }
     }
     
+    std::string elementType = checkedType(index);
     if (baseType.size() > 2 && baseType[0] == '[' && baseType.back() != '*') {
-      irStream << "  %" << temp << " = getelementptr " << expandStructType(baseType) << ", " << expandStructType(baseType) << "* " << baseAddr << ", i32 0, i32 " << idxVal << "\n";
-      //irStream << "; getting lhs address: %" << temp << '\n';
-      return "%" + temp;
+      return {emitElementPtr(baseType, baseAddr, idxVal), elementType + "*"};
     }
    
     if (baseType.size() > 3 && baseType[0] == '[' && baseType.back() == '*') {
       std::string arrayType = baseType.substr(0, baseType.size() - 1);
-      irStream << "  %" << temp << " = getelementptr " << expandStructType(arrayType) << ", " << expandStructType(arrayType) << "* " << baseAddr << ", i32 0, i32 " << idxVal << "\n";
-      //irStream << "; getting lhs address: %" << temp << '\n';
-      return "%" + temp;
+      return {emitElementPtr(arrayType, baseAddr, idxVal), elementType + "*"};
     }
    
-    std::string elementType = getElementType(baseType);
     std::string loadedPtr = createTemp();
-    irStream << "  %" << loadedPtr << " = load " << expandStructType(baseType) << ", " << expandStructType(baseType) << "* " << baseAddr << "\n";
-    irStream << "  %" << temp << " = getelementptr " << expandStructType(elementType) << ", " << expandStructType(elementType) << "* %" << loadedPtr << ", i32 " << idxVal << "\n";
-    return "%" + temp;
+    builder.load(loadedPtr, expandStructType(baseType), baseAddr);
+    builder.gep(temp, expandStructType(elementType), "%" + loadedPtr, {{"i32", idxVal}}, false);
+    return {"%" + temp, elementType + "*"};
   } else if (auto* array = dynamic_cast<ArrayExpressionNode*>(lhs)) {
     // For array expression, generate the value, alloc temp, store, return pointer
     std::string value = visit(array);
     std::string arrayType = getLhsType(array);
     std::string tempPtr = createTemp();
-    irStream << "  %" << tempPtr << " = alloca " << expandStructType(arrayType) << "\n";
-    irStream << "  store " << expandStructType(arrayType) << " " << value << ", " << expandStructType(arrayType) << "* %" << tempPtr << "\n";
-    return "%" + tempPtr;
+    emitAlloca(arrayType, tempPtr);
+    builder.store(expandStructType(arrayType), value, "%" + tempPtr);
+    return {"%" + tempPtr, arrayType + "*"};
   } else {
     error("Unsupported lhs type in assignment");
-    return "";
+    return {};
   }
 }
 
-std::string IRGenerator::getElementType(const std::string& typeStr) {
-  //irStream << "; getting element type\n";
-  bool isPtr = false;
-  std::string base = typeStr;
-  if (!base.empty() && base.back() == '*') {
-    isPtr = true;
-    base = base.substr(0, base.size() - 1);
-  }
-  std::string elem;
-  if (base.size() > 2 && base[0] == '[') {
-    // 数组，elem是元素类型
-    size_t xPos = base.find(" x ");
-    if (xPos != std::string::npos) {
-      elem = base.substr(xPos + 3, base.size() - xPos - 4); // remove ]
-    } else {
-      elem = base;
-    }
-    // 对于数组，不加*，因为索引数组返回元素类型，无论base是否是指针
-  } else {
-    elem = base;
-    if (isPtr) {
-      elem += '*';
-    }
-  }
-  //irStream << "; elem type: " << elem << '\n';
-  return elem;
+std::string IRGenerator::getLhsType(ExpressionNode* lhs) {
+  auto it = lhsTypeCache.find(lhs);
+  if (it != lhsTypeCache.end()) return it->second;
+  std::string type = computeLhsType(lhs);
+  if (!type.empty()) lhsTypeCache[lhs] = type;
+  return type;
 }
 
-std::string IRGenerator::getLhsType(ExpressionNode* lhs) {
-  //irStream << "; getting lhs type\n";
-  if (auto* lit = dynamic_cast<LiteralExpressionNode*>(lhs)) {
-    // 对于literal，返回其类型
-    if (std::holds_alternative<std::unique_ptr<bool>>(lit->literal)) {
-      return "i1";
-    } else {
-      // check if large number
-      if (std::holds_alternative<std::unique_ptr<integer_literal>>(lit->literal)) {
-        std::string value = std::get<std::unique_ptr<integer_literal>>(lit->literal)->value;
-        try {
-          long long val = std::stoll(value);
-          if (val > 2147483647LL || val < -2147483648LL) {
-            return "i64";
-          }
-        } catch (...) {
-        }
-      }
-      return "i32";
-    }
+std::string IRGenerator::computeLhsType(ExpressionNode* lhs) {
+  if (auto* path = dynamic_cast<PathExpressionNode*>(lhs)) {
+    // 变量是它的存放方式：栈槽为T*，寄存器为T
+    if (ConstantItemNode* item = lookupConstant(path)) return constantIRType(item);
+    return lookupVarType(path);
   } else if (auto* group = dynamic_cast<GroupedExpressionNode*>(lhs)) {
-    //irStream << "; getting type of grouped expression\n";
     return getLhsType(group->expression.get());
-  } else if (auto* path = dynamic_cast<PathExpressionNode*>(lhs)) {
-    std::string name = path->toString();
-    //irStream << "; name of pathexpression in getting type : " << name << '\n';
-    if (constantTable.find(name) != constantTable.end()) {
-      // 常量
-      std::string value = constantTable[name];
-      if (value[0] == '"') {
-        return "i8*";
-      } else {
-        return "i32";
-      }
-    } else {
-      std::string lhsType = lookupVarType(name);
-      //irStream << "; result of getLhsType of PathExpression: " << lhsType << '\n';
-      return lhsType;
-    }
-  } else if (auto* cast = dynamic_cast<TypeCastExpressionNode*>(lhs)) {
-    std::string dstType = toIRType(cast->type.get());
-    bool isDstU32 = false;
-    if (auto* typePath = dynamic_cast<TypePathNode*>(cast->type.get())) {
-      if (typePath->type_path->toString() == "u32") {
-        isDstU32 = true;
-      }
-    }
-    if (isDstU32) {
-      //irStream << "; type of typecastexpression: i64\n";
-      return "i64";
-    } else {
-      //irStream << "; type of typecastexpression: " << dstType << '\n';
-      return dstType;
-    }
+  } else if (auto* wrapper = dynamic_cast<ExpressionWithoutBlockNode*>(lhs)) {
+    return std::visit([&](auto&& arg) -> std::string { return getLhsType(arg.get()); }, wrapper->expr);
   } else if (auto* opExpr = dynamic_cast<OperatorExpressionNode*>(lhs)) {
-    // 让类型推导与 visit(OperatorExpressionNode*) 保持一致
-    return std::visit([&](auto&& arg) -> std::string {
-      using T = std::decay_t<decltype(arg)>;
-      if constexpr (std::is_same_v<T, std::unique_ptr<ArithmeticOrLogicalExpressionNode>>) {
-        return "i32";
-      } else if constexpr (std::is_same_v<T, std::unique_ptr<ComparisonExpressionNode>>) {
-        return "i1";
-      } else if constexpr (std::is_same_v<T, std::unique_ptr<AssignmentExpressionNode>>) {
-        // assignment 表达式通常没有可用值，这里返回 void 以避免崩溃
-        return "void";
-      } else if constexpr (std::is_same_v<T, std::unique_ptr<CompoundAssignmentExpressionNode>>) {
-        return "void";
-      } else if constexpr (std::is_same_v<T, std::unique_ptr<BorrowExpressionNode>>) {
-        return getLhsType(arg.get());
-      } else {
-        return "i32";
-      }
-    }, opExpr->operator_expression);
-  } else if (dynamic_cast<ArithmeticOrLogicalExpressionNode*>(lhs)) {
-    //irStream << "; getting type of arithmetic expr\n";
-    std::string lhsType = getLhsType(static_cast<ArithmeticOrLogicalExpressionNode*>(lhs)->expression1.get());
-    std::string rhsType = getLhsType(static_cast<ArithmeticOrLogicalExpressionNode*>(lhs)->expression2.get());
-    //irStream << "; lhsType: " << lhsType << ", rhsType: " << rhsType << ", resultType: " << ((lhsType == "i64" || rhsType == "i64") ? "i64" : "i32") << '\n';
-    if (static_cast<ArithmeticOrLogicalExpressionNode*>(lhs)->type == OperationType::SHL || static_cast<ArithmeticOrLogicalExpressionNode*>(lhs)->type == OperationType::SHR) return "i32";
-    return (lhsType == "i64" || rhsType == "i64" || lhsType == "i64*" || rhsType == "i64*") ? "i64" : "i32";
-  } else if (dynamic_cast<ComparisonExpressionNode*>(lhs)) {
-    return "i1";
-  } else if (dynamic_cast<LazyBooleanExpressionNode*>(lhs)) {
-    return "i1";
-  } else if (auto* neg = dynamic_cast<NegationExpressionNode*>(lhs)) {
-    // 当前 IR 里 NegationExpressionNode::BANG 也按 i32 来处理
-    std::string res = getLhsType(neg->expression.get());
-    if (res == "i1*") return "i1";
-    if (res == "i32*") return "i32";
-    return res;
-  } else if (auto* deref = dynamic_cast<DereferenceExpressionNode*>(lhs)) {
-    // *expr, 类型是 expr 类型去掉 *
-    std::string exprType = getLhsType(deref->expression.get());
-    if (exprType.back() == '*') {
-      return exprType.substr(0, exprType.size() - 1);
-    } else {
-      error("Dereference on non-pointer type");
-      return "";
-    }
-  } else if (auto* field = dynamic_cast<FieldExpressionNode*>(lhs)) {
-    // 检查是否是 register 字段
-    //irStream << "; getting lhstype of field expression\n";
-    if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-      std::string baseName = path->toString();
-      std::string fieldType = lookupVarType(baseName + "." + field->identifier.id);
-      if (!fieldType.empty()) {
-        return fieldType;
-      }
-    }
-    //irStream << "; getting base type of field expression\n";
-    std::string baseType = getLhsTypeWithStar(field->expression.get());
-    //irStream << "; base type in fieldexpression: " << baseType << '\n';
-    if (baseType == "") {
-      if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-        //irStream << "; trying to get type in struct field\n";
-        std::string name = path->toString();
-        //irStream <<"; finding " << name << " in struct field\n";
-        std::string fieldName = name + "." + field->identifier.id;
-        //irStream << "; getting type of struct item: " << fieldName << '\n';
-        baseType = lookupVarType(fieldName);
-        return baseType;
-      }
-    }
-    size_t starPos = baseType.find('*');
-    std::string structName;
-    if (starPos != std::string::npos) {
-      structName = baseType.substr(1, starPos - 1);
-    } else {
-      structName = baseType.substr(1);
-    }
-    auto it = structFields.find(structName);
-    if (it == structFields.end()) {
-      error("Unknown struct " + structName);
-      return "";
-    }
-    int index = -1;
-    for (int i = 0; i < it->second.size(); ++i) {
-      if (it->second[i].first == field->identifier.id) {
-        index = i;
-        break;
-      }
-    }
-    if (index == -1) {
-      error("Field not found " + field->identifier.id);
-      return "";
-    }
-    if (starPos != std::string::npos) {
-      //irStream << "; field expression type: " << it->second[index].second << "\n";
-      return it->second[index].second;
-    } else {
-      //irStream << "; field expression type: " << it->second[index].second << "\n";
-      return it->second[index].second;
-    }
-  } else if (auto* index = dynamic_cast<IndexExpressionNode*>(lhs)) {
-    // base[index], 类型是 base 的元素类型
-    //irStream << "; getting type of index expression\n";
-    std::string baseType = getLhsTypeWithStar(index->base.get());
-    //irStream << "; base type in index expression: " << baseType << "\n";
-    std::string elementType = getElementType(baseType);
-    //irStream << "; element type in getting type of indexexpression: " << elementType << '\n';
-    if (elementType != baseType) {
-      // 是数组
-      return elementType;
-    } else if (baseType.back() == '*') {
-      // 是指针
-      return baseType.substr(0, baseType.size() - 1);
-    } else {
-      error("Index on non-array non-pointer type");
-      return "";
-    }
-  } else if (auto* structExpr = dynamic_cast<StructExpressionNode*>(lhs)) {
-    std::string structName = structExpr->pathin_expression->toString();
-    return "%" + structName;
-  } else if (auto* array = dynamic_cast<ArrayExpressionNode*>(lhs)) {
-    // 数组类型，如 [3 x i32]*
-    std::string elemType = "i32";
-    if (!array->expressions.empty()) {
-      elemType = getLhsType(array->expressions[0].get());
-    }
-    int size;
-    if (array->type == ArrayExpressionType::REPEAT) {
-      auto countOpt = evaluateConstant(array->expressions[1].get());
-      if (!countOpt) {
-        error("Array repeat count must be constant");
-        return "";
-      }
-      size = *countOpt;
-    } else {
-      size = array->expressions.size();
-    }
-    return "[" + std::to_string(size) + " x " + elemType + "]";
-  } else if (auto* cast = dynamic_cast<TypeCastExpressionNode*>(lhs)) {
-    return toIRType(cast->type.get());
-  } else if (auto* borrow = dynamic_cast<BorrowExpressionNode*>(lhs)) {
-    // &expr 的类型是 expr 类型再加一层指针
-    //irStream << "; getting type of borrow expression\n";
-    std::string inner = getLhsType(borrow->expression.get());
-    if (inner.empty()) inner = "i32";
-    return inner + "*";
-  } else if (auto* call = dynamic_cast<CallExpressionNode*>(lhs)) {
-    std::string funcName;
-    if (auto* path = dynamic_cast<PathExpressionNode*>(call->expression.get())) {
-      funcName = path->toString();
-    } else {
-      error("Unsupported function expression in call");
-      return "";
-    }
-    funcName = mangleFuncName(funcName);
-    std::string retType = functionTable[funcName];
-    //irStream << "; function name: " << funcName << '\n';
-    if (retType.empty()) {
-      retType = "i32";
-      //irStream << "; function " << funcName << " not found in function table, default to i32\n";
-    }
-    return retType;
-  } else if (auto* ifExpr = dynamic_cast<IfExpressionNode*>(lhs)) {
-    if (ifExpr->block_expression && ifExpr->block_expression->expression_without_block) {
-      return getLhsType(ifExpr->block_expression->expression_without_block.get());
-    } else {
-      return "void";
-    }
-  } else if (auto* exprWithoutBlock = dynamic_cast<ExpressionWithoutBlockNode*>(lhs)) {
-    return std::visit([&](auto&& arg) -> std::string {
-      return getLhsType(arg.get());
-    }, exprWithoutBlock->expr);
-  } else if (auto* methodCall = dynamic_cast<MethodCallExpressionNode*>(lhs)) {
-    std::string methodName;
-    if (std::holds_alternative<Identifier>(methodCall->path_expr_segment)) {
-      methodName = std::get<Identifier>(methodCall->path_expr_segment).id;
-    } else {
-      error("PathInType in method call not supported");
-      return "";
-    }
-    std::string selfType = getLhsType(methodCall->expression.get());
-    std::string baseTypeForName = stripTrailingStars(selfType);
-    if (!baseTypeForName.empty() && baseTypeForName.front() == '%') baseTypeForName.erase(baseTypeForName.begin());
-    std::string mangledMethodName = baseTypeForName.empty() ? methodName : (baseTypeForName + "_" + methodName);
-    std::string retType = functionTable[mangledMethodName];
-    if (retType.empty()) retType = "i32";
-    return retType;
-  } else {
-    error(std::string("Unsupported expression in getting lhs type: ") + typeid(*lhs).name());
-    return "";
+    return std::visit([&](auto&& arg) -> std::string { return getLhsType(arg.get()); }, opExpr->operator_expression);
   }
+  // 其他表达式的值就是语义检查推导出的类型
+  return checkedType(lhs);
 }
 
-std::string IRGenerator::getLhsTypeWithStar(ExpressionNode* lhs) {
-  if (auto* path = dynamic_cast<PathExpressionNode*>(lhs)) {
-    std::string name = path->toString();
-    //irStream << "; name of pathexpression in getting type : " << name << '\n';
-    if (constantTable.find(name) != constantTable.end()) {
-      // 常量
-      std::string value = constantTable[name];
-      if (value[0] == '"') {
-        return "i8*";
-      } else {
-        return "i32";
-      }
-    } else {
-      std::string type = lookupVarType(name);
-      if (type.back() != '*') {
-        return type + "*";
-      } else {
-        return type;
-      }
-    }
-  } else if (auto* deref = dynamic_cast<DereferenceExpressionNode*>(lhs)) {
-    // *expr, 类型是 expr 类型去掉 *
-    std::string exprType = getLhsType(deref->expression.get());
-    if (exprType.back() == '*') {
-      return exprType.substr(0, exprType.size() - 1);
-    } else {
-      error("Dereference on non-pointer type");
-      return "";
-    }
-  } else if (auto* field = dynamic_cast<FieldExpressionNode*>(lhs)) {
-    // 检查是否是 register 字段
-    if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-      std::string baseName = path->toString();
-      std::string fieldType = lookupVarType(baseName + "." + field->identifier.id);
-      if (!fieldType.empty()) {
-        return fieldType;
-      }
-    }
-    //irStream << "; getting base type of field expression\n";
-    std::string baseType = getLhsTypeWithStar(field->expression.get());
-    //irStream << "; base type in fieldexpression: " << baseType << '\n';
-    if (baseType == "") {
-      if (auto* path = dynamic_cast<PathExpressionNode*>(field->expression.get())) {
-        //irStream << "; trying to get type in struct field\n";
-        std::string name = path->toString();
-        //irStream <<"; finding " << name << " in struct field\n";
-        std::string fieldName = name + "." + field->identifier.id;
-        //irStream << "; getting type of struct item: " << fieldName << '\n';
-        baseType = lookupVarType(fieldName);
-        return baseType;
-      }
-    }
-    size_t starPos = baseType.find('*');
-    std::string structName;
-    if (starPos != std::string::npos) {
-      structName = baseType.substr(1, starPos - 1);
-    } else {
-      structName = baseType.substr(1);
-    }
-    auto it = structFields.find(structName);
-    if (it == structFields.end()) {
-      error("Unknown struct " + structName);
-      return "";
-    }
-    int index = -1;
-    for (int i = 0; i < it->second.size(); ++i) {
-      if (it->second[i].first == field->identifier.id) {
-        index = i;
-        break;
-      }
-    }
-    if (index == -1) {
-      error("Field not found " + field->identifier.id);
-      return "";
-    }
-    if (starPos != std::string::npos) {
-      return it->second[index].second + "*";
-    } else {
-      return it->second[index].second;
-    }
-  } else if (auto* index = dynamic_cast<IndexExpressionNode*>(lhs)) {
-    // base[index], 类型是 base 的元素类型
-    //irStream << "; getting type with star of index expression\n";
-    std::string baseType = getLhsTypeWithStar(index->base.get());
-    //irStream << "; base type in index expression: " << baseType << "\n";
-    std::string elementType = getElementType(baseType);
-    //irStream << "; element type in getting type of indexexpression: " << elementType << '\n';
-    if (elementType != baseType) {
-      // 是数组
-      if (baseType.back() == '*') elementType = elementType + "*";
-      return elementType;
-    } else if (baseType.back() == '*') {
-      // 是指针
-      return baseType.substr(0, baseType.size() - 1);
-    } else {
-      error("Index on non-array non-pointer type");
-      return "";
-    }
-  } else if (auto* methodCall = dynamic_cast<MethodCallExpressionNode*>(lhs)) {
-    std::string methodName;
-    if (std::holds_alternative<Identifier>(methodCall->path_expr_segment)) {
-      methodName = std::get<Identifier>(methodCall->path_expr_segment).id;
-    } else {
-      error("PathInType in method call not supported");
-      return "";
-    }
-    std::string selfType = getLhsType(methodCall->expression.get());
-    std::string baseTypeForName = stripTrailingStars(selfType);
-    if (!baseTypeForName.empty() && baseTypeForName.front() == '%') baseTypeForName.erase(baseTypeForName.begin());
-    std::string mangledMethodName = baseTypeForName.empty() ? methodName : (baseTypeForName + "_" + methodName);
-    std::string retType = functionTable[mangledMethodName];
-    if (retType.empty()) retType = "i32";
-    return retType;
-  } else {
-    error("Unsupported lhs type in assignment");
-    return "";
+std::optional<int> IRGenerator::evaluateConstant(ExpressionNode* expr) {
+  auto len = consts->array_length(expr, constResolver());
+  if (!len) return std::nullopt;
+  return (int)*len;
+}
+
+ConstEvaluator::Resolver IRGenerator::constResolver() {
+  return [this](const std::string& name) -> const ConstantItemNode* {
+    auto it = constantTable.find(name);
+    return it != constantTable.end() ? it->second : nullptr;
+  };
+}
+
+std::string IRGenerator::constantOperand(ConstantItemNode* item) {
+  if (auto value = consts->evaluate_item(item, constResolver())) {
+    return value->toString();
+  }
+  // 字符串等非标量常量，保持字面量本身
+  if (auto* lit = dynamic_cast<LiteralExpressionNode*>(item->expression.get())) {
+    return lit->toString();
   }
+  error("Constant expression cannot be evaluated");
+  return "";
 }
 
-std::optional<int> IRGenerator::evaluateConstant(ExpressionNode* expr) {
-  if (auto* lit = dynamic_cast<LiteralExpressionNode*>(expr)) {
-    if (std::holds_alternative<std::unique_ptr<integer_literal>>(lit->literal)) {
-      auto& int_lit = std::get<std::unique_ptr<integer_literal>>(lit->literal);
-      return std::stoll(int_lit->value, nullptr, int_lit->base);
-    }
-  } else if (auto* path = dynamic_cast<PathExpressionNode*>(expr)) {
-    std::string name = path->toString();
-    if (constantTable.find(name) != constantTable.end()) {
-      return std::stoi(constantTable[name]);
+// expr能在编译期求出时返回它作为type类型的LLVM常量（不带类型前缀），否则返回空
+std::string IRGenerator::constantInitializer(ExpressionNode* expr, const std::string& type) {
+  if (auto* wrapper = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+    if (auto* a = std::get_if<std::unique_ptr<ArrayExpressionNode>>(&wrapper->expr)) return constantInitializer(a->get(), type);
+    if (auto* st = std::get_if<std::unique_ptr<StructExpressionNode>>(&wrapper->expr)) return constantInitializer(st->get(), type);
+    if (auto* g = std::get_if<std::unique_ptr<GroupedExpressionNode>>(&wrapper->expr)) return constantInitializer(g->get(), type);
+  }
+  if (auto* group = dynamic_cast<GroupedExpressionNode*>(expr)) return constantInitializer(group->expression.get(), type);
+  const IRType* irType = irTypes.get(type);
+  const std::string& t = irType->expanded;
+  if (t.empty()) return "";
+  if (irType->isArray()) {
+    auto* array = dynamic_cast<ArrayExpressionNode*>(expr);
+    if (!array || array->if_empty) return "";
+    int n = irType->count;
+    const std::string& elem = irType->element->expanded;
+    std::vector<std::string> values;
+    if (array->type == ArrayExpressionType::REPEAT) {
+      auto count = evaluateConstant(array->expressions[1].get());
+      std::string v = constantInitializer(array->expressions[0].get(), elem);
+      if (!count || *count != n || v.empty()) return "";
+      values.assign(n, v);
     } else {
-      //irStream << "; constant: " << name << " not found\n";
-    }
-  } else if (auto* arith = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(expr)) {
-    auto lhs = evaluateConstant(arith->expression1.get());
-    auto rhs = evaluateConstant(arith->expression2.get());
-    if (lhs && rhs) {
-      switch (arith->type) {
-        case ADD: return *lhs + *rhs;
-        case MINUS: return *lhs - *rhs;
-        case MUL: return *lhs * *rhs;
-        case DIV: return *lhs / *rhs;
-        case MOD: return *lhs % *rhs;
-        default: break;
-      }
+      if ((int)array->expressions.size() != n) return "";
+      for (const auto& e : array->expressions) {
+        values.push_back(constantInitializer(e.get(), elem));
+        if (values.back().empty()) return "";
+      }
+    }
+    bool zero = true;
+    for (const auto& v : values) zero = zero && (v == "0" || v == "false" || v == "zeroinitializer");
+    if (zero) return "zeroinitializer";
+    std::string init = "[";
+    for (size_t k = 0; k < values.size(); k++) init += (k ? ", " : "") + elem + " " + values[k];
+    return init + "]";
+  }
+  if (irType->kind == IRType::Kind::Struct) {
+    auto* struct_ = dynamic_cast<StructExpressionNode*>(expr);
+    if (!struct_ || struct_->struct_base || !struct_->struct_expr_fields) return "";
+    std::string structName = struct_->pathin_expression->toString();
+    const ItemIndex::Struct* s = findStruct(structName);
+    if (!s || expandStructType("%" + structName) != t) return "";
+    auto fields = structLayout(s);
+    std::vector<std::string> values(fields.size());
+    for (const auto& field : struct_->struct_expr_fields->struct_expr_fields) {
+      if (!std::holds_alternative<Identifier>(field->id_or_tupe_index)) return "";
+      int index = fieldIndex(structName, std::get<Identifier>(field->id_or_tupe_index).id);
+      if (index == -1) return "";
+      values[index] = constantInitializer(field->expression.get(), fields[index].second);
+    }
+    std::string init = "{";
+    for (size_t k = 0; k < values.size(); k++) {
+      if (values[k].empty()) return "";
+      init += (k ? ", " : "") + expandStructType(fields[k].second) + " " + values[k];
+    }
+    return init + "}";
+  }
+  if (t != "i1" && t != "i32" && t != "i64") return "";
+  auto value = consts->evaluate(expr, "", constResolver());
+  if (!value || value->is_bool() != (t == "i1")) return "";
+  return value->toString();
+}
+
+// 只读的全局数据，类型和初始值都相同的共用一个
+std::string IRGenerator::constantGlobal(const std::string& type, const std::string& init, const std::string& name) {
+  std::string t = expandStructType(type);
+  std::string key = t + " " + init;
+  auto it = constantData.find(key);
+  if (it != constantData.end()) return it->second;
+  std::string ref = llvmGlobalRef(name.empty() ? ".const." + std::to_string(constantData.size()) : name);
+  globalDefs += ref + " = private unnamed_addr constant " + key + ", align " + std::to_string(getTypeAlign(t)) + "\n";
+  constantData[key] = ref;
+  return ref;
+}
+
+// 和let定义的变量一样使用：符号是指向数据的指针，读元素直接从全局数据中读
+void IRGenerator::bindConstantGlobal(const ConstantGlobal& c) {
+  std::string temp = createTemp();
+  std::string t = expandStructType(c.type);
+  builder.setEntryInsert(true);
+  builder.gep(temp, t, c.ref, {{"i32", "0"}}, false);
+  builder.setEntryInsert(false);
+  locals[c.item] = {temp, c.type + "*", true};
+}
+
+// 字符串字面量放进常量池，相同内容共用一个全局变量，使用处是常量gep表达式，不产生指令
+std::string IRGenerator::stringConstant(const std::string& bytes) {
+  static const char* hex = "0123456789ABCDEF";
+  std::string init = "c\"";
+  for (unsigned char c : bytes) {
+    if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+      init += (char)c;
+    } else {
+      init += '\\';
+      init += hex[c >> 4];
+      init += hex[c & 15];
     }
-  } else if (auto* grouped = dynamic_cast<GroupedExpressionNode*>(expr)) {
-    return evaluateConstant(grouped->expression.get());
-  } else {
-    irStream << "Unknow type of expression in evaluating constant" << typeid(*expr).name() << '\n';
-    error(std::string("Unknow type of expression in evaluating constant") + typeid(*expr).name());
   }
-  return std::nullopt;
+  init += "\\00\"";
+  std::string type = "[" + std::to_string(bytes.size() + 1) + " x i8]";
+  return "getelementptr inbounds (" + type + ", " + type + "* " + constantGlobal(type, init) + ", i32 0, i32 0)";
 }
 
-std::optional<int> IRGenerator::computeConstantValue(ArithmeticOrLogicalExpressionNode* node) {
-  auto lhs = evaluateConstant(node->expression1.get());
-  auto rhs = evaluateConstant(node->expression2.get());
-  if (lhs && rhs) {
-    switch (node->type) {
-      case ADD: return *lhs + *rhs;
-      case MINUS: return *lhs - *rhs;
-      case MUL: return *lhs * *rhs;
-      case DIV: return *lhs / *rhs;
-      case MOD: return *lhs % *rhs;
-      default: break;
-    }
+std::string IRGenerator::constantIRType(ConstantItemNode* item) {
+  if (auto value = consts->evaluate_item(item, constResolver())) {
+    if (value->is_bool()) return "i1";
+    if (value->value < INT32_MIN || value->value > INT32_MAX) return "i64";
+    return "i32";
+  }
+  if (auto* lit = dynamic_cast<LiteralExpressionNode*>(item->expression.get())) {
+    if (lit->toString()[0] == '"') return "i8*";
   }
-  return std::nullopt;
+  return "i32";
 }
 
 bool IRGenerator::hasReturn(BlockExpressionNode* block) {
@@ -3619,20 +3101,6 @@ bool IRGenerator::willReturnInExpression(ExpressionNode* expr) {
   return false;
 }
 
-bool IRGenerator::isLetDefined(const std::string& name) {
-  size_t dotPos = name.find('.');
-  if (dotPos != std::string::npos) {
-    // 对于字段，暂时不支持，直接返回 false
-    return false;
-  }
-  for (auto it = isLetDefinedScopes.rbegin(); it != isLetDefinedScopes.rend(); ++it) {
-    if (it->find(name) != it->end()) {
-      return (*it)[name];
-    }
-  }
-  return false;
-}
-
 std::string IRGenerator::visit_in_rhs(ExpressionNode* node) {
   if (auto* arith = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(node)) {
     return visit_in_rhs(arith);
@@ -3650,40 +3118,38 @@ std::string IRGenerator::visit_in_rhs(ArithmeticOrLogicalExpressionNode* node) {
   std::string lhs = visit_in_rhs(static_cast<ExpressionNode*>(node->expression1.get()));
   std::string lhsType = getLhsType(node->expression1.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression1.get())) {
-    std::string lhs_path = path->toString();
-    std::string lhs_type = lookupVarType(lhs_path);
-    std::string lhs_addr = lookupSymbol(lhs_path);
+    std::string lhs_type = lookupVarType(path);
+    std::string lhs_addr = lookupSymbol(path);
     if (lhs_type == "i32*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i32, i32* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i32", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i32";
     } else if (lhs_type == "i64*") {
       std::string lhs_temp = createTemp();
-      irStream << "  %" << lhs_temp << " = load i64, i64* %" << lhs_addr << '\n';
+      builder.load(lhs_temp, "i64", "%" + lhs_addr);
       lhs = "%" + lhs_temp;
       lhsType = "i64";
     }
   }
   if (auto* type_cast = dynamic_cast<TypeCastExpressionNode*>(node->expression1.get())) {
     if (auto* path = dynamic_cast<PathExpressionNode*>(type_cast->expression.get())) {
-      std::string lhs_path = path->toString();
-      std::string lhs_type = lookupVarType(lhs_path);
-      std::string lhs_addr = lookupSymbol(lhs_path);
+      std::string lhs_type = lookupVarType(path);
+      std::string lhs_addr = lookupSymbol(path);
       if (lhs_type == "i32*") {
         std::string lhs_temp = createTemp();
-        irStream << "  %" << lhs_temp << " = load i32, i32* %" << lhs_addr << '\n';
+        builder.load(lhs_temp, "i32", "%" + lhs_addr);
         lhs = "%" + lhs_temp;
         lhsType = "i32";
       } else if (lhs_type == "i64*") {
         std::string lhs_temp = createTemp();
-        irStream << "  %" << lhs_temp << " = load i64, i64* %" << lhs_addr << '\n';
+        builder.load(lhs_temp, "i64", "%" + lhs_addr);
         lhs = "%" + lhs_temp;
         lhsType = "i64";
         if (toIRType(type_cast->type.get()) == "i32") {
           lhsType = "i32";
           std::string temp = createTemp();
-          irStream << "  %" << temp << " = trunc i64 " << lhs << " to i32\n";
+          builder.cast(temp, IROp::Trunc, "i64", lhs, "i32");
           lhs = "%" + temp;
         }
       }
@@ -3694,34 +3160,32 @@ std::string IRGenerator::visit_in_rhs(ArithmeticOrLogicalExpressionNode* node) {
   std::string rhs = visit_in_rhs(static_cast<ExpressionNode*>(node->expression2.get()));
   std::string rhsType = getLhsType(node->expression2.get());
   if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression2.get())) {
-    std::string rhs_path = path->toString();
-    std::string rhs_type = lookupVarType(rhs_path);
-    std::string rhs_addr = lookupSymbol(rhs_path);
+    std::string rhs_type = lookupVarType(path);
+    std::string rhs_addr = lookupSymbol(path);
     if (rhs_type == "i32*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i32, i32* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i32", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i32";
     } else if (rhs_type == "i64*") {
       std::string rhs_temp = createTemp();
-      irStream << "  %" << rhs_temp << " = load i64, i64* %" << rhs_addr << '\n';
+      builder.load(rhs_temp, "i64", "%" + rhs_addr);
       rhs = "%" + rhs_temp;
       rhsType = "i64";
     }
   }
   if (auto* type_cast = dynamic_cast<TypeCastExpressionNode*>(node->expression2.get())) {
     if (auto* path = dynamic_cast<PathExpressionNode*>(type_cast->expression.get())) {
-      std::string rhs_path = path->toString();
-      std::string rhs_type = lookupVarType(rhs_path);
-      std::string rhs_addr = lookupSymbol(rhs_path);
+      std::string rhs_type = lookupVarType(path);
+      std::string rhs_addr = lookupSymbol(path);
       if (rhs_type == "i32*") {
         std::string rhs_temp = createTemp();
-        irStream << "  %" << rhs_temp << " = load i32, i32* %" << rhs_addr << '\n';
+        builder.load(rhs_temp, "i32", "%" + rhs_addr);
         rhs = "%" + rhs_temp;
         rhsType = "i32";
       } else if (rhs_type == "i64*") {
         std::string rhs_temp = createTemp();
-        irStream << "  %" << rhs_temp << " = load i64, i64* %" << rhs_addr << '\n';
+        builder.load(rhs_temp, "i64", "%" + rhs_addr);
         rhs = "%" + rhs_temp;
         rhsType = "i64";
       }
@@ -3734,42 +3198,42 @@ std::string IRGenerator::visit_in_rhs(ArithmeticOrLogicalExpressionNode* node) {
   //irStream << "; lhsType: " << lhsType << ", rhsType: " << rhsType << ", resultType: " << resultType << "\n";
   //irStream << "; lhs address: " << lhs << ", rhs address: " << rhs << '\n';
   std::string temp = createTemp();
-  std::string op;
+  IROp op;
   switch (node->type) {
-    case ADD: op = "add"; break;
-    case MINUS: op = "sub"; break;
-    case MUL: op = "mul"; break;
-    case DIV: op = "sdiv"; break;
-    case MOD: op = "srem"; break;
-    case AND: op = "and"; break;
-    case OR: op = "or"; break;
-    case XOR: op = "xor"; break;
-    case SHL: op = "shl"; break;
-    case SHR: op = "ashr"; break;
-    default: op = "add";
-  }
-  if (resultType == "i64" && !(op == "shl" || op == "ashr")) {
+    case ADD: op = IROp::Add; break;
+    case MINUS: op = IROp::Sub; break;
+    case MUL: op = IROp::Mul; break;
+    case DIV: op = IROp::SDiv; break;
+    case MOD: op = IROp::SRem; break;
+    case AND: op = IROp::And; break;
+    case OR: op = IROp::Or; break;
+    case XOR: op = IROp::Xor; break;
+    case SHL: op = IROp::Shl; break;
+    case SHR: op = IROp::AShr; break;
+    default: op = IROp::Add;
+  }
+  if (resultType == "i64" && !(op == IROp::Shl || op == IROp::AShr)) {
     if (lhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << lhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", lhs, "i64");
       lhs = "%" + temp;
     }
     if (rhsType == "i32") {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = sext i32 " << rhs << " to i64\n";
+      builder.cast(temp, IROp::SExt, "i32", rhs, "i64");
       rhs = "%" + temp;
     }
   }
-  if (op == "shl" || op == "ashr") {
+  if (op == IROp::Shl || op == IROp::AShr) {
     if (resultType == "i64" && lhsType == "i32") {
       //irStream << "; need modifying in shl or ashr" << '\n';
       resultType = "i32";
       std::string modTemp = createTemp();
-      irStream << "  %" << modTemp << " = trunc i64 " << rhs << " to i32\n";
+      builder.cast(modTemp, IROp::Trunc, "i64", rhs, "i32");
       rhs = "%" + modTemp;
     }
   }
-  irStream << "  %" << temp << " = " << op << " " << resultType << " " << lhs << ", " << rhs << "\n";
+  builder.binary(temp, op, resultType, lhs, rhs);
   return "%" + temp;
 }
 
@@ -3780,24 +3244,20 @@ std::string IRGenerator::visit_in_rhs(IfExpressionNode* node) {
     cond = visit(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get());
     //irStream << "; condition expression type: " << typeid(*std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get()).name() << '\n';
     if (auto* path = dynamic_cast<PathExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
-      std::string condName = path->toString();
-      //irStream << "; condName: " << condName << '\n';
-      std::string condType = lookupVarType(condName);
+      std::string condType = lookupVarType(path);
       //irStream << "; condType: " << condType << '\n';
       if (condType == "i1*") {
         std::string condTemp = createTemp();
-        irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+        builder.load(condTemp, "i1", cond);
         cond = "%" + condTemp;
       }
     } else if (auto* grouped = dynamic_cast<GroupedExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
       if (auto* path = dynamic_cast<PathExpressionNode*>(grouped->expression.get())) {
-        std::string condName = path->toString();
-        //irStream << "; condName: " << condName << '\n';
-        std::string condType = lookupVarType(condName);
+        std::string condType = lookupVarType(path);
         //irStream << "; condType: " << condType << '\n';
         if (condType == "i1*") {
           std::string condTemp = createTemp();
-          irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+          builder.load(condTemp, "i1", cond);
           cond = "%" + condTemp;
         }
       }
@@ -3814,13 +3274,13 @@ std::string IRGenerator::visit_in_rhs(IfExpressionNode* node) {
   // 不使用 phi：用一个临时栈槽在分支内 store，endLabel 处 load。
   // 结果类型尽量从 if 表达式自身推断（getLhsType(IfExpressionNode*)）。
   std::string resultType = getLhsType(static_cast<ExpressionNode*>(node));
-  if (resultType.empty() || resultType == "void" || resultType == "i32*") resultType = "i32";
+  if (resultType.empty() || resultType == "void") resultType = "i32";
   std::string resultPtr = createTemp();
-  irStream << "  %" << resultPtr << " = alloca " << expandStructType(resultType) << "\n";
+  emitAlloca(resultType, resultPtr);
 
-  irStream << "  br i1 " << cond << ", label %" << thenLabel << ", label %" << elseLabel << "\n";
+  builder.condBr(cond, thenLabel, elseLabel);
 
-  irStream << thenLabel << ":\n";
+  builder.label(thenLabel);
   //irStream << "  ; then branch let assignment\n";
   // 处理 statements，但不处理 expression_without_block 的 store/br
   std::string pos_stat_ret;
@@ -3834,22 +3294,19 @@ std::string IRGenerator::visit_in_rhs(IfExpressionNode* node) {
   //irStream << "; thenType: " << thenType << ", resultType: " << resultType << "\n";
   if (resultType == "i64" && thenType == "i32") {
     std::string t = createTemp();
-    irStream << "  %" << t << " = sext i32 " << thenValue << " to i64\n";
+    builder.cast(t, IROp::SExt, "i32", thenValue, "i64");
     thenValue = "%" + t;
   } else if (resultType == "i32" && thenType == "i64") {
     std::string t = createTemp();
-    irStream << "  %" << t << " = trunc i64 " << thenValue << " to i32\n";
-    thenValue = "%" + t;
-  } else if (thenType == "i32*") {
-    std::string t = createTemp();
-    irStream << "  %" << t << " = load i32, i32* " << thenValue << "\n";
+    builder.cast(t, IROp::Trunc, "i64", thenValue, "i32");
     thenValue = "%" + t;
+  } else if (thenType == resultType + "*") {
+    thenValue = emitLoad(resultType, thenValue);
   }
-  irStream << "  store " << expandStructType(resultType) << " " << thenValue
-           << ", " << expandStructType(resultType) << "* %" << resultPtr << "\n";
-  irStream << "  br label %" << endLabel << "\n";
+  builder.store(expandStructType(resultType), thenValue, "%" + resultPtr);
+  builder.br(endLabel);
 
-  irStream << elseLabel << ":\n";
+  builder.label(elseLabel);
   //irStream << "  ; else branch let assignment\n";
   std::string elseValue;
   std::string elseType = resultType;
@@ -3873,25 +3330,21 @@ std::string IRGenerator::visit_in_rhs(IfExpressionNode* node) {
   }
   if (resultType == "i64" && elseType == "i32") {
     std::string t = createTemp();
-    irStream << "  %" << t << " = sext i32 " << elseValue << " to i64\n";
+    builder.cast(t, IROp::SExt, "i32", elseValue, "i64");
     elseValue = "%" + t;
   } else if (resultType == "i32" && elseType == "i64") {
     std::string t = createTemp();
-    irStream << "  %" << t << " = trunc i64 " << elseValue << " to i32\n";
-    elseValue = "%" + t;
-  } else if (elseType == "i32*") {
-    std::string t = createTemp();
-    irStream << "  %" << t << " = load i32, i32* " << elseValue << "\n";
+    builder.cast(t, IROp::Trunc, "i64", elseValue, "i32");
     elseValue = "%" + t;
+  } else if (elseType == resultType + "*") {
+    elseValue = emitLoad(resultType, elseValue);
   }
-  irStream << "  store " << expandStructType(resultType) << " " << elseValue
-           << ", " << expandStructType(resultType) << "* %" << resultPtr << "\n";
-  irStream << "  br label %" << endLabel << "\n";
+  builder.store(expandStructType(resultType), elseValue, "%" + resultPtr);
+  builder.br(endLabel);
 
-  irStream << endLabel << ":\n";
+  builder.label(endLabel);
   std::string loaded = createTemp();
-  irStream << "  %" << loaded << " = load " << expandStructType(resultType)
-           << ", " << expandStructType(resultType) << "* %" << resultPtr << "\n";
+  builder.load(loaded, expandStructType(resultType), "%" + resultPtr);
   return "%" + loaded;
 }
 
@@ -3909,36 +3362,37 @@ bool IRGenerator::isConstantZero(ExpressionNode* expr) {
   return false;
 }
 
-int IRGenerator::getTypeSize(const std::string& type) {
-  if (type == "i32") return 4;
-  if (type == "i64") return 8;
-  if (type == "i1") return 1;
-  if (type[0] == '%') {
-    std::string name = type.substr(1);
-    auto it = structFields.find(name);
-    if (it != structFields.end()) {
-      int total = 0;
-      for (auto& f : it->second) {
-        std::string fieldType = f.second;
-        total += getTypeSize(fieldType);
-      }
-      return total;
-    }
-  } else if (type[0] == '[') {
-    // array [N x T]
-    size_t xPos = type.find(" x ");
-    if (xPos != std::string::npos) {
-      std::string nStr = type.substr(1, xPos - 1);
-      std::string tStr = type.substr(xPos + 3, type.size() - xPos - 4); // remove ]
-      int n = std::stoi(nStr);
-      int elemSize = getTypeSize(tStr);
-      return n * elemSize;
-    }
-  } else if (type.back() == '*') {
-    // pointer, assume 8 bytes
-    return 8;
-  }
-  return 4; // default
+int64_t IRGenerator::getTypeSize(const std::string& type) {
+  return irTypes.get(type)->size;
+}
+
+int IRGenerator::getTypeAlign(const std::string& type) {
+  return irTypes.get(type)->align;
+}
+
+bool IRGenerator::isAggregate(const std::string& type) {
+  return irTypes.get(type)->isAggregate();
+}
+
+void IRGenerator::emitCopy(const std::string& type, const std::string& dst, const std::string& src) {
+  std::string t = expandStructType(type);
+  if (!isAggregate(type)) {
+    builder.store(t, emitLoad(type, src), dst);
+    return;
+  }
+  std::string align = std::to_string(getTypeAlign(t));
+  std::string d = createTemp();
+  std::string s = createTemp();
+  builder.cast(d, IROp::BitCast, t + "*", dst, "i8*");
+  builder.cast(s, IROp::BitCast, t + "*", src, "i8*");
+  builder.call("", "void", "@llvm.memcpy.p0i8.p0i8.i64", {{"i8*", "%" + d, "align " + align}, {"i8*", "%" + s, "align " + align}, {"i64", std::to_string(getTypeSize(t))}, {"i1", "false"}});
+}
+
+void IRGenerator::emitZero(const std::string& type, const std::string& ptr) {
+  std::string t = expandStructType(type);
+  std::string p = createTemp();
+  builder.cast(p, IROp::BitCast, t + "*", ptr, "i8*");
+  builder.call("", "void", "@llvm.memset.p0i8.i64", {{"i8*", "%" + p, "align " + std::to_string(getTypeAlign(t))}, {"i8", "0"}, {"i64", std::to_string(getTypeSize(t))}, {"i1", "false"}});
 }
 
 std::string IRGenerator::visit_in_rhs(StatementNode* node) {
@@ -3960,7 +3414,6 @@ void IRGenerator::preScanFunctionBody(BlockExpressionNode* node) {
 }
 
 std::string IRGenerator::visit_block_in_loop(BlockExpressionNode* node) {
-  enterScope();
   for (const auto& stmt : node->statement) {
     if (stmt->expr_statement) {
       if (auto* ifExpr = dynamic_cast<IfExpressionNode*>(stmt->expr_statement->expression.get())) {
@@ -3978,24 +3431,21 @@ std::string IRGenerator::visit_block_in_loop(BlockExpressionNode* node) {
       std::string value = visit(node->expression_without_block.get());
       if (auto* p = std::get_if<std::unique_ptr<PathExpressionNode>>(&node->expression_without_block->expr)) {
         PathExpressionNode* path = p->get();
-        std::string retName = path->toString();
-        std::string retType = lookupVarType(retName);
+        std::string retType = lookupVarType(path);
         std::string retTemp = createTemp();
-        if (isLetDefined(retName) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
-          irStream << "  %" << retTemp << " = load " << expandStructType(currentRetType)
-                 << ", " << expandStructType(retType) << " " << value << "\n";
+        if (isLetDefined(path) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
+          builder.load(retTemp, expandStructType(currentRetType), value);
           value = "%" + retTemp;
         }
       }
       if (!std::holds_alternative<std::unique_ptr<ReturnExpressionNode>>(node->expression_without_block->expr)) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << value << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), value, "%" + returnVar);
+        builder.br(returnLabel);
       }
     } else {
       result = visit(node->expression_without_block.get());
     }
   }
-  exitScope();
   return result;
 }
 
@@ -4008,25 +3458,21 @@ std::string IRGenerator::visit_if_in_loop(IfExpressionNode* node) {
     //irStream << "; cond: " << cond << "\n";
     //irStream << "; expresstin type: " << typeid(*expr.get()).name() << "\n";
     if (auto* path = dynamic_cast<PathExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
-      std::string condName = path->toString();
-      //irStream << "; condName: " << condName << "\n";
-      std::string condType = lookupVarType(condName);
+      std::string condType = lookupVarType(path);
       //irStream << "; condType: " << condType << "\n";
       if (condType == "i1*") {
         std::string condTemp = createTemp();
-        irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+        builder.load(condTemp, "i1", cond);
         cond = "%" + condTemp;
       }
     }
     if (auto* group = dynamic_cast<GroupedExpressionNode*>(std::get<std::unique_ptr<ExpressionNode>>(node->conditions->condition).get())) {
       if (auto* path = dynamic_cast<PathExpressionNode*>(group->expression.get())) {
-        std::string condName = path->toString();
-        //irStream << "; condName: " << condName << "\n";
-        std::string condType = lookupVarType(condName);
+        std::string condType = lookupVarType(path);
         //irStream << "; condType: " << condType << "\n";
         if (condType == "i1*") {
           std::string condTemp = createTemp();
-          irStream << "  %" << condTemp << " = load i1, i1* " << cond << "\n";
+          builder.load(condTemp, "i1", cond);
           cond = "%" + condTemp;
         }
       }
@@ -4059,44 +3505,44 @@ std::string IRGenerator::visit_if_in_loop(IfExpressionNode* node) {
   std::string endLabel = allBranchesWillReturn ? "" : createLabel();
   //irStream << "; end label: " << endLabel << '\n';
 
-  irStream << "  br i1 " << cond << ", label %" << thenLabel << ", label %" << elseLabel << "\n";
+  builder.condBr(cond, thenLabel, elseLabel);
 
   // 总是生成 phi，如果需要
   std::string thenValue = "";
   std::string elseValue = "";
   std::string phiValue = "";
 
-  irStream << thenLabel << ":\n";
+  builder.label(thenLabel);
   //irStream << "  ; then branch\n";
   thenValue = visit_ifblock_in_loop(node->block_expression.get());
   if (!allBranchesWillReturn) {
-    irStream << "  br label %" << endLabel << "\n";
+    builder.br(endLabel);
   }
 
-  irStream << elseLabel << ":\n";
+  builder.label(elseLabel);
   //irStream << "  ; else branch\n";
   if (node->else_block) {
     elseValue = visit(node->else_block.get());
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   } else if (node->else_if) {
     elseValue = visit(node->else_if.get());
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   } else {
     // no else, always br
     if (!allBranchesWillReturn) {
-      irStream << "  br label %" << endLabel << "\n";
+      builder.br(endLabel);
     }
   }
 
   if (!allBranchesWillReturn) {
-    irStream << endLabel << ":\n";
+    builder.label(endLabel);
     if (!thenValue.empty() && !elseValue.empty()) {
       std::string temp = createTemp();
-      irStream << "  %" << temp << " = phi " << currentRetType << " [ " << thenValue << ", %" << thenLabel << " ], [ " << elseValue << ", %" << elseLabel << " ]\n";
+      builder.phi(temp, currentRetType, {{thenValue, thenLabel}, {elseValue, elseLabel}});
       phiValue = "%" + temp;
     }
   }
@@ -4104,15 +3550,15 @@ std::string IRGenerator::visit_if_in_loop(IfExpressionNode* node) {
   // 如果在函数体中，store phiValue 到 returnVar 并 br
   if (inFunctionBody) {
     if (!phiValue.empty()) {
-      irStream << "  store " << expandStructType(currentRetType) << " " << phiValue << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-      irStream << "  br label %" << returnLabel << "\n";
+      builder.store(expandStructType(currentRetType), phiValue, "%" + returnVar);
+      builder.br(returnLabel);
     }
     return "";
   } else {
     if (inFunctionBody) {
       if (!phiValue.empty()) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << phiValue << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), phiValue, "%" + returnVar);
+        builder.br(returnLabel);
       }
       return "";
     } else {
@@ -4122,43 +3568,23 @@ std::string IRGenerator::visit_if_in_loop(IfExpressionNode* node) {
 }
 
 void IRGenerator::visit_let_in_loop(LetStatement *node) {
-  std::string varName = node->pattern->toString(); // 简化
   std::string type;
-  std::string typeNameStr;
   if (node->type) {
-    typeNameStr = node->type->toString();
-    //irStream << "; type name in let statement: " << typeNameStr << '\n';
     if (auto* ref = dynamic_cast<ReferenceTypeNode*>(node->type.get())) {
-      std::string innerType = toIRType(ref->type.get());
-      // check if u32 and overflow
-      if (auto* typePath = dynamic_cast<TypePathNode*>(ref->type.get())) {
-        std::string path = typePath->type_path->toString();
-        if (path == "u32") {
-          innerType = "i64";
-        }
-      }
-      type = innerType + "*";
+      type = toIRType(ref->type.get()) + "*";
     } else {
       type = toIRType(node->type.get());
-      if (auto* typePath = dynamic_cast<TypePathNode*>(node->type.get())) {
-        std::string path = typePath->type_path->toString();
-        if (path == "u32") {
-          type = "i64";
-        }
-      }
     }
   } else {
     type = "i32";
-    typeNameStr = "i32";
   }
   std::string temp;
   temp = createTemp();
-  //irStream << "; var name in let statement: " << varName << '\n';
   //irStream << "; var type in let statement: " << type + "*" << '\n';
   //irStream << "; var address in let statement: " << temp << '\n';
   bool isArray = type.find('[') != std::string::npos;
-  irStream << "  %" << temp << " = alloca " << expandStructType(type) << "\n";
-  if (node->expression) {
+  emitAlloca(type, temp);
+  if (node->expression && !emitInto(node->expression.get(), type, "%" + temp)) {
   // 检查 rhs 是否是 if expression
     // 普通 rhs
     std::string value = visit_in_rhs(node->expression.get());
@@ -4166,29 +3592,28 @@ void IRGenerator::visit_let_in_loop(LetStatement *node) {
     if (type == "i64" && rhsType == "i32") {
       rhsType = "i64";
       std::string rhsTemp = createTemp();
-      irStream << "  %" << rhsTemp << " = sext i32 " << value << " to i64\n";
+      builder.cast(rhsTemp, IROp::SExt, "i32", value, "i64");
       value = "%" + rhsTemp;
     }
+    bool copied = false;
     if (auto* path = dynamic_cast<PathExpressionNode*>(node->expression.get())) {
-      std::string letName = path->toString();
-      std::string letType = lookupVarType(letName);
-      if (letType == type + "*") {
+      std::string letType = lookupVarType(path);
+      if (letType == type + "*" && isAggregate(type)) {
+        emitCopy(type, "%" + temp, value);
+        copied = true;
+      } else if (letType == type + "*") {
         std::string letTemp = createTemp();
-        irStream << "  %" << letTemp << " = load " << type << ", " << type << "* " << value << '\n';
+        builder.load(letTemp, type, value);
         value = "%" + letTemp;
       }
     }
-    irStream << "  store " << expandStructType(type) << " " << value << ", " << expandStructType(type) << "* %" << temp << "\n";
+    if (!copied) builder.store(expandStructType(type), value, "%" + temp);
   }
-  // 更新 scopes 在计算 value 之后
-  symbolScopes.back()[varName] = temp;
-  varTypeScopes.back()[varName] = type + "*";
-  typeNameScopes.back()[varName] = typeNameStr;
-  isLetDefinedScopes.back()[varName] = true;
+  // 在计算 value 之后登记，初始值中的同名变量是外层的
+  locals[node] = {temp, type + "*", true};
 }
 
 std::string IRGenerator::visit_ifblock_in_loop(BlockExpressionNode* node) {
-  enterScope();
   for (const auto& stmt : node->statement) {
     if (stmt->let_statement) {
       visit_let_in_loop(stmt->let_statement.get());
@@ -4202,24 +3627,21 @@ std::string IRGenerator::visit_ifblock_in_loop(BlockExpressionNode* node) {
       std::string value = visit(node->expression_without_block.get());
       if (auto* p = std::get_if<std::unique_ptr<PathExpressionNode>>(&node->expression_without_block->expr)) {
         PathExpressionNode* path = p->get();
-        std::string retName = path->toString();
-        std::string retType = lookupVarType(retName);
+        std::string retType = lookupVarType(path);
         std::string retTemp = createTemp();
-        if (isLetDefined(retName) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
-          irStream << "  %" << retTemp << " = load " << expandStructType(currentRetType)
-                 << ", " << expandStructType(retType) << " " << value << "\n";
+        if (isLetDefined(path) && expandStructType(retType) == expandStructType(currentRetType) + "*") {
+          builder.load(retTemp, expandStructType(currentRetType), value);
           value = "%" + retTemp;
         }
       }
       if (!std::holds_alternative<std::unique_ptr<ReturnExpressionNode>>(node->expression_without_block->expr)) {
-        irStream << "  store " << expandStructType(currentRetType) << " " << value << ", " << expandStructType(currentRetType) << "* %" << returnVar << "\n";
-        irStream << "  br label %" << returnLabel << "\n";
+        builder.store(expandStructType(currentRetType), value, "%" + returnVar);
+        builder.br(returnLabel);
       }
     } else {
       result = visit(node->expression_without_block.get());
     }
   }
-  exitScope();
   return result;
 }
 #endif
@@ -0,0 +1,190 @@
+#ifndef IR_ANALYSIS_HPP
+#define IR_ANALYSIS_HPP
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir_module.hpp"
+
+// 支配树，用Cooper-Harvey-Kennedy的迭代算法在逆后序上求直接支配者
+// 只包含从入口可达的基本块
+class DominatorTree {
+ public:
+  explicit DominatorTree(const IRFunction& f) { build(f); }
+
+  const std::vector<IRBasicBlock*>& reversePostOrder() const { return rpo; }
+
+  bool reachable(const IRBasicBlock* bb) const { return order.count(bb) != 0; }
+
+  IRBasicBlock* idom(const IRBasicBlock* bb) const {
+    auto it = order.find(bb);
+    if (it == order.end() || it->second == 0) return nullptr;
+    return rpo[doms[it->second]];
+  }
+
+  const std::vector<IRBasicBlock*>& children(const IRBasicBlock* bb) const {
+    static const std::vector<IRBasicBlock*> none;
+    auto it = order.find(bb);
+    return it == order.end() ? none : kids[it->second];
+  }
+
+  // a是否支配b（包括a == b）
+  bool dominates(const IRBasicBlock* a, const IRBasicBlock* b) const {
+    auto ia = order.find(a), ib = order.find(b);
+    if (ia == order.end() || ib == order.end()) return false;
+    int x = ia->second, y = ib->second;
+    // 支配者在逆后序中总排在前面，沿直接支配者往上走即可
+    while (y > x) y = doms[y];
+    return y == x;
+  }
+
+  // 指令a是否支配指令b
+  bool dominates(const IRInstruction* a, const IRInstruction* b) const {
+    if (a->parent != b->parent) return dominates(a->parent, b->parent);
+    for (const IRInstruction* i = a; i; i = i->next) {
+      if (i == b) return true;
+    }
+    return false;
+  }
+
+  // 支配边界
+  const std::vector<IRBasicBlock*>& frontier(const IRBasicBlock* bb) {
+    if (df.empty()) buildFrontiers();
+    static const std::vector<IRBasicBlock*> none;
+    auto it = order.find(bb);
+    return it == order.end() ? none : df[it->second];
+  }
+
+ private:
+  std::vector<IRBasicBlock*> rpo;
+  std::unordered_map<const IRBasicBlock*, int> order;  // 块在rpo中的位置
+  std::vector<int> doms;
+  std::vector<std::vector<IRBasicBlock*>> kids;
+  std::vector<std::vector<IRBasicBlock*>> df;
+
+  void build(const IRFunction& f) {
+    IRBasicBlock* entry = f.entry();
+    if (!entry) return;
+    // 非递归的DFS求后序
+    std::vector<IRBasicBlock*> post;
+    std::unordered_map<const IRBasicBlock*, bool> visited;
+    std::vector<std::pair<IRBasicBlock*, size_t>> stack;
+    std::vector<std::vector<IRBasicBlock*>> succs;
+    visited[entry] = true;
+    stack.push_back({entry, 0});
+    succs.push_back(entry->successors());
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      if (top.second < succs.back().size()) {
+        IRBasicBlock* s = succs.back()[top.second++];
+        if (!visited[s]) {
+          visited[s] = true;
+          stack.push_back({s, 0});
+          succs.push_back(s->successors());
+        }
+      } else {
+        post.push_back(top.first);
+        stack.pop_back();
+        succs.pop_back();
+      }
+    }
+    rpo.assign(post.rbegin(), post.rend());
+    for (size_t i = 0; i < rpo.size(); i++) order[rpo[i]] = (int)i;
+
+    std::vector<std::vector<int>> preds(rpo.size());
+    for (size_t i = 0; i < rpo.size(); i++) {
+      for (IRBasicBlock* p : rpo[i]->predecessors()) {
+        auto it = order.find(p);
+        if (it != order.end()) preds[i].push_back(it->second);
+      }
+    }
+    doms.assign(rpo.size(), -1);
+    doms[0] = 0;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t i = 1; i < rpo.size(); i++) {
+        int newIdom = -1;
+        for (int p : preds[i]) {
+          if (doms[p] == -1) continue;
+          newIdom = newIdom == -1 ? p : intersect(p, newIdom);
+        }
+        if (newIdom != doms[i]) {
+          doms[i] = newIdom;
+          changed = true;
+        }
+      }
+    }
+    kids.assign(rpo.size(), {});
+    for (size_t i = 1; i < rpo.size(); i++) kids[doms[i]].push_back(rpo[i]);
+  }
+
+  int intersect(int a, int b) const {
+    while (a != b) {
+      while (a > b) a = doms[a];
+      while (b > a) b = doms[b];
+    }
+    return a;
+  }
+
+  void buildFrontiers() {
+    df.assign(rpo.size(), {});
+    for (size_t i = 0; i < rpo.size(); i++) {
+      std::vector<int> preds;
+      for (IRBasicBlock* p : rpo[i]->predecessors()) {
+        auto it = order.find(p);
+        if (it != order.end()) preds.push_back(it->second);
+      }
+      if (preds.size() < 2) continue;
+      for (int p : preds) {
+        for (int runner = p; runner != doms[i]; runner = doms[runner]) {
+          auto& list = df[runner];
+          if (list.empty() || list.back() != rpo[i]) list.push_back(rpo[i]);
+        }
+      }
+    }
+  }
+};
+
+// 自然循环：回边t->h（h支配t）的循环体是h加上不经过h能到达t的所有块
+// 同一个循环头的多条回边合成一个循环；loops按块数从小到大排序，内层循环在前
+struct IRLoop {
+  IRBasicBlock* header;
+  std::vector<IRBasicBlock*> latches;
+  std::unordered_set<IRBasicBlock*> blocks;
+
+  bool contains(const IRBasicBlock* bb) const { return blocks.count(const_cast<IRBasicBlock*>(bb)) != 0; }
+
+  bool contains(const IRValue* v) const {
+    return v->isInstruction() && static_cast<const IRInstruction*>(v)->parent && contains(static_cast<const IRInstruction*>(v)->parent);
+  }
+};
+
+inline std::vector<IRLoop> findLoops(const DominatorTree& dt) {
+  std::vector<IRLoop> loops;
+  for (IRBasicBlock* bb : dt.reversePostOrder()) {
+    IRLoop loop{bb, {}, {}};
+    for (IRBasicBlock* p : bb->predecessors()) {
+      if (dt.dominates(bb, p)) loop.latches.push_back(p);
+    }
+    if (loop.latches.empty()) continue;
+    loop.blocks.insert(bb);
+    std::vector<IRBasicBlock*> work;
+    for (IRBasicBlock* t : loop.latches) {
+      if (loop.blocks.insert(t).second) work.push_back(t);
+    }
+    while (!work.empty()) {
+      IRBasicBlock* x = work.back();
+      work.pop_back();
+      for (IRBasicBlock* p : x->predecessors()) {
+        if (dt.reachable(p) && loop.blocks.insert(p).second) work.push_back(p);
+      }
+    }
+    loops.push_back(std::move(loop));
+  }
+  std::stable_sort(loops.begin(), loops.end(), [](const IRLoop& a, const IRLoop& b) { return a.blocks.size() < b.blocks.size(); });
+  return loops;
+}
+
+#endif
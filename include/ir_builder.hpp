@@ -0,0 +1,314 @@
+#ifndef IR_BUILDER_HPP
+#define IR_BUILDER_HPP
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir_module.hpp"
+
+// 直接在IRModule中构建函数和指令。值按名字引用：%t3这样的局部值、@f这样的全局符号，
+// 其余文本（5、true、null、常量表达式）是常量；基本块用不带%的标签名。
+// 名字是纯数字的值（%0、%1）和LLVM一样是未命名的，打印时重新编号
+class IRBuilder {
+ public:
+  struct Param {
+    std::string type;
+    std::string attrs;
+    std::string name;
+  };
+  struct Arg {
+    std::string type;
+    std::string value;
+    std::string attrs = "";
+  };
+  struct Index {
+    std::string type;
+    std::string value;
+  };
+
+  explicit IRBuilder(IRModule& m) : module(m) {}
+
+  IRModule& getModule() { return module; }
+  bool inFunction() const { return state.fn != nullptr; }
+
+  // 函数之外的内容（注释、全局变量、声明）原样保存
+  void text(const std::string& s) {
+    if (!module.entries.empty() && !module.entries.back().function) {
+      module.entries.back().text += s;
+    } else {
+      module.entries.push_back({s, nullptr});
+    }
+  }
+
+  // %name = type { ... }，字段类型记下来给gep/extractvalue推算结果类型
+  void namedType(const std::string& name, const std::vector<std::string>& fields) {
+    std::string body;
+    for (size_t i = 0; i < fields.size(); i++) body += (i ? ", " : "") + fields[i];
+    module.namedTypes[name] = "{" + body + "}";
+    text("%" + name + " = type { " + body + " }\n");
+  }
+
+  // 函数可以嵌套定义，外层函数的构建状态先保存起来
+  void beginFunction(const std::string& retType, const std::string& name, const std::vector<Param>& params,
+                     const std::string& prefix = "", bool vararg = false) {
+    saved.push_back(std::move(state));
+    state = State();
+    module.functions.push_back(std::make_unique<IRFunction>(&module, name));
+    IRFunction* f = module.functions.back().get();
+    module.entries.push_back({"", f});
+    module.global(name);
+    f->retType = retType;
+    f->prefix = prefix;
+    f->vararg = vararg;
+    state.fn = f;
+    for (const auto& p : params) {
+      bool numbered = isNumbered(p.name);
+      f->args.push_back(std::make_unique<IRArgument>(p.type, numbered ? "" : p.name, p.attrs));
+      f->reserveName(numbered ? "" : p.name);
+      define(p.name, f->args.back().get());
+    }
+    state.cur = f->createBlock("");
+  }
+
+  void endFunction() {
+    if (!state.forward.empty()) fail("undefined value %" + state.forward.begin()->first);
+    for (const auto& b : state.blocks) {
+      if (!b.second.placed) fail("undefined label %" + b.first);
+    }
+    state = std::move(saved.back());
+    saved.pop_back();
+  }
+
+  IRFunction* function() const { return state.fn; }
+
+  // 开始名为name的基本块，之前跳转到它时建立的块移到当前位置
+  void label(const std::string& name) {
+    requireFunction();
+    auto& b = state.blocks[name];
+    if (!b.block) b.block = state.fn->createBlock(name);
+    else if (b.placed) fail("redefinition of label " + name);
+    auto& blocks = state.fn->blocks;
+    auto it = std::find_if(blocks.begin(), blocks.end(), [&](const std::unique_ptr<IRBasicBlock>& p) { return p.get() == b.block; });
+    std::rotate(it, it + 1, blocks.end());
+    b.placed = true;
+    state.cur = b.block;
+    state.terminated = false;
+  }
+
+  // 打开时指令放到入口块开头已有的这类指令之后（栈槽等只在入口分配一次的东西）
+  void setEntryInsert(bool on) { state.atEntry = on; }
+
+  // 在before之前插入之后的指令，before为空时回到当前块末尾
+  void setInsertBefore(IRInstruction* before) { state.before = before; }
+
+  void allocate(const std::string& result, const std::string& type, int align = 0) {
+    IRInstruction* i = create(IROp::Alloca, type + "*", result);
+    i->elemType = type;
+    i->align = align;
+  }
+
+  void load(const std::string& result, const std::string& type, const std::string& ptr, int align = 0) {
+    IRInstruction* i = create(IROp::Load, type, result);
+    i->elemType = type;
+    i->addOperand(value(ptr, type + "*"));
+    i->align = align;
+  }
+
+  void store(const std::string& type, const std::string& v, const std::string& ptr, int align = 0) {
+    IRInstruction* i = create(IROp::Store, "void", "");
+    i->addOperand(value(v, type));
+    i->addOperand(value(ptr, type + "*"));
+    i->align = align;
+  }
+
+  void binary(const std::string& result, IROp op, const std::string& type, const std::string& lhs, const std::string& rhs,
+              const std::string& flags = "") {
+    IRInstruction* i = create(op, type, result);
+    i->flags = flags;
+    i->addOperand(value(lhs, type));
+    i->addOperand(value(rhs, type));
+  }
+
+  void icmp(const std::string& result, const std::string& pred, const std::string& type, const std::string& lhs,
+            const std::string& rhs) {
+    IRInstruction* i = create(IROp::ICmp, "i1", result);
+    i->pred = pred;
+    i->addOperand(value(lhs, type));
+    i->addOperand(value(rhs, type));
+  }
+
+  void cast(const std::string& result, IROp op, const std::string& from, const std::string& v, const std::string& to) {
+    IRInstruction* i = create(op, to, result);
+    i->addOperand(value(v, from));
+  }
+
+  // 第一个下标按指针走，之后的下标在elemType里逐层取元素或字段
+  void gep(const std::string& result, const std::string& elemType, const std::string& base, const std::vector<Index>& indices,
+           bool inbounds = true) {
+    IRInstruction* i = create(IROp::GetElementPtr, "", result);
+    i->flags = inbounds ? "inbounds" : "";
+    i->elemType = elemType;
+    i->addOperand(value(base, elemType + "*"));
+    std::string t = elemType;
+    for (size_t k = 0; k < indices.size(); k++) {
+      IRValue* idx = value(indices[k].value, indices[k].type);
+      i->addOperand(idx);
+      if (k > 0) {
+        int64_t n = idx->isConstant() && static_cast<IRConstant*>(idx)->isInt() ? static_cast<IRConstant*>(idx)->intValue() : 0;
+        t = module.elementType(t, n);
+      }
+    }
+    i->type = t + "*";
+  }
+
+  void extractValue(const std::string& result, const std::string& aggType, const std::string& agg, const std::vector<unsigned>& indices) {
+    IRInstruction* i = create(IROp::ExtractValue, "", result);
+    i->addOperand(value(agg, aggType));
+    std::string t = aggType;
+    for (unsigned k : indices) t = module.elementType(t, k);
+    i->indices = indices;
+    i->type = t;
+  }
+
+  void insertValue(const std::string& result, const std::string& aggType, const std::string& agg, const std::string& elemType,
+                   const std::string& elem, const std::vector<unsigned>& indices) {
+    IRInstruction* i = create(IROp::InsertValue, aggType, result);
+    i->addOperand(value(agg, aggType));
+    i->addOperand(value(elem, elemType));
+    i->indices = indices;
+  }
+
+  // calleeType是变参函数需要写出的函数类型，如 i32 (i8*, ...)
+  void call(const std::string& result, const std::string& retType, const std::string& callee, const std::vector<Arg>& args,
+            const std::string& calleeType = "", const std::string& flags = "") {
+    IRInstruction* i = create(IROp::Call, retType, retType == "void" ? "" : result);
+    i->calleeType = calleeType;
+    i->flags = flags;
+    i->addOperand(value(callee, ""));
+    for (const auto& a : args) {
+      i->addOperand(value(a.value, a.type));
+      i->argAttrs.push_back(a.attrs);
+    }
+  }
+
+  void select(const std::string& result, const std::string& cond, const std::string& type, const std::string& a, const std::string& b) {
+    IRInstruction* i = create(IROp::Select, type, result);
+    i->addOperand(value(cond, "i1"));
+    i->addOperand(value(a, type));
+    i->addOperand(value(b, type));
+  }
+
+  void phi(const std::string& result, const std::string& type, const std::vector<std::pair<std::string, std::string>>& incoming) {
+    IRInstruction* i = create(IROp::Phi, type, result);
+    for (const auto& in : incoming) i->addIncoming(value(in.first, type), block(in.second));
+  }
+
+  void br(const std::string& dest) {
+    IRInstruction* i = create(IROp::Br, "void", "");
+    i->addOperand(block(dest));
+  }
+
+  void condBr(const std::string& cond, const std::string& ifTrue, const std::string& ifFalse) {
+    IRInstruction* i = create(IROp::CondBr, "void", "");
+    i->addOperand(value(cond, "i1"));
+    i->addOperand(block(ifTrue));
+    i->addOperand(block(ifFalse));
+  }
+
+  void ret(const std::string& type, const std::string& v) {
+    IRInstruction* i = create(IROp::Ret, "void", "");
+    i->addOperand(value(v, type));
+  }
+
+  void retVoid() { create(IROp::Ret, "void", ""); }
+
+  void unreachable() { create(IROp::Unreachable, "void", ""); }
+
+ private:
+  struct Label {
+    IRBasicBlock* block = nullptr;
+    bool placed = false;
+  };
+  struct State {
+    IRFunction* fn = nullptr;
+    IRBasicBlock* cur = nullptr;
+    bool terminated = false;
+    bool atEntry = false;
+    IRInstruction* entryEnd = nullptr;  // 入口块开头最后一条setEntryInsert时放入的指令
+    IRInstruction* before = nullptr;
+    std::unordered_map<std::string, IRValue*> locals;
+    std::unordered_map<std::string, Label> blocks;
+    std::unordered_map<std::string, std::unique_ptr<IRValue>> forward;  // 先使用后定义的值
+  };
+
+  IRModule& module;
+  State state;
+  std::vector<State> saved;
+
+  [[noreturn]] static void fail(const std::string& msg) { throw std::runtime_error("IR builder: " + msg); }
+
+  static bool isNumbered(const std::string& n) { return !n.empty() && std::isdigit((unsigned char)n[0]); }
+
+  void requireFunction() const {
+    if (!state.fn) fail("instruction outside of a function");
+  }
+
+  void define(const std::string& n, IRValue* v) {
+    if (n.empty()) return;
+    if (state.locals.count(n)) fail("redefinition of %" + n);
+    state.locals[n] = v;
+    auto it = state.forward.find(n);
+    if (it != state.forward.end()) {
+      it->second->replaceAllUsesWith(v);
+      state.forward.erase(it);
+    }
+  }
+
+  IRValue* value(const std::string& tok, const std::string& type) {
+    if (tok.empty()) fail("missing operand of type " + type);
+    if (tok[0] == '%') {
+      std::string n = tok.substr(1);
+      auto it = state.locals.find(n);
+      if (it != state.locals.end()) return it->second;
+      auto& f = state.forward[n];
+      if (!f) f = std::make_unique<IRValue>(IRValue::Kind::Constant, type, tok);
+      return f.get();
+    }
+    if (tok[0] == '@') return module.global(tok.substr(1), type);
+    return module.constant(type, tok);
+  }
+
+  IRBasicBlock* block(const std::string& name) {
+    requireFunction();
+    auto& b = state.blocks[name];
+    if (!b.block) b.block = state.fn->createBlock(name);
+    return b.block;
+  }
+
+  // 终结指令之后没有标签的指令属于一个新的未命名块
+  IRInstruction* create(IROp op, const std::string& type, const std::string& result) {
+    requireFunction();
+    IRInstruction* i = state.fn->createInst(op, type, isNumbered(result) ? "" : result);
+    if (state.atEntry) {
+      IRBasicBlock* entry = state.fn->entry();
+      entry->insertBefore(state.entryEnd ? state.entryEnd->next : entry->first, i);
+      state.entryEnd = i;
+    } else if (state.before) {
+      state.before->parent->insertBefore(state.before, i);
+    } else {
+      if (state.terminated) {
+        state.cur = state.fn->createBlock("");
+        state.terminated = false;
+      }
+      state.cur->append(i);
+      state.terminated = i->isTerminator();
+    }
+    define(result, i);
+    return i;
+  }
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef IR_DCE_HPP
+#define IR_DCE_HPP
+
+#include <unordered_set>
+#include <vector>
+#include "ir_module.hpp"
+
+// 死代码删除和CFG化简：删掉不可达块、结果没人用的无副作用指令、只写不读的栈槽，
+// 合并只有一条边相连的块，跳过只含一条br的空块
+class DeadCodeElimination {
+ public:
+  explicit DeadCodeElimination(IRFunction& f) : fn(f), module(*f.parent) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    bool changed = false;
+    bool again = true;
+    while (again) {
+      again = false;
+      again |= removeUnreachableBlocks();
+      again |= removeDeadInstructions();
+      again |= simplifyCFG();
+      changed |= again;
+    }
+    return changed;
+  }
+
+ private:
+  IRFunction& fn;
+  IRModule& module;
+
+  static void removePhiIncoming(IRBasicBlock* bb, IRBasicBlock* pred) {
+    for (IRInstruction* i = bb->first; i && i->op == IROp::Phi; i = i->next) {
+      for (unsigned k = 0; k < i->numIncoming(); k++) {
+        if (i->incomingBlock(k) == pred) {
+          i->removeIncoming(k);
+          break;
+        }
+      }
+    }
+  }
+
+  bool removeUnreachableBlocks() {
+    std::unordered_set<IRBasicBlock*> reachable;
+    std::vector<IRBasicBlock*> work{fn.entry()};
+    reachable.insert(fn.entry());
+    while (!work.empty()) {
+      IRBasicBlock* bb = work.back();
+      work.pop_back();
+      for (IRBasicBlock* s : bb->successors()) {
+        if (reachable.insert(s).second) work.push_back(s);
+      }
+    }
+    std::vector<IRBasicBlock*> dead;
+    for (const auto& bb : fn.blocks) {
+      if (!reachable.count(bb.get())) dead.push_back(bb.get());
+    }
+    if (dead.empty()) return false;
+    for (IRBasicBlock* bb : dead) {
+      for (IRBasicBlock* s : bb->successors()) {
+        if (reachable.count(s)) removePhiIncoming(s, bb);
+      }
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->hasResult()) i->replaceAllUsesWith(module.constant(i->type, "undef"));
+      }
+    }
+    for (IRBasicBlock* bb : dead) fn.removeBlock(bb);
+    return true;
+  }
+
+  static bool hasSideEffects(const IRInstruction* i) {
+    switch (i->op) {
+      case IROp::Store:
+      case IROp::Call:
+      case IROp::Br:
+      case IROp::CondBr:
+      case IROp::Ret:
+      case IROp::Unreachable:
+        return true;
+      // 除零会陷入，除数不是非零常量时保留
+      case IROp::SDiv:
+      case IROp::UDiv:
+      case IROp::SRem:
+      case IROp::URem: {
+        const IRValue* d = i->operands[1];
+        return !(d->isConstant() && static_cast<const IRConstant*>(d)->isInt() && static_cast<const IRConstant*>(d)->intValue() != 0);
+      }
+      default:
+        return false;
+    }
+  }
+
+  // 只被store写入（作为地址）、从来不被读的alloca
+  static bool writeOnly(const IRInstruction* a) {
+    for (const auto& u : a->uses) {
+      if (u.user->op != IROp::Store || u.index != 1) return false;
+    }
+    return true;
+  }
+
+  bool removeDeadInstructions() {
+    std::vector<IRInstruction*> deadStores;
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op == IROp::Alloca && !i->uses.empty() && writeOnly(i)) {
+          for (const auto& u : i->uses) deadStores.push_back(u.user);
+        }
+      }
+    }
+    for (IRInstruction* s : deadStores) fn.erase(s);
+
+    // 从有副作用的指令出发沿操作数标记活跃，其余的都删掉
+    std::unordered_set<const IRInstruction*> live;
+    std::vector<IRInstruction*> work;
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (hasSideEffects(i) && live.insert(i).second) work.push_back(i);
+      }
+    }
+    while (!work.empty()) {
+      IRInstruction* i = work.back();
+      work.pop_back();
+      for (IRValue* op : i->operands) {
+        if (!op->isInstruction()) continue;
+        auto* def = static_cast<IRInstruction*>(op);
+        if (live.insert(def).second) work.push_back(def);
+      }
+    }
+    std::vector<IRInstruction*> dead;
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (!live.count(i)) dead.push_back(i);
+      }
+    }
+    // 死指令之间可能互相引用（如循环中的phi），先全部断开再删除
+    for (IRInstruction* i : dead) i->dropOperands();
+    for (IRInstruction* i : dead) fn.erase(i);
+    return !dead.empty() || !deadStores.empty();
+  }
+
+  static bool hasPhi(const IRBasicBlock* bb) { return bb->first && bb->first->op == IROp::Phi; }
+
+  static unsigned edgesTo(const IRInstruction* term, const IRBasicBlock* bb) {
+    unsigned n = 0;
+    for (const IRValue* op : term->operands) n += op == bb;
+    return n;
+  }
+
+  static IRValue* incomingFor(const IRInstruction* phi, const IRBasicBlock* pred) {
+    for (unsigned k = 0; k < phi->numIncoming(); k++) {
+      if (phi->incomingBlock(k) == pred) return phi->incomingValue(k);
+    }
+    return nullptr;
+  }
+
+  void replaceTerminator(IRBasicBlock* bb, IRBasicBlock* target) {
+    IRInstruction* term = bb->terminator();
+    IRInstruction* br = fn.createInst(IROp::Br, "void");
+    br->addOperand(target);
+    bb->insertBefore(term, br);
+    fn.erase(term);
+  }
+
+  bool simplifyCFG() {
+    bool changed = false;
+    for (size_t b = 0; b < fn.blocks.size(); b++) {
+      IRBasicBlock* bb = fn.blocks[b].get();
+      IRInstruction* term = bb->terminator();
+      if (!term) continue;
+
+      // 条件恒定或两个目标相同的条件跳转
+      if (term->op == IROp::CondBr) {
+        auto* t = static_cast<IRBasicBlock*>(term->operands[1]);
+        auto* f = static_cast<IRBasicBlock*>(term->operands[2]);
+        const IRValue* c = term->operands[0];
+        if (t == f) {
+          removePhiIncoming(t, bb);
+          replaceTerminator(bb, t);
+          changed = true;
+        } else if (c->isConstant() && static_cast<const IRConstant*>(c)->isInt()) {
+          bool taken = static_cast<const IRConstant*>(c)->intValue() != 0;
+          removePhiIncoming(taken ? f : t, bb);
+          replaceTerminator(bb, taken ? t : f);
+          changed = true;
+        }
+        continue;
+      }
+      if (term->op != IROp::Br) continue;
+      auto* succ = static_cast<IRBasicBlock*>(term->operands[0]);
+      if (succ == bb) continue;
+
+      // 后继只有这一个前驱：把后继并到当前块
+      auto succPreds = succ->predecessors();
+      if (succPreds.size() == 1 && edgesTo(term, succ) == 1 && succ != fn.entry()) {
+        while (hasPhi(succ)) {
+          IRInstruction* phi = succ->first;
+          phi->replaceAllUsesWith(phi->numIncoming() ? phi->incomingValue(0) : module.constant(phi->type, "undef"));
+          fn.erase(phi);
+        }
+        fn.erase(term);
+        while (succ->first) {
+          IRInstruction* i = succ->first;
+          succ->unlink(i);
+          bb->append(i);
+        }
+        succ->replaceAllUsesWith(bb);
+        fn.removeBlock(succ);
+        changed = true;
+        b--;  // 合并后当前块的终结指令变了，重新处理
+        continue;
+      }
+
+      // 当前块只有一条br：让前驱直接跳到后继
+      if (bb != fn.entry() && bb->first == term && forwardEmptyBlock(bb, succ)) {
+        changed = true;
+        b--;
+      }
+    }
+    return changed;
+  }
+
+  bool forwardEmptyBlock(IRBasicBlock* bb, IRBasicBlock* succ) {
+    bool redirected = false;
+    for (IRBasicBlock* pred : bb->predecessors()) {
+      IRInstruction* pterm = pred->terminator();
+      if (edgesTo(pterm, bb) != 1) continue;
+      bool alreadyPred = edgesTo(pterm, succ) != 0;
+      if (alreadyPred) {
+        // pred同时跳到succ：只有succ的phi在两条边上取值相同时才能合并
+        bool same = true;
+        for (IRInstruction* i = succ->first; i && i->op == IROp::Phi; i = i->next) {
+          same = same && incomingFor(i, bb) == incomingFor(i, pred);
+        }
+        if (!same) continue;
+      }
+      // phi的入边按CFG的边计算，pred到succ多了一条边就多一个入边
+      for (IRInstruction* i = succ->first; i && i->op == IROp::Phi; i = i->next) {
+        i->addIncoming(incomingFor(i, bb), pred);
+      }
+      for (unsigned k = 0; k < pterm->operands.size(); k++) {
+        if (pterm->operands[k] == bb) pterm->setOperand(k, succ);
+      }
+      redirected = true;
+    }
+    if (!redirected) return false;
+    if (bb->predecessors().empty()) {
+      removePhiIncoming(succ, bb);
+      fn.removeBlock(bb);
+    }
+    return true;
+  }
+};
+
+inline bool eliminateDeadCode(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= DeadCodeElimination(*f).run();
+  return changed;
+}
+
+#endif
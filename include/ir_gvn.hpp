@@ -0,0 +1,251 @@
+#ifndef IR_GVN_HPP
+#define IR_GVN_HPP
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir_analysis.hpp"
+
+// 指针指向的对象：沿gep/bitcast找到最底下的指针，并判断局部栈槽是否逃逸
+class PointerInfo {
+ public:
+  explicit PointerInfo(const IRFunction& f) {
+    for (const auto& bb : f.blocks) {
+      for (const IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op == IROp::Alloca && escapes(i)) escaped.insert(i);
+      }
+    }
+  }
+
+  static const IRValue* root(const IRValue* p) {
+    while (p->isInstruction()) {
+      auto* i = static_cast<const IRInstruction*>(p);
+      if (i->op != IROp::GetElementPtr && i->op != IROp::BitCast) break;
+      p = i->operands[0];
+    }
+    return p;
+  }
+
+  static bool isAlloca(const IRValue* v) {
+    return v->isInstruction() && static_cast<const IRInstruction*>(v)->op == IROp::Alloca;
+  }
+
+  // llvm.memcpy/llvm.memset：只写第一个指针实参指向的内存，指针实参不会被保存下来
+  static bool isMemoryIntrinsic(const IRInstruction* i) {
+    if (i->op != IROp::Call || i->operands[0]->kind != IRValue::Kind::Global) return false;
+    const std::string& name = i->operands[0]->name;
+    return name.rfind("llvm.memcpy.", 0) == 0 || name.rfind("llvm.memset.", 0) == 0;
+  }
+
+  // 调用可能写入p指向的内存
+  bool callMayWrite(const IRInstruction* call, const IRValue* p) const {
+    if (isMemoryIntrinsic(call)) return mayAlias(root(call->operands[1]), root(p));
+    return !isLocal(p);
+  }
+
+  // 地址没有传出函数的栈槽，调用不会读写它
+  bool isLocal(const IRValue* p) const {
+    const IRValue* r = root(p);
+    return isAlloca(r) && !escaped.count(r);
+  }
+
+  bool mayAlias(const IRValue* a, const IRValue* b) const {
+    if (a == b) return true;
+    const IRValue* ra = root(a);
+    const IRValue* rb = root(b);
+    if (ra != rb) {
+      // 不同的栈槽、栈槽和全局变量、不同的全局变量互不重叠；地址传出去的栈槽可能
+      // 经过phi、load、call的结果等其他指针访问，只有没传出去的栈槽和它们不重叠
+      bool aa = isAlloca(ra), ab = isAlloca(rb);
+      bool ga = ra->kind == IRValue::Kind::Global, gb = rb->kind == IRValue::Kind::Global;
+      if ((aa || ga) && (ab || gb)) return false;
+      if ((aa && !escaped.count(ra)) || (ab && !escaped.count(rb))) return false;
+      return true;
+    }
+    // 同一个基址上下标全是常量且不同的两个gep
+    if (!a->isInstruction() || !b->isInstruction()) return true;
+    auto* ga = static_cast<const IRInstruction*>(a);
+    auto* gb = static_cast<const IRInstruction*>(b);
+    if (ga->op != IROp::GetElementPtr || gb->op != IROp::GetElementPtr) return true;
+    if (ga->operands[0] != gb->operands[0] || ga->elemType != gb->elemType || ga->operands.size() != gb->operands.size()) return true;
+    for (size_t k = 1; k < ga->operands.size(); k++) {
+      auto* x = ga->operands[k];
+      auto* y = gb->operands[k];
+      if (!x->isConstant() || !y->isConstant()) return true;
+      if (!static_cast<const IRConstant*>(x)->isInt() || !static_cast<const IRConstant*>(y)->isInt()) return true;
+      if (static_cast<const IRConstant*>(x)->intValue() != static_cast<const IRConstant*>(y)->intValue()) return false;
+    }
+    return true;
+  }
+
+ private:
+  std::unordered_set<const IRValue*> escaped;
+
+  static bool escapes(const IRInstruction* p) {
+    for (const auto& u : p->uses) {
+      const IRInstruction* user = u.user;
+      if (user->op == IROp::Load) continue;
+      if (user->op == IROp::Store && u.index == 1) continue;
+      if (isMemoryIntrinsic(user) && (u.index == 1 || u.index == 2)) continue;
+      if ((user->op == IROp::GetElementPtr && u.index == 0) || user->op == IROp::BitCast) {
+        if (escapes(user)) return true;
+        continue;
+      }
+      return true;
+    }
+    return false;
+  }
+};
+
+// 基于支配树的GVN：沿支配树先序遍历，表中记录支配当前位置的表达式，
+// 相同的纯运算、gep直接复用；load在没有可能重叠的写入时复用之前load/store的值
+class GVN {
+ public:
+  explicit GVN(IRFunction& f) : fn(f), pointers(f) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    DominatorTree dt(fn);
+    struct Frame {
+      IRBasicBlock* bb;
+      std::vector<std::pair<IRValue*, IRValue*>> memory;  // 进入块时可用的(地址, 值)
+      size_t scope = 0;  // 本块在scopeKeys中开始的位置，为0表示还没处理
+      bool entered = false;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({fn.entry(), {}, 0, false});
+    while (!stack.empty()) {
+      Frame& top = stack.back();
+      if (top.entered) {
+        // 离开这个块：撤销它加入的表达式
+        while (scopeKeys.size() > top.scope) {
+          auto it = table.find(scopeKeys.back());
+          it->second.pop_back();
+          if (it->second.empty()) table.erase(it);
+          scopeKeys.pop_back();
+        }
+        stack.pop_back();
+        continue;
+      }
+      top.entered = true;
+      top.scope = scopeKeys.size();
+      IRBasicBlock* bb = top.bb;
+      std::vector<std::pair<IRValue*, IRValue*>> memory = std::move(top.memory);
+      processBlock(bb, memory);
+      const auto& kids = dt.children(bb);
+      for (auto it = kids.rbegin(); it != kids.rend(); ++it) {
+        IRBasicBlock* child = *it;
+        // 只有唯一前驱就是本块时，块结束时的内存状态才能带进去
+        auto preds = child->predecessors();
+        bool inherit = preds.size() == 1 && preds[0] == bb;
+        stack.push_back({child, inherit ? memory : std::vector<std::pair<IRValue*, IRValue*>>{}, 0, false});
+      }
+    }
+    return changed;
+  }
+
+ private:
+  IRFunction& fn;
+  PointerInfo pointers;
+  std::unordered_map<std::string, std::vector<IRValue*>> table;
+  std::vector<std::string> scopeKeys;
+  bool changed = false;
+
+  static bool commutative(const IRInstruction* i) {
+    switch (i->op) {
+      case IROp::Add:
+      case IROp::Mul:
+      case IROp::And:
+      case IROp::Or:
+      case IROp::Xor:
+        return true;
+      case IROp::ICmp:
+        return i->pred == "eq" || i->pred == "ne";
+      default:
+        return false;
+    }
+  }
+
+  static bool numberable(const IRInstruction* i) {
+    return i->isBinary() || i->isCast() || i->op == IROp::ICmp || i->op == IROp::GetElementPtr ||
+           i->op == IROp::ExtractValue || i->op == IROp::InsertValue || i->op == IROp::Select || i->op == IROp::Phi;
+  }
+
+  static std::string key(const IRInstruction* i) {
+    std::vector<const IRValue*> ops(i->operands.begin(), i->operands.end());
+    if (commutative(i) && std::less<const IRValue*>()(ops[1], ops[0])) std::swap(ops[0], ops[1]);
+    std::string k = irOpName(i->op);
+    k += '|';
+    k += i->type;
+    k += '|';
+    k += i->pred;
+    k += '|';
+    k += i->flags;
+    k += '|';
+    k += i->elemType;
+    for (unsigned idx : i->indices) k += "," + std::to_string(idx);
+    // phi只能和同一个块中的phi合并
+    if (i->op == IROp::Phi) k += "@" + std::to_string((uintptr_t)i->parent);
+    for (const IRValue* v : ops) k += "|" + std::to_string((uintptr_t)v);
+    return k;
+  }
+
+  void replace(IRInstruction* i, IRValue* v) {
+    i->replaceAllUsesWith(v);
+    fn.erase(i);
+    changed = true;
+  }
+
+  void invalidate(std::vector<std::pair<IRValue*, IRValue*>>& memory, const IRValue* ptr) {
+    memory.erase(std::remove_if(memory.begin(), memory.end(),
+                                [&](const std::pair<IRValue*, IRValue*>& m) { return pointers.mayAlias(m.first, ptr); }),
+                 memory.end());
+  }
+
+  void processBlock(IRBasicBlock* bb, std::vector<std::pair<IRValue*, IRValue*>>& memory) {
+    for (IRInstruction* i = bb->first; i;) {
+      IRInstruction* next = i->next;
+      if (i->op == IROp::Load) {
+        IRValue* ptr = i->operands[0];
+        IRValue* known = nullptr;
+        for (const auto& m : memory) {
+          if (m.first == ptr && m.second->type == i->type) known = m.second;
+        }
+        if (known) {
+          replace(i, known);
+        } else {
+          memory.push_back({ptr, i});
+        }
+      } else if (i->op == IROp::Store) {
+        IRValue* ptr = i->operands[1];
+        invalidate(memory, ptr);
+        memory.push_back({ptr, i->operands[0]});
+      } else if (i->op == IROp::Call) {
+        // 调用可能读写任何逃逸出去的内存，memcpy/memset只写目标
+        memory.erase(std::remove_if(memory.begin(), memory.end(),
+                                    [&](const std::pair<IRValue*, IRValue*>& m) { return pointers.callMayWrite(i, m.first); }),
+                     memory.end());
+      } else if (numberable(i)) {
+        std::string k = key(i);
+        auto it = table.find(k);
+        if (it != table.end()) {
+          replace(i, it->second.back());
+        } else {
+          table[k].push_back(i);
+          scopeKeys.push_back(k);
+        }
+      }
+      i = next;
+    }
+  }
+};
+
+inline bool numberValues(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= GVN(*f).run();
+  return changed;
+}
+
+#endif
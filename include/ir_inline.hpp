@@ -0,0 +1,264 @@
+#ifndef IR_INLINE_HPP
+#define IR_INLINE_HPP
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir_module.hpp"
+
+// 函数内联：在调用图的强连通分量上自底向上处理，被调函数先完成内联再内联到调用者中
+// 代价是被调函数的指令数，同一个分量内（互相递归）的调用不内联
+class Inliner {
+ public:
+  // 被调函数指令数不超过这个值时内联；只有一个调用点时放宽，递归函数收紧
+  static constexpr unsigned threshold = 40;
+  static constexpr unsigned singleCallThreshold = 200;
+  static constexpr unsigned recursiveThreshold = 15;
+
+  explicit Inliner(IRModule& m) : module(m) {}
+
+  bool run() {
+    for (const auto& f : module.functions) {
+      if (inlinable(f.get())) byName[f->name] = f.get();
+    }
+    std::unordered_map<const IRFunction*, unsigned> callSites;
+    for (const auto& f : module.functions) {
+      for (IRInstruction* call : calls(f.get())) callSites[byName.at(call->operands[0]->name)]++;
+    }
+    bool changed = false;
+    for (const auto& scc : stronglyConnectedComponents()) {
+      std::unordered_set<const IRFunction*> members(scc.begin(), scc.end());
+      for (IRFunction* caller : scc) {
+        for (IRInstruction* call : calls(caller)) {
+          IRFunction* callee = byName.at(call->operands[0]->name);
+          if (members.count(callee)) continue;
+          unsigned limit = callSites[callee] == 1 ? singleCallThreshold : threshold;
+          if (recursive.count(callee)) limit = recursiveThreshold;
+          if (size(callee) > limit) continue;
+          inlineCall(caller, call, callee);
+          foldAggregates(caller);
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+
+ private:
+  IRModule& module;
+  std::unordered_map<std::string, IRFunction*> byName;  // 能作为被调函数内联的函数
+  std::unordered_set<const IRFunction*> recursive;
+
+  static bool inlinable(const IRFunction* f) {
+    return f->entry() && !f->vararg && f->name != "main";
+  }
+
+  static unsigned size(const IRFunction* f) {
+    unsigned n = 0;
+    for (const auto& bb : f->blocks) {
+      for (const IRInstruction* i = bb->first; i; i = i->next) n += i->op != IROp::Alloca;
+    }
+    return n;
+  }
+
+  // f中调用模块内可内联函数的call
+  std::vector<IRInstruction*> calls(const IRFunction* f) const {
+    std::vector<IRInstruction*> result;
+    for (const auto& bb : f->blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op != IROp::Call || i->operands[0]->kind != IRValue::Kind::Global) continue;
+        auto it = byName.find(i->operands[0]->name);
+        if (it == byName.end() || it->second->args.size() + 1 != i->operands.size()) continue;
+        result.push_back(i);
+      }
+    }
+    return result;
+  }
+
+  // Tarjan算法，分量按被调者在前的顺序给出
+  std::vector<std::vector<IRFunction*>> stronglyConnectedComponents() {
+    std::vector<std::vector<IRFunction*>> result;
+    std::unordered_map<const IRFunction*, unsigned> index, low;
+    std::unordered_set<const IRFunction*> onStack;
+    std::vector<IRFunction*> stack;
+    unsigned counter = 0;
+    struct Frame {
+      IRFunction* f;
+      std::vector<IRFunction*> succs;
+      size_t next;
+    };
+    for (const auto& root : module.functions) {
+      if (index.count(root.get())) continue;
+      std::vector<Frame> frames;
+      auto push = [&](IRFunction* f) {
+        index[f] = low[f] = counter++;
+        stack.push_back(f);
+        onStack.insert(f);
+        std::vector<IRFunction*> succs;
+        for (IRInstruction* call : calls(f)) {
+          IRFunction* callee = byName.at(call->operands[0]->name);
+          if (callee == f) recursive.insert(f);
+          succs.push_back(callee);
+        }
+        frames.push_back({f, std::move(succs), 0});
+      };
+      push(root.get());
+      while (!frames.empty()) {
+        Frame& top = frames.back();
+        if (top.next < top.succs.size()) {
+          IRFunction* s = top.succs[top.next++];
+          if (!index.count(s)) {
+            push(s);
+          } else if (onStack.count(s)) {
+            low[top.f] = std::min(low[top.f], index[s]);
+          }
+          continue;
+        }
+        IRFunction* f = top.f;
+        frames.pop_back();
+        if (!frames.empty()) low[frames.back().f] = std::min(low[frames.back().f], low[f]);
+        if (low[f] != index[f]) continue;
+        std::vector<IRFunction*> scc;
+        IRFunction* x;
+        do {
+          x = stack.back();
+          stack.pop_back();
+          onStack.erase(x);
+          scc.push_back(x);
+        } while (x != f);
+        if (scc.size() > 1) recursive.insert(scc.begin(), scc.end());
+        result.push_back(std::move(scc));
+      }
+    }
+    return result;
+  }
+
+  void inlineCall(IRFunction* caller, IRInstruction* call, IRFunction* callee) {
+    IRBasicBlock* bb = call->parent;
+    // 内联进来的块以被调函数名为前缀，去掉名字中需要加引号的字符
+    std::string prefix;
+    for (char c : callee->name) {
+      if (c != '"') prefix += (std::isalnum((unsigned char)c) || c == '_' || c == '.') ? c : '_';
+    }
+    prefix += ".";
+
+    // 在call之后把块切开，call之后的指令放到cont中
+    IRBasicBlock* after = nullptr;
+    for (size_t k = 0; k + 1 < caller->blocks.size(); k++) {
+      if (caller->blocks[k].get() == bb) after = caller->blocks[k + 1].get();
+    }
+    IRBasicBlock* cont = caller->createBlock(caller->uniqueName(prefix + "exit"), after);
+    for (IRBasicBlock* s : bb->successors()) {
+      for (IRInstruction* phi = s->first; phi && phi->op == IROp::Phi; phi = phi->next) {
+        for (unsigned k = 0; k < phi->numIncoming(); k++) {
+          if (phi->incomingBlock(k) == bb) phi->setOperand(2 * k + 1, cont);
+        }
+      }
+    }
+    while (call->next) {
+      IRInstruction* i = call->next;
+      bb->unlink(i);
+      cont->append(i);
+    }
+
+    // 先建好所有块和指令，再填操作数，phi和分支可以引用后面的块
+    std::unordered_map<const IRValue*, IRValue*> map;
+    for (size_t k = 0; k < callee->args.size(); k++) map[callee->args[k].get()] = call->operands[k + 1];
+    std::vector<std::pair<IRInstruction*, IRInstruction*>> clones;
+    for (const auto& block : callee->blocks) {
+      IRBasicBlock* copy = caller->createBlock(caller->uniqueName(prefix + (block->name.empty() ? "entry" : block->name)), cont);
+      map[block.get()] = copy;
+      for (IRInstruction* i = block->first; i; i = i->next) {
+        IRInstruction* c = caller->createInst(i->op, i->type, i->name.empty() ? "" : caller->uniqueName(i->name));
+        c->pred = i->pred;
+        c->elemType = i->elemType;
+        c->indices = i->indices;
+        c->calleeType = i->calleeType;
+        c->argAttrs = i->argAttrs;
+        c->flags = i->flags;
+        c->tail = false;
+        c->align = i->align;
+        copy->append(c);
+        map[i] = c;
+        clones.push_back({i, c});
+      }
+    }
+    std::vector<std::pair<IRValue*, IRBasicBlock*>> returns;
+    for (auto& [orig, c] : clones) {
+      for (IRValue* op : orig->operands) {
+        auto it = map.find(op);
+        c->addOperand(it == map.end() ? op : it->second);
+      }
+      if (c->op == IROp::Ret) {
+        // ret改成跳到cont
+        IRBasicBlock* from = c->parent;
+        if (!c->operands.empty()) returns.push_back({c->operands[0], from});
+        IRInstruction* br = caller->createInst(IROp::Br, "void");
+        br->addOperand(cont);
+        from->insertBefore(c, br);
+        caller->erase(c);
+      }
+    }
+
+    // 被调函数入口块的栈槽放到调用者的入口块
+    auto* entryCopy = static_cast<IRBasicBlock*>(map.at(callee->entry()));
+    IRBasicBlock* callerEntry = caller->entry();
+    for (IRInstruction* i = entryCopy->first; i;) {
+      IRInstruction* next = i->next;
+      if (i->op == IROp::Alloca) {
+        entryCopy->unlink(i);
+        callerEntry->insertBefore(callerEntry->first, i);
+      }
+      i = next;
+    }
+
+    if (call->hasResult()) {
+      IRValue* result;
+      if (returns.size() == 1) {
+        result = returns[0].first;
+      } else if (returns.empty()) {
+        result = module.constant(call->type, "undef");
+      } else {
+        IRInstruction* phi = caller->createInst(IROp::Phi, call->type, call->name.empty() ? "" : caller->uniqueName(call->name));
+        for (auto& [v, from] : returns) phi->addIncoming(v, from);
+        cont->insertBefore(cont->first, phi);
+        result = phi;
+      }
+      call->replaceAllUsesWith(result);
+    }
+    caller->erase(call);
+    IRInstruction* br = caller->createInst(IROp::Br, "void");
+    br->addOperand(entryCopy);
+    bb->append(br);
+  }
+
+  // 按字段展开传参后，被调函数用insertvalue重建结构体再取字段，内联后直接取插入的值
+  void foldAggregates(IRFunction* f) {
+    for (const auto& bb : f->blocks) {
+      for (IRInstruction* i = bb->first; i;) {
+        IRInstruction* next = i->next;
+        if (i->op == IROp::ExtractValue && i->indices.size() == 1) {
+          IRValue* agg = i->operands[0];
+          while (agg->isInstruction()) {
+            auto* ins = static_cast<IRInstruction*>(agg);
+            if (ins->op != IROp::InsertValue || ins->indices.size() != 1) break;
+            if (ins->indices[0] == i->indices[0]) {
+              i->replaceAllUsesWith(ins->operands[1]);
+              f->erase(i);
+              break;
+            }
+            agg = ins->operands[0];
+          }
+        }
+        i = next;
+      }
+    }
+  }
+};
+
+inline bool inlineFunctions(IRModule& m) {
+  return Inliner(m).run();
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef IR_LICM_HPP
+#define IR_LICM_HPP
+
+#include <vector>
+#include "ir_analysis.hpp"
+#include "ir_gvn.hpp"
+
+// 循环不变量外提：给每个自然循环准备一个preheader，把操作数都在循环外定义的纯运算
+// 以及循环中没有可能重叠的写入的load移到preheader中。内层循环先处理，提出来的指令
+// 在处理外层循环时还可以继续往外提
+class LICM {
+ public:
+  explicit LICM(IRFunction& f) : fn(f), pointers(f) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    DominatorTree dt(fn);
+    std::vector<IRLoop> loops = findLoops(dt);
+    bool changed = false;
+    for (size_t k = 0; k < loops.size(); k++) {
+      IRLoop& loop = loops[k];
+      if (!canHoistFrom(loop)) continue;
+      IRBasicBlock* pre = preheader(loop);
+      if (!pre) continue;
+      // 新建的preheader属于所有外层循环
+      for (size_t o = k + 1; o < loops.size(); o++) {
+        if (loops[o].contains(loop.header)) loops[o].blocks.insert(pre);
+      }
+      changed |= hoist(loop, pre);
+    }
+    return changed;
+  }
+
+ private:
+  IRFunction& fn;
+  PointerInfo pointers;
+
+  // 循环头的phi要求入边都来自已知块，循环内的块都要有终结指令
+  bool canHoistFrom(const IRLoop& loop) const {
+    for (IRBasicBlock* bb : loop.blocks) {
+      if (!bb->terminator()) return false;
+    }
+    return loop.header != fn.entry();
+  }
+
+  // 唯一的循环外前驱且它只跳到循环头时直接用它，否则在循环头前插一个新块
+  IRBasicBlock* preheader(IRLoop& loop) {
+    std::vector<IRBasicBlock*> outside;
+    for (IRBasicBlock* p : loop.header->predecessors()) {
+      if (!loop.contains(p)) outside.push_back(p);
+    }
+    if (outside.empty()) return nullptr;
+    if (outside.size() == 1 && outside[0]->terminator()->op == IROp::Br) return outside[0];
+
+    IRBasicBlock* pre = fn.createBlock(fn.uniqueName(loop.header->name.empty() ? "preheader" : loop.header->name + ".preheader"), loop.header);
+    for (IRInstruction* phi = loop.header->first; phi && phi->op == IROp::Phi; phi = phi->next) {
+      // 来自循环外的入边合并成preheader中的一个phi
+      IRInstruction* merged = fn.createInst(IROp::Phi, phi->type, fn.uniqueName(phi->name.empty() ? "phi" : phi->name));
+      for (unsigned k = 0; k < phi->numIncoming();) {
+        if (loop.contains(phi->incomingBlock(k))) {
+          k++;
+          continue;
+        }
+        merged->addIncoming(phi->incomingValue(k), phi->incomingBlock(k));
+        phi->removeIncoming(k);
+      }
+      pre->append(merged);
+      phi->addIncoming(merged, pre);
+    }
+    for (IRBasicBlock* p : outside) {
+      IRInstruction* term = p->terminator();
+      for (unsigned k = 0; k < term->operands.size(); k++) {
+        if (term->operands[k] == loop.header) term->setOperand(k, pre);
+      }
+    }
+    IRInstruction* br = fn.createInst(IROp::Br, "void");
+    br->addOperand(loop.header);
+    pre->append(br);
+    return pre;
+  }
+
+  // 执行它不会出错，可以放到可能不执行它的位置
+  static bool speculatable(const IRInstruction* i) {
+    switch (i->op) {
+      case IROp::SDiv:
+      case IROp::UDiv:
+      case IROp::SRem:
+      case IROp::URem: {
+        const IRValue* d = i->operands[1];
+        if (!d->isConstant() || !static_cast<const IRConstant*>(d)->isInt()) return false;
+        int64_t v = static_cast<const IRConstant*>(d)->intValue();
+        return v != 0 && v != -1;
+      }
+      case IROp::Phi:
+      case IROp::Alloca:
+      case IROp::Load:
+        return false;
+      default:
+        return i->isBinary() || i->isCast() || i->op == IROp::ICmp || i->op == IROp::GetElementPtr ||
+               i->op == IROp::ExtractValue || i->op == IROp::InsertValue || i->op == IROp::Select;
+    }
+  }
+
+  // 地址是栈槽、参数或全局变量本身，或者只经过常量下标的gep得到
+  static bool dereferenceable(const IRValue* p) {
+    while (p->isInstruction()) {
+      auto* i = static_cast<const IRInstruction*>(p);
+      if (i->op == IROp::Alloca) return true;
+      if (i->op == IROp::BitCast) return false;
+      if (i->op != IROp::GetElementPtr) return false;
+      for (size_t k = 1; k < i->operands.size(); k++) {
+        const IRValue* idx = i->operands[k];
+        if (!idx->isConstant() || !static_cast<const IRConstant*>(idx)->isInt()) return false;
+        if (static_cast<const IRConstant*>(idx)->intValue() < 0) return false;
+      }
+      p = i->operands[0];
+    }
+    return p->kind == IRValue::Kind::Argument || p->kind == IRValue::Kind::Global;
+  }
+
+  bool invariantLoad(const IRLoop& loop, const IRInstruction* load) const {
+    const IRValue* ptr = load->operands[0];
+    if (!dereferenceable(ptr)) return false;
+    for (IRBasicBlock* bb : loop.blocks) {
+      for (const IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op == IROp::Store && pointers.mayAlias(i->operands[1], ptr)) return false;
+        if (i->op == IROp::Call && pointers.callMayWrite(i, ptr)) return false;
+      }
+    }
+    return true;
+  }
+
+  bool hoist(const IRLoop& loop, IRBasicBlock* pre) {
+    bool changed = false;
+    bool again = true;
+    while (again) {
+      again = false;
+      // 只有操作数都已经在循环外的指令才会外提，所以定义总是先于使用者放进preheader
+      for (const auto& block : fn.blocks) {
+        IRBasicBlock* bb = block.get();
+        if (!loop.contains(bb) || bb == pre) continue;
+        for (IRInstruction* i = bb->first; i;) {
+          IRInstruction* next = i->next;
+          bool invariant = true;
+          for (const IRValue* op : i->operands) invariant = invariant && !loop.contains(op);
+          if (invariant && (speculatable(i) || (i->op == IROp::Load && invariantLoad(loop, i)))) {
+            bb->unlink(i);
+            pre->insertBefore(pre->terminator(), i);
+            again = changed = true;
+          }
+          i = next;
+        }
+      }
+    }
+    return changed;
+  }
+};
+
+inline bool hoistLoopInvariants(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= LICM(*f).run();
+  return changed;
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef IR_MEM2REG_HPP
+#define IR_MEM2REG_HPP
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir_analysis.hpp"
+
+// mem2reg：把只被整体load/store的alloca提升成SSA值
+// 在迭代支配边界上插phi（只插在变量活跃的块），再沿CFG重命名
+class Mem2Reg {
+ public:
+  explicit Mem2Reg(IRFunction& f) : fn(f), module(*f.parent) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op == IROp::Alloca && promotable(i)) {
+          index[i] = (unsigned)allocas.size();
+          allocas.push_back(i);
+        }
+      }
+    }
+    if (allocas.empty()) return false;
+    DominatorTree dt(fn);
+    for (unsigned k = 0; k < allocas.size(); k++) insertPhis(dt, k);
+    rename();
+    cleanup(dt);
+    return true;
+  }
+
+ private:
+  IRFunction& fn;
+  IRModule& module;
+  std::vector<IRInstruction*> allocas;
+  std::unordered_map<const IRValue*, unsigned> index;
+  std::unordered_map<const IRInstruction*, unsigned> phiOwner;  // 新插入的phi属于哪个alloca
+  std::vector<IRInstruction*> phis;
+
+  // 只能作为load的地址、store的目标地址使用，且读写的类型与分配的类型一致
+  static bool promotable(const IRInstruction* a) {
+    for (const auto& u : a->uses) {
+      const IRInstruction* user = u.user;
+      if (user->op == IROp::Load) {
+        if (user->type != a->elemType) return false;
+      } else if (user->op == IROp::Store) {
+        if (u.index != 1 || user->operands[0]->type != a->elemType) return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void insertPhis(DominatorTree& dt, unsigned k) {
+    IRInstruction* a = allocas[k];
+    // alloca本身相当于写入了undef
+    std::unordered_set<IRBasicBlock*> defs;
+    if (dt.reachable(a->parent)) defs.insert(a->parent);
+    for (const auto& u : a->uses) {
+      if (u.user->op == IROp::Store && dt.reachable(u.user->parent)) defs.insert(u.user->parent);
+    }
+
+    // 活跃入口：块中在任何store之前先load了该变量，再沿前驱向上传播
+    std::unordered_set<IRBasicBlock*> liveIn;
+    std::vector<IRBasicBlock*> work;
+    for (const auto& u : a->uses) {
+      IRBasicBlock* bb = u.user->parent;
+      if (u.user->op != IROp::Load || !dt.reachable(bb) || liveIn.count(bb)) continue;
+      if (defs.count(bb)) {
+        bool storedFirst = false;
+        for (IRInstruction* i = bb->first; i && i != u.user; i = i->next) {
+          if (i == a || (i->op == IROp::Store && i->operands[1] == a)) {
+            storedFirst = true;
+            break;
+          }
+        }
+        if (storedFirst) continue;
+      }
+      liveIn.insert(bb);
+      work.push_back(bb);
+    }
+    while (!work.empty()) {
+      IRBasicBlock* bb = work.back();
+      work.pop_back();
+      for (IRBasicBlock* p : bb->predecessors()) {
+        if (!dt.reachable(p) || defs.count(p) || liveIn.count(p)) continue;
+        liveIn.insert(p);
+        work.push_back(p);
+      }
+    }
+
+    // 按块的顺序处理，保证插入的phi及其名字每次都一样
+    std::unordered_set<IRBasicBlock*> hasPhi;
+    work.clear();
+    for (auto it = fn.blocks.rbegin(); it != fn.blocks.rend(); ++it) {
+      if (defs.count(it->get())) work.push_back(it->get());
+    }
+    while (!work.empty()) {
+      IRBasicBlock* bb = work.back();
+      work.pop_back();
+      for (IRBasicBlock* y : dt.frontier(bb)) {
+        if (hasPhi.count(y) || !liveIn.count(y)) continue;
+        hasPhi.insert(y);
+        IRInstruction* phi = fn.createInst(IROp::Phi, a->elemType, fn.uniqueName(a->name.empty() ? "phi" : a->name));
+        y->insertBefore(y->first, phi);
+        phiOwner[phi] = k;
+        phis.push_back(phi);
+        if (!defs.count(y)) work.push_back(y);
+      }
+    }
+  }
+
+  IRValue* undef(const std::string& type) { return module.constant(type, "undef"); }
+
+  void rename() {
+    struct Item {
+      IRBasicBlock* bb;
+      IRBasicBlock* pred;
+      std::vector<IRValue*> values;
+    };
+    std::vector<IRValue*> init(allocas.size());
+    for (unsigned k = 0; k < allocas.size(); k++) init[k] = undef(allocas[k]->elemType);
+    std::unordered_set<IRBasicBlock*> visited;
+    std::vector<Item> work;
+    work.push_back({fn.entry(), nullptr, init});
+    while (!work.empty()) {
+      Item item = std::move(work.back());
+      work.pop_back();
+      IRBasicBlock* bb = item.bb;
+      auto& values = item.values;
+      // 先给本块的phi补上来自pred的入边
+      if (item.pred) {
+        for (IRInstruction* i = bb->first; i && i->op == IROp::Phi; i = i->next) {
+          auto it = phiOwner.find(i);
+          if (it != phiOwner.end()) i->addIncoming(values[it->second], item.pred);
+        }
+      }
+      if (!visited.insert(bb).second) continue;
+      for (IRInstruction* i = bb->first; i;) {
+        IRInstruction* next = i->next;
+        if (i->op == IROp::Phi) {
+          auto it = phiOwner.find(i);
+          if (it != phiOwner.end()) values[it->second] = i;
+        } else if (i->op == IROp::Alloca) {
+          auto it = index.find(i);
+          if (it != index.end()) values[it->second] = undef(i->elemType);
+        } else if (i->op == IROp::Load) {
+          auto it = index.find(i->operands[0]);
+          if (it != index.end()) {
+            i->replaceAllUsesWith(values[it->second]);
+            fn.erase(i);
+          }
+        } else if (i->op == IROp::Store) {
+          auto it = index.find(i->operands[1]);
+          if (it != index.end()) {
+            values[it->second] = i->operands[0];
+            fn.erase(i);
+          }
+        }
+        i = next;
+      }
+      // 同一个后继出现多次时每条边都要有入边
+      auto succs = bb->successors();
+      for (size_t s = 0; s < succs.size(); s++) {
+        if (s + 1 < succs.size() || visited.count(succs[s])) work.push_back({succs[s], bb, values});
+        else work.push_back({succs[s], bb, std::move(values)});
+      }
+    }
+  }
+
+  void cleanup(DominatorTree& dt) {
+    // 不可达块中剩下的load/store直接去掉
+    for (IRInstruction* a : allocas) {
+      std::vector<IRInstruction*> users;
+      for (const auto& u : a->uses) users.push_back(u.user);
+      for (IRInstruction* user : users) {
+        if (!user->parent) continue;
+        if (user->op == IROp::Load) user->replaceAllUsesWith(undef(user->type));
+        fn.erase(user);
+      }
+      fn.erase(a);
+    }
+    // 不可达前驱在phi上给undef
+    for (IRInstruction* phi : phis) {
+      std::vector<IRBasicBlock*> preds;
+      for (const auto& u : phi->parent->uses) {
+        if (u.user->isTerminator() && u.user->parent && !dt.reachable(u.user->parent)) preds.push_back(u.user->parent);
+      }
+      for (IRBasicBlock* p : preds) phi->addIncoming(undef(phi->type), p);
+    }
+    // 所有入边都相同（或者是自己）的phi直接替换掉
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (IRInstruction* phi : phis) {
+        if (!phi->parent) continue;
+        IRValue* same = nullptr;
+        bool trivial = true;
+        for (unsigned k = 0; k < phi->numIncoming(); k++) {
+          IRValue* v = phi->incomingValue(k);
+          if (v == phi || v == same) continue;
+          if (same) {
+            trivial = false;
+            break;
+          }
+          same = v;
+        }
+        if (!trivial) continue;
+        phi->replaceAllUsesWith(same ? same : undef(phi->type));
+        fn.erase(phi);
+        changed = true;
+      }
+    }
+  }
+};
+
+inline bool promoteMemoryToRegisters(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= Mem2Reg(*f).run();
+  return changed;
+}
+
+#endif
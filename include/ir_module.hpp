@@ -0,0 +1,709 @@
+#ifndef IR_MODULE_HPP
+#define IR_MODULE_HPP
+
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 内存中的IR：Module/Function/BasicBlock/Instruction，带use-def链。
+// IRGenerator通过IRBuilder直接构建，在这里做分析和优化，最后再统一打印成文本。
+
+class IRInstruction;
+class IRBasicBlock;
+class IRFunction;
+class IRModule;
+
+struct IRUse {
+  IRInstruction* user;
+  unsigned index;
+};
+
+class IRValue {
+ public:
+  enum class Kind { Constant, Global, Argument, Block, Instruction };
+
+  Kind kind;
+  std::string type;  // LLVM类型，基本块为label
+  std::string name;  // 不带%/@，为空时打印时按顺序编号
+  std::vector<IRUse> uses;
+
+  IRValue(Kind k, std::string t, std::string n) : kind(k), type(std::move(t)), name(std::move(n)) {}
+  virtual ~IRValue() = default;
+
+  bool isConstant() const { return kind == Kind::Constant; }
+  bool isInstruction() const { return kind == Kind::Instruction; }
+  bool isBlock() const { return kind == Kind::Block; }
+
+  void replaceAllUsesWith(IRValue* v);
+};
+
+// 常量：name保存常量本身的文本（5、true、null、undef、常量表达式等）
+class IRConstant : public IRValue {
+ public:
+  IRConstant(std::string t, std::string text) : IRValue(Kind::Constant, std::move(t), std::move(text)) {}
+
+  bool isInt() const {
+    if (name == "true" || name == "false") return type == "i1";
+    if (type.empty() || type[0] != 'i' || type.back() == '*') return false;
+    size_t i = (!name.empty() && name[0] == '-') ? 1 : 0;
+    if (i >= name.size()) return false;
+    for (; i < name.size(); i++) {
+      if (!std::isdigit((unsigned char)name[i])) return false;
+    }
+    return true;
+  }
+
+  int64_t intValue() const {
+    if (name == "true") return 1;
+    if (name == "false") return 0;
+    return std::stoll(name);
+  }
+};
+
+// 全局符号（函数、全局变量），name是@后面的部分，可能带引号
+class IRGlobal : public IRValue {
+ public:
+  IRGlobal(std::string t, std::string n) : IRValue(Kind::Global, std::move(t), std::move(n)) {}
+};
+
+class IRArgument : public IRValue {
+ public:
+  std::string attrs;  // noundef等参数属性
+  IRArgument(std::string t, std::string n, std::string a) : IRValue(Kind::Argument, std::move(t), std::move(n)), attrs(std::move(a)) {}
+};
+
+enum class IROp {
+  Alloca, Load, Store, Br, CondBr, Ret, Unreachable,
+  Add, Sub, Mul, SDiv, UDiv, SRem, URem, And, Or, Xor, Shl, LShr, AShr,
+  ICmp, SExt, ZExt, Trunc, BitCast, PtrToInt, IntToPtr,
+  GetElementPtr, ExtractValue, InsertValue, Call, Phi, Select
+};
+
+static const char* irOpName(IROp op) {
+  switch (op) {
+    case IROp::Alloca: return "alloca";
+    case IROp::Load: return "load";
+    case IROp::Store: return "store";
+    case IROp::Br: case IROp::CondBr: return "br";
+    case IROp::Ret: return "ret";
+    case IROp::Unreachable: return "unreachable";
+    case IROp::Add: return "add";
+    case IROp::Sub: return "sub";
+    case IROp::Mul: return "mul";
+    case IROp::SDiv: return "sdiv";
+    case IROp::UDiv: return "udiv";
+    case IROp::SRem: return "srem";
+    case IROp::URem: return "urem";
+    case IROp::And: return "and";
+    case IROp::Or: return "or";
+    case IROp::Xor: return "xor";
+    case IROp::Shl: return "shl";
+    case IROp::LShr: return "lshr";
+    case IROp::AShr: return "ashr";
+    case IROp::ICmp: return "icmp";
+    case IROp::SExt: return "sext";
+    case IROp::ZExt: return "zext";
+    case IROp::Trunc: return "trunc";
+    case IROp::BitCast: return "bitcast";
+    case IROp::PtrToInt: return "ptrtoint";
+    case IROp::IntToPtr: return "inttoptr";
+    case IROp::GetElementPtr: return "getelementptr";
+    case IROp::ExtractValue: return "extractvalue";
+    case IROp::InsertValue: return "insertvalue";
+    case IROp::Call: return "call";
+    case IROp::Phi: return "phi";
+    case IROp::Select: return "select";
+  }
+  return "";
+}
+
+// 各指令的操作数约定：
+//   store: [value, ptr]     load: [ptr]           br: [dest]       condbr: [cond, true, false]
+//   ret: [] 或 [value]      gep: [ptr, idx...]    call: [callee, args...]
+//   phi: [v0, bb0, v1, bb1, ...]                  select: [cond, a, b]
+class IRInstruction : public IRValue {
+ public:
+  IROp op;
+  IRBasicBlock* parent = nullptr;
+  IRInstruction* prev = nullptr;
+  IRInstruction* next = nullptr;
+  std::vector<IRValue*> operands;
+
+  std::string pred;        // icmp的条件
+  std::string elemType;    // alloca分配的类型，load/gep的源类型
+  std::vector<unsigned> indices;  // extractvalue/insertvalue的下标
+  std::string calleeType;  // call显式写出的函数类型，如 i32 (i8*, ...)
+  std::vector<std::string> argAttrs;  // call每个实参的属性
+  std::string flags;       // gep的inbounds，二元运算的nsw等，call末尾的属性
+  bool tail = false;
+  int align = 0;
+
+  IRInstruction(IROp o, std::string t, std::string n) : IRValue(Kind::Instruction, std::move(t), std::move(n)), op(o) {}
+
+  bool hasResult() const { return type != "void"; }
+  bool isTerminator() const { return op == IROp::Br || op == IROp::CondBr || op == IROp::Ret || op == IROp::Unreachable; }
+  bool isBinary() const { return op >= IROp::Add && op <= IROp::AShr; }
+  bool isCast() const { return op >= IROp::SExt && op <= IROp::IntToPtr; }
+
+  void addOperand(IRValue* v) {
+    operands.push_back(v);
+    v->uses.push_back({this, (unsigned)operands.size() - 1});
+  }
+
+  void setOperand(unsigned i, IRValue* v) {
+    removeUse(operands[i], i);
+    operands[i] = v;
+    v->uses.push_back({this, i});
+  }
+
+  // 删除[start, start+count)的操作数，后面操作数的use下标随之前移
+  void removeOperands(unsigned start, unsigned count) {
+    for (unsigned i = start; i < operands.size(); i++) removeUse(operands[i], i);
+    operands.erase(operands.begin() + start, operands.begin() + start + count);
+    for (unsigned i = start; i < operands.size(); i++) operands[i]->uses.push_back({this, i});
+  }
+
+  void dropOperands() {
+    for (unsigned i = 0; i < operands.size(); i++) removeUse(operands[i], i);
+    operands.clear();
+  }
+
+  unsigned numIncoming() const { return operands.size() / 2; }
+  IRValue* incomingValue(unsigned i) const { return operands[2 * i]; }
+  IRBasicBlock* incomingBlock(unsigned i) const;
+  void addIncoming(IRValue* v, IRBasicBlock* bb);
+  void removeIncoming(unsigned i) { removeOperands(2 * i, 2); }
+
+  std::vector<IRBasicBlock*> successors() const;
+
+ private:
+  void removeUse(IRValue* v, unsigned i) {
+    for (size_t k = 0; k < v->uses.size(); k++) {
+      if (v->uses[k].user == this && v->uses[k].index == i) {
+        v->uses[k] = v->uses.back();
+        v->uses.pop_back();
+        return;
+      }
+    }
+  }
+};
+
+class IRBasicBlock : public IRValue {
+ public:
+  IRFunction* parent;
+  IRInstruction* first = nullptr;
+  IRInstruction* last = nullptr;
+
+  IRBasicBlock(IRFunction* f, std::string n) : IRValue(Kind::Block, "label", std::move(n)), parent(f) {}
+
+  bool empty() const { return first == nullptr; }
+
+  IRInstruction* terminator() const { return (last && last->isTerminator()) ? last : nullptr; }
+
+  std::vector<IRBasicBlock*> successors() const {
+    IRInstruction* t = terminator();
+    return t ? t->successors() : std::vector<IRBasicBlock*>{};
+  }
+
+  // 前驱由终结指令对本块的use得到；同一个前驱可能出现多次（condbr两个目标相同）
+  std::vector<IRBasicBlock*> predecessors() const {
+    std::vector<IRBasicBlock*> preds;
+    for (const auto& u : uses) {
+      if (u.user->isTerminator() && u.user->parent) {
+        bool seen = false;
+        for (auto* p : preds) seen = seen || p == u.user->parent;
+        if (!seen) preds.push_back(u.user->parent);
+      }
+    }
+    return preds;
+  }
+
+  void append(IRInstruction* inst) {
+    inst->parent = this;
+    inst->prev = last;
+    inst->next = nullptr;
+    if (last) last->next = inst; else first = inst;
+    last = inst;
+  }
+
+  void insertBefore(IRInstruction* pos, IRInstruction* inst) {
+    if (!pos) { append(inst); return; }
+    inst->parent = this;
+    inst->next = pos;
+    inst->prev = pos->prev;
+    if (pos->prev) pos->prev->next = inst; else first = inst;
+    pos->prev = inst;
+  }
+
+  // 只从链表中摘下，不处理操作数
+  void unlink(IRInstruction* inst) {
+    if (inst->prev) inst->prev->next = inst->next; else first = inst->next;
+    if (inst->next) inst->next->prev = inst->prev; else last = inst->prev;
+    inst->prev = inst->next = nullptr;
+    inst->parent = nullptr;
+  }
+};
+
+inline IRBasicBlock* IRInstruction::incomingBlock(unsigned i) const {
+  return static_cast<IRBasicBlock*>(operands[2 * i + 1]);
+}
+
+inline void IRInstruction::addIncoming(IRValue* v, IRBasicBlock* bb) {
+  addOperand(v);
+  addOperand(bb);
+}
+
+inline std::vector<IRBasicBlock*> IRInstruction::successors() const {
+  std::vector<IRBasicBlock*> succ;
+  if (op == IROp::Br) succ.push_back(static_cast<IRBasicBlock*>(operands[0]));
+  if (op == IROp::CondBr) {
+    succ.push_back(static_cast<IRBasicBlock*>(operands[1]));
+    succ.push_back(static_cast<IRBasicBlock*>(operands[2]));
+  }
+  return succ;
+}
+
+inline void IRValue::replaceAllUsesWith(IRValue* v) {
+  if (v == this) return;
+  std::vector<IRUse> old;
+  old.swap(uses);
+  for (const auto& u : old) {
+    u.user->operands[u.index] = v;
+    v->uses.push_back(u);
+  }
+}
+
+class IRFunction {
+ public:
+  IRModule* parent;
+  std::string name;      // @后面的部分
+  std::string retType;
+  std::string prefix;    // define和返回类型之间的内容，如dso_local
+  std::string suffix;    // 参数列表之后的属性
+  bool vararg = false;
+  std::vector<std::unique_ptr<IRArgument>> args;
+  std::vector<std::unique_ptr<IRBasicBlock>> blocks;
+
+  IRFunction(IRModule* m, std::string n) : parent(m), name(std::move(n)) {}
+
+  IRBasicBlock* entry() const { return blocks.empty() ? nullptr : blocks.front().get(); }
+
+  // before不为空时新块放在它前面，否则放在最后
+  IRBasicBlock* createBlock(const std::string& n, const IRBasicBlock* before = nullptr) {
+    auto bb = std::make_unique<IRBasicBlock>(this, n);
+    IRBasicBlock* result = bb.get();
+    auto pos = blocks.end();
+    for (auto it = blocks.begin(); before && it != blocks.end(); ++it) {
+      if (it->get() == before) pos = it;
+    }
+    blocks.insert(pos, std::move(bb));
+    if (!n.empty()) names.insert({n, 1});
+    return result;
+  }
+
+  IRInstruction* createInst(IROp op, const std::string& t, const std::string& n = "") {
+    pool.push_back(std::make_unique<IRInstruction>(op, t, n));
+    if (!n.empty()) names.insert({n, 1});
+    return pool.back().get();
+  }
+
+  // 以base为前缀生成函数内不重复的名字
+  std::string uniqueName(const std::string& base) {
+    auto it = names.find(base);
+    if (it == names.end()) {
+      names.insert({base, 1});
+      return base;
+    }
+    while (true) {
+      std::string n = base + "." + std::to_string(it->second++);
+      if (!names.count(n)) {
+        names.insert({n, 1});
+        return n;
+      }
+    }
+  }
+
+  void reserveName(const std::string& n) {
+    if (!n.empty()) names.insert({n, 1});
+  }
+
+  // 从基本块中删除指令并释放它对操作数的使用；调用前指令的结果应当已经没有使用者
+  void erase(IRInstruction* inst) {
+    if (inst->parent) inst->parent->unlink(inst);
+    inst->dropOperands();
+  }
+
+  // 删除基本块及其中所有指令；调用前其他块中对它的引用应当已经去掉
+  void removeBlock(IRBasicBlock* bb) {
+    for (IRInstruction* i = bb->first; i;) {
+      IRInstruction* n = i->next;
+      erase(i);
+      i = n;
+    }
+    for (size_t k = 0; k < blocks.size(); k++) {
+      if (blocks[k].get() == bb) {
+        deadBlocks.push_back(std::move(blocks[k]));
+        blocks.erase(blocks.begin() + k);
+        break;
+      }
+    }
+  }
+
+ private:
+  std::vector<std::unique_ptr<IRInstruction>> pool;  // 拥有所有指令，包括已经删除的
+  std::vector<std::unique_ptr<IRBasicBlock>> deadBlocks;
+  std::unordered_map<std::string, unsigned> names;
+};
+
+class IRModule {
+ public:
+  // 模块中的顶层条目按原顺序保存：函数定义之外的内容（类型、全局变量、声明、注释）保留为文本
+  struct Entry {
+    std::string text;
+    IRFunction* function = nullptr;
+  };
+  std::vector<Entry> entries;
+  std::vector<std::unique_ptr<IRFunction>> functions;
+  std::unordered_map<std::string, std::string> namedTypes;  // %Foo = type {...}
+
+  IRConstant* constant(const std::string& t, const std::string& text) {
+    std::string key = t + '\0' + text;
+    auto it = constants.find(key);
+    if (it != constants.end()) return it->second.get();
+    auto* c = new IRConstant(t, text);
+    constants[key].reset(c);
+    return c;
+  }
+
+  IRConstant* constInt(const std::string& t, int64_t v) {
+    if (t == "i1") return constant(t, v ? "true" : "false");
+    return constant(t, std::to_string(v));
+  }
+
+  IRGlobal* global(const std::string& n, const std::string& t = "") {
+    auto it = globals.find(n);
+    if (it != globals.end()) {
+      if (it->second->type.empty()) it->second->type = t;
+      return it->second.get();
+    }
+    auto* g = new IRGlobal(t, n);
+    globals[n].reset(g);
+    return g;
+  }
+
+  IRFunction* findFunction(const std::string& n) const {
+    for (const auto& f : functions) {
+      if (f->name == n) return f.get();
+    }
+    return nullptr;
+  }
+
+  // 聚合类型agg第index个元素的类型；命名的struct类型先展开
+  std::string elementType(const std::string& agg, int64_t index) const {
+    std::string t = agg;
+    while (!t.empty() && t[0] == '%') {
+      auto it = namedTypes.find(t.substr(1));
+      if (it == namedTypes.end()) return "";
+      t = it->second;
+    }
+    if (t.empty()) return "";
+    if (t[0] == '[') {
+      size_t x = t.find(" x ");
+      return t.substr(x + 3, t.size() - x - 4);
+    }
+    if (t[0] == '{') {
+      auto fields = splitStructFields(t);
+      if (index < 0 || index >= (int64_t)fields.size()) return "";
+      return fields[index];
+    }
+    return "";
+  }
+
+  static std::vector<std::string> splitStructFields(const std::string& t) {
+    std::vector<std::string> fields;
+    int depth = 0;
+    std::string cur;
+    for (size_t i = 1; i + 1 < t.size(); i++) {
+      char c = t[i];
+      if (c == '{' || c == '[' || c == '(' || c == '<') depth++;
+      if (c == '}' || c == ']' || c == ')' || c == '>') depth--;
+      if (c == ',' && depth == 0) {
+        fields.push_back(cur);
+        cur.clear();
+        continue;
+      }
+      if (c == ' ' && cur.empty()) continue;
+      cur.push_back(c);
+    }
+    if (!cur.empty()) fields.push_back(cur);
+    return fields;
+  }
+
+  std::string print() const;
+
+ private:
+  std::unordered_map<std::string, std::unique_ptr<IRConstant>> constants;
+  std::unordered_map<std::string, std::unique_ptr<IRGlobal>> globals;
+};
+
+// ===== 打印成LLVM文本 =====
+
+class IRPrinter {
+ public:
+  explicit IRPrinter(std::string& o) : out(o) {}
+
+  void printFunction(const IRFunction& f) {
+    number(f);
+    out += "define ";
+    if (!f.prefix.empty()) {
+      out += f.prefix;
+      out += ' ';
+    }
+    out += f.retType;
+    out += " @";
+    out += f.name;
+    out += '(';
+    for (size_t i = 0; i < f.args.size(); i++) {
+      if (i) out += ", ";
+      const IRArgument* a = f.args[i].get();
+      out += a->type;
+      if (!a->attrs.empty()) {
+        out += ' ';
+        out += a->attrs;
+      }
+      out += ' ';
+      ref(a);
+    }
+    if (f.vararg) out += f.args.empty() ? "..." : ", ...";
+    out += ')';
+    if (!f.suffix.empty()) {
+      out += ' ';
+      out += f.suffix;
+    }
+    out += " {\n";
+    for (size_t b = 0; b < f.blocks.size(); b++) {
+      const IRBasicBlock* bb = f.blocks[b].get();
+      if (b > 0 || !bb->name.empty()) {
+        if (bb->name.empty()) out += std::to_string(slots.at(bb));
+        else out += bb->name;
+        out += ":\n";
+      }
+      for (const IRInstruction* i = bb->first; i; i = i->next) printInstruction(i);
+    }
+    out += "}\n";
+  }
+
+ private:
+  std::string& out;
+  std::unordered_map<const IRValue*, unsigned> slots;
+
+  // 未命名的值按LLVM的规则编号：参数、基本块、有结果的指令依次排列
+  void number(const IRFunction& f) {
+    slots.clear();
+    unsigned n = 0;
+    for (const auto& a : f.args) {
+      if (a->name.empty()) slots[a.get()] = n++;
+    }
+    for (const auto& bb : f.blocks) {
+      if (bb->name.empty()) slots[bb.get()] = n++;
+      for (const IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->hasResult() && i->name.empty()) slots[i] = n++;
+      }
+    }
+  }
+
+  void ref(const IRValue* v) {
+    switch (v->kind) {
+      case IRValue::Kind::Constant:
+        out += v->name;
+        return;
+      case IRValue::Kind::Global:
+        out += '@';
+        out += v->name;
+        return;
+      default:
+        out += '%';
+        if (v->name.empty()) out += std::to_string(slots.at(v));
+        else out += v->name;
+    }
+  }
+
+  void typed(const IRValue* v) {
+    out += v->type;
+    out += ' ';
+    ref(v);
+  }
+
+  void alignSuffix(const IRInstruction* i) {
+    if (i->align) {
+      out += ", align ";
+      out += std::to_string(i->align);
+    }
+  }
+
+  void printInstruction(const IRInstruction* i) {
+    out += "  ";
+    if (i->hasResult()) {
+      ref(i);
+      out += " = ";
+    }
+    if (i->tail) out += "tail ";
+    out += irOpName(i->op);
+    switch (i->op) {
+      case IROp::Alloca:
+        out += ' ';
+        out += i->elemType;
+        alignSuffix(i);
+        break;
+      case IROp::Load:
+        out += ' ';
+        out += i->type;
+        out += ", ";
+        typed(i->operands[0]);
+        alignSuffix(i);
+        break;
+      case IROp::Store:
+        out += ' ';
+        typed(i->operands[0]);
+        out += ", ";
+        typed(i->operands[1]);
+        alignSuffix(i);
+        break;
+      case IROp::Br:
+        out += " label ";
+        ref(i->operands[0]);
+        break;
+      case IROp::CondBr:
+        out += ' ';
+        typed(i->operands[0]);
+        out += ", label ";
+        ref(i->operands[1]);
+        out += ", label ";
+        ref(i->operands[2]);
+        break;
+      case IROp::Ret:
+        out += ' ';
+        if (i->operands.empty()) out += "void";
+        else typed(i->operands[0]);
+        break;
+      case IROp::Unreachable:
+        break;
+      case IROp::ICmp:
+        out += ' ';
+        out += i->pred;
+        out += ' ';
+        typed(i->operands[0]);
+        out += ", ";
+        ref(i->operands[1]);
+        break;
+      case IROp::GetElementPtr:
+        out += ' ';
+        if (!i->flags.empty()) {
+          out += i->flags;
+          out += ' ';
+        }
+        out += i->elemType;
+        for (const IRValue* v : i->operands) {
+          out += ", ";
+          typed(v);
+        }
+        break;
+      case IROp::ExtractValue:
+      case IROp::InsertValue:
+        out += ' ';
+        typed(i->operands[0]);
+        if (i->op == IROp::InsertValue) {
+          out += ", ";
+          typed(i->operands[1]);
+        }
+        for (unsigned k : i->indices) {
+          out += ", ";
+          out += std::to_string(k);
+        }
+        break;
+      case IROp::Call:
+        out += ' ';
+        out += i->calleeType.empty() ? i->type : i->calleeType;
+        out += ' ';
+        ref(i->operands[0]);
+        out += '(';
+        for (size_t k = 1; k < i->operands.size(); k++) {
+          if (k > 1) out += ", ";
+          out += i->operands[k]->type;
+          if (k - 1 < i->argAttrs.size() && !i->argAttrs[k - 1].empty()) {
+            out += ' ';
+            out += i->argAttrs[k - 1];
+          }
+          out += ' ';
+          ref(i->operands[k]);
+        }
+        out += ')';
+        if (!i->flags.empty()) {
+          out += ' ';
+          out += i->flags;
+        }
+        break;
+      case IROp::Phi:
+        out += ' ';
+        out += i->type;
+        for (unsigned k = 0; k < i->numIncoming(); k++) {
+          out += k ? ", [ " : " [ ";
+          ref(i->incomingValue(k));
+          out += ", ";
+          ref(i->incomingBlock(k));
+          out += " ]";
+        }
+        break;
+      case IROp::Select:
+        out += ' ';
+        typed(i->operands[0]);
+        out += ", ";
+        typed(i->operands[1]);
+        out += ", ";
+        typed(i->operands[2]);
+        break;
+      default:
+        if (i->isBinary()) {
+          out += ' ';
+          if (!i->flags.empty()) {
+            out += i->flags;
+            out += ' ';
+          }
+          typed(i->operands[0]);
+          out += ", ";
+          ref(i->operands[1]);
+        } else if (i->isCast()) {
+          out += ' ';
+          typed(i->operands[0]);
+          out += " to ";
+          out += i->type;
+        }
+        break;
+    }
+    out += '\n';
+  }
+};
+
+inline std::string IRModule::print() const {
+  std::string out;
+  size_t estimate = 0;
+  for (const auto& e : entries) estimate += e.text.size();
+  for (const auto& f : functions) {
+    for (const auto& bb : f->blocks) {
+      for (const IRInstruction* i = bb->first; i; i = i->next) estimate += 48;
+    }
+    estimate += 64;
+  }
+  out.reserve(estimate);
+  IRPrinter printer(out);
+  for (const auto& e : entries) {
+    if (e.function) printer.printFunction(*e.function);
+    else out += e.text;
+  }
+  return out;
+}
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef IR_SCCP_HPP
+#define IR_SCCP_HPP
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir_module.hpp"
+
+// 稀疏条件常量传播（Wegman-Zadeck）：只沿可能执行的边传播常量，
+// 把结果是常量的指令替换成常量，把条件恒定的br改成无条件跳转
+class SCCP {
+ public:
+  explicit SCCP(IRFunction& f) : fn(f), module(*f.parent) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    markBlock(fn.entry());
+    while (!blockWork.empty() || !instWork.empty()) {
+      while (!instWork.empty()) {
+        IRInstruction* i = instWork.back();
+        instWork.pop_back();
+        if (i->parent && executable.count(i->parent)) visit(i);
+      }
+      while (!blockWork.empty()) {
+        IRBasicBlock* bb = blockWork.back();
+        blockWork.pop_back();
+        for (IRInstruction* i = bb->first; i; i = i->next) visit(i);
+      }
+    }
+    return rewrite();
+  }
+
+  // 整数类型的位数，不是整数类型时为0
+  static unsigned bitsOf(const std::string& type) {
+    if (type.size() < 2 || type[0] != 'i') return 0;
+    unsigned bits = 0;
+    for (size_t i = 1; i < type.size(); i++) {
+      if (!std::isdigit((unsigned char)type[i])) return 0;
+      bits = bits * 10 + (type[i] - '0');
+    }
+    return bits <= 64 ? bits : 0;
+  }
+
+  // 截断到bits位后再符号扩展，常量都以这种形式保存
+  static int64_t wrap(uint64_t v, unsigned bits) {
+    if (bits >= 64) return (int64_t)v;
+    return (int64_t)(v << (64 - bits)) >> (64 - bits);
+  }
+
+  static uint64_t zextOf(int64_t v, unsigned bits) {
+    return bits >= 64 ? (uint64_t)v : (uint64_t)v & ((1ULL << bits) - 1);
+  }
+
+  // 对两个常量求值；除零、移位越界等结果未定义的情况返回false，指令保留到运行时
+  static bool fold(IROp op, const std::string& pred, unsigned bits, int64_t a, int64_t b, int64_t& r) {
+    uint64_t ua = zextOf(a, bits), ub = zextOf(b, bits);
+    int64_t minValue = wrap(1ULL << (bits - 1), bits);
+    switch (op) {
+      case IROp::Add: r = wrap((uint64_t)a + (uint64_t)b, bits); return true;
+      case IROp::Sub: r = wrap((uint64_t)a - (uint64_t)b, bits); return true;
+      case IROp::Mul: r = wrap((uint64_t)a * (uint64_t)b, bits); return true;
+      case IROp::And: r = a & b; return true;
+      case IROp::Or: r = a | b; return true;
+      case IROp::Xor: r = a ^ b; return true;
+      case IROp::SDiv:
+      case IROp::SRem:
+        if (b == 0 || (a == minValue && b == -1)) return false;
+        r = op == IROp::SDiv ? a / b : a % b;
+        return true;
+      case IROp::UDiv:
+      case IROp::URem:
+        if (ub == 0) return false;
+        r = wrap(op == IROp::UDiv ? ua / ub : ua % ub, bits);
+        return true;
+      case IROp::Shl:
+      case IROp::LShr:
+      case IROp::AShr:
+        if (ub >= bits) return false;
+        if (op == IROp::Shl) r = wrap(ua << ub, bits);
+        else if (op == IROp::LShr) r = wrap(ua >> ub, bits);
+        else r = a >> ub;
+        return true;
+      case IROp::ICmp:
+        if (pred == "eq") r = a == b;
+        else if (pred == "ne") r = a != b;
+        else if (pred == "slt") r = a < b;
+        else if (pred == "sle") r = a <= b;
+        else if (pred == "sgt") r = a > b;
+        else if (pred == "sge") r = a >= b;
+        else if (pred == "ult") r = ua < ub;
+        else if (pred == "ule") r = ua <= ub;
+        else if (pred == "ugt") r = ua > ub;
+        else if (pred == "uge") r = ua >= ub;
+        else return false;
+        r = wrap(r, 1);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+ private:
+  enum class State { Unknown, Constant, Overdefined };
+  struct Lattice {
+    State state = State::Unknown;
+    int64_t value = 0;
+  };
+
+  IRFunction& fn;
+  IRModule& module;
+  std::unordered_map<const IRValue*, Lattice> values;
+  std::unordered_set<const IRBasicBlock*> executable;
+  std::set<std::pair<const IRBasicBlock*, const IRBasicBlock*>> edges;
+  std::vector<IRBasicBlock*> blockWork;
+  std::vector<IRInstruction*> instWork;
+
+  Lattice get(const IRValue* v) {
+    if (v->isInstruction()) return values[v];
+    Lattice l;
+    l.state = State::Overdefined;
+    if (v->isConstant()) {
+      auto* c = static_cast<const IRConstant*>(v);
+      unsigned bits = bitsOf(c->type);
+      if (bits && c->isInt()) {
+        l.state = State::Constant;
+        l.value = wrap((uint64_t)c->intValue(), bits);
+      }
+    }
+    return l;
+  }
+
+  void update(IRInstruction* i, Lattice l) {
+    Lattice& old = values[i];
+    if (old.state == State::Overdefined) return;
+    if (old.state == State::Constant && l.state == State::Constant && old.value != l.value) l.state = State::Overdefined;
+    if (old.state == l.state && (l.state != State::Constant || old.value == l.value)) return;
+    if (l.state == State::Unknown) return;
+    old = l;
+    for (const auto& u : i->uses) instWork.push_back(u.user);
+  }
+
+  void overdefine(IRInstruction* i) {
+    Lattice l;
+    l.state = State::Overdefined;
+    update(i, l);
+  }
+
+  void constant(IRInstruction* i, int64_t v) {
+    Lattice l;
+    l.state = State::Constant;
+    l.value = v;
+    update(i, l);
+  }
+
+  void markBlock(IRBasicBlock* bb) {
+    if (executable.insert(bb).second) blockWork.push_back(bb);
+  }
+
+  void markEdge(IRBasicBlock* from, IRBasicBlock* to) {
+    if (!edges.insert({from, to}).second) return;
+    if (executable.count(to)) {
+      // 块已经处理过，新的入边只影响phi
+      for (IRInstruction* i = to->first; i && i->op == IROp::Phi; i = i->next) instWork.push_back(i);
+    } else {
+      markBlock(to);
+    }
+  }
+
+  void visit(IRInstruction* i) {
+    switch (i->op) {
+      case IROp::Br:
+        markEdge(i->parent, static_cast<IRBasicBlock*>(i->operands[0]));
+        return;
+      case IROp::CondBr: {
+        Lattice c = get(i->operands[0]);
+        auto* t = static_cast<IRBasicBlock*>(i->operands[1]);
+        auto* f = static_cast<IRBasicBlock*>(i->operands[2]);
+        if (c.state == State::Constant) {
+          markEdge(i->parent, c.value ? t : f);
+        } else if (c.state == State::Overdefined) {
+          markEdge(i->parent, t);
+          markEdge(i->parent, f);
+        }
+        return;
+      }
+      case IROp::Phi: {
+        Lattice result;
+        for (unsigned k = 0; k < i->numIncoming(); k++) {
+          if (!edges.count({i->incomingBlock(k), i->parent})) continue;
+          Lattice v = get(i->incomingValue(k));
+          if (v.state == State::Unknown) continue;
+          if (v.state == State::Overdefined || (result.state == State::Constant && result.value != v.value)) {
+            overdefine(i);
+            return;
+          }
+          result = v;
+        }
+        update(i, result);
+        return;
+      }
+      case IROp::Select: {
+        Lattice c = get(i->operands[0]);
+        if (c.state == State::Unknown) return;
+        if (c.state == State::Constant) {
+          Lattice v = get(i->operands[c.value ? 1 : 2]);
+          if (v.state == State::Overdefined || v.state == State::Constant) update(i, v);
+          return;
+        }
+        Lattice a = get(i->operands[1]), b = get(i->operands[2]);
+        if (a.state == State::Constant && b.state == State::Constant && a.value == b.value) update(i, a);
+        else if (a.state == State::Overdefined || b.state == State::Overdefined || a.state == State::Constant || b.state == State::Constant) overdefine(i);
+        return;
+      }
+      case IROp::SExt:
+      case IROp::ZExt:
+      case IROp::Trunc: {
+        unsigned from = bitsOf(i->operands[0]->type), to = bitsOf(i->type);
+        Lattice a = get(i->operands[0]);
+        if (!from || !to || a.state == State::Overdefined) {
+          overdefine(i);
+        } else if (a.state == State::Constant) {
+          uint64_t v = i->op == IROp::ZExt ? zextOf(a.value, from) : (uint64_t)a.value;
+          constant(i, wrap(v, to));
+        }
+        return;
+      }
+      default:
+        break;
+    }
+    if (!i->hasResult()) return;
+    if (!i->isBinary() && i->op != IROp::ICmp) {
+      overdefine(i);
+      return;
+    }
+    unsigned bits = bitsOf(i->operands[0]->type);
+    Lattice a = get(i->operands[0]), b = get(i->operands[1]);
+    if (!bits || a.state == State::Overdefined || b.state == State::Overdefined) {
+      overdefine(i);
+      return;
+    }
+    if (a.state != State::Constant || b.state != State::Constant) return;
+    int64_t r;
+    if (fold(i->op, i->pred, bits, a.value, b.value, r)) constant(i, r);
+    else overdefine(i);
+  }
+
+  bool rewrite() {
+    bool changed = false;
+    for (const auto& bb : fn.blocks) {
+      if (!executable.count(bb.get())) continue;
+      for (IRInstruction* i = bb->first; i;) {
+        IRInstruction* next = i->next;
+        auto it = values.find(i);
+        if (i->hasResult() && it != values.end() && it->second.state == State::Constant) {
+          i->replaceAllUsesWith(module.constInt(i->type, it->second.value));
+          fn.erase(i);
+          changed = true;
+        }
+        i = next;
+      }
+      // 只有一个后继可能执行的条件跳转改成无条件跳转
+      IRInstruction* term = bb->terminator();
+      if (!term || term->op != IROp::CondBr) continue;
+      auto* t = static_cast<IRBasicBlock*>(term->operands[1]);
+      auto* f = static_cast<IRBasicBlock*>(term->operands[2]);
+      bool toT = edges.count({bb.get(), t}) != 0, toF = edges.count({bb.get(), f}) != 0;
+      if (toT == toF) continue;
+      IRBasicBlock* live = toT ? t : f;
+      IRBasicBlock* dead = toT ? f : t;
+      if (dead != live) removePhiIncoming(dead, bb.get());
+      IRInstruction* br = fn.createInst(IROp::Br, "void");
+      br->addOperand(live);
+      bb->insertBefore(term, br);
+      fn.erase(term);
+      changed = true;
+    }
+    return changed;
+  }
+
+  static void removePhiIncoming(IRBasicBlock* bb, IRBasicBlock* pred) {
+    for (IRInstruction* i = bb->first; i && i->op == IROp::Phi; i = i->next) {
+      for (unsigned k = 0; k < i->numIncoming(); k++) {
+        if (i->incomingBlock(k) == pred) {
+          i->removeIncoming(k);
+          break;
+        }
+      }
+    }
+  }
+};
+
+inline bool propagateConstants(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= SCCP(*f).run();
+  return changed;
+}
+
+#endif
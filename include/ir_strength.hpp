@@ -0,0 +1,287 @@
+#ifndef IR_STRENGTH_HPP
+#define IR_STRENGTH_HPP
+
+#include <string>
+#include <vector>
+#include "ir_analysis.hpp"
+#include "ir_sccp.hpp"
+
+// 强度削减：识别循环头上按常量步长递增的归纳变量，把它乘常量、用它做下标的gep
+// 改成每轮加一次的新归纳变量（指针每轮前进step个元素）；再把乘、除、取模常量
+// 换成移位、掩码或乘magic number
+class StrengthReduction {
+ public:
+  explicit StrengthReduction(IRFunction& f) : fn(f), module(*f.parent) {}
+
+  bool run() {
+    if (!fn.entry()) return false;
+    bool changed = false;
+    DominatorTree dt(fn);
+    for (const IRLoop& loop : findLoops(dt)) changed |= reduceLoop(loop);
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i;) {
+        IRInstruction* next = i->next;
+        changed |= reduceArithmetic(i);
+        i = next;
+      }
+    }
+    return changed;
+  }
+
+  // 32位有符号除以d（d >= 2）的magic number，见Hacker's Delight 10-4。
+  // 返回的m按无符号理解，x / d = ((sext(x) * m) >> (32 + s)) + (x < 0)
+  static void magic(int64_t d, int64_t& m, unsigned& s) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = (uint32_t)d;
+    uint32_t anc = two31 - 1 - two31 % ad;
+    unsigned p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+      p++;
+      q1 *= 2;
+      r1 *= 2;
+      if (r1 >= anc) {
+        q1++;
+        r1 -= anc;
+      }
+      q2 *= 2;
+      r2 *= 2;
+      if (r2 >= ad) {
+        q2++;
+        r2 -= ad;
+      }
+      delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    m = (int64_t)(uint32_t)(q2 + 1);
+    s = p - 32;
+  }
+
+ private:
+  IRFunction& fn;
+  IRModule& module;
+
+  // 基本归纳变量：phi = [init, preheader], [phi + step, latch]
+  struct InductionVariable {
+    IRInstruction* phi;
+    IRValue* init;
+    int64_t step;
+  };
+
+  static bool constantInt(const IRValue* v, int64_t& out) {
+    if (!v->isConstant() || !static_cast<const IRConstant*>(v)->isInt()) return false;
+    out = static_cast<const IRConstant*>(v)->intValue();
+    return true;
+  }
+
+  static int log2Exact(int64_t v) {
+    if (v <= 0 || (v & (v - 1))) return -1;
+    int k = 0;
+    while ((int64_t(1) << k) != v) k++;
+    return k;
+  }
+
+  IRInstruction* emit(IROp op, const std::string& type, IRValue* a, IRValue* b, IRInstruction* before) {
+    IRInstruction* i = fn.createInst(op, type);
+    i->addOperand(a);
+    if (b) i->addOperand(b);
+    before->parent->insertBefore(before, i);
+    return i;
+  }
+
+  IRInstruction* cast(IROp op, const std::string& type, IRValue* v, IRInstruction* before) {
+    return emit(op, type, v, nullptr, before);
+  }
+
+  void replace(IRInstruction* i, IRValue* v) {
+    i->replaceAllUsesWith(v);
+    fn.erase(i);
+  }
+
+  // 唯一的循环外前驱并且只跳到循环头（LICM已经为需要的循环建好）
+  static IRBasicBlock* preheader(const IRLoop& loop) {
+    IRBasicBlock* pre = nullptr;
+    for (IRBasicBlock* p : loop.header->predecessors()) {
+      if (loop.contains(p)) continue;
+      if (pre) return nullptr;
+      pre = p;
+    }
+    if (!pre || !pre->terminator() || pre->terminator()->op != IROp::Br) return nullptr;
+    return pre;
+  }
+
+  std::vector<InductionVariable> inductionVariables(const IRLoop& loop, IRBasicBlock* pre, IRBasicBlock* latch) const {
+    std::vector<InductionVariable> result;
+    for (IRInstruction* phi = loop.header->first; phi && phi->op == IROp::Phi; phi = phi->next) {
+      if (phi->numIncoming() != 2 || !SCCP::bitsOf(phi->type)) continue;
+      unsigned in = phi->incomingBlock(0) == pre ? 0 : 1;
+      if (phi->incomingBlock(in) != pre || phi->incomingBlock(1 - in) != latch) continue;
+      IRValue* next = phi->incomingValue(1 - in);
+      if (!next->isInstruction()) continue;
+      auto* add = static_cast<IRInstruction*>(next);
+      if (add->op != IROp::Add && add->op != IROp::Sub) continue;
+      bool onLeft = add->operands[0] == phi;
+      if (!onLeft && (add->op == IROp::Sub || add->operands[1] != phi)) continue;
+      int64_t step;
+      if (!constantInt(add->operands[onLeft ? 1 : 0], step)) continue;
+      if (add->op == IROp::Sub) step = -step;
+      result.push_back({phi, phi->incomingValue(in), step});
+    }
+    return result;
+  }
+
+  // 在循环头建一个新的归纳变量：进入循环时为start，每轮在latch末尾用op前进step
+  IRInstruction* newInductionVariable(const IRLoop& loop, IRBasicBlock* pre, IRBasicBlock* latch, IRInstruction* old, IRValue* start,
+                                      IROp op, IRValue* step) {
+    IRInstruction* phi = fn.createInst(IROp::Phi, old->type, fn.uniqueName(old->name.empty() ? "iv" : old->name + ".iv"));
+    loop.header->insertBefore(loop.header->first, phi);
+    IRInstruction* next = emit(op, old->type, phi, step, latch->terminator());
+    // gep的源类型是指针指向的类型
+    if (op == IROp::GetElementPtr) next->elemType = old->type.substr(0, old->type.size() - 1);
+    phi->addIncoming(start, pre);
+    phi->addIncoming(next, latch);
+    return phi;
+  }
+
+  bool reduceLoop(const IRLoop& loop) {
+    if (loop.latches.size() != 1) return false;
+    for (IRBasicBlock* bb : loop.blocks) {
+      if (!bb->terminator()) return false;
+    }
+    IRBasicBlock* pre = preheader(loop);
+    if (!pre) return false;
+    IRBasicBlock* latch = loop.latches[0];
+    bool changed = false;
+    for (const InductionVariable& iv : inductionVariables(loop, pre, latch)) {
+      unsigned bits = SCCP::bitsOf(iv.phi->type);
+      std::vector<IRInstruction*> users;
+      for (const auto& u : iv.phi->uses) {
+        if (loop.contains(u.user->parent)) users.push_back(u.user);
+      }
+      for (IRInstruction* user : users) {
+        if (!user->parent) continue;
+        if (user->op == IROp::Mul) {
+          // iv * c：起始值init * c，步长step * c
+          int64_t c;
+          IRValue* other = user->operands[0] == iv.phi ? user->operands[1] : user->operands[0];
+          if (!constantInt(other, c)) continue;
+          int64_t init;
+          IRValue* start;
+          if (constantInt(iv.init, init)) {
+            start = module.constInt(user->type, SCCP::wrap((uint64_t)init * (uint64_t)c, bits));
+          } else {
+            start = emit(IROp::Mul, user->type, iv.init, other, pre->terminator());
+          }
+          IRValue* step = module.constInt(user->type, SCCP::wrap((uint64_t)iv.step * (uint64_t)c, bits));
+          replace(user, newInductionVariable(loop, pre, latch, user, start, IROp::Add, step));
+          changed = true;
+        } else if (user->op == IROp::GetElementPtr && user->operands.back() == iv.phi && user->type.back() == '*') {
+          // gep base, ..., iv：其余操作数都在循环外时，改成每轮前进step个元素的指针
+          bool invariant = true;
+          for (size_t k = 0; k + 1 < user->operands.size(); k++) {
+            invariant = invariant && user->operands[k] != iv.phi && !loop.contains(user->operands[k]);
+          }
+          if (!invariant) continue;
+          IRInstruction* start = fn.createInst(IROp::GetElementPtr, user->type);
+          start->elemType = user->elemType;
+          start->flags = user->flags;
+          for (size_t k = 0; k + 1 < user->operands.size(); k++) start->addOperand(user->operands[k]);
+          start->addOperand(iv.init);
+          pre->insertBefore(pre->terminator(), start);
+          IRValue* step = module.constInt(iv.phi->type, iv.step);
+          replace(user, newInductionVariable(loop, pre, latch, user, start, IROp::GetElementPtr, step));
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+
+  // x / 2^k向零取整：负数先加上2^k - 1再算术右移
+  IRInstruction* divPowerOfTwo(IRInstruction* i, IRValue* x, unsigned k, unsigned bits) {
+    const std::string& t = i->type;
+    IRInstruction* sign = emit(IROp::AShr, t, x, module.constInt(t, bits - 1), i);
+    IRInstruction* bias = emit(IROp::LShr, t, sign, module.constInt(t, bits - k), i);
+    return emit(IROp::Add, t, x, bias, i);
+  }
+
+  // 32位x / d（d >= 2）：64位乘法取高位，再把负数的结果加一改成向零取整
+  IRInstruction* divMagic(IRInstruction* i, IRValue* x, int64_t d) {
+    int64_t m;
+    unsigned s;
+    magic(d, m, s);
+    IRInstruction* wide = cast(IROp::SExt, "i64", x, i);
+    IRInstruction* prod = emit(IROp::Mul, "i64", wide, module.constInt("i64", m), i);
+    IRInstruction* high = emit(IROp::AShr, "i64", prod, module.constInt("i64", 32 + s), i);
+    IRInstruction* q = cast(IROp::Trunc, "i32", high, i);
+    IRInstruction* neg = emit(IROp::LShr, "i32", x, module.constInt("i32", 31), i);
+    return emit(IROp::Add, "i32", q, neg, i);
+  }
+
+  bool reduceArithmetic(IRInstruction* i) {
+    if (i->op != IROp::Mul && i->op != IROp::SDiv && i->op != IROp::SRem) return false;
+    unsigned bits = SCCP::bitsOf(i->type);
+    if (bits < 2) return false;
+    const std::string& t = i->type;
+    IRValue* x = i->operands[0];
+    int64_t d;
+    if (i->op == IROp::Mul) {
+      if (!constantInt(i->operands[1], d)) {
+        if (!constantInt(x, d)) return false;
+        x = i->operands[1];
+      }
+      if (d == 1) {
+        replace(i, x);
+        return true;
+      }
+      int k = log2Exact(d);
+      if (k <= 0) return false;
+      replace(i, emit(IROp::Shl, t, x, module.constInt(t, k), i));
+      return true;
+    }
+
+    // 除数为0、-1、最小负数时保留原指令
+    if (!constantInt(i->operands[1], d)) return false;
+    int64_t minValue = SCCP::wrap(1ULL << (bits - 1), bits);
+    if (d == 0 || d == -1 || d == minValue) return false;
+    bool negative = d < 0;
+    if (negative) d = -d;
+    if (d == 1) {
+      replace(i, i->op == IROp::SDiv ? x : module.constInt(t, 0));
+      return true;
+    }
+    int k = log2Exact(d);
+    IRValue* q;
+    if (k > 0) {
+      IRInstruction* biased = divPowerOfTwo(i, x, k, bits);
+      if (i->op == IROp::SRem) {
+        // x % 2^k = x - (biased & -2^k)，余数的符号跟随被除数，与除数的符号无关
+        IRInstruction* rounded = emit(IROp::And, t, biased, module.constInt(t, -d), i);
+        replace(i, emit(IROp::Sub, t, x, rounded, i));
+        return true;
+      }
+      q = emit(IROp::AShr, t, biased, module.constInt(t, k), i);
+    } else if (bits == 32) {
+      q = divMagic(i, x, d);
+      if (i->op == IROp::SRem) {
+        IRInstruction* prod = emit(IROp::Mul, t, q, module.constInt(t, d), i);
+        replace(i, emit(IROp::Sub, t, x, prod, i));
+        return true;
+      }
+    } else {
+      return false;
+    }
+    if (negative) q = emit(IROp::Sub, t, module.constInt(t, 0), q, i);
+    replace(i, q);
+    return true;
+  }
+};
+
+inline bool reduceStrength(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= StrengthReduction(*f).run();
+  return changed;
+}
+
+#endif
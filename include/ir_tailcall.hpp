@@ -0,0 +1,224 @@
+#ifndef IR_TAILCALL_HPP
+#define IR_TAILCALL_HPP
+
+#include <vector>
+#include "ir_dce.hpp"
+#include "ir_gvn.hpp"
+
+// 尾递归消除：函数在尾位置调用自己时，把实参接到入口处的phi上再跳回开头，
+// 递归变成循环，栈深度不再随递归次数增长。形如 n * f(n - 1)、n + f(n - 1) 的
+// 递归用一个累加器phi改写：递归处先把n乘（加）进累加器，其他返回处返回累加器运算后的值
+class TailRecursionElimination {
+ public:
+  explicit TailRecursionElimination(IRFunction& f) : fn(f), module(*f.parent), pointers(f) {}
+
+  bool run() {
+    if (!fn.entry() || fn.vararg) return false;
+    // 被调函数可能通过逃逸的指针访问本函数的栈槽，改成循环后会复用同一个栈槽
+    for (IRInstruction* i = fn.entry()->first; i; i = i->next) {
+      if (i->op == IROp::Alloca && !pointers.isLocal(i)) return false;
+    }
+    // 每层在返回前free自己的堆上数组，改成循环后中间各层的释放会被跳过
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        if (i->op == IROp::Call && i->operands[0]->kind == IRValue::Kind::Global && i->operands[0]->name == "free") return false;
+      }
+    }
+    std::vector<Site> sites;
+    IROp accumulator = IROp::Ret;  // Ret表示不需要累加器
+    for (const auto& bb : fn.blocks) {
+      for (IRInstruction* i = bb->first; i; i = i->next) {
+        Site site;
+        if (!tailPosition(i, site)) continue;
+        if (site.op != IROp::Ret) {
+          if (accumulator != IROp::Ret && accumulator != site.op) continue;
+          accumulator = site.op;
+        }
+        sites.push_back(site);
+      }
+    }
+    if (sites.empty()) return false;
+    transform(sites, accumulator);
+    return true;
+  }
+
+ private:
+  IRFunction& fn;
+  IRModule& module;
+  PointerInfo pointers;
+
+  // 一个尾递归调用点，以及call结果可能参与的一次累加运算
+  struct Site {
+    IRInstruction* call = nullptr;
+    IROp op = IROp::Ret;
+    IRValue* operand = nullptr;  // 参与运算的另一个值
+  };
+
+  bool tailPosition(IRInstruction* call, Site& site) const {
+    if (call->op != IROp::Call || call->operands[0]->kind != IRValue::Kind::Global) return false;
+    if (call->operands[0]->name != fn.name || call->operands.size() != fn.args.size() + 1) return false;
+    // 实参不能指向本函数的栈槽
+    for (size_t k = 1; k < call->operands.size(); k++) {
+      if (PointerInfo::isAlloca(PointerInfo::root(call->operands[k]))) return false;
+    }
+    site.call = call;
+    IRValue* value = call->hasResult() ? call : nullptr;
+    IRBasicBlock* bb = call->parent;
+    IRInstruction* i = call->next;
+    // call的结果只能沿着这条路径流到ret
+    if (value && call->uses.size() != 1) return false;
+    if (i && (i->op == IROp::Add || i->op == IROp::Mul) && value && i->uses.size() == 1) {
+      IRValue* other = i->operands[0] == value ? i->operands[1] : i->operands[0];
+      if (other != value && (i->operands[0] == value || i->operands[1] == value)) {
+        site.op = i->op;
+        site.operand = other;
+        value = i;
+        i = i->next;
+      }
+    }
+    for (size_t steps = 0; i && steps < fn.blocks.size(); steps++) {
+      if (i->op == IROp::Ret) return i->operands.empty() ? !value : i->operands[0] == value;
+      if (i->op != IROp::Br) return false;
+      auto* succ = static_cast<IRBasicBlock*>(i->operands[0]);
+      IRInstruction* carried = nullptr;
+      IRInstruction* phi = succ->first;
+      for (; phi && phi->op == IROp::Phi; phi = phi->next) {
+        for (unsigned k = 0; k < phi->numIncoming(); k++) {
+          if (phi->incomingBlock(k) == bb && phi->incomingValue(k) == value && value) carried = phi;
+        }
+      }
+      // 没有phi接收时后继直接使用这个值
+      if (carried) value = carried;
+      bb = succ;
+      i = phi;
+    }
+    return false;
+  }
+
+  static IRValue* identity(IRModule& m, IROp op, const std::string& type) { return m.constInt(type, op == IROp::Mul ? 1 : 0); }
+
+  void transform(const std::vector<Site>& sites, IROp accumulator) {
+    // 原入口块变成循环头，新建一个入口块放栈槽
+    IRBasicBlock* header = fn.entry();
+    IRBasicBlock* entry = fn.createBlock("", header);
+    if (header->name.empty()) header->name = fn.uniqueName("tailrecurse");
+    for (IRInstruction* i = header->first; i;) {
+      IRInstruction* next = i->next;
+      if (i->op == IROp::Alloca) {
+        header->unlink(i);
+        entry->append(i);
+      }
+      i = next;
+    }
+    IRInstruction* br = fn.createInst(IROp::Br, "void");
+    br->addOperand(header);
+    entry->append(br);
+
+    std::vector<IRInstruction*> params;
+    for (const auto& arg : fn.args) {
+      IRInstruction* phi = fn.createInst(IROp::Phi, arg->type, fn.uniqueName(arg->name.empty() ? "arg" : arg->name + ".tr"));
+      header->insertBefore(header->first, phi);
+      arg->replaceAllUsesWith(phi);
+      phi->addIncoming(arg.get(), entry);
+      params.push_back(phi);
+    }
+    IRInstruction* acc = nullptr;
+    if (accumulator != IROp::Ret) {
+      acc = fn.createInst(IROp::Phi, fn.retType, fn.uniqueName("accumulator.tr"));
+      header->insertBefore(header->first, acc);
+      acc->addIncoming(identity(module, accumulator, fn.retType), entry);
+    }
+
+    for (const Site& site : sites) {
+      IRBasicBlock* bb = site.call->parent;
+      // 原来的后继不再有来自这个块的入边，路径上变得不可达的块最后由DCE删掉
+      IRInstruction* term = bb->terminator();
+      if (term->op == IROp::Br) {
+        auto* succ = static_cast<IRBasicBlock*>(term->operands[0]);
+        for (IRInstruction* phi = succ->first; phi && phi->op == IROp::Phi; phi = phi->next) {
+          for (unsigned k = 0; k < phi->numIncoming(); k++) {
+            if (phi->incomingBlock(k) == bb) {
+              phi->removeIncoming(k);
+              break;
+            }
+          }
+        }
+      }
+      while (bb->last != site.call) fn.erase(bb->last);
+      for (size_t k = 0; k < params.size(); k++) params[k]->addIncoming(site.call->operands[k + 1], bb);
+      if (acc) {
+        IRValue* next = acc;
+        if (site.op != IROp::Ret) {
+          IRValue* x = site.operand;
+          for (size_t k = 0; k < params.size(); k++) {
+            if (x == fn.args[k].get()) x = params[k];
+          }
+          next = emit(site.op, acc, x, site.call);
+        }
+        acc->addIncoming(next, bb);
+      }
+      fn.erase(site.call);
+      IRInstruction* jump = fn.createInst(IROp::Br, "void");
+      jump->addOperand(header);
+      bb->append(jump);
+    }
+
+    // 每次递归都原样传回的参数不需要phi
+    for (size_t k = 0; k < params.size(); k++) {
+      bool unchanged = true;
+      for (unsigned e = 0; e < params[k]->numIncoming(); e++) {
+        IRValue* v = params[k]->incomingValue(e);
+        unchanged = unchanged && (v == params[k] || v == fn.args[k].get());
+      }
+      if (!unchanged) continue;
+      params[k]->replaceAllUsesWith(fn.args[k].get());
+      fn.erase(params[k]);
+    }
+    if (acc) {
+      // 其余的返回处返回 acc op 返回值
+      for (const auto& bb : fn.blocks) {
+        IRInstruction* ret = bb->terminator();
+        if (!ret || ret->op != IROp::Ret) continue;
+        ret->setOperand(0, emit(accumulator, acc, ret->operands[0], ret));
+      }
+    }
+    DeadCodeElimination(fn).run();
+  }
+
+  IRInstruction* emit(IROp op, IRValue* a, IRValue* b, IRInstruction* before) {
+    IRInstruction* i = fn.createInst(op, fn.retType);
+    i->addOperand(a);
+    i->addOperand(b);
+    before->parent->insertBefore(before, i);
+    return i;
+  }
+};
+
+// 调用不会访问本函数的栈槽时加上tail标记，后端可以在尾位置复用栈帧；
+// memcpy/memset会访问传给它的栈槽，不加标记
+inline void markTailCalls(IRFunction& fn) {
+  if (!fn.entry()) return;
+  PointerInfo pointers(fn);
+  for (const auto& bb : fn.blocks) {
+    for (IRInstruction* i = bb->first; i; i = i->next) {
+      if (i->op == IROp::Alloca && !pointers.isLocal(i)) return;
+    }
+  }
+  for (const auto& bb : fn.blocks) {
+    for (IRInstruction* i = bb->first; i; i = i->next) {
+      if (i->op == IROp::Call && !PointerInfo::isMemoryIntrinsic(i)) i->tail = true;
+    }
+  }
+}
+
+inline bool eliminateTailRecursion(IRModule& m) {
+  bool changed = false;
+  for (auto& f : m.functions) changed |= TailRecursionElimination(*f).run();
+  return changed;
+}
+
+inline void markTailCalls(IRModule& m) {
+  for (auto& f : m.functions) markTailCalls(*f);
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef IR_TYPE_HPP
+#define IR_TYPE_HPP
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 驻留的LLVM类型：每个类型字符串只解析一次，展开后的写法、大小、对齐、元素类型
+// 都在解析时算好，之后的查询都是字段访问。生成器和IRBuilder目前仍然传类型字符串，
+// 每次查询先按字符串查一次表
+// TODO: toIRType、getLhsType、lhsAddress、IRBuilder和IRValue改为传const IRType*，只在IRPrinter中转成字符串
+struct IRType {
+  enum class Kind { Void, Int, Pointer, Array, Struct, Other };
+  Kind kind = Kind::Other;
+  std::string name;      // 原来的写法，如 [4 x %Pt]*
+  std::string expanded;  // 命名结构体展开成字段列表后的写法
+  unsigned bits = 0;     // 整数位数
+  const IRType* element = nullptr;  // 指针指向的类型或数组元素类型
+  int count = 0;                    // 数组长度
+  std::vector<const IRType*> fields;
+  // x86-64的数据布局：标量和指针按自身大小对齐，结构体字段按对齐补齐，总大小是对齐的倍数
+  int64_t size = 4;  // 大数组的字节数可能超过int
+  int align = 4;
+
+  bool isPointer() const { return kind == Kind::Pointer; }
+  bool isArray() const { return kind == Kind::Array; }
+  bool isAggregate() const { return kind == Kind::Array || kind == Kind::Struct; }
+};
+
+class IRTypeTable {
+ public:
+  const IRType* get(const std::string& s) {
+    auto it = cache.find(s);
+    if (it != cache.end()) return it->second;
+    const IRType* t = parse(s);
+    cache[s] = t;
+    return t;
+  }
+
+  // 命名结构体%name的字段类型。之前解析过的类型可能把它当成了未知类型，全部作废
+  void defineStruct(const std::string& name, std::vector<std::string> fieldTypes) {
+    structs[name] = std::move(fieldTypes);
+    cache.clear();
+  }
+
+ private:
+  std::unordered_map<std::string, const IRType*> cache;
+  std::vector<std::unique_ptr<IRType>> storage;  // 作废的类型也保留，已经拿到的指针仍然有效
+  std::unordered_map<std::string, std::vector<std::string>> structs;
+
+  IRType* create(const std::string& s, IRType::Kind kind) {
+    storage.push_back(std::make_unique<IRType>());
+    IRType* t = storage.back().get();
+    t->kind = kind;
+    t->name = t->expanded = s;
+    return t;
+  }
+
+  // {T1, T2, ...}按最外层的逗号切开
+  static std::vector<std::string> splitFields(const std::string& s) {
+    std::vector<std::string> fields;
+    int depth = 0;
+    std::string cur;
+    for (size_t k = 1; k + 1 < s.size(); k++) {
+      char c = s[k];
+      if (c == '{' || c == '[') depth++;
+      if (c == '}' || c == ']') depth--;
+      if (c == ',' && depth == 0) {
+        fields.push_back(cur);
+        cur.clear();
+      } else if (c != ' ' || !cur.empty()) {
+        cur += c;
+      }
+    }
+    while (!cur.empty() && cur.back() == ' ') cur.pop_back();
+    if (!cur.empty()) fields.push_back(cur);
+    return fields;
+  }
+
+  void layoutStruct(IRType* t, const std::vector<std::string>& fieldTypes) {
+    t->kind = IRType::Kind::Struct;
+    t->size = 0;
+    t->align = 1;
+    t->expanded = "{";
+    for (size_t k = 0; k < fieldTypes.size(); k++) {
+      const IRType* f = get(fieldTypes[k]);
+      t->fields.push_back(f);
+      t->size = (t->size + f->align - 1) / f->align * f->align + f->size;
+      t->align = std::max(t->align, f->align);
+      t->expanded += (k ? ", " : "") + f->expanded;
+    }
+    t->expanded += "}";
+    t->size = (t->size + t->align - 1) / t->align * t->align;
+  }
+
+  const IRType* parse(const std::string& s) {
+    if (s.empty()) return create(s, IRType::Kind::Other);
+    if (s.back() == '*') {
+      IRType* t = create(s, IRType::Kind::Pointer);
+      t->element = get(s.substr(0, s.size() - 1));
+      t->expanded = t->element->expanded + "*";
+      t->size = t->align = 8;
+      return t;
+    }
+    if (s[0] == '[') {
+      IRType* t = create(s, IRType::Kind::Other);
+      size_t x = s.find(" x ");
+      if (x == std::string::npos) return t;
+      t->kind = IRType::Kind::Array;
+      t->count = std::stoi(s.substr(1, x - 1));
+      t->element = get(s.substr(x + 3, s.size() - x - 4));
+      t->expanded = "[" + std::to_string(t->count) + " x " + t->element->expanded + "]";
+      t->size = t->element->size * t->count;
+      t->align = t->element->align;
+      return t;
+    }
+    if (s[0] == '{') {
+      IRType* t = create(s, IRType::Kind::Struct);
+      layoutStruct(t, splitFields(s));
+      return t;
+    }
+    if (s[0] == '%') {
+      IRType* t = create(s, IRType::Kind::Other);
+      auto it = structs.find(s.substr(1));
+      if (it != structs.end()) layoutStruct(t, it->second);
+      return t;
+    }
+    if (s == "void") return create(s, IRType::Kind::Void);
+    if (s[0] == 'i' && s.size() > 1 && std::all_of(s.begin() + 1, s.end(), ::isdigit)) {
+      IRType* t = create(s, IRType::Kind::Int);
+      t->bits = std::stoi(s.substr(1));
+      t->size = t->align = t->bits <= 8 ? 1 : t->bits <= 16 ? 2 : t->bits <= 32 ? 4 : 8;
+      return t;
+    }
+    return create(s, IRType::Kind::Other);
+  }
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef ITEM_INDEX_HPP
+#define ITEM_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "parser.hpp"
+
+//建好后不再变化的一组名字上的完美哈希（两级hash-and-displace）：
+//第一级把名字分到桶里，建表时按桶从大到小为每个桶找一个种子，让桶内的名字用这个种子
+//哈希后都落到还空着的槽里。查询固定是两次哈希加一次字符串比较，没有冲突链
+class PerfectHash {
+ public:
+  //重复的名字只保留最先出现的那个，find返回它在names中的下标
+  void build(const std::vector<std::string>& names) {
+    keys.clear();
+    positions.clear();
+    std::vector<int> order(names.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return names[a] < names[b]; });
+    for (size_t k = 0; k < order.size(); k++) {
+      if (k > 0 && names[order[k]] == names[order[k - 1]]) continue;
+      keys.push_back(names[order[k]]);
+      positions.push_back(order[k]);
+    }
+
+    size_t n = keys.size();
+    seeds.assign(std::max<size_t>(1, n / 2), 0);
+    slots.assign(n + n / 4 + 1, -1);
+    std::vector<std::vector<int>> buckets(seeds.size());
+    for (size_t i = 0; i < n; i++) buckets[hash(keys[i], 0) % seeds.size()].push_back((int)i);
+    std::vector<size_t> by_size(buckets.size());
+    for (size_t b = 0; b < by_size.size(); b++) by_size[b] = b;
+    std::stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+    std::vector<size_t> taken;
+    for (size_t b : by_size) {
+      if (buckets[b].empty()) break;
+      uint32_t seed = 1;
+      while (!place(buckets[b], seed, taken)) {
+        if (++seed == (1u << 24)) throw std::runtime_error("cannot build perfect hash for item index");
+      }
+      seeds[b] = seed;
+      for (size_t j = 0; j < taken.size(); j++) slots[taken[j]] = buckets[b][j];
+    }
+  }
+
+  //找不到时返回-1
+  int find(const std::string& name) const {
+    if (keys.empty()) return -1;
+    int i = slots[hash(name, seeds[hash(name, 0) % seeds.size()]) % slots.size()];
+    return (i >= 0 && keys[i] == name) ? positions[i] : -1;
+  }
+
+ private:
+  std::vector<std::string> keys;
+  std::vector<int> positions;  //keys[i]在names中的下标
+  std::vector<uint32_t> seeds; //每个桶的种子
+  std::vector<int> slots;      //槽中是keys的下标，空槽为-1
+
+  //用seed放下整个桶时返回true，taken是各个key的槽
+  bool place(const std::vector<int>& bucket, uint32_t seed, std::vector<size_t>& taken) const {
+    taken.clear();
+    for (int i : bucket) {
+      size_t slot = hash(keys[i], seed) % slots.size();
+      if (slots[slot] >= 0 || std::find(taken.begin(), taken.end(), slot) != taken.end()) return false;
+      taken.push_back(slot);
+    }
+    return true;
+  }
+
+  //FNV-1a，种子混进初始值，最后再搅一次让高位也参与取模
+  static uint64_t hash(const std::string& s, uint64_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+    for (unsigned char c : s) {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    return h ^ (h >> 32);
+  }
+};
+
+//整个程序顶层item的只读索引：parse之后建一次，语义检查和IR生成都从这里查
+//每张表建一个完美哈希，查找不随item数增长；同名的item保留最先出现的那个
+class ItemIndex {
+ public:
+  struct Field {
+    std::string name;
+    TypeNode* type;
+    int offset; //字段在struct中的下标，也就是IR中extractvalue/getelementptr用的下标
+  };
+
+  struct Struct {
+    std::string name;
+    const StructStructNode* node;
+    std::vector<Field> fields; //按声明顺序
+    PerfectHash field_index;
+
+    const Field* find_field(const std::string& field) const {
+      int i = field_index.find(field);
+      return i >= 0 ? &fields[i] : nullptr;
+    }
+  };
+
+  struct Method {
+    std::string type; //impl的类型
+    std::string name;
+    std::string trait; //inherent impl中的方法为空
+    FunctionNode* function;
+  };
+
+  struct Trait {
+    std::string name;
+    const TraitNode* node;
+  };
+
+  //块中定义的struct不进索引，用同样的表示记在各自的作用域里
+  static Struct make_struct(const StructStructNode* st) {
+    Struct s{st->identifier, st, {}, {}};
+    std::vector<std::string> names;
+    if (st->struct_fields) {
+      for (size_t i = 0; i < st->struct_fields->struct_fields.size(); i++) {
+        const auto& field = st->struct_fields->struct_fields[i];
+        s.fields.push_back({field->identifier, field->type.get(), (int)i});
+        names.push_back(field->identifier);
+      }
+    }
+    s.field_index.build(names);
+    return s;
+  }
+
+  static std::shared_ptr<const ItemIndex> build(const std::vector<std::unique_ptr<ASTNode>>& ast) {
+    auto index = std::make_shared<ItemIndex>();
+    for (const auto& node : ast) {
+      if (auto* item = dynamic_cast<ItemNode*>(node.get())) index->add(item);
+    }
+    index->finish();
+    return index;
+  }
+
+  const Struct* find_struct(const std::string& name) const {
+    int i = struct_index.find(name);
+    return i >= 0 ? &structs[i] : nullptr;
+  }
+
+  const Field* find_field(const std::string& struct_name, const std::string& field) const {
+    const Struct* s = find_struct(struct_name);
+    return s ? s->find_field(field) : nullptr;
+  }
+
+  //找不到时返回-1
+  int field_offset(const std::string& struct_name, const std::string& field) const {
+    const Field* f = find_field(struct_name, field);
+    return f ? f->offset : -1;
+  }
+
+  FunctionNode* find_function(const std::string& name) const {
+    int i = function_index.find(name);
+    return i >= 0 ? functions[i].second : nullptr;
+  }
+
+  //inherent impl中的方法优先于trait impl中的同名方法
+  const Method* find_method(const std::string& type, const std::string& name) const {
+    int i = method_index.find(pair_key(type, name));
+    return i >= 0 ? &methods[i] : nullptr;
+  }
+
+  //type的所有方法，是methods中连续的一段
+  std::pair<const Method*, const Method*> methods_of(const std::string& type) const {
+    int lo = type_index.find(type);
+    if (lo < 0) return {nullptr, nullptr};
+    size_t hi = lo;
+    while (hi < methods.size() && methods[hi].type == type) ++hi;
+    return {methods.data() + lo, methods.data() + hi};
+  }
+
+  const Trait* find_trait(const std::string& name) const {
+    int i = trait_index.find(name);
+    return i >= 0 ? &traits[i] : nullptr;
+  }
+
+  bool implements(const std::string& type, const std::string& trait) const {
+    return impl_index.find(pair_key(type, trait)) >= 0;
+  }
+
+ private:
+  std::vector<Struct> structs;
+  std::vector<std::pair<std::string, FunctionNode*>> functions;
+  std::vector<Method> methods; //按(type, name, trait)排序
+  std::vector<Trait> traits;
+  std::vector<std::pair<std::string, std::string>> trait_impls; //(type, trait)
+  PerfectHash struct_index;
+  PerfectHash function_index;
+  PerfectHash method_index; //(type, name)
+  PerfectHash type_index;   //type的第一个方法
+  PerfectHash trait_index;
+  PerfectHash impl_index;   //(type, trait)
+
+  //名字中不会出现'\0'，用它拼接两部分的key
+  static std::string pair_key(const std::string& a, const std::string& b) { return a + '\0' + b; }
+
+  void add(ItemNode* item) {
+    if (auto* func = dynamic_cast<FunctionNode*>(item)) {
+      functions.emplace_back(func->identifier, func);
+    } else if (auto* st = dynamic_cast<StructStructNode*>(item)) {
+      structs.push_back(make_struct(st));
+    } else if (auto* impl = dynamic_cast<InherentImplNode*>(item)) {
+      std::string type = impl->type ? impl->type->toString() : "";
+      for (auto& assoc : impl->associated_item) {
+        if (auto* fn = std::get_if<std::unique_ptr<FunctionNode>>(&assoc->associated_item)) {
+          methods.push_back({type, (*fn)->identifier, "", fn->get()});
+        }
+      }
+    } else if (auto* timpl = dynamic_cast<TraitImplNode*>(item)) {
+      std::string type = timpl->forType ? timpl->forType->toString() : "";
+      std::string trait = timpl->traitType ? timpl->traitType->toString() : "";
+      trait_impls.emplace_back(type, trait);
+      for (auto& assoc : timpl->associatedItems) {
+        if (auto* fn = std::get_if<std::unique_ptr<FunctionNode>>(&assoc->associated_item)) {
+          methods.push_back({type, (*fn)->identifier, trait, fn->get()});
+        }
+      }
+    } else if (auto* trait = dynamic_cast<TraitNode*>(item)) {
+      traits.push_back({trait->identifier, trait});
+    }
+  }
+
+  void finish() {
+    std::stable_sort(methods.begin(), methods.end(), [](const Method& a, const Method& b) {
+      return std::tie(a.type, a.name, a.trait) < std::tie(b.type, b.name, b.trait);
+    });
+    std::vector<std::string> names;
+    for (const auto& s : structs) names.push_back(s.name);
+    struct_index.build(names);
+    names.clear();
+    for (const auto& f : functions) names.push_back(f.first);
+    function_index.build(names);
+    names.clear();
+    for (const auto& m : methods) names.push_back(pair_key(m.type, m.name));
+    method_index.build(names);
+    names.clear();
+    for (const auto& m : methods) names.push_back(m.type);
+    type_index.build(names);
+    names.clear();
+    for (const auto& t : traits) names.push_back(t.name);
+    trait_index.build(names);
+    names.clear();
+    for (const auto& impl : trait_impls) names.push_back(pair_key(impl.first, impl.second));
+    impl_index.build(names);
+  }
+};
+
+#endif
@@ -3,12 +3,14 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <cstdint>
 #include <variant>
 #include <optional>
 #include <unordered_set>
 #include "lexer.hpp"
 
 class ModuleNode;
+class TypeNode;
 class FunctionNode;
 class StructStructNode;
 class TupleStructNode;
@@ -118,6 +120,8 @@ class of expression
 */
 class ExpressionNode : public ASTNode {
  public:
+  TypeNode* checked_type = nullptr; //语义检查推导出的类型（不拥有），IR生成直接使用
+
   ExpressionNode(NodeType t, int l, int c) : ASTNode(t, l, c) {};
 
   NodeType get_type() { return type; }
@@ -134,9 +138,29 @@ class of items
 */
 class ItemNode : public ASTNode {
  public:
+  //增量语义检查用：item所有token的hash、函数签名部分（函数体之前）的hash、item中出现过的identifier
+  uint64_t token_hash = 0;
+  uint64_t signature_hash = 0;
+  std::vector<std::string> referenced_names;
+
   ItemNode(NodeType t, int l, int c) : ASTNode(t, l, c) {};
 };
 
+//FNV-1a，对[begin, end)范围内token的类型和值做hash
+uint64_t hash_tokens(const std::vector<Token>& tokens, int begin, int end) {
+  uint64_t h = 1469598103934665603ULL;
+  auto mix = [&h](unsigned char c) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  };
+  for (int i = begin; i < end && i < tokens.size(); i++) {
+    mix(static_cast<unsigned char>(tokens[i].type));
+    for (char c : tokens[i].value) mix(static_cast<unsigned char>(c));
+    mix(0);
+  }
+  return h;
+}
+
 /*
 class of types
 */
@@ -1733,6 +1757,7 @@ class QualifiedPathInExpression {
 class PathExpressionNode : public ExpressionNode {
  public:
   std::variant<std::unique_ptr<PathInExpression>, std::unique_ptr<QualifiedPathInExpression>> path;
+  const void* binding = nullptr; //语义检查解析到的声明：LetStatement、FunctionParam、SelfParam或ConstantItemNode，函数名等为空
 
   template<typename T>
   PathExpressionNode(T p, int l, int c) : path(std::move(p)), ExpressionNode(NodeType::PathExpression, l, c) {};
@@ -1844,6 +1869,7 @@ class MethodCallExpressionNode : public ExpressionNode {
   std::unique_ptr<ExpressionNode> expression = nullptr;
   std::variant<PathInType, Identifier> path_expr_segment;
   std::unique_ptr<CallParams> call_params;
+  std::string resolved_method; //语义检查时解析到的方法，形如 Type::method
 
   template<typename T>
   MethodCallExpressionNode(std::unique_ptr<ExpressionNode> expr, T pes, std::unique_ptr<CallParams> cp, int l, int c) 
@@ -2606,6 +2632,20 @@ class parser {
 
   int get_pos() { return pos; }
 
+  //记录item的token hash和出现过的identifier，sig_end之前的token算作签名
+  void record_item_tokens(ItemNode* item, int begin, int sig_end) {
+    if (!item) return;
+    item->token_hash = hash_tokens(tokens, begin, pos);
+    item->signature_hash = hash_tokens(tokens, begin, sig_end);
+    std::unordered_set<std::string> names;
+    item->referenced_names.clear();
+    for (int i = begin; i < pos; i++) {
+      if (tokens[i].type == IDENTIFIER && names.insert(tokens[i].value).second) {
+        item->referenced_names.push_back(tokens[i].value);
+      }
+    }
+  }
+
   void roll_back(int pre_pos) {
     pos = pre_pos;
   }
@@ -5324,6 +5364,7 @@ Parser
 
   std::unique_ptr<FunctionNode> parser::ParseFunctionItem() {
     //std::cout << "ParseFunctionItem" << std::endl;
+    int begin = get_pos();
     FunctionQualifier fq = parseFunctionQualifier();
     auto fn_tok = get();
     if (!fn_tok || fn_tok->value != "fn") {
@@ -5351,6 +5392,7 @@ Parser
       func->return_type = ParseFunctionReturnType();
     }
     next = peek();
+    int sig_end = get_pos();
 
     if (next && next->value == "{") {
       //std::cout << "parse block expression in function item" << std::endl;
@@ -5366,12 +5408,14 @@ Parser
     } else {
       throw std::runtime_error("Expected function body or ';'");
     }
+    record_item_tokens(func.get(), begin, sig_end);
 
     return func;
   }
 
   std::unique_ptr<FunctionNode> parser::ParseFunctionItemInImpl(const std::string& impl_type_name) {
     //std::cout << "ParseFunctionItemInImpl" << std::endl;
+    int begin = get_pos();
     FunctionQualifier fq = parseFunctionQualifier();
 
     auto fn_tok = get();
@@ -5401,6 +5445,7 @@ Parser
     }
 
     next = peek();
+    int sig_end = get_pos();
     if (next && next->value == "{") {
       //std::cout << "parse block expression" << std::endl;
       func->block_expression = std::move(parseBlockExpression());
@@ -5410,6 +5455,7 @@ Parser
       throw std::runtime_error("Expected function body or ';'");
     }
     func->impl_type_name = impl_type_name;
+    record_item_tokens(func.get(), begin, sig_end);
     return func;
   }
 
@@ -6475,12 +6521,17 @@ std::unique_ptr<TypePathFn> parser::ParseTypePathFn() {
       if (!tok) break;
 
       std::unique_ptr<ASTNode> node;
+      int begin = get_pos();
 
       try { node = std::move(upcast<ASTNode>(ParseItem())); }
       catch (const std::exception& e) { 
         //std::cerr << "Caught exception: " << e.what() << std::endl;
         node = nullptr; 
       }
+      if (auto* item = dynamic_cast<ItemNode*>(node.get())) {
+        //函数在ParseFunctionItem里已经记录过，其他item整体都算签名
+        if (!dynamic_cast<FunctionNode*>(item)) record_item_tokens(item, begin, get_pos());
+      }
 
       if (tok->value == "struct" || tok->value == "fn" || tok->value == "impl" || tok->value == "enum" || tok->value == "const") {
         if (!node) throw std::runtime_error("error in parsing item");
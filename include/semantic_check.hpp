@@ -1,6 +1,15 @@
 #ifndef SEMANTIC_HPP
 #define SEMANTIC_HPP
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
 #include "parser.hpp"
+#include "const_eval.hpp"
+#include "item_index.hpp"
 
 template<typename T, typename U>
 bool isSameDerived(const std::unique_ptr<T>& lhs, const std::unique_ptr<U>& rhs) {
@@ -8,16 +17,6 @@ bool isSameDerived(const std::unique_ptr<T>& lhs, const std::unique_ptr<U>& rhs)
   return typeid(*lhs) == typeid(*rhs);
 }
 
-bool isOverflow(const std::string num) {
-  const std::string MAX_INT_STR = "2147483647";
-
-  if (num.size() > MAX_INT_STR.size()) return true;
-
-  if (num.size() < MAX_INT_STR.size()) return false;
-
-  return num > MAX_INT_STR;
-}
-
 std::string getFunctionParamTypeString(const FunctionParam* param) {
   return std::visit([](auto&& arg) -> std::string {
     using T = std::decay_t<decltype(arg)>;
@@ -33,22 +32,13 @@ std::string getFunctionParamTypeString(const FunctionParam* param) {
   }, param->info);
 }
 
-struct FieldInfo {
-  std::string name;
-  TypeNode* type;
-};
-
-struct StructInfo {
-  std::string name;
-  std::vector<FieldInfo> fields;
-};
-
 struct Symbol {
   std::string name;
   TypeNode* type;
   bool isMutable;
   bool isRef;
   bool isInitialized;
+  const void* decl = nullptr; //声明这个名字的节点，记到PathExpressionNode::binding上
 };
 
 struct FunctionSymbol {
@@ -63,32 +53,11 @@ struct TypeSymbol {
   TypeNode* node = nullptr;
 };
 
-struct TraitSymbol {
-  std::string name;
-  bool isUnsafe = false;
-  std::vector<FunctionSymbol> functions;
-  std::vector<std::string> super_traits;
-};
-
-struct struct_item {
-  std::string struct_id;
-  std::string item_id;
-
-  bool operator<(const struct_item& other) const noexcept {
-    return std::tie(struct_id, item_id) < std::tie(other.struct_id, other.item_id);
-  }
-
-  bool operator==(const struct_item& other) const noexcept {
-    return struct_id == other.struct_id && item_id == other.item_id;
-  }
-};
-
 struct SymbolTable {
   std::unordered_set<std::string> structs;
   std::unordered_map<std::string, FunctionParameter*> functions;
   std::unordered_map<std::string, TypeNode*> function_types;
   std::unordered_set<std::string> constants;
-  std::map<struct_item, std::string> struct_items; //从identifier到type的map
 
   SymbolTable() = default;
 
@@ -96,10 +65,6 @@ struct SymbolTable {
     return structs.count(name);
   }
 
-  bool has_struct_item(const std::string& struct_name, const std::string& item_name) const {
-    return struct_items.count({struct_name, item_name});
-  }
-
   bool has_function(const std::string& name) const {
     return functions.count(name);
   }
@@ -107,16 +72,13 @@ struct SymbolTable {
   bool has_constant(const std::string& name) const {
     return constants.count(name);
   }
-
-  bool has_struct_item(const std::string& struct_name, const std::string& item_name) {
-    return struct_items.count({struct_name, item_name});
-  }
 };
 
 struct ConstantInfo {
   std::string id;
   TypeNode* type;
   ExpressionNode* expr;
+  const ConstantItemNode* node;
 };
 
 class Scope {
@@ -127,9 +89,9 @@ class Scope {
   //如果是一个普通的func，key是function的identifier
   //var_table同理
   std::unordered_map<std::string, TypeSymbol> type_table;      // 类型
-  std::unordered_map<std::string, StructInfo> declared_struct; //已经声明的struct
-  std::unordered_map<std::string, FunctionSymbol> declared_struct_functions; //已经声明的struct的函数, key是struct+"::"+函数的id，value是这个函数的相关信息
-  std::unordered_map<std::string, TraitSymbol> trait_table; //从trait到trait相关信息的函数
+  //顶层的struct和trait都在ItemIndex里，这里只记块中定义的
+  std::unordered_map<std::string, ItemIndex::Struct> local_structs;
+  std::unordered_map<std::string, const TraitNode*> local_traits;
   std::unordered_map<std::string, ConstantInfo> const_table; //从const的id到信息
   SymbolTable symbol_table;
   Scope* parent; // 父作用域
@@ -146,7 +108,8 @@ class Scope {
   }
 
   Symbol* lookupVar(const std::string& name) {
-    if (var_table.count(name)) return &var_table[name];
+    auto it = var_table.find(name);
+    if (it != var_table.end()) return &it->second;
     if (parent) return parent->lookupVar(name);
     return nullptr;
   }
@@ -160,11 +123,9 @@ class Scope {
   }
 
   FunctionSymbol* lookupFunc(const std::string& name) {
-    if (func_table.count(name)) {
-      return &func_table[name];
-    }
-    if (declared_struct_functions.count(name)) {
-      return &declared_struct_functions[name];
+    auto it = func_table.find(name);
+    if (it != func_table.end()) {
+      return &it->second;
     }
     if (parent) {
       return parent->lookupFunc(name);
@@ -172,20 +133,12 @@ class Scope {
     return nullptr;
   }
 
-  FunctionSymbol* lookupStructFunc(const std::string& name) {
-    if (declared_struct_functions.count(name)) {
-      return &declared_struct_functions[name];
-    }
-    if (parent) {
-      return parent->lookupStructFunc(name);
-    }
-    return nullptr;
-  }
 
   
   TypeNode* get_function_type(const std::string& name) {
-    if (symbol_table.function_types.count(name)) {
-      return symbol_table.function_types[name];
+    auto it = symbol_table.function_types.find(name);
+    if (it != symbol_table.function_types.end()) {
+      return it->second;
     } else if (parent) {
       return parent->get_function_type(name);
     }
@@ -201,14 +154,23 @@ class Scope {
   }
 
   TypeSymbol* lookupType(const std::string& name) {
-    if (type_table.count(name)) return &type_table[name];
+    auto it = type_table.find(name);
+    if (it != type_table.end()) return &it->second;
     if (parent) return parent->lookupType(name);
     return nullptr;
   }
 
-  StructInfo* lookupStruct(const std::string& name) {
-    if (declared_struct.count(name)) return &declared_struct[name];
-    if (parent) return parent->lookupStruct(name);
+  const ItemIndex::Struct* lookupLocalStruct(const std::string& name) {
+    auto it = local_structs.find(name);
+    if (it != local_structs.end()) return &it->second;
+    if (parent) return parent->lookupLocalStruct(name);
+    return nullptr;
+  }
+
+  const TraitNode* lookupLocalTrait(const std::string& name) {
+    auto it = local_traits.find(name);
+    if (it != local_traits.end()) return it->second;
+    if (parent) return parent->lookupLocalTrait(name);
     return nullptr;
   }
 
@@ -226,8 +188,9 @@ class Scope {
   }
 
   FunctionParameter* find_func_param(const std::string& name) {
-    if (symbol_table.functions.count(name)) {
-      return symbol_table.functions[name];
+    auto it = symbol_table.functions.find(name);
+    if (it != symbol_table.functions.end()) {
+      return it->second;
     } else {
       if (parent) return parent->find_func_param(name);
       else return nullptr;
@@ -235,8 +198,9 @@ class Scope {
   }
 
   ConstantInfo* lookupConst(const std::string& name) {
-    if (const_table.count(name)) {
-      return &const_table[name];
+    auto it = const_table.find(name);
+    if (it != const_table.end()) {
+      return &it->second;
     } else {
       if (parent) return parent->lookupConst(name);
       else return nullptr;
@@ -266,18 +230,135 @@ bool is_type_equal(const TypeNode* type1, const TypeNode* type2) {
   return s1 == s2;
 }
 
+uint64_t hash_combine(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+uint64_t hash_string(const std::string& str) {
+  uint64_t h = 1469598103934665603ULL;
+  for (char c : str) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+//增量语义检查的缓存，key是函数体的token和它依赖的签名算出来的hash，value是检查结果和诊断信息
+//命中时只跳过检查，IR生成用的标注（checked_type、binding）指向本次的AST，仍然重新计算
+//文件格式：第一行是版本，之后每条记录是 "key ok 诊断长度" 一行，后面跟着诊断内容
+class CheckCache {
+ public:
+  struct Entry {
+    bool ok;
+    std::string diag;
+  };
+
+  static constexpr const char* VERSION = "rcompiler-check-cache 1";
+
+  std::string path;
+  std::unordered_map<uint64_t, Entry> entries; //从文件里读到的结果
+  std::unordered_map<uint64_t, Entry> current; //本次检查用到的结果，保存时只写这些，删掉的函数不会一直留在文件里
+  size_t lookups = 0;
+  size_t hits = 0;
+
+  CheckCache(std::string p) : path(std::move(p)) {}
+
+  void load() {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return;
+    std::string header;
+    if (!std::getline(in, header) || header != VERSION) return;
+    uint64_t key;
+    int ok;
+    size_t len;
+    while (in >> key >> ok >> len) {
+      in.get();
+      std::string diag(len, '\0');
+      if (!in.read(&diag[0], len)) break;
+      entries[key] = Entry{ok != 0, std::move(diag)};
+    }
+  }
+
+  bool find(uint64_t key, Entry& entry) {
+    lookups++;
+    auto it = entries.find(key);
+    if (it == entries.end()) return false;
+    hits++;
+    entry = it->second;
+    current[key] = it->second;
+    return true;
+  }
+
+  void store(uint64_t key, Entry entry) {
+    current[key] = std::move(entry);
+  }
+
+  //先写临时文件再rename，中途失败不会留下写了一半的缓存
+  bool save() const {
+    std::string tmp = path + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      if (!out) return false;
+      out << VERSION << '\n';
+      for (const auto& [key, entry] : current) {
+        out << key << ' ' << (entry.ok ? 1 : 0) << ' ' << entry.diag.size() << '\n' << entry.diag;
+      }
+      if (!out) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+  void report(std::ostream& os) const {
+    double rate = lookups ? 100.0 * hits / lookups : 0.0;
+    os << "semantic check cache: " << hits << "/" << lookups << " function body checks skipped ("
+       << std::fixed << std::setprecision(1) << rate << "%), all bodies re-annotated" << std::endl;
+  }
+};
+
 class semantic_checker {
  private:
   std::vector<std::unique_ptr<ASTNode>> ast;
   Scope* currentScope;
+  std::ostream* err = &std::cerr; //诊断信息的输出，并行检查时每个函数体写到自己的buffer里
+  std::unique_ptr<CheckCache> cache; //增量检查的缓存，没有调用enable_cache时为空
+  std::shared_ptr<ConstEvaluator> consts = std::make_shared<ConstEvaluator>(); //常量求值，之后交给IRGenerator继续使用
+  std::shared_ptr<const ItemIndex> items; //顶层item的只读索引，构造时建立，IRGenerator也使用
+
+  //一个需要单独检查的函数体；impl不为空时是impl中的方法
+  struct BodyJob {
+    const FunctionNode* function;
+    const InherentImplNode* impl;
+    std::string possible_self;
+  };
+
+  //并行检查用的checker：以冻结的全局scope为父作用域，自己的scope链只在当前线程里使用
+  semantic_checker(Scope* global, std::ostream* diag, std::shared_ptr<ConstEvaluator> c, std::shared_ptr<const ItemIndex> index)
+      : currentScope(new Scope(global)), err(diag), consts(std::move(c)), items(std::move(index)) {}
 
  public:
   ~semantic_checker() = default;
 
   semantic_checker(std::vector<std::unique_ptr<ASTNode>> a) : ast(std::move(a)) {
     currentScope = new Scope(nullptr);
+    items = ItemIndex::build(ast);
   };
 
+  //打开增量检查的缓存文件，check()时hash没有变化的函数体直接使用上次的结果
+  void enable_cache(const std::string& path) {
+    cache = std::make_unique<CheckCache>(path);
+    cache->load();
+  }
+
+  const CheckCache* get_cache() const { return cache.get(); }
+
+  //检查完成后取出带有类型标注的AST，交给IRGenerator，不需要重新parse
+  std::vector<std::unique_ptr<ASTNode>> take_ast() { return std::move(ast); }
+
+  //检查时已经求出的常量值，IRGenerator直接复用
+  std::shared_ptr<ConstEvaluator> get_const_evaluator() const { return consts; }
+
+  std::shared_ptr<const ItemIndex> get_item_index() const { return items; }
+
   void enterScope() {
     Scope* newScope = new Scope(currentScope);
     currentScope = newScope;
@@ -295,8 +376,8 @@ class semantic_checker {
     }
   }
 
-  void declareVariable(const std::string& name, TypeNode* type, bool isMut) {
-    Symbol sym{name, type, isMut, false};
+  void declareVariable(const std::string& name, TypeNode* type, bool isMut, const LetStatement* decl) {
+    Symbol sym{name, type, isMut, false, false, decl};
     currentScope->insertVar(name, std::move(sym));
     //std::cout << "declaring variable : " << name << std::endl; 
   }
@@ -379,7 +460,7 @@ class semantic_checker {
         typeNode = typedSelf->type.get();
       }
 
-      Symbol selfSymbol{selfName, typeNode, false, true};
+      Symbol selfSymbol{selfName, typeNode, false, true, false, self.get()};
       currentScope->insertVar(selfName, std::move(selfSymbol));
     }
 
@@ -427,30 +508,27 @@ class semantic_checker {
         }
         //std::cout << "declaring: " << paramName << " whose if_mut is " << if_mut << std::endl;
       } else if (std::holds_alternative<std::unique_ptr<ellipsis>>(fp->info)) {
-        std::cerr << "Variadic ... parameters not supported" << std::endl;
+        *err << "Variadic ... parameters not supported" << std::endl;
         continue;
       } else {
         throw std::runtime_error("wrong type of element in functionparameter");
       }
 
-      Symbol paramSymbol{paramName, typeNode, if_mut, true};
+      Symbol paramSymbol{paramName, typeNode, if_mut, true, false, fp};
       currentScope->insertVar(paramName, std::move(paramSymbol));
     }
   }
 
+  void declareConstant(const ConstantItemNode* Const) {
+    ConstantInfo info{Const->identifier.value(), Const->type.get(), Const->expression.get(), Const};
+    currentScope->const_table[Const->identifier.value()] = info;
+    Symbol symbol{Const->identifier.value(), Const->type.get(), false, false, true, Const};
+    currentScope->insertVar(Const->identifier.value(), symbol);
+  }
+
   void declareStruct(const StructStructNode* structNode) {
     if (!structNode) return;
 
-    StructInfo structInfo;
-    structInfo.name = structNode->identifier;
-
-    for (const auto& field : structNode->struct_fields->struct_fields) {
-      FieldInfo fieldInfo;
-      fieldInfo.name = field->identifier;
-      fieldInfo.type = field->type.get();
-      structInfo.fields.push_back(std::move(fieldInfo));
-    }
-
     TypeSymbol typeSym;
     typeSym.name = structNode->identifier;
     //不要type，直接到declaredScope里面找有没有这个identifier对应的struct
@@ -464,10 +542,42 @@ class semantic_checker {
       targetScope->insertType(structNode->identifier, typeSym);
       //std::cout << "Declared struct struct type: " << structNode->identifier << " in scope: " << currentScope->id << std::endl;
     } catch (const std::exception& e) {
-      std::cerr << "Error declaring struct: " << e.what() << std::endl;
+      *err << "Error declaring struct: " << e.what() << std::endl;
     }
 
-    currentScope->declared_struct[structNode->identifier] = std::move(structInfo);
+    //块中的struct（以及重复定义的顶层struct）不是索引里的那个节点，记在当前作用域里遮住外层的同名struct
+    auto* indexed = items->find_struct(structNode->identifier);
+    if (!indexed || indexed->node != structNode) {
+      currentScope->local_structs[structNode->identifier] = ItemIndex::make_struct(structNode);
+    }
+  }
+
+  const ItemIndex::Struct* lookup_struct(const std::string& name) {
+    if (auto* local = currentScope->lookupLocalStruct(name)) return local;
+    return items->find_struct(name);
+  }
+
+  const TraitNode* lookup_trait(const std::string& name) {
+    if (auto* local = currentScope->lookupLocalTrait(name)) return local;
+    auto* indexed = items->find_trait(name);
+    return indexed ? indexed->node : nullptr;
+  }
+
+  //struct中字段的类型，没有这个字段时为nullptr
+  static TypeNode* field_type(const ItemIndex::Struct* s, const std::string& field) {
+    auto* f = s->find_field(field);
+    return f ? f->type : nullptr;
+  }
+
+  //trait中声明的函数名，按声明顺序
+  static std::vector<std::string> trait_functions(const TraitNode* trait) {
+    std::vector<std::string> names;
+    for (const auto& item : trait->associatedItems) {
+      if (auto funcPtr = std::get_if<std::unique_ptr<FunctionNode>>(&item->associated_item)) {
+        if (std::find(names.begin(), names.end(), (*funcPtr)->identifier) == names.end()) names.push_back((*funcPtr)->identifier);
+      }
+    }
+    return names;
   }
 
   
@@ -1554,16 +1664,12 @@ class semantic_checker {
                 struct_type = ref->type.get();
               }
               std::string struct_name = struct_type->toString();
-              auto* structInfo = currentScope->lookupStruct(struct_name);
+              auto* structInfo = lookup_struct(struct_name);
               std::string item_name = field_expr->identifier.id;
               //std::cout << "finding " << item_name << " in struct: " << structInfo->name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "item in struct " << structInfo->name << " : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  auto* array_type = dynamic_cast<ArrayTypeNode*>(t);
-                  return array_type->type->toString();
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                auto* array_type = dynamic_cast<ArrayTypeNode*>(t);
+                return array_type->type->toString();
               }
             }
             //std::cout << "error in getting type in indexexpression with field expression" << std::endl;
@@ -1741,16 +1847,12 @@ class semantic_checker {
                 struct_type = ref->type.get();
               }
               std::string struct_name = struct_type->toString();
-              auto* structInfo = currentScope->lookupStruct(struct_name);
+              auto* structInfo = lookup_struct(struct_name);
               std::string item_name = field_expr->identifier.id;
               //std::cout << "finding " << item_name << " in struct: " << structInfo->name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "item in struct " << structInfo->name << " : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  auto* array_type = dynamic_cast<ArrayTypeNode*>(t);
-                  return array_type->type->toString();
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                auto* array_type = dynamic_cast<ArrayTypeNode*>(t);
+                return array_type->type->toString();
               }
             }
             //std::cout << "error in getting type in indexexpression with field expression" << std::endl;
@@ -1781,14 +1883,31 @@ class semantic_checker {
           || type == "bool" || type == "char" || type == "()");
   }
 
-  bool check_array_length_const(ArrayTypeNode* array) {//检查arrayType的长度是pathExpression的时候是不是const类型
-    if (auto* len = dynamic_cast<PathExpressionNode*>(array->expression.get())) {
-      std::string length = len->toString();
-      //std::cout << "length of array : " << length << std::endl;
-      if (!currentScope->lookupConst(length)) return false;
-      if (auto* subArray = dynamic_cast<ArrayTypeNode*>(array->type.get())) {
-        if (!check_array_length_const(subArray)) return false;
-      }
+  //在当前作用域中按名字找const item，Self::X按possible_self展开；找不到时求值器再查全局的const
+  //求值器调用resolver时持有自己的锁，这里不能再调用consts
+  ConstEvaluator::Resolver const_resolver() {
+    return [this](const std::string& name) -> const ConstantItemNode* {
+      std::string key = name;
+      if (key.rfind("Self::", 0) == 0) key = currentScope->possible_self + key.substr(4);
+      if (auto* info = currentScope->lookupConst(key)) return info->node;
+      return nullptr;
+    };
+  }
+
+  //数组长度或重复次数的值，不是常量表达式时返回-1
+  int array_length(const ExpressionNode* expr) {
+    auto len = consts->array_length(expr, const_resolver());
+    return len ? (int)*len : -1;
+  }
+
+  bool check_array_length_const(ArrayTypeNode* array) {//检查arrayType的长度是不是合法的常量表达式
+    std::string why;
+    if (!consts->array_length(array->expression.get(), const_resolver(), &why)) {
+      *err << "invalid array length: " << why << std::endl;
+      return false;
+    }
+    if (auto* subArray = dynamic_cast<ArrayTypeNode*>(array->type.get())) {
+      if (!check_array_length_const(subArray)) return false;
     }
     return true;
   }
@@ -1846,6 +1965,104 @@ class semantic_checker {
     return false;
   }
 
+  //登记函数签名，check_Item和并行检查前的声明阶段共用
+  void declare_function(const FunctionNode* function) {
+    FunctionSymbol func_info;
+    func_info.name = function->identifier;
+    func_info.param_types = function->function_parameter.get();
+
+    if (function->return_type) func_info.return_type = function->return_type->type.get();
+
+    currentScope->insertFunc(function->identifier, func_info);
+
+    currentScope->symbol_table.functions[function->identifier] = function->function_parameter.get();
+    currentScope->symbol_table.function_types[function->identifier] = func_info.return_type;
+  }
+
+  //检查impl的类型是否已经声明，并把所有方法登记到当前scope的func_table里
+  bool declare_impl(const InherentImplNode* Impl) {
+    std::string type = Impl->type->toString();
+    //std::cout << "type of InherentImplNode : " << type << std::endl;
+    if (!lookup_struct(type)) {
+      //std::cout << "[Error]: Trying to implement an undeclared struct" << std::endl;
+      return false;
+    }
+    for (int i = 0; i < Impl->associated_item.size(); i++) {
+      if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&Impl->associated_item[i]->associated_item)) {
+        if (funcNode->get()->block_expression && has_exit_in_block(funcNode->get()->block_expression.get())) {
+          *err << "exit not allowed in methods" << std::endl;
+          return false;
+        }
+      }
+    }
+    for (int i = 0; i < Impl->associated_item.size(); i++) {
+      if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&Impl->associated_item[i]->associated_item)) {
+        FunctionNode* function = funcNode->get();
+
+        FunctionSymbol fs;
+        fs.name = function->identifier;
+        fs.param_types = function->function_parameter.get();
+        if (function->return_type) fs.return_type = function->return_type->type.get();
+        fs.impl_type_name = type;
+        std::string func_to_declare = type + "::" + fs.name;
+        currentScope->insertFunc(func_to_declare, fs);
+        //std::cout << "declaring function: " << func_to_declare << " in scope: " << currentScope->id << std::endl;
+      }
+    }
+    return true;
+  }
+
+  //检查impl中一个方法的函数体，currentScope是impl对应的scope，possible_self已经设置好
+  bool check_impl_method(const InherentImplNode* Impl, const FunctionNode* function) {
+    if (function->block_expression) {
+      //std::cout << "checking blockexpression of function in scope : " << currentScope->id << std::endl;
+      enterScope();
+      declareFunctionParameters(function->function_parameter.get(), currentScope, function->impl_type_name);
+      bool ans = check_BlockExpression_without_changing_scope(dynamic_cast<BlockExpressionNode*>(function->block_expression.get()));
+      exitScope();
+      //std::cout << "finish checking block expression" << std::endl;
+      if (!ans) {
+        return ans;
+      }
+    }
+  
+    if (function->return_type && function->block_expression) {
+      //std::cout << "checking if return type mismatch in function : " << function->identifier << std::endl;
+      std::string declared_return_type = function->return_type->type->toString();
+      if (!currentScope->is_forward_declared(declared_return_type) && !is_legal_type(declared_return_type)) {
+        //std::cout << "undefined return type : " << declared_return_type << " in function : " << function->identifier << std::endl;
+      }
+      //std::cout << "checking if the return types match in blockexpression" << std::endl;
+      //std::cout << "current scope : " << currentScope->id << std::endl;
+      enterScope();
+      declareFunctionParameters(function->function_parameter.get(), currentScope, function->impl_type_name);
+      if (!check_return_type_without_changing_scope(function->block_expression.get())) {
+        //std::cout << "return type mismatch in blockexpression" << std::endl;
+        exitScope();
+        return false;
+      }
+      //std::cout << "getting return type in blockexpression" << std::endl;
+      //std::cout << "current scope : " << currentScope->id << std::endl;
+      std::string actual_return_type = get_return_type_without_changing_scope(function->block_expression.get());
+      size_t pos = actual_return_type.rfind("::");
+      if (pos != std::string::npos) {
+        actual_return_type = actual_return_type.substr(0, pos);
+      }
+      if (declared_return_type == "Self" || declared_return_type == "self") {
+        declared_return_type = Impl->type->toString();
+      }
+      //std::cout << "declared return type: " << declared_return_type << std::endl;
+      //std::cout << "actual return type: " << actual_return_type << std::endl;
+      if (declared_return_type != "Self" && declared_return_type != "self" && actual_return_type != declared_return_type) {
+        //std::cout << "[Return Type Error]: function " << function->identifier << std::endl;
+        exitScope();
+        return false;
+      }
+      exitScope();
+    }
+    return true;
+  }
+
   //在impl中，function可能会有selfParam，需要记录self指向的是什么类型，同时需要记录这个类型的函数和成员来检查methodcall是否合法
   //function本身只需要记录可能存在的self是指向什么类，在Scope中存储这个类的相关信息
   bool check_Item(const ItemNode* expr) {
@@ -1860,7 +2077,7 @@ class semantic_checker {
           return false;
         }
         if (has_sth_after_exit(function->block_expression.get())) {
-          std::cerr << "nothing allowed after exit in main function" << std::endl;
+          *err << "nothing allowed after exit in main function" << std::endl;
           return false;
         }
         if (function->return_type) {
@@ -1875,22 +2092,13 @@ class semantic_checker {
       } else {
         if (function->block_expression) {
           if (has_exit_in_block(function->block_expression.get())) {
-            std::cerr << "function exit cannot be used in non_main function" << std::endl;
+            *err << "function exit cannot be used in non_main function" << std::endl;
             return false;
           }
         }
       }
-      
-      FunctionSymbol func_info;
-      func_info.name = function->identifier;
-      func_info.param_types = function->function_parameter.get();
 
-      if (function->return_type) func_info.return_type = function->return_type->type.get();
-
-      currentScope->insertFunc(function->identifier, func_info);
-
-      currentScope->symbol_table.functions[function->identifier] = function->function_parameter.get();
-      currentScope->symbol_table.function_types[function->identifier] = func_info.return_type;
+      declare_function(function);
 
       if (function->block_expression) {
         //std::cout << "checking blockexpression of function in scope : " << currentScope->id << std::endl;
@@ -1973,44 +2181,33 @@ class semantic_checker {
     }
     //===Trait===
     if (auto* Trait = dynamic_cast<const TraitNode*>(expr)) {
-      //在trait_table里插入对应信息
-      if (currentScope->trait_table.find(Trait->identifier) != currentScope->trait_table.end()) {
-        std::cerr << "Error: duplicate trait definition: " << Trait->identifier << std::endl;
+      //顶层trait在索引里，索引中同名的是另一个节点说明重复定义；块中的trait记在当前作用域里
+      auto* indexed = items->find_trait(Trait->identifier);
+      bool top_level = indexed && indexed->node == Trait;
+      if ((!top_level && indexed && !currentScope->parent) || currentScope->local_traits.count(Trait->identifier)) {
+        *err << "Error: duplicate trait definition: " << Trait->identifier << std::endl;
         return false;
       }
 
-      TraitSymbol traitSym;
-      traitSym.name = Trait->identifier;
-
+      std::vector<std::string> declared;
       for (const auto& item : Trait->associatedItems) {
         if (auto funcPtr = std::get_if<std::unique_ptr<FunctionNode>>(&item->associated_item)) {
-          FunctionNode* func = funcPtr->get();
-
-          FunctionSymbol funcSym;
-          funcSym.name = func->identifier;
-          funcSym.param_types = func->function_parameter.get();
-          funcSym.return_type = func->return_type ? func->return_type->type.get() : nullptr;
-          funcSym.impl_type_name = std::nullopt;
-
-          bool dup = false;
-          for (auto& existing : traitSym.functions) {
-            if (existing.name == funcSym.name) {
-              std::cerr << "Error: duplicate function " << funcSym.name << " in trait " << Trait->identifier << std::endl;
-              dup = true;
-              break;
-            }
+          const std::string& name = (*funcPtr)->identifier;
+          if (std::find(declared.begin(), declared.end(), name) != declared.end()) {
+            *err << "Error: duplicate function " << name << " in trait " << Trait->identifier << std::endl;
+          } else {
+            declared.push_back(name);
           }
-          if (!dup) traitSym.functions.push_back(funcSym);
         }
         else if (auto constPtr = std::get_if<std::unique_ptr<ConstantItemNode>>(&item->associated_item)) {
 
         }
         else {
-          std::cerr << "Warning: unknown associated item in trait " << Trait->identifier << std::endl;
+          *err << "Warning: unknown associated item in trait " << Trait->identifier << std::endl;
         }
       }
 
-      currentScope->trait_table[Trait->identifier] = std::move(traitSym);
+      if (!top_level) currentScope->local_traits[Trait->identifier] = Trait;
       //std::cout << "inserting trait : " << Trait->identifier << " in scope : " << currentScope->id << std::endl;
       return true;
     }
@@ -2023,15 +2220,26 @@ class semantic_checker {
     
     //===constant===
     if (auto* Const = dynamic_cast<const ConstantItemNode*>(expr)) {
-      ConstantInfo info{Const->identifier.value(), Const->type.get(), Const->expression.get()};
       //std::cout << "declaring constant : " << Const->identifier.value() << std::endl;
-      currentScope->const_table[Const->identifier.value()] = info;
-      Symbol symbol{Const->identifier.value(), Const->type.get(), false, false, true};
-      currentScope->insertVar(Const->identifier.value(), symbol);
+      declareConstant(Const);
+      if (ConstEvaluator::is_scalar_type(Const->type->toString())) {
+        //整数和bool常量直接求值，值的类型要和声明的类型一致
+        std::string why;
+        auto value = consts->evaluate_item(Const, const_resolver(), &why);
+        if (!value) {
+          *err << "invalid constant " << Const->identifier.value() << ": " << why << std::endl;
+          return false;
+        }
+        if (value->type != Const->type->toString()) {
+          *err << "mismatched types in constant " << Const->identifier.value() << ": expected " << Const->type->toString() << ", found " << value->type << std::endl;
+          return false;
+        }
+        return true;
+      }
       if (Const->type->toString() != getExpressionType(Const->expression.get())->toString()) {
         if ((Const->type->toString() == "usize" || Const->type->toString() == "u32") && getExpressionType(Const->expression.get())->toString() == "i32") {
           auto* lit = dynamic_cast<LiteralExpressionNode*>(Const->expression.get());
-          if (lit->toString()[0] != '-') {
+          if (lit && lit->toString()[0] != '-') {
             return true;
           }
         }
@@ -2044,98 +2252,17 @@ class semantic_checker {
 
     //===InherentImplementation===
     if (auto* Impl = dynamic_cast<const InherentImplNode*>(expr)) {
-      std::string type = Impl->type->toString();
-      //std::cout << "type of InherentImplNode : " << type << std::endl;
-      if (currentScope->declared_struct.find(type) != currentScope->declared_struct.end()) {//是已经declared过的struct
-        currentScope->possible_self = type;
-        //std::cout << "setting current possible self : " << type << std::endl;
-        for (int i = 0; i < Impl->associated_item.size(); i++) {
-          if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&Impl->associated_item[i]->associated_item)) {
-            if (funcNode->get()->block_expression && has_exit_in_block(funcNode->get()->block_expression.get())) {
-              std::cerr << "exit not allowed in methods" << std::endl;
-              return false;
-            }
-          }
-        }
-        enterScope();
-        for (int i = 0; i < Impl->associated_item.size(); i++) {
-          //std::cout << "checking the " << i << "th item in impl node" << std::endl;
-          if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&Impl->associated_item[i]->associated_item)) {
-            FunctionNode* function = funcNode->get();
-
-            FunctionSymbol fs;
-            fs.name = function->identifier;
-
-            if (function->function_parameter) {
-              fs.param_types = function->function_parameter.get();
-            }
-
-            if (function->return_type) {
-              fs.return_type = function->return_type->type.get();
-            }
-
-            fs.impl_type_name = type;
-            std::string func_to_declare = fs.impl_type_name.value() + "::" + fs.name;
-            if (function->return_type) fs.return_type = function->return_type->type.get();
-            fs.param_types = function->function_parameter.get();
-            currentScope->parent->declared_struct_functions[func_to_declare] = fs;
-            currentScope->parent->insertFunc(func_to_declare, fs);
-            //std::cout << "declaring function: " << func_to_declare << " in scope: " << currentScope->parent->id << std::endl; 
-            //std::cout << "size of function_table in scope function added to: " << currentScope->parent->declared_struct_functions.size() << std::endl;            
-
-            if (function->block_expression) {
-              //std::cout << "checking blockexpression of function in scope : " << currentScope->id << std::endl;
-              enterScope();
-              declareFunctionParameters(function->function_parameter.get(), currentScope, function->impl_type_name);
-              bool ans = check_BlockExpression_without_changing_scope(dynamic_cast<BlockExpressionNode*>(function->block_expression.get()));
-              exitScope();
-              //std::cout << "finish checking block expression" << std::endl;
-              if (!ans) {
-                return ans;
-              }
-            }
-          
-            if (function->return_type && function->block_expression) {
-              //std::cout << "checking if return type mismatch in function : " << function->identifier << std::endl;
-              std::string declared_return_type = function->return_type->type->toString();
-              if (!currentScope->is_forward_declared(declared_return_type) && !is_legal_type(declared_return_type)) {
-                //std::cout << "undefined return type : " << declared_return_type << " in function : " << function->identifier << std::endl;
-              }
-              //std::cout << "checking if the return types match in blockexpression" << std::endl;
-              //std::cout << "current scope : " << currentScope->id << std::endl;
-              enterScope();
-              declareFunctionParameters(function->function_parameter.get(), currentScope, function->impl_type_name);
-              if (!check_return_type_without_changing_scope(function->block_expression.get())) {
-                //std::cout << "return type mismatch in blockexpression" << std::endl;
-                exitScope();
-                return false;
-              }
-              //std::cout << "getting return type in blockexpression" << std::endl;
-              //std::cout << "current scope : " << currentScope->id << std::endl;
-              std::string actual_return_type = get_return_type_without_changing_scope(function->block_expression.get());
-              size_t pos = actual_return_type.rfind("::");
-              if (pos != std::string::npos) {
-                actual_return_type = actual_return_type.substr(0, pos);
-              }
-              if (declared_return_type == "Self" || declared_return_type == "self") {
-                declared_return_type = Impl->type->toString();
-              }
-              //std::cout << "declared return type: " << declared_return_type << std::endl;
-              //std::cout << "actual return type: " << actual_return_type << std::endl;
-              if (declared_return_type != "Self" && declared_return_type != "self" && actual_return_type != declared_return_type) {
-                //std::cout << "[Return Type Error]: function " << function->identifier << std::endl;
-                exitScope();
-                return false;
-              }
-              exitScope();
-            }
-          }
+      if (!declare_impl(Impl)) return false;
+      currentScope->possible_self = Impl->type->toString();
+      //std::cout << "setting current possible self : " << Impl->type->toString() << std::endl;
+      enterScope();
+      for (int i = 0; i < Impl->associated_item.size(); i++) {
+        //std::cout << "checking the " << i << "th item in impl node" << std::endl;
+        if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&Impl->associated_item[i]->associated_item)) {
+          if (!check_impl_method(Impl, funcNode->get())) return false;
         }
-        exitScope();
-      } else {
-        //std::cout << "[Error]: Trying to implement an undeclared struct" << std::endl;
-        return false;
       }
+      exitScope();
     }
 
     //===TraitImplNode===
@@ -2144,13 +2271,12 @@ class semantic_checker {
       std::string targetType = TraitImpl->forType->toString();
   
       // 查找 trait 是否存在
-      auto it = currentScope->trait_table.find(traitName);
-      if (it == currentScope->trait_table.end()) {
-        std::cerr << "Error: undefined trait '" << traitName << "' used in implementation for type '" << targetType << "'\n";
+      const TraitNode* trait = lookup_trait(traitName);
+      if (!trait) {
+        *err << "Error: undefined trait '" << traitName << "' used in implementation for type '" << targetType << "'\n";
         return false;
       }
-  
-      TraitSymbol& traitSym = it->second;
+      std::vector<std::string> traitFunctions = trait_functions(trait);
   
       std::unordered_map<std::string, FunctionNode*> implFunctions;
       for (const auto& assoc : TraitImpl->associatedItems) {
@@ -2162,10 +2288,10 @@ class semantic_checker {
   
       // 检查每个 trait 函数是否被实现
       bool allImplemented = true;
-      for (const auto& traitFunc : traitSym.functions) {
-        if (implFunctions.find(traitFunc.name) == implFunctions.end()) {
-          std::cerr << "Error: trait '" << traitName 
-                    << "' requires method '" << traitFunc.name 
+      for (const auto& traitFunc : traitFunctions) {
+        if (implFunctions.find(traitFunc) == implFunctions.end()) {
+          *err << "Error: trait '" << traitName 
+                    << "' requires method '" << traitFunc 
                     << "', but it is not implemented in '" << targetType << "'\n";
           allImplemented = false;
         }
@@ -2177,11 +2303,11 @@ class semantic_checker {
       // 检查 impl 中是否定义了多余的函数（trait 中未声明）
       for (const auto& [fname, fnode] : implFunctions) {
         bool declaredInTrait = false;
-        for (const auto& tf : traitSym.functions) {
-          if (tf.name == fname) { declaredInTrait = true; break; }
+        for (const auto& tf : traitFunctions) {
+          if (tf == fname) { declaredInTrait = true; break; }
         }
         if (!declaredInTrait) {
-            std::cerr << "Warning: function '" << fname 
+            *err << "Warning: function '" << fname 
                       << "' in impl of '" << traitName 
                       << "' for '" << targetType 
                       << "' is not declared in the trait.\n";
@@ -2189,8 +2315,8 @@ class semantic_checker {
       }
   
       //检查parameter是否匹配
-      for (const auto& tf : traitSym.functions) {
-        auto implIt = implFunctions.find(tf.name);
+      for (const auto& tf : traitFunctions) {
+        auto implIt = implFunctions.find(tf);
         if (implIt != implFunctions.end()) {
           auto implFunc = implIt->second;
           
@@ -2198,12 +2324,10 @@ class semantic_checker {
       }
   
       if (!allImplemented) {
-        std::cerr << "Trait implementation for '" << traitName << "' on type '" << targetType << "' is incomplete." << std::endl;
+        *err << "Trait implementation for '" << traitName << "' on type '" << targetType << "' is incomplete." << std::endl;
         return false;
       }
   
-      currentScope->trait_table[traitName] = traitSym;
-  
       return true;
     }
 
@@ -2264,13 +2388,7 @@ class semantic_checker {
 
   int get_array_length(const ArrayTypeNode* arrType) {
     if (!arrType || !arrType->expression) return -1;
-    if (auto *lenLit = dynamic_cast<LiteralExpressionNode*>(arrType->expression.get())) {
-      if (auto intLit = std::get_if<std::unique_ptr<integer_literal>>(&lenLit->literal)) {
-        //std::cout << "array length: " << (*intLit)->value << std::endl;
-        return std::stoi((*intLit)->value);
-      }
-    }
-    return -1;
+    return array_length(arrType->expression.get());
   }
 
   std::string PathIdentSegmentToString(const PathIdentSegment& segment) {
@@ -2435,9 +2553,9 @@ class semantic_checker {
       if (auto* letStat = stat->let_statement.get()) {
         try {
           //std::cout << "try to declare var : " << letStat->pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << letStat->get_if_mutable() << std::endl;
-          declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable());
+          declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable(), letStat);
         } catch (const std::exception& e) {
-          std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+          *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
         }
       }
       if (auto* expr = stat->expr_statement.get()) {
@@ -2479,9 +2597,9 @@ class semantic_checker {
       if (auto* letStat = stat->let_statement.get()) {
         try {
           //std::cout << "try to declare var : " << letStat->pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << letStat->get_if_mutable() << std::endl;
-          declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable());
+          declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable(), letStat);
         } catch (const std::exception& e) {
-          std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+          *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
         }
       }
       if (auto* expr = stat->expr_statement.get()) {
@@ -2519,9 +2637,9 @@ class semantic_checker {
         if (auto* letStat = stat->let_statement.get()) {
           try {
             //std::cout << "try to declare var : " << letStat->pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << letStat->get_if_mutable() << std::endl;
-            declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable());
+            declareVariable(letStat->pattern->toString(), letStat->type.get(), letStat->get_if_mutable(), letStat);
           } catch (const std::exception& e) {
-            std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+            *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
           }
         }
         if (auto* expr = stat->expr_statement.get()) {
@@ -2553,16 +2671,242 @@ class semantic_checker {
     return nullptr;
   }
 
+  //给函数体加上IR生成使用的标注：路径记下声明它的节点（binding），每个表达式记下它的值的类型（checked_type）
+  //按检查时的方式重新建立作用域，只查表不做检查；函数体命中检查缓存时只做这一步
+  void annotate_function(const FunctionNode* function) {
+    if (!function->block_expression) return;
+    enterScope();
+    declareFunctionParameters(function->function_parameter.get(), currentScope, function->impl_type_name);
+    annotate_block(function->block_expression.get());
+    exitScope();
+  }
+
+  void annotate_block(BlockExpressionNode* block) {
+    if (!block) return;
+    enterScope();
+    for (auto& stat : block->statement) {
+      if (auto* let = stat->let_statement.get()) {
+        annotate(let->expression.get());
+        annotate_block(let->block_expression.get());
+        declareVariable(let->pattern->toString(), let->type.get(), let->get_if_mutable(), let);
+      } else if (stat->expr_statement) {
+        annotate(stat->expr_statement->expression.get());
+      } else if (auto* function = dynamic_cast<FunctionNode*>(stat->item.get())) {
+        declare_function(function);
+        annotate_function(function);
+      } else if (auto* Const = dynamic_cast<ConstantItemNode*>(stat->item.get())) {
+        declareConstant(Const);
+      } else if (auto* Struct = dynamic_cast<StructStructNode*>(stat->item.get())) {
+        declareStruct(Struct);
+      }
+    }
+    annotate(block->expression_without_block.get());
+    exitScope();
+  }
+
+  void annotate(ExpressionNode* expr) {
+    if (!expr) return;
+    auto each = [this](auto& node) { annotate(node.get()); };
+    if (auto* field = dynamic_cast<FieldExpressionNode*>(expr)) {
+      annotate(field->expression.get());
+    } else if (auto* index = dynamic_cast<IndexExpressionNode*>(expr)) {
+      annotate(index->base.get());
+      annotate(index->index.get());
+    } else if (auto* ewb = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+      std::visit(each, ewb->expr);
+    } else if (auto* op = dynamic_cast<OperatorExpressionNode*>(expr)) {
+      std::visit(each, op->operator_expression);
+    } else if (auto* block = dynamic_cast<BlockExpressionNode*>(expr)) {
+      annotate_block(block);
+    } else if (auto* borrow = dynamic_cast<BorrowExpressionNode*>(expr)) {
+      annotate(borrow->expression.get());
+    } else if (auto* deref = dynamic_cast<DereferenceExpressionNode*>(expr)) {
+      annotate(deref->expression.get());
+    } else if (auto* neg = dynamic_cast<NegationExpressionNode*>(expr)) {
+      annotate(neg->expression.get());
+    } else if (auto* cast = dynamic_cast<TypeCastExpressionNode*>(expr)) {
+      annotate(cast->expression.get());
+    } else if (auto* group = dynamic_cast<GroupedExpressionNode*>(expr)) {
+      annotate(group->expression.get());
+    } else if (auto* arith = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(expr)) {
+      annotate(arith->expression1.get());
+      annotate(arith->expression2.get());
+    } else if (auto* cmp = dynamic_cast<ComparisonExpressionNode*>(expr)) {
+      annotate(cmp->expression1.get());
+      annotate(cmp->expression2.get());
+    } else if (auto* lazy = dynamic_cast<LazyBooleanExpressionNode*>(expr)) {
+      annotate(lazy->expression1.get());
+      annotate(lazy->expression2.get());
+    } else if (auto* assign = dynamic_cast<AssignmentExpressionNode*>(expr)) {
+      annotate(assign->expression1.get());
+      annotate(assign->expression2.get());
+    } else if (auto* compound = dynamic_cast<CompoundAssignmentExpressionNode*>(expr)) {
+      annotate(compound->expression1.get());
+      annotate(compound->expression2.get());
+    } else if (auto* array = dynamic_cast<ArrayExpressionNode*>(expr)) {
+      for (auto& e : array->expressions) annotate(e.get());
+    } else if (auto* tuple = dynamic_cast<TupleExpressionNode*>(expr)) {
+      for (auto& e : tuple->expressions) annotate(e.get());
+    } else if (auto* tuple_index = dynamic_cast<TupleIndexingExpressionNode*>(expr)) {
+      annotate(tuple_index->expression.get());
+    } else if (auto* struct_expr = dynamic_cast<StructExpressionNode*>(expr)) {
+      if (struct_expr->struct_expr_fields) {
+        for (auto& f : struct_expr->struct_expr_fields->struct_expr_fields) annotate(f->expression.get());
+      }
+    } else if (auto* call = dynamic_cast<CallExpressionNode*>(expr)) {
+      annotate(call->expression.get());
+      if (call->call_params) {
+        for (auto& e : call->call_params->expressions) annotate(e.get());
+      }
+    } else if (auto* method_call = dynamic_cast<MethodCallExpressionNode*>(expr)) {
+      annotate(method_call->expression.get());
+      if (method_call->call_params) {
+        for (auto& e : method_call->call_params->expressions) annotate(e.get());
+      }
+    } else if (auto* ret = dynamic_cast<ReturnExpressionNode*>(expr)) {
+      annotate(ret->expression.get());
+    } else if (auto* bre = dynamic_cast<BreakExpressionNode*>(expr)) {
+      annotate(bre->expr.get());
+    } else if (auto* loop = dynamic_cast<class LoopExpression*>(expr)) {
+      std::visit(each, loop->loop_expression);
+    } else if (auto* inf = dynamic_cast<InfiniteLoopExpressionNode*>(expr)) {
+      annotate_block(inf->block_expression.get());
+    } else if (auto* pred = dynamic_cast<PredicateLoopExpressionNode*>(expr)) {
+      if (auto* cond = std::get_if<std::unique_ptr<ExpressionNode>>(&pred->conditions->condition)) annotate(cond->get());
+      annotate_block(pred->block_expression.get());
+    } else if (auto* if_expr = dynamic_cast<IfExpressionNode*>(expr)) {
+      if (auto* cond = std::get_if<std::unique_ptr<ExpressionNode>>(&if_expr->conditions->condition)) annotate(cond->get());
+      annotate_block(if_expr->block_expression.get());
+      annotate_block(if_expr->else_block.get());
+      annotate(if_expr->else_if.get());
+    }
+    expr->checked_type = resolve_self(value_type(expr));
+  }
+
+  //表达式的值的类型，子表达式已经标注过；没有值的表达式是()，推导不出来时为nullptr
+  TypeNode* value_type(ExpressionNode* expr) {
+    auto inner = [](auto& node) -> TypeNode* { return node->checked_type; };
+    if (auto* ewb = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+      return std::visit(inner, ewb->expr);
+    } else if (auto* op = dynamic_cast<OperatorExpressionNode*>(expr)) {
+      return std::visit(inner, op->operator_expression);
+    } else if (auto* loop = dynamic_cast<class LoopExpression*>(expr)) {
+      return std::visit(inner, loop->loop_expression);
+    } else if (auto* lit = dynamic_cast<LiteralExpressionNode*>(expr)) {
+      //没有后缀、超出i32范围的整数按i64处理
+      if (untyped_literal(lit)) {
+        try {
+          long long val = std::stoll(std::get<std::unique_ptr<integer_literal>>(lit->literal)->value);
+          if (val > 2147483647LL || val < -2147483648LL) return new TypePathNode("i64");
+        } catch (...) {
+        }
+      }
+      return getExpressionType(lit);
+    } else if (dynamic_cast<PathExpressionNode*>(expr) || dynamic_cast<FieldExpressionNode*>(expr)
+               || dynamic_cast<IndexExpressionNode*>(expr)) {
+      return getExpressionType(expr);
+    } else if (auto* call = dynamic_cast<CallExpressionNode*>(expr)) {
+      if (TypeNode* type = getExpressionType(call)) return type;
+      return unit_type();
+    } else if (auto* method_call = dynamic_cast<MethodCallExpressionNode*>(expr)) {
+      //推导时会重新推导接收者，保留annotate给它的标注
+      TypeNode* base = method_call->expression->checked_type;
+      TypeNode* type = getExpressionType(method_call);
+      method_call->expression->checked_type = base;
+      if (type && type->toString() == "Self" && !method_call->resolved_method.empty()) {
+        return new TypePathNode(method_call->resolved_method.substr(0, method_call->resolved_method.rfind("::")));
+      }
+      return type;
+    } else if (auto* group = dynamic_cast<GroupedExpressionNode*>(expr)) {
+      return group->expression->checked_type;
+    } else if (auto* neg = dynamic_cast<NegationExpressionNode*>(expr)) {
+      return neg->expression->checked_type;
+    } else if (auto* cast = dynamic_cast<TypeCastExpressionNode*>(expr)) {
+      return cast->type.get();
+    } else if (auto* borrow = dynamic_cast<BorrowExpressionNode*>(expr)) {
+      TypeNode* type = borrow->expression->checked_type;
+      return type ? new ReferenceTypeNode(type, borrow->if_mut, 0, 0) : nullptr;
+    } else if (auto* deref = dynamic_cast<DereferenceExpressionNode*>(expr)) {
+      //&self的类型记为impl的类型
+      auto* ref = dynamic_cast<ReferenceTypeNode*>(deref->expression->checked_type);
+      return ref ? ref->type.get() : deref->expression->checked_type;
+    } else if (auto* arith = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(expr)) {
+      //两边类型相同，没有后缀的字面量跟随另一边
+      if (untyped_literal(arith->expression1.get())) return arith->expression2->checked_type;
+      return arith->expression1->checked_type;
+    } else if (dynamic_cast<ComparisonExpressionNode*>(expr) || dynamic_cast<LazyBooleanExpressionNode*>(expr)) {
+      return new TypePathNode("bool");
+    } else if (auto* block = dynamic_cast<BlockExpressionNode*>(expr)) {
+      if (block->expression_without_block) return block->expression_without_block->checked_type;
+    } else if (auto* if_expr = dynamic_cast<IfExpressionNode*>(expr)) {
+      if (auto* tail = if_expr->block_expression->expression_without_block.get()) return tail->checked_type;
+    } else if (auto* array = dynamic_cast<ArrayExpressionNode*>(expr)) {
+      if (array->if_empty || !array->expressions[0]->checked_type) return nullptr;
+      TypeNode* elem = array->expressions[0]->checked_type;
+      if (array->type == ArrayExpressionType::REPEAT) return new ArrayTypeNode(elem, array->expressions[1].get(), 0, 0);
+      return new ArrayTypeNode(elem, new LiteralExpressionNode(new integer_literal(std::to_string(array->expressions.size())), 0, 0), 0, 0);
+    } else if (auto* struct_expr = dynamic_cast<StructExpressionNode*>(expr)) {
+      return new TypePathNode(struct_expr->pathin_expression->toString());
+    } else if (auto* loop = dynamic_cast<InfiniteLoopExpressionNode*>(expr)) {
+      if (TypeNode* type = getExpressionType(loop)) return type;
+    } else if (dynamic_cast<TupleExpressionNode*>(expr) || dynamic_cast<TupleIndexingExpressionNode*>(expr)) {
+      return getExpressionType(expr);
+    }
+    //赋值、循环、return/break/continue，以及没有尾表达式的块
+    return unit_type();
+  }
+
+  static TypeNode* unit_type() {
+    return new TupleTypeNode(std::vector<std::unique_ptr<TypeNode>>(), 0, 0);
+  }
+
+  //没有后缀的整数字面量
+  static bool untyped_literal(ExpressionNode* expr) {
+    if (auto* ewb = dynamic_cast<ExpressionWithoutBlockNode*>(expr)) {
+      auto* lit = std::get_if<std::unique_ptr<LiteralExpressionNode>>(&ewb->expr);
+      return lit && untyped_literal(lit->get());
+    }
+    auto* lit = dynamic_cast<LiteralExpressionNode*>(expr);
+    if (!lit || !std::holds_alternative<std::unique_ptr<integer_literal>>(lit->literal)) return false;
+    const std::string& raw = std::get<std::unique_ptr<integer_literal>>(lit->literal)->raw;
+    return raw.find_first_of("iu") == std::string::npos;
+  }
+
+  //impl中的Self换成impl的类型
+  TypeNode* resolve_self(TypeNode* type) {
+    if (!type || currentScope->possible_self.empty()) return type;
+    if (auto* ref = dynamic_cast<ReferenceTypeNode*>(type)) {
+      TypeNode* inner = resolve_self(ref->type.get());
+      return inner == ref->type.get() ? type : new ReferenceTypeNode(inner, ref->if_mut, 0, 0);
+    }
+    if (dynamic_cast<TypePathNode*>(type) && type->toString() == "Self") return new TypePathNode(currentScope->possible_self);
+    return type;
+  }
+
+  //记录methodcall实际调用的方法，Self换成impl的类型
+  void bind_method(MethodCallExpressionNode* method_call, std::string base, const std::string& func_name) {
+    if (base == "Self" || base == "self") base = currentScope->possible_self;
+    if (base.empty()) return;
+    method_call->resolved_method = base + "::" + func_name;
+  }
+
+  //推导表达式的类型，并把结果记在节点上，IR生成时直接使用
   TypeNode* getExpressionType(ExpressionNode* expr) {
+    TypeNode* type = inferExpressionType(expr);
+    if (expr && type) expr->checked_type = type;
+    return type;
+  }
+
+  TypeNode* inferExpressionType(ExpressionNode* expr) {
     if (auto* block = dynamic_cast<BlockExpressionNode*>(expr)) {
       enterScope();
       for (int i = 0; i < block->statement.size(); i++) {
         if (block->statement[i]->let_statement) {
           try {
             //std::cout << "try to declare var : " << block->statement[i]->let_statement->pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << block->statement[i]->let_statement->get_if_mutable() << std::endl;
-            declareVariable(block->statement[i]->let_statement->pattern->toString(), block->statement[i]->let_statement->type.get(), block->statement[i]->let_statement->get_if_mutable());
+            declareVariable(block->statement[i]->let_statement->pattern->toString(), block->statement[i]->let_statement->type.get(), block->statement[i]->let_statement->get_if_mutable(), block->statement[i]->let_statement.get());
           } catch (const std::exception& e) {
-            std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+            *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
           }
         }
         auto* stat = block->statement[i].get();
@@ -2626,15 +2970,11 @@ class semantic_checker {
             return nullptr;
           } else {
             //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-            if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+            if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
               std::string item_name = field_expr->identifier.id;
               //std::cout << "finding " << item_name << " in struct" << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "item in struct " << structInfo->name << " : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  return t;
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                return t;
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl; 
               return nullptr;
@@ -2646,14 +2986,10 @@ class semantic_checker {
         } else {
           std::string item_name = field_expr->identifier.id;
           //std::cout << "finding struct : " << path_expr->toString() << std::endl;
-          if (auto* structInfo = currentScope->lookupStruct(path_expr->toString())) {
+          if (auto* structInfo = lookup_struct(path_expr->toString())) {
             //std::cout << "finding item in struct : " << item_name << std::endl;
-            for (int i = 0; i < structInfo->fields.size(); i++) {
-              //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-              if (structInfo->fields[i].name == item_name) {
-                auto* t = structInfo->fields[i].type;
-                return t;
-              }
+            if (auto* t = field_type(structInfo, item_name)) {
+              return t;
             }
             //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
             return nullptr;
@@ -2666,14 +3002,10 @@ class semantic_checker {
               typeStr = type->toString();
             }
             typeStr.erase(0, typeStr.find_first_not_of('&'));
-            if (auto* structInfo = currentScope->lookupStruct(typeStr)) {
+            if (auto* structInfo = lookup_struct(typeStr)) {
               //std::cout << "finding item in struct : " << item_name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  return t;
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                return t;
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << getExpressionType(path_expr)->toString() << std::endl;
               return nullptr;
@@ -2687,15 +3019,11 @@ class semantic_checker {
         if (auto* path = dynamic_cast<TypePathNode*>(index_type)) {
           std::string item_name = path->toString();
           //std::cout << "struct in fieldexpression : " << item_name << std::endl;
-          if (auto* structInfo = currentScope->lookupStruct(item_name)) {
+          if (auto* structInfo = lookup_struct(item_name)) {
             //std::cout << "found strcut : " << item_name << " whose field size is " << structInfo->fields.size() << std::endl;
             //std::cout << "finding item: " << field_expr->identifier.id << " in struct: " << item_name << std::endl;
-            for (int i = 0; i < structInfo->fields.size(); i++) {
-              //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-              if (structInfo->fields[i].name == field_expr->identifier.id) {
-                auto* t = structInfo->fields[i].type;
-                return t;
-              }
+            if (auto* t = field_type(structInfo, field_expr->identifier.id)) {
+              return t;
             }
             //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
             return nullptr;
@@ -2709,18 +3037,14 @@ class semantic_checker {
         if (auto* path_type = dynamic_cast<TypePathNode*>(type)) {
           std::string path = path_type->toString();
           //std::cout << "path of innerfield in field expression : " << path << std::endl;
-          auto* info = currentScope->lookupStruct(path);
+          auto* info = lookup_struct(path);
           if (!info) {
             //std::cout << "error in finding struct : " << path << std::endl;
           }
           std::string item_name = field_expr->identifier.id;
           //std::cout << "finding item in struct : " << item_name << std::endl;
-          for (int i = 0; i < info->fields.size(); i++) {
-            //std::cout << "declared item in field : " << info->fields[i].name << std::endl;
-            if (info->fields[i].name == item_name) {
-              auto* t = info->fields[i].type;
-              return t;
-            }
+          if (auto* t = field_type(info, item_name)) {
+            return t;
           }
           //std::cout << "unknown item : " << item_name << " in struct : " << path << std::endl;
           return nullptr;
@@ -2745,9 +3069,10 @@ class semantic_checker {
         //std::cout << "var_table size: " << currentScope->var_table.size() << std::endl;
         return nullptr;
       }
-      TypeNode* t = currentScope->lookupVar(path_pattern) ? currentScope->lookupVar(path_pattern)->type : currentScope->lookupVar(path)->type;
-      //std::cout << "type of pathexpression got : " << t->toString() << std::endl;
-      return t;
+      Symbol* symbol = currentScope->lookupVar(path_pattern) ? currentScope->lookupVar(path_pattern) : currentScope->lookupVar(path);
+      pathExpr->binding = symbol->decl;
+      //std::cout << "type of pathexpression got : " << symbol->type->toString() << std::endl;
+      return symbol->type;
     }
     if (auto* arrayExpr = dynamic_cast<ArrayExpressionNode*>(expr)) {
       //std::cout << "getting type of arrayExpression" << std::endl;
@@ -2873,15 +3198,12 @@ class semantic_checker {
               return nullptr;
             } else {
               //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-              if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+              if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
                 //std::cout << "getting valid struct of self" << std::endl;
                 std::string item_name = method_call_expr->PathtoString();
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 return nullptr;
@@ -2891,14 +3213,11 @@ class semantic_checker {
               }
             }
           } else {
-            if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+            if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
               std::string item_name = method_call_expr->PathtoString();
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                    return array->type.get();
-                  }
+              if (auto* t = field_type(structInfo, item_name)) {
+                if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                  return array->type.get();
                 }
               }
               return nullptr;
@@ -2918,16 +3237,12 @@ class semantic_checker {
               return nullptr;
             } else {
               //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-              if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+              if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
                 std::string item_name = field_expr->identifier.id;
                 //std::cout << "finding item in struct : " << item_name << std::endl;
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl; 
@@ -2940,15 +3255,11 @@ class semantic_checker {
           } else {
             std::string item_name = field_expr->identifier.id;
             //std::cout << "finding struct : " << path_expr->toString() << std::endl;
-            if (auto* structInfo = currentScope->lookupStruct(path_expr->toString())) {
+            if (auto* structInfo = lookup_struct(path_expr->toString())) {
               //std::cout << "finding item in struct : " << item_name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                    return array->type.get();
-                  }
+              if (auto* t = field_type(structInfo, item_name)) {
+                if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                  return array->type.get();
                 }
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
@@ -2956,15 +3267,11 @@ class semantic_checker {
             } else {
               std::string typeStr = getExpressionType(path_expr)->toString();
               typeStr.erase(0, typeStr.find_first_not_of('&'));
-              if (auto* structInfo = currentScope->lookupStruct(typeStr)) {
+              if (auto* structInfo = lookup_struct(typeStr)) {
                 //std::cout << "finding item in struct : " << item_name << std::endl;
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 //std::cout << "unknown item : " << item_name << " in struct : " << getExpressionType(path_expr)->toString() << std::endl;
@@ -3003,7 +3310,7 @@ class semantic_checker {
       auto* expr1 = logic_expr->expression1.get();
       auto* type = getExpressionType(expr1);
       if (!type) {
-        std::cerr << "failed to get type of certain expression in arithmetic or logical expression" << std::endl;
+        *err << "failed to get type of certain expression in arithmetic or logical expression" << std::endl;
         return nullptr;
       }
       if (auto* path_type = dynamic_cast<TypePathNode*>(type)) {
@@ -3161,6 +3468,7 @@ class semantic_checker {
           //std::cout << "function: " << func << " not found" << std::endl;
           return nullptr;
         }
+        bind_method(method_call, base, func_name);
         return func_type;
       } else if (auto* ref = dynamic_cast<ReferenceTypeNode*>(type)) {
         //std::cout << "getting type in reference type" << std::endl;
@@ -3176,6 +3484,7 @@ class semantic_checker {
             //std::cout << "function: " << func << " not found" << std::endl;
             return nullptr;
           }
+          bind_method(method_call, base, func_name);
           return func_type;
         }
       } else if (auto* array = dynamic_cast<ArrayTypeNode*>(type)) {
@@ -3196,9 +3505,9 @@ class semantic_checker {
         if (block->statement[i]->let_statement) {
           try {
             //std::cout << "try to declare var : " << block->statement[i]->let_statement->pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << block->statement[i]->let_statement->get_if_mutable() << std::endl;
-            declareVariable(block->statement[i]->let_statement->pattern->toString(), block->statement[i]->let_statement->type.get(), block->statement[i]->let_statement->get_if_mutable());
+            declareVariable(block->statement[i]->let_statement->pattern->toString(), block->statement[i]->let_statement->type.get(), block->statement[i]->let_statement->get_if_mutable(), block->statement[i]->let_statement.get());
           } catch (const std::exception& e) {
-            std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+            *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
           }
         }
         auto* stat = block->statement[i].get();
@@ -3258,15 +3567,11 @@ class semantic_checker {
             return nullptr;
           } else {
             //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-            if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+            if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
               std::string item_name = field_expr->identifier.id;
               //std::cout << "finding " << item_name << " in struct" << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "item in struct " << structInfo->name << " : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  return t;
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                return t;
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl; 
               return nullptr;
@@ -3278,14 +3583,10 @@ class semantic_checker {
         } else {
           std::string item_name = field_expr->identifier.id;
           //std::cout << "finding struct : " << path_expr->toString() << std::endl;
-          if (auto* structInfo = currentScope->lookupStruct(path_expr->toString())) {
+          if (auto* structInfo = lookup_struct(path_expr->toString())) {
             //std::cout << "finding item in struct : " << item_name << std::endl;
-            for (int i = 0; i < structInfo->fields.size(); i++) {
-              //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-              if (structInfo->fields[i].name == item_name) {
-                auto* t = structInfo->fields[i].type;
-                return t;
-              }
+            if (auto* t = field_type(structInfo, item_name)) {
+              return t;
             }
             //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
             return nullptr;
@@ -3298,14 +3599,10 @@ class semantic_checker {
               typeStr = type->toString();
             }
             typeStr.erase(0, typeStr.find_first_not_of('&'));
-            if (auto* structInfo = currentScope->lookupStruct(typeStr)) {
+            if (auto* structInfo = lookup_struct(typeStr)) {
               //std::cout << "finding item in struct : " << item_name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  return t;
-                }
+              if (auto* t = field_type(structInfo, item_name)) {
+                return t;
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << getExpressionType(path_expr)->toString() << std::endl;
               return nullptr;
@@ -3319,15 +3616,11 @@ class semantic_checker {
         if (auto* path = dynamic_cast<TypePathNode*>(index_type)) {
           std::string item_name = path->toString();
           //std::cout << "struct in fieldexpression : " << item_name << std::endl;
-          if (auto* structInfo = currentScope->lookupStruct(item_name)) {
+          if (auto* structInfo = lookup_struct(item_name)) {
             //std::cout << "found strcut : " << item_name << " whose field size is " << structInfo->fields.size() << std::endl;
             //std::cout << "finding item: " << field_expr->identifier.id << " in struct: " << item_name << std::endl;
-            for (int i = 0; i < structInfo->fields.size(); i++) {
-              //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-              if (structInfo->fields[i].name == field_expr->identifier.id) {
-                auto* t = structInfo->fields[i].type;
-                return t;
-              }
+            if (auto* t = field_type(structInfo, field_expr->identifier.id)) {
+              return t;
             }
             //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
             return nullptr;
@@ -3341,18 +3634,14 @@ class semantic_checker {
         if (auto* path_type = dynamic_cast<TypePathNode*>(type)) {
           std::string path = path_type->toString();
           //std::cout << "path of innerfield in field expression : " << path << std::endl;
-          auto* info = currentScope->lookupStruct(path);
+          auto* info = lookup_struct(path);
           if (!info) {
             //std::cout << "error in finding struct : " << path << std::endl;
           }
           std::string item_name = field_expr->identifier.id;
           //std::cout << "finding item in struct : " << item_name << std::endl;
-          for (int i = 0; i < info->fields.size(); i++) {
-            //std::cout << "declared item in field : " << info->fields[i].name << std::endl;
-            if (info->fields[i].name == item_name) {
-              auto* t = info->fields[i].type;
-              return t;
-            }
+          if (auto* t = field_type(info, item_name)) {
+            return t;
           }
           //std::cout << "unknown item : " << item_name << " in struct : " << path << std::endl;
           return nullptr;
@@ -3487,15 +3776,12 @@ class semantic_checker {
               return nullptr;
             } else {
               //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-              if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+              if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
                 //std::cout << "getting valid struct of self" << std::endl;
                 std::string item_name = method_call_expr->PathtoString();
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 return nullptr;
@@ -3505,14 +3791,11 @@ class semantic_checker {
               }
             }
           } else {
-            if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+            if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
               std::string item_name = method_call_expr->PathtoString();
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                    return array->type.get();
-                  }
+              if (auto* t = field_type(structInfo, item_name)) {
+                if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                  return array->type.get();
                 }
               }
               return nullptr;
@@ -3532,16 +3815,12 @@ class semantic_checker {
               return nullptr;
             } else {
               //std::cout << "getting valid self : " << currentScope->possible_self << std::endl;
-              if (auto* structInfo = currentScope->lookupStruct(currentScope->possible_self)) {
+              if (auto* structInfo = lookup_struct(currentScope->possible_self)) {
                 std::string item_name = field_expr->identifier.id;
                 //std::cout << "finding item in struct : " << item_name << std::endl;
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl; 
@@ -3554,15 +3833,11 @@ class semantic_checker {
           } else {
             std::string item_name = field_expr->identifier.id;
             //std::cout << "finding struct : " << path_expr->toString() << std::endl;
-            if (auto* structInfo = currentScope->lookupStruct(path_expr->toString())) {
+            if (auto* structInfo = lookup_struct(path_expr->toString())) {
               //std::cout << "finding item in struct : " << item_name << std::endl;
-              for (int i = 0; i < structInfo->fields.size(); i++) {
-                //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                if (structInfo->fields[i].name == item_name) {
-                  auto* t = structInfo->fields[i].type;
-                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                    return array->type.get();
-                  }
+              if (auto* t = field_type(structInfo, item_name)) {
+                if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                  return array->type.get();
                 }
               }
               //std::cout << "unknown item : " << item_name << " in struct : " << path_expr->toString() << std::endl;
@@ -3570,15 +3845,11 @@ class semantic_checker {
             } else {
               std::string typeStr = getExpressionType(path_expr)->toString();
               typeStr.erase(0, typeStr.find_first_not_of('&'));
-              if (auto* structInfo = currentScope->lookupStruct(typeStr)) {
+              if (auto* structInfo = lookup_struct(typeStr)) {
                 //std::cout << "finding item in struct : " << item_name << std::endl;
-                for (int i = 0; i < structInfo->fields.size(); i++) {
-                  //std::cout << "declared item in field : " << structInfo->fields[i].name << std::endl;
-                  if (structInfo->fields[i].name == item_name) {
-                    auto* t = structInfo->fields[i].type;
-                    if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
-                      return array->type.get();
-                    }
+                if (auto* t = field_type(structInfo, item_name)) {
+                  if (auto* array = dynamic_cast<ArrayTypeNode*>(t)) {
+                    return array->type.get();
                   }
                 }
                 //std::cout << "unknown item : " << item_name << " in struct : " << getExpressionType(path_expr)->toString() << std::endl;
@@ -3617,7 +3888,7 @@ class semantic_checker {
       auto* expr1 = logic_expr->expression1.get();
       auto* type = getExpressionType(expr1);
       if (!type) {
-        std::cerr << "failed to get type of certain expression in arithmetic or logical expression" << std::endl;
+        *err << "failed to get type of certain expression in arithmetic or logical expression" << std::endl;
         return nullptr;
       }
       if (auto* path_type = dynamic_cast<TypePathNode*>(type)) {
@@ -3775,6 +4046,7 @@ class semantic_checker {
           //std::cout << "function: " << func << " not found" << std::endl;
           return nullptr;
         }
+        bind_method(method_call, base, func_name);
         return func_type;
       } else if (auto* ref = dynamic_cast<ReferenceTypeNode*>(type)) {
         //std::cout << "getting type in reference type" << std::endl;
@@ -3790,6 +4062,7 @@ class semantic_checker {
             //std::cout << "function: " << func << " not found" << std::endl;
             return nullptr;
           }
+          bind_method(method_call, base, func_name);
           return func_type;
         }
       } else if (auto* array = dynamic_cast<ArrayTypeNode*>(type)) {
@@ -3831,102 +4104,20 @@ class semantic_checker {
     if (!lhs || !rhs) return false;
     auto* lhs_inner = dynamic_cast<ArrayTypeNode*>(lhs->type.get());
     auto* rhs_inner = dynamic_cast<ArrayTypeNode*>(rhs->type.get());
-    if (lhs_inner && rhs_inner) {
-      int lhsLen = -1, rhsLen = -1;
-    
-      if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lhs->expression.get())) {
-        if (auto intLit = std::get_if<std::unique_ptr<integer_literal>>(&lenLit->literal)) {
-          lhsLen = std::stoi((*intLit)->value);
-        }
-      } else if (auto* path = dynamic_cast<PathExpressionNode*>(lhs->expression.get())) {
-        std::string name = path->toString();
-        if (auto* info = currentScope->lookupConst(name)) {
-          if (auto* lit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-            std::string literal = lit->toString();
-            if (std::all_of(literal.begin(), literal.end(), ::isdigit)) {
-              lhsLen = std::stoi(literal);
-            }
-            else {
-              //std::cout << "invalid const type for array size: " << name << std::endl;
-              return false;
-            }
-          }
-        }
-      }
-
-      if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(rhs->expression.get())) {
-        if (auto intLit = std::get_if<std::unique_ptr<integer_literal>>(&lenLit->literal)) {
-          rhsLen = std::stoi((*intLit)->value);
-        }
-      } else if (auto* path = dynamic_cast<PathExpressionNode*>(rhs->expression.get())) {
-        std::string name = path->toString();
-        if (auto* info = currentScope->lookupConst(name)) {
-          if (auto* lit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-            std::string literal = lit->toString();
-            if (std::all_of(literal.begin(), literal.end(), ::isdigit)) {
-              rhsLen = std::stoi(literal);
-            }
-            else {
-              //std::cout << "invalid const type for array size: " << name << std::endl;
-              return false;
-            }
-          }
-        }
-      }
-
-      if (lhsLen != -1 && rhsLen != -1 && lhsLen != rhsLen) {
-        //std::cout << "Array length mismatch at one dimension: expected " 
-        //          << lhsLen << ", got " << rhsLen << std::endl;
-        return false;
-      }
-
-      return check_arrayType(lhs_inner, rhs_inner, currentScope);
-    }
-
     if ((lhs_inner && !rhs_inner) || (!lhs_inner && rhs_inner)) {
       //std::cout << "Array dimension mismatch" << std::endl;
       return false;
     }
 
-    int lhsLen = -1, rhsLen = -1;
-
-    if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lhs->expression.get())) {
-      if (auto intLit = std::get_if<std::unique_ptr<integer_literal>>(&lenLit->literal)) {
-        lhsLen = std::stoi((*intLit)->value);
-      }
-    } else if (auto* path = dynamic_cast<PathExpressionNode*>(lhs->expression.get())) {
-      std::string name = path->toString();
-      if (auto* info = currentScope->lookupConst(name)) {
-        if (auto* lit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-          std::string literal = lit->toString();
-          if (std::all_of(literal.begin(), literal.end(), ::isdigit))
-            lhsLen = std::stoi(literal);
-        }
-      }
-    }
-
-    if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(rhs->expression.get())) {
-      if (auto intLit = std::get_if<std::unique_ptr<integer_literal>>(&lenLit->literal)) {
-        rhsLen = std::stoi((*intLit)->value);
-      }
-    } else if (auto* path = dynamic_cast<PathExpressionNode*>(rhs->expression.get())) {
-      std::string name = path->toString();
-      if (auto* info = currentScope->lookupConst(name)) {
-        if (auto* lit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-          std::string literal = lit->toString();
-          if (std::all_of(literal.begin(), literal.end(), ::isdigit)) {
-            rhsLen = std::stoi(literal);
-          }
-        }
-      }
-    }
-
+    int lhsLen = array_length(lhs->expression.get());
+    int rhsLen = array_length(rhs->expression.get());
     if (lhsLen != -1 && rhsLen != -1 && lhsLen != rhsLen) {
-      //std::cout << "Array length mismatch at final dimension: expected "
+      //std::cout << "Array length mismatch: expected "
       //          << lhsLen << ", got " << rhsLen << std::endl;
       return false;
     }
 
+    if (lhs_inner) return check_arrayType(lhs_inner, rhs_inner, currentScope);
     return true;
   }
 
@@ -3942,7 +4133,7 @@ class semantic_checker {
 
     //std::cout << "checking expression in letstatement" << std::endl;
     if (!check_expression(letStatement.expression.get())) {
-      std::cerr << "error in expression in letstatement" << std::endl;
+      *err << "error in expression in letstatement" << std::endl;
       return false;
     }
     //std::cout << "finish checking expression in letstatement with pattern : " << expr->let_statement->pattern->toString() << std::endl;
@@ -3984,7 +4175,7 @@ class semantic_checker {
         s2 = "";
       }
       if (!((s1 == "usize" || s1 == "u32") && s2 == "i32")) {
-        std::cerr << "type mismatch in letstatement" << std::endl;
+        *err << "type mismatch in letstatement" << std::endl;
         //std::cout << "s1: " << s1 << std::endl;
         //std::cout << "s2: " << s2 << std::endl;
         return false;
@@ -3992,15 +4183,15 @@ class semantic_checker {
     }
 
     if (auto* possible_underscore = dynamic_cast<UnderscoreExpressionNode*>(expr->let_statement->expression.get())) {
-      std::cerr << "underscore expression is not allowed in RHS" << std::endl;
+      *err << "underscore expression is not allowed in RHS" << std::endl;
       throw std::runtime_error("underscore expression is not allowed in RHS");
     }
 
     try {
       //std::cout << "try to declare var : " << letStatement.pattern->toString()  << " in scope :" << currentScope->id << "whose if_mut is " << letStatement.get_if_mutable() << std::endl;
-      declareVariable(letStatement.pattern->toString(), letStatement.type.get(), letStatement.get_if_mutable());
+      declareVariable(letStatement.pattern->toString(), letStatement.type.get(), letStatement.get_if_mutable(), &letStatement);
     } catch (const std::exception& e) {
-      std::cerr << "[Declare Error in LetStatement] : " << e.what() << std::endl;
+      *err << "[Declare Error in LetStatement] : " << e.what() << std::endl;
     }
     //Array:检查类型和数量
     if (auto *d = dynamic_cast<ArrayTypeNode*>(letStatement.type.get())) {
@@ -4079,157 +4270,8 @@ class semantic_checker {
         if (symbol) {
           //std::cout << "getting symbol with type: " << symbol->type->toString() << std::endl;
           if (auto* array_type = dynamic_cast<ArrayTypeNode*>(symbol->type)) {
-            int declaredLength = -1;
-            if (auto *lenLit = dynamic_cast<LiteralExpressionNode*>(d->expression.get())) {
-              if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                declaredLength = std::stoi(intLit->value);
-              } else {
-                //std::cout << "wrong type of length in initializer" << std::endl;
-                return false;
-              }
-            } else if (auto *lenVar = dynamic_cast<PathExpressionNode*>(d->expression.get())) {
-              std::string path = lenVar->toString();
-              auto* info = currentScope->lookupConst(path);
-              if (info) {
-                if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-                  if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                    declaredLength = std::stoi(intLit->value);
-                  } else {
-                    //std::cout << "wrong type of length in initializer" << std::endl;
-                    return false;
-                  }
-                }
-              }              
-            } else if (auto *lenVar = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(d->expression.get())) {
-              //只处理了二元的情况
-              std::string left;
-              std::string right;
-              if (auto* left_path = dynamic_cast<PathExpressionNode*>(lenVar->expression1.get())) {
-                left = left_path->toString();
-                //std::cout << "left: " << left << std::endl;    
-                auto* info = currentScope->lookupConst(left);
-                if (info) {
-                  if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-                    if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                      left = intLit->value;
-                    } else {
-                      //std::cout << "wrong type of length in initializer" << std::endl;
-                      return false;
-                    }
-                  }
-                }               
-              } else if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lenVar->expression1.get())) {
-                if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                  left = intLit->value;
-                  //std::cout << "left: " << left << std::endl;   
-                } else {
-                  //std::cout << "wrong type of length in initializer" << std::endl;
-                  return false;
-                }
-              }
-              if (auto* right_path = dynamic_cast<PathExpressionNode*>(lenVar->expression2.get())) {
-                right = right_path->toString();
-                //std::cout << "right: " << right << std::endl;                
-              } else if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lenVar->expression2.get())) {
-                if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                  right = intLit->value;
-                  //std::cout << "right: " << right << std::endl;   
-                } else {
-                  //std::cout << "wrong type of length in initializer" << std::endl;
-                  return false;
-                }
-              }
-              //ADD, MINUS, MUL, DIV, MOD, AND, OR, XOR, SHL, SHR
-              switch(lenVar->type) {
-                case(OperationType::ADD): declaredLength = std::stoi(left) + std::stoi(right); break;
-                case(OperationType::MINUS): declaredLength = std::stoi(left) - std::stoi(right); break;
-                case(OperationType::MUL): declaredLength = std::stoi(left) * std::stoi(right); break;
-                case(OperationType::DIV): declaredLength = std::stoi(left) / std::stoi(right); break;
-                case(OperationType::MOD): declaredLength = std::stoi(left) % std::stoi(right); break;
-                case(OperationType::AND): declaredLength = std::stoi(left) & std::stoi(right); break;
-                case(OperationType::OR): declaredLength = std::stoi(left) | std::stoi(right); break;
-                case(OperationType::XOR): declaredLength = std::stoi(left) ^ std::stoi(right); break;
-                case(OperationType::SHL): declaredLength = std::stoi(left) << std::stoi(right); break;
-                case(OperationType::SHR): declaredLength = std::stoi(left) >> std::stoi(right); break;
-                default: std::cout << "unknown type of operation" << std::endl; return false;
-              };
-            }
-            //std::cout << "getting declared length: " << declaredLength << std::endl;
-            int itemLength = -1;
-            if (auto *lenLit = dynamic_cast<LiteralExpressionNode*>(array_type->expression.get())) {
-              if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                itemLength = std::stoi(intLit->value);
-              } else {
-                //std::cout << "wrong type of length in initializer" << std::endl;
-                return false;
-              }
-            } else if (auto* lenVar = dynamic_cast<PathExpressionNode*>(array_type->expression.get())) {
-              //std::cout << "path of length in array type of rhs in letstatement: " << lenVar->toString() << std::endl;
-              auto* info = currentScope->lookupConst(lenVar->toString());
-              if (info) {
-                if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-                  if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                    itemLength = std::stoi(intLit->value);
-                  } else {
-                    //std::cout << "wrong type of length in initializer" << std::endl;
-                    return false;
-                  }
-                }
-              }
-            } else if (auto *lenVar = dynamic_cast<ArithmeticOrLogicalExpressionNode*>(array_type->expression.get())) {
-              //只处理了二元的情况
-              std::string left;
-              std::string right;
-              if (auto* left_path = dynamic_cast<PathExpressionNode*>(lenVar->expression1.get())) {
-                left = left_path->toString();
-                //std::cout << "left: " << left << std::endl;
-                auto* info = currentScope->lookupConst(left);
-                if (info) {
-                  if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-                    if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                      left = intLit->value;
-                    } else {
-                      //std::cout << "wrong type of length in initializer" << std::endl;
-                      return false;
-                    }
-                  }
-                }      
-              } else if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lenVar->expression1.get())) {
-                if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                  left = intLit->value;
-                  //std::cout << "left: " << left << std::endl;   
-                } else {
-                  //std::cout << "wrong type of length in initializer" << std::endl;
-                  return false;
-                }
-              }
-              if (auto* right_path = dynamic_cast<PathExpressionNode*>(lenVar->expression2.get())) {
-                right = right_path->toString();
-                //std::cout << "right: " << right << std::endl;                
-              } else if (auto* lenLit = dynamic_cast<LiteralExpressionNode*>(lenVar->expression2.get())) {
-                if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-                  right = intLit->value;
-                  //std::cout << "right: " << right << std::endl;   
-                } else {
-                  //std::cout << "wrong type of length in initializer" << std::endl;
-                  return false;
-                }
-              }
-              //ADD, MINUS, MUL, DIV, MOD, AND, OR, XOR, SHL, SHR
-              switch(lenVar->type) {
-                case(OperationType::ADD): itemLength = std::stoi(left) + std::stoi(right); break;
-                case(OperationType::MINUS): itemLength = std::stoi(left) - std::stoi(right); break;
-                case(OperationType::MUL): itemLength = std::stoi(left) * std::stoi(right); break;
-                case(OperationType::DIV): itemLength = std::stoi(left) / std::stoi(right); break;
-                case(OperationType::MOD): itemLength = std::stoi(left) % std::stoi(right); break;
-                case(OperationType::AND): itemLength = std::stoi(left) & std::stoi(right); break;
-                case(OperationType::OR): itemLength = std::stoi(left) | std::stoi(right); break;
-                case(OperationType::XOR): itemLength = std::stoi(left) ^ std::stoi(right); break;
-                case(OperationType::SHL): itemLength = std::stoi(left) << std::stoi(right); break;
-                case(OperationType::SHR): itemLength = std::stoi(left) >> std::stoi(right); break;
-                default: std::cout << "unknown type of operation" << std::endl; return false;
-              };
-            }
+            int declaredLength = array_length(d->expression.get());
+            int itemLength = array_length(array_type->expression.get());
             //std::cout << "getting itemlength: " << itemLength << std::endl;
             if (itemLength != declaredLength && declaredLength != 999) {
               //std::cout << "itemLength: " << itemLength << std::endl;
@@ -4254,15 +4296,7 @@ class semantic_checker {
       bool check_array = check_arrayType(d, dynamic_cast<ArrayTypeNode*>(t), currentScope);
       if (!check_array) return false;
       //std::cout << "finish function check_arrayType" << std::endl;
-      int declaredLength = -1;
-      if (auto *lenLit = dynamic_cast<LiteralExpressionNode*>(d->expression.get())) {
-        if (auto& intLit = std::get<std::unique_ptr<integer_literal>>(lenLit->literal)) {
-          declaredLength = std::stoi(intLit->value);
-        } else {
-          //std::cout << "wrong type of length in initializer" << std::endl;
-          return false;
-        }
-      }
+      int declaredLength = array_length(d->expression.get());
       int itemLength = -1;
       if (rhs) {
         if (rhs->type == ArrayExpressionType::LITERAL) {
@@ -4282,7 +4316,7 @@ class semantic_checker {
             if (temp_type != type) {
               //std::cout << "type of expression[0] in array : " << type << std::endl;
               //std::cout << "type of expression[" << i << "] in array : " << temp_type << std::endl;
-              std::cerr << "type mismatch in array" << std::endl;
+              *err << "type mismatch in array" << std::endl;
               return false;
             }
           }
@@ -4292,35 +4326,7 @@ class semantic_checker {
             //std::cout << "wrong number of expressions for repeat type of arrayExpression" << std::endl;
             return false;
           }
-          auto *lengthLiteral = dynamic_cast<LiteralExpressionNode*>(rhs->expressions[1].get());//得到表示repeat次数的LiteralExpression
-          if (!lengthLiteral) { 
-            //std::cout << "the type of the second expression in repeat ArrayExpression is not literalexpression" << std::endl;
-            if (auto *path = dynamic_cast<PathExpressionNode*>(rhs->expressions[1].get())) {
-              std::string var_name = path->toString();
-              auto* info = currentScope->lookupConst(var_name);
-              if (info) {
-                //std::cout << "constant: " << var_name << " found" << std::endl;
-                if (auto* lit = dynamic_cast<LiteralExpressionNode*>(info->expr)) {
-                  std::string literal = lit->toString();
-                  for (int i = 0; i < literal.size(); i++) {
-                    if (!isdigit(literal[i])) {
-                      //std::cout << "invalid type of const in array definition" << std::endl;
-                      return false;
-                    }
-                  }
-                  itemLength = std::stoi(literal);
-                } else {
-                  //std::cout << "invalid type of const in array definition" << std::endl;
-                  return false;
-                }
-              }
-            }
-          }
-          if (lengthLiteral) {
-            //std::cout << "the second expression in repeat arrayexpression is leteralexpression" << std::endl;
-            auto& repeat_time = std::get<std::unique_ptr<integer_literal>>(lengthLiteral->literal);
-            itemLength = std::stoi(repeat_time->value);
-          }
+          itemLength = array_length(rhs->expressions[1].get());
         }
       }
       //std::cout << "declaredLength : " << declaredLength << std::endl;
@@ -4529,7 +4535,7 @@ class semantic_checker {
       try {
         types = get_logic_expr_types(d);
       } catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
+        *err << e.what() << std::endl;
         return false;
       }
       std::unordered_set<std::string> t;
@@ -4626,7 +4632,7 @@ class semantic_checker {
     } else if (auto *d = dynamic_cast<const PredicateLoopExpressionNode*>(expr)) {
       //std::cout << "checking predicate loop expression" << std::endl;
       if (!d->conditions || !check_conditions(d->conditions.get()) || !d->conditions->check()) {
-        std::cerr << "error in conditions" << std::endl;
+        *err << "error in conditions" << std::endl;
         return false;
       }
       enterScope();
@@ -4637,7 +4643,7 @@ class semantic_checker {
     } else if (auto *d = dynamic_cast<const IfExpressionNode*>(expr)) {
       //std::cout << "checking if expression" << std::endl;
       if (!check_conditions(d->conditions.get()) || !d->conditions->check()) {
-        std::cerr << "error in conditions" << std::endl;
+        *err << "error in conditions" << std::endl;
         return false;
       }
       if (d->block_expression) {
@@ -4887,8 +4893,8 @@ class semantic_checker {
       //std::cout << "checking struct expression" << std::endl;
       std::string struct_name = struct_expr->pathin_expression->toString();
       //std::cout << "name of the struct : " << struct_name << std::endl;
-      auto* struct_info = currentScope->lookupStruct(struct_name);
-      int declared_item_num = struct_info->fields.size();
+      auto* struct_info = lookup_struct(struct_name);
+      int declared_item_num = struct_info->node->struct_fields->struct_fields.size();
       int actual_item_num = struct_expr->struct_expr_fields->struct_expr_fields.size();
       //std::cout << "declared item num : " << declared_item_num << std::endl;
       //std::cout << "actual item num : " << actual_item_num << std::endl;
@@ -4896,7 +4902,7 @@ class semantic_checker {
         return false;
       }
       for (int i = 0; i < declared_item_num; i++) {
-        auto* type1 = struct_info->fields[i].type;
+        auto* type1 = struct_info->node->struct_fields->struct_fields[i]->type.get();
         auto* type2 = getExpressionType(struct_expr->struct_expr_fields->struct_expr_fields[i]->expression.get());
         if (!is_type_equal(type1, type2)) {
           //std::cout << "type of def : " << type1->toString() << std::endl;
@@ -4926,7 +4932,7 @@ class semantic_checker {
             std::string t = getExpressionType(call_expr->call_params->expressions[0].get())->toString();
             //std::cout << "type of param in exit expression : " << t << std::endl;
             if (t != "i32") {
-              std::cerr << "param except i32 not allowed in 'exit' function" << std::endl;
+              *err << "param except i32 not allowed in 'exit' function" << std::endl;
               return false;
             }
           }
@@ -4950,22 +4956,25 @@ class semantic_checker {
           return false;
         }
         if (call_expr->call_params) {
+          auto* func_param = currentScope->find_func_param(func_name);
+          if (!func_param) {
+            //std::cout << "function : " << func_name << " not found" << std::endl;
+          }
           for (int i = 0; i < call_expr->call_params->expressions.size(); i++) {
             if (auto* lit_expr = dynamic_cast<LiteralExpressionNode*>(call_expr->call_params->expressions[i].get())) {
               if (std::holds_alternative<std::unique_ptr<integer_literal>>(lit_expr->literal)) {
-                std::string num = lit_expr->toString();
-                //std::cout << "integer literal in function param: " << num << std::endl;
-                if (isOverflow(num)) {
+                //整数字面量按对应参数的类型检查范围
+                std::string param_type = "i32";
+                if (func_param && i < func_param->function_params.size()) {
+                  param_type = getFunctionParamTypeString(func_param->function_params[i].get());
+                }
+                if (!consts->literal_fits(lit_expr, param_type)) {
                   //std::cout << "overflow of integer_literal in call expression" << std::endl;
                   return false;
                 }
               }
             }
           }
-          auto* func_param = currentScope->find_func_param(func_name);
-          if (!func_param) {
-            //std::cout << "function : " << func_name << " not found" << std::endl;
-          }
           //std::cout << "size of function param: " << func_param->function_params.size() << std::endl;
           for (int i = 0; i < call_expr->call_params->expressions.size(); i++) {
             std::string type1 = getExpressionType(call_expr->call_params->expressions[i].get())->toString();
@@ -5024,15 +5033,12 @@ class semantic_checker {
       if (!check_Item(expr)) return false;
       //std::cout << "inserting structstruct : " << structstruct->identifier << std::endl;
       currentScope->symbol_table.structs.insert(structstruct->identifier);
-      for (int i = 0; i < structstruct->struct_fields->struct_fields.size(); i++) {
-        currentScope->symbol_table.struct_items[{structstruct->identifier, structstruct->struct_fields->struct_fields[i]->identifier}] 
-        = structstruct->struct_fields->struct_fields[i]->type->toString();
-      }
     } else if (auto* tuplestruct = dynamic_cast<const TupleStructNode*>(expr)) {
       currentScope->symbol_table.structs.insert(tuplestruct->identifier);
 
     } else if (auto* constant = dynamic_cast<const ConstantItemNode*>(expr)) {
       currentScope->symbol_table.constants.insert(constant->identifier.value());
+      consts->declare(constant->identifier.value(), constant);
     } else if (auto* trait = dynamic_cast<const TraitNode*>(expr)) {
       std::string base = trait->identifier;
       //std::cout << "base: " << base << std::endl;
@@ -5058,6 +5064,7 @@ class semantic_checker {
           std::string constant = base + "::" + node->identifier.value();
           //std::cout << "inserting : " << constant << std::endl;
           currentScope->symbol_table.constants.insert(constant);
+          consts->declare(constant, node);
         } else if (auto* funcPtr = std::get_if<std::unique_ptr<FunctionNode>>(&inherent_impl->associated_item[i]->associated_item)) {
           FunctionNode* node = funcPtr->get();
           std::string func = base + "::" + node->identifier;
@@ -5085,11 +5092,13 @@ class semantic_checker {
           std::string constant = base + "::" + node->identifier.value();
           //std::cout << "inserting : " << constant << std::endl;
           currentScope->symbol_table.constants.insert(constant);
+          consts->declare(constant, node);
         } else if (auto* funcPtr = std::get_if<std::unique_ptr<FunctionNode>>(&TraitImpl->associatedItems[i]->associated_item)) {
           FunctionNode* node = funcPtr->get();
           std::string func = base + "::" + node->identifier;
           //std::cout << "inserting : " << func << std::endl;
           currentScope->symbol_table.functions[func] = node->function_parameter.get();
+          if (node->return_type) currentScope->symbol_table.function_types[func] = node->return_type->type.get();
         }
       }
     }
@@ -5117,7 +5126,7 @@ class semantic_checker {
       if (auto item = dynamic_cast<ItemNode*>(ast[i].get())) {
         //std::cout << "forward declaring item which is the " << i << "th node in ast" << std::endl;
         if (!forward_declare(item)) {
-          std::cerr << "error in forward declaring" << std::endl;
+          *err << "error in forward declaring" << std::endl;
           return false;
         };
       }
@@ -5133,6 +5142,9 @@ class semantic_checker {
       //std::cout << it->first << std::endl;
     }
     
+    //声明阶段：按顺序登记函数签名和impl中的方法，其余item照常检查
+    //函数体放到jobs里，等全局表不再修改之后并行检查
+    std::vector<BodyJob> jobs;
     for (int i = 0; i < ast.size(); i++) {
       //std::cout << "checking the " << i + 1 << "th ASTNode" << std::endl;
       if (auto *d = dynamic_cast<StatementNode*>(ast[i].get())) {
@@ -5143,6 +5155,21 @@ class semantic_checker {
       }
       if (auto *d = dynamic_cast<ItemNode*>(ast[i].get())) {
         if (auto *structstruct = dynamic_cast<StructStructNode*>(d)) continue;
+        if (auto *function = dynamic_cast<FunctionNode*>(d)) {
+          declare_function(function);
+          jobs.push_back({function, nullptr, currentScope->possible_self});
+          continue;
+        }
+        if (auto *impl = dynamic_cast<InherentImplNode*>(d)) {
+          if (!declare_impl(impl)) return false;
+          currentScope->possible_self = impl->type->toString();
+          for (int j = 0; j < impl->associated_item.size(); j++) {
+            if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&impl->associated_item[j]->associated_item)) {
+              jobs.push_back({funcNode->get(), impl, currentScope->possible_self});
+            }
+          }
+          continue;
+        }
         //std::cout << "checking item node" << std::endl;
         if (!check_Item(d)) return false;
       }
@@ -5152,6 +5179,133 @@ class semantic_checker {
       }
       //std::cout << "finish checking the " << i + 1 << "th ASTNode" << std::endl;
     }
+    return check_bodies(jobs);
+  }
+
+  //函数体的检查结果只取决于它自己的token、它提到的函数/方法的签名，以及struct、const、trait等item组成的类型环境
+  //顶层的let和表达式会直接修改全局scope，有这种节点时不使用缓存
+  bool collect_signatures(std::unordered_map<std::string, uint64_t>& signatures, uint64_t& env_hash) {
+    for (int i = 0; i < ast.size(); i++) {
+      auto* item = dynamic_cast<ItemNode*>(ast[i].get());
+      if (!item) return false;
+      if (auto* function = dynamic_cast<FunctionNode*>(item)) {
+        signatures[function->identifier] = hash_combine(signatures[function->identifier], function->signature_hash);
+      } else if (auto* impl = dynamic_cast<InherentImplNode*>(item)) {
+        std::string type = impl->type->toString();
+        for (int j = 0; j < impl->associated_item.size(); j++) {
+          if (auto* funcNode = std::get_if<std::unique_ptr<FunctionNode>>(&impl->associated_item[j]->associated_item)) {
+            FunctionNode* method = funcNode->get();
+            signatures[method->identifier] = hash_combine(signatures[method->identifier], method->signature_hash);
+            signatures[type] = hash_combine(signatures[type], method->signature_hash);
+          }
+        }
+      } else {
+        env_hash = hash_combine(env_hash, item->token_hash);
+      }
+    }
+    return true;
+  }
+
+  uint64_t body_cache_key(const BodyJob& job, const std::unordered_map<std::string, uint64_t>& signatures, uint64_t env_hash) {
+    uint64_t key = hash_combine(hash_string(CheckCache::VERSION), env_hash);
+    key = hash_combine(key, hash_string(job.possible_self));
+    key = hash_combine(key, job.impl ? 1 : 0);
+    key = hash_combine(key, job.function->token_hash);
+    std::vector<std::string> names = job.function->referenced_names;
+    names.push_back(job.possible_self);
+    for (const auto& name : names) {
+      auto it = signatures.find(name);
+      if (it == signatures.end()) continue;
+      key = hash_combine(key, hash_string(name));
+      key = hash_combine(key, it->second);
+    }
+    return key;
+  }
+
+  //检查一个函数体并加上标注，在worker线程里调用；annotate_only时函数体已经检查过（命中缓存），只加标注
+  bool check_body(const BodyJob& job, bool annotate_only = false) {
+    currentScope->possible_self = job.possible_self;
+    bool ans = true;
+    if (!annotate_only) {
+      if (!job.impl) {
+        ans = check_Item(job.function);
+      } else {
+        enterScope();
+        ans = check_impl_method(job.impl, job.function);
+        exitScope();
+      }
+    }
+    if (ans) {
+      if (job.impl) enterScope();
+      annotate_function(job.function);
+      if (job.impl) exitScope();
+    }
+    return ans;
+  }
+
+  //声明阶段结束后currentScope（全局scope）只读，函数体之间互相独立，分给多个线程检查
+  //每个函数体的诊断先写到自己的buffer里，最后按item顺序输出，遇到第一个失败的就停下，和串行检查的结果一致
+  bool check_bodies(const std::vector<BodyJob>& jobs) {
+    std::vector<char> results(jobs.size(), 0);
+    std::vector<std::string> diags(jobs.size());
+    std::vector<std::exception_ptr> errors(jobs.size());
+    std::vector<uint64_t> keys(jobs.size(), 0);
+    std::vector<size_t> pending;
+    std::vector<char> cached(jobs.size(), 0);  //命中缓存、检查通过的函数体只需要重新加标注
+    std::unordered_map<std::string, uint64_t> signatures;
+    uint64_t env_hash = 0;
+    bool use_cache = cache && collect_signatures(signatures, env_hash);
+    for (size_t k = 0; k < jobs.size(); k++) {
+      if (use_cache) {
+        keys[k] = body_cache_key(jobs[k], signatures, env_hash);
+        CheckCache::Entry entry;
+        if (cache->find(keys[k], entry)) {
+          results[k] = entry.ok;
+          diags[k] = entry.diag;
+          if (!entry.ok) continue;
+          cached[k] = 1;
+        }
+      }
+      pending.push_back(k);
+    }
+
+    std::atomic<size_t> next{0};
+    Scope* global = currentScope;
+    auto worker = [&]() {
+      for (size_t i = next++; i < pending.size(); i = next++) {
+        size_t k = pending[i];
+        std::ostringstream out;
+        semantic_checker local(global, &out, consts, items);
+        try {
+          bool ok = local.check_body(jobs[k], cached[k]);
+          if (!cached[k]) results[k] = ok;
+        } catch (...) {
+          errors[k] = std::current_exception();
+        }
+        while (local.currentScope != global) local.exitScope();
+        if (!cached[k]) diags[k] = out.str();
+      }
+    };
+
+    size_t thread_num = std::max(1u, std::thread::hardware_concurrency());
+    thread_num = std::min(thread_num, pending.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < thread_num; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    if (use_cache) {
+      for (size_t k : pending) {
+        if (!errors[k] && !cached[k]) cache->store(keys[k], CheckCache::Entry{results[k] != 0, diags[k]});
+      }
+      cache->save();
+    }
+
+    for (size_t k = 0; k < jobs.size(); k++) {
+      *err << diags[k];
+      if (errors[k]) std::rethrow_exception(errors[k]);
+      if (!results[k]) return false;
+    }
     return true;
   }
 };
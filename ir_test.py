@@ -83,9 +83,20 @@ def main():
     start_time = time.time()
     base_dir = "."
     src_dir = os.path.join("RCompiler-Testcases", "IR-1", "src")
+    regression_dir = "regression"
     testcases_dir = "testcases"
 
-    if not os.path.exists(src_dir):
+    # 测试集中的comprehensive1..50，再加上仓库中regression目录下的回归用例
+    folders = []
+    if os.path.exists(src_dir):
+        for i in range(1, 51):
+            folder = f"comprehensive{i}"
+            if os.path.exists(os.path.join(src_dir, folder)):
+                folders.append((folder, os.path.join(src_dir, folder)))
+    if os.path.exists(regression_dir):
+        for folder in sorted(os.listdir(regression_dir)):
+            folders.append((folder, os.path.join(regression_dir, folder)))
+    if not folders:
         print("Source directory not found")
         return
 
@@ -93,12 +104,7 @@ def main():
     total = 0
     total_test_time = 0.0
 
-    for i in range(1, 51):
-        folder = f"comprehensive{i}"
-        folder_path = os.path.join(src_dir, folder)
-        if not os.path.exists(folder_path):
-            continue
-    
+    for folder, folder_path in folders:
         start_time = time.time()
         rx_file = None
         in_file = None
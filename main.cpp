@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
 #include <memory>
 #include <vector>
 #include <string>
@@ -28,24 +29,29 @@ int main() {
         }
 
         semantic_checker sc(std::move(ast));
-        if (!sc.check()) {
+        // 设置了RCOMPILER_CHECK_CACHE时，用这个文件做增量语义检查的缓存
+        const char* cache_path = std::getenv("RCOMPILER_CHECK_CACHE");
+        if (cache_path) sc.enable_cache(cache_path);
+        bool checked = sc.check();
+        if (cache_path) {
+            std::ostream report(oldcerr);
+            sc.get_cache()->report(report);
+        }
+        if (!checked) {
             //std::cout << "Semantic error" << std::endl;
             return 1;
         }
 
-        parser par1(tokens);
-        std::vector<std::unique_ptr<ASTNode>> ast1;
-        try {
-            ast1 = par1.parse();
-        } catch (const std::exception& e) {
-            return 0;
-        }
+        // 直接使用语义检查过、带有类型标注的AST生成IR
+        std::vector<std::unique_ptr<ASTNode>> checked_ast = sc.take_ast();
         std::cout.rdbuf(oldcout);
         // 生成IR
-        IRGenerator generator;
+        IRGenerator generator(sc.get_const_evaluator(), sc.get_item_index());
+        // 设置了RCOMPILER_LARGE_ARRAY时，用它作为数组不再放在栈上的字节数阈值
+        if (const char* threshold = std::getenv("RCOMPILER_LARGE_ARRAY")) generator.largeArrayThreshold = std::atoi(threshold);
         std::string irCode;
         try {
-            irCode = generator.generate(std::move(ast1));
+            irCode = generator.generate(checked_ast);
         } catch (const std::exception& e) {
             return 0;
         }